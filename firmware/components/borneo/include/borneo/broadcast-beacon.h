@@ -0,0 +1,22 @@
+#pragma once
+
+#include <time.h>
+
+#include "borneo/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 信标里不依赖 RTOS 和网络的部分，方便在 PC 上测试
+
+// 信标里给时间戳预留的宽度，uint32_t 的时间戳最多 10 位十进制
+#define BROADCAST_TIMESTAMP_WIDTH 10
+
+void BroadcastBeacon_patch_timestamp(uint8_t* dest, time_t timestamp);
+uint32_t BroadcastBeacon_next_interval(uint32_t interval_secs, uint32_t probe_count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -7,6 +7,24 @@ extern "C" {
 #endif
 /* Declarations of this file */
 
+// 局域网发现：
+// 客户端往 BORNEO_DEVICE_PROBE_PORT 发送探测包，设备单播回复一个信标，内容和广播的信标相同
+// 设备也会往 BORNEO_DEVICE_UDP_PORT 广播信标给不会探测的老客户端，没收到过探测时一直按最小间隔广播，
+// 老客户端发现设备的速度和以前一样；收到过探测说明客户端会主动查询，之后间隔每次翻倍，最长退避到
+// BROADCAST_PROBED_MAX_INTERVAL_SECS
+// 重新连上 WiFi 时间隔恢复到最小值
+
+#define BORNEO_DISCOVERY_PROBE "{\"MagicWord\":9966,\"Probe\":1}"
+
+#ifndef BROADCAST_MIN_INTERVAL_SECS
+#define BROADCAST_MIN_INTERVAL_SECS 5
+#endif
+
+// 收到过探测之后的最长广播间隔
+#ifndef BROADCAST_PROBED_MAX_INTERVAL_SECS
+#define BROADCAST_PROBED_MAX_INTERVAL_SECS 600
+#endif
+
 int Broadcast_init();
 int Broadcast_start();
 
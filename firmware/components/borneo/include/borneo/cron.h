@@ -2,6 +2,7 @@
 
 #include <time.h>
 #include "borneo/rtc.h"
+#include "borneo/utils/json-writer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,15 +13,17 @@ extern "C" {
  * 任务计划时间
  */
 typedef struct {
-    uint8_t dow; // 周几，第 0 位表示周一
+    uint8_t dow; // 周几，第 0 位表示周日，和 struct tm 的 tm_wday 一致
     uint32_t hours; // 小时，第 0 位表示 0 时，0~23
     uint8_t minute; // 分钟，按值计，也就是一个任务里一天最多执行 24 次
 } Cron;
 
 cJSON* Cron_to_json(const Cron* cron);
+int Cron_write_json(const Cron* cron, JsonWriter* writer);
 int Cron_from_json(Cron* cron, const cJSON* json);
 
 bool Cron_can_execute(const Cron* cron, const struct tm* rtc);
+time_t Cron_next_after(const Cron* cron, time_t after);
 
 #ifdef __cplusplus
 }
@@ -15,7 +15,18 @@ extern "C" {
 #define BORNEO_DEVICE_COMPATIBLE "borneo,doser"
 
 #define BORNEO_DEVICE_UDP_PORT 9060
+#define BORNEO_DEVICE_PROBE_PORT 9061
+
+// RPC 的端口，PC 上的服务端改成不需要 root 权限的端口
+#ifndef BORNEO_DEVICE_TCP_PORT
 #define BORNEO_DEVICE_TCP_PORT 1022
+#endif
+
+#ifndef BORNEO_DEVICE_WS_PORT
+#define BORNEO_DEVICE_WS_PORT 1023
+#endif
+
+#define BORNEO_DEVICE_RPC_UDP_PORT BORNEO_DEVICE_TCP_PORT // 和 TCP 端口号相同
 
 typedef struct {
     const char* device_name;
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "borneo/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 通过 mDNS/DNS-SD 公布 RPC 服务，客户端查询 _borneo._tcp.local 就能找到设备，只有收到查询才会应答
+// TXT 记录里带上序列号、型号和端口，客户端不用连上设备就能区分
+
+#define MDNS_SERVICE_TYPE "_borneo"
+#define MDNS_SERVICE_PROTO "_tcp"
+
+int MdnsService_init();
+int MdnsService_start();
+
+#ifdef __cplusplus
+}
+#endif
@@ -16,6 +16,7 @@ typedef struct {
     // Configuration
     uint32_t p, i, d;
     int64_t outmax, outmin;
+    int64_t integ_max, integ_min; // 积分项的范围，用来抗积分饱和，FastPid_configure() 默认为 int32 的范围
     bool cfg_err;
 
     // State
@@ -27,12 +28,45 @@ typedef struct {
 bool FastPid_set_coefficients(FastPid* pid, float kp, float ki, float kd, float hz);
 bool FastPid_set_output_config(FastPid* pid, int bits, bool sign);
 bool FastPid_set_output_range(FastPid* pid, int16_t min, int16_t max);
+bool FastPid_set_integral_range(FastPid* pid, int16_t min, int16_t max);
 void FastPid_reset(FastPid* pid);
 bool FastPid_configure(FastPid* pid, float kp, float ki, float kd, float hz, int bits, bool sign);
 int16_t FastPid_step(FastPid* pid, int16_t sp, int16_t fb);
 
 inline bool FastPid_has_error(const FastPid* pid) { return pid->cfg_err; }
 
+#ifndef FAST_PID_BANK_MAX
+#define FAST_PID_BANK_MAX 4
+#endif
+
+/*
+  N controllers in struct-of-arrays layout, stepped together in one pass.
+  Results are bit-exact with FastPid_step(). Configure each controller as a FastPid first and load it into the bank.
+  The integral sum is kept in 32 bits, since it is always clamped into the int32 range.
+*/
+typedef struct {
+    size_t count;
+
+    // Configuration
+    int32_t p[FAST_PID_BANK_MAX];
+    int32_t i[FAST_PID_BANK_MAX];
+    int32_t d[FAST_PID_BANK_MAX];
+    int32_t outmax[FAST_PID_BANK_MAX];
+    int32_t outmin[FAST_PID_BANK_MAX];
+    int32_t integ_max[FAST_PID_BANK_MAX];
+    int32_t integ_min[FAST_PID_BANK_MAX];
+
+    // State
+    int32_t sum[FAST_PID_BANK_MAX];
+    int32_t last_err[FAST_PID_BANK_MAX];
+    int16_t last_sp[FAST_PID_BANK_MAX];
+} FastPidBank;
+
+void FastPidBank_init(FastPidBank* bank, size_t count);
+void FastPidBank_load(FastPidBank* bank, size_t index, const FastPid* pid);
+void FastPidBank_store(const FastPidBank* bank, size_t index, FastPid* pid);
+void FastPidBank_step(FastPidBank* bank, const int16_t* sp, const int16_t* fb, int16_t* out);
+
 #ifdef __cplusplus
 }
 #endif
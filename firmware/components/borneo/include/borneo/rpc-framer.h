@@ -0,0 +1,60 @@
+#pragma once
+
+#include "borneo/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 把 TCP 字节流切分成以 '\0' 结尾的请求帧
+// 帧直接在接收缓冲区里原地解析，已扫描过的位置会被记住，不会重复查找
+// 缓冲区只有在写满时才把剩下的半个帧搬到开头，每次请求都不需要 memmove
+//
+// 连接开头是 CBOR 自描述标签 D9 D9 F7 的，之后的请求都是 CBOR 编码，每个帧前面是两字节大端序的长度
+// 其他情况都按 JSON-RPC 处理，JSON 文本不可能以 0xD9 开头
+
+#define RPC_FRAMER_CBOR_MAGIC_SIZE 3
+#define RPC_FRAMER_LENGTH_PREFIX_SIZE 2
+
+typedef enum {
+    RPC_ENCODING_UNKNOWN = 0, // 还没收到足够的数据判断编码
+    RPC_ENCODING_JSON = 1,
+    RPC_ENCODING_CBOR = 2,
+} RpcEncoding;
+
+typedef enum {
+    RPC_FRAME_NONE = 0, // 还没有收到完整的帧
+    RPC_FRAME_OK = 1, // 取到一个完整的帧
+    RPC_FRAME_OVERSIZE = 2, // 帧超过了缓冲区大小，已经被丢弃
+} RpcFrameStatus;
+
+typedef struct {
+    const uint8_t* data; // JSON 帧包括结尾的 '\0'，CBOR 帧不包括长度前缀
+    size_t size;
+} RpcFrame;
+
+typedef struct {
+    uint8_t* buffer;
+    size_t capacity;
+    size_t head; // 下一个帧的开始位置
+    size_t tail; // 已接收数据的结束位置
+    size_t scanned; // [head, scanned) 里确定没有 '\0'
+    size_t frame_end; // 已经找到的下一个帧的结束位置（不含），0 表示还没找到
+    size_t discard_remaining; // CBOR 超长帧还需要丢弃的字节数
+    RpcEncoding encoding; // 由连接开头的数据决定，之后不再改变
+    bool is_discarding; // 正在丢弃超长帧剩下的部分
+} RpcFramer;
+
+int RpcFramer_init(RpcFramer* framer, void* buffer, size_t capacity);
+void RpcFramer_reset(RpcFramer* framer);
+uint8_t* RpcFramer_prepare(RpcFramer* framer, size_t* available);
+void RpcFramer_commit(RpcFramer* framer, size_t size);
+RpcFrameStatus RpcFramer_next(RpcFramer* framer, RpcFrame* frame);
+bool RpcFramer_has_frame(RpcFramer* framer);
+
+inline RpcEncoding RpcFramer_encoding(const RpcFramer* framer) { return framer->encoding; }
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,14 +1,98 @@
 #pragma once
 
 #include "borneo/common.h"
+#include "borneo/utils/json-writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 /* Declarations of this file */
 
+#ifndef RPC_SERVER_MAX_CONNECTIONS
+#define RPC_SERVER_MAX_CONNECTIONS 3
+#endif
+
+// 客户端接收慢时每个连接最多积压的响应字节数，积压期间这个连接不处理新的请求，超过就关闭连接
+#ifndef RPC_SERVER_MAX_TX_BACKLOG
+#define RPC_SERVER_MAX_TX_BACKLOG (1024 * 16)
+#endif
+
+// 每个连接最多缓存的通知个数，客户端来不及接收时相同 key 的通知会合并成最新的一个
+#ifndef RPC_SERVER_MAX_NOTIFICATIONS
+#define RPC_SERVER_MAX_NOTIFICATIONS 8
+#endif
+
+// 每个连接上同时挂起的异步调用个数，每个挂起的调用在连接上预留一个完成结果的位置
+#ifndef RPC_SERVER_MAX_PENDING_CALLS
+#define RPC_SERVER_MAX_PENDING_CALLS 4
+#endif
+
+#define RPC_NOTIFICATION_MAX_ARG_SIZE 24
+
+// UDP 端口上一个数据报就是一次调用，开头是客户端选的 4 字节请求序号（大端），后面是请求本身
+// 请求序号之后是 CBOR 自描述标签的就是 CBOR 请求，否则按 JSON 处理，JSON 不需要结尾的 '\0'
+// 响应数据报的开头是相同的请求序号，后面是和请求相同编码的响应，没有标签也没有 '\0'
+// 响应放不下一个数据报时返回 RPC_ERROR_RESPONSE_TOO_LARGE 错误，请求超过一个数据报时返回 RPC_ERROR_REQUEST_TOO_LARGE 错误
+// 两种情况客户端都应该改用 TCP
+#ifndef RPC_SERVER_MAX_DATAGRAM_SIZE
+#define RPC_SERVER_MAX_DATAGRAM_SIZE 1024
+#endif
+
+// 最近处理过的数据报的响应留在缓存里，客户端超时重发相同序号的请求时直接重发响应，不会再调用一次方法
+#ifndef RPC_SERVER_DATAGRAM_CACHE_SIZE
+#define RPC_SERVER_DATAGRAM_CACHE_SIZE 4
+#endif
+
+#define RPC_SERVER_DATAGRAM_HEADER_SIZE 4
+
+typedef int (*RpcNotificationParamsWriter)(const void* arg, JsonWriter* writer);
+
+/**
+ * 服务端主动推送给订阅者的通知（没有 id 的 JSON-RPC 请求）
+ * params 在真正发送的时候才由 write_params 根据 arg 生成，所以发布通知不需要分配内存
+ */
+typedef struct {
+    uint32_t topic; // 主题位掩码，连接订阅了其中任意一个主题就会收到
+    uint32_t key; // 同一主题下 key 相同的通知还没发出去时，新的会替换旧的
+    const char* method;
+    RpcNotificationParamsWriter write_params;
+    union {
+        uint8_t arg[RPC_NOTIFICATION_MAX_ARG_SIZE];
+        uint64_t arg_alignment;
+    };
+} RpcNotification;
+
+/**
+ * 异步方法挂起的调用，由 RpcServer_begin_call() 在 RPC 方法里生成，可以复制给其他任务，在那里完成
+ */
+typedef struct {
+    uint16_t connection; // 发起调用的连接在服务端的下标
+    uint16_t generation; // 连接关闭时加一，连接关闭以后才完成的调用直接丢掉
+    uint64_t id; // JSON-RPC 请求的 id，响应靠它和请求对应
+} RpcPendingCall;
+
+/**
+ * 异步调用的结果，和通知一样在真正发送的时候才由 write_result 根据 arg 生成
+ */
+typedef struct {
+    uint64_t id;
+    int32_t error_code; // 0 表示成功
+    const char* error_message; // 发送的时候才读取，必须是常量字符串
+    RpcNotificationParamsWriter write_result; // 为 NULL 时结果是 null
+    union {
+        uint8_t arg[RPC_NOTIFICATION_MAX_ARG_SIZE];
+        uint64_t arg_alignment;
+    };
+} RpcCompletion;
+
+// 响应都写到服务端提供的 writer 里，writer 写满时会直接发送到连接上
+// 返回非 0 表示这个连接已经没法继续使用（比如响应发出一半之后出错），服务端会关闭连接
 typedef struct RpcRequestHandlerTag {
-    int (*handle_rpc)(const void* rxbuf, size_t rxbuf_size, void* txbuf, size_t* txbuf_size);
+    int (*handle_rpc)(const void* rxbuf, size_t rxbuf_size, JsonWriter* writer);
+    // 生成一个没有 id 的错误响应，用于请求没法交给 handle_rpc 的情况，比如请求过长
+    int (*make_error)(int code, const char* message, JsonWriter* writer);
+    int (*write_notification)(const RpcNotification* notification, JsonWriter* writer);
+    int (*write_completion)(const RpcCompletion* completion, JsonWriter* writer);
 } RpcRequestHandler;
 
 int RpcServer_init(RpcRequestHandler* request_handler);
@@ -16,6 +100,16 @@ int RpcServer_start();
 int RpcServer_stop();
 int RpcServer_close();
 
+int RpcServer_subscribe(uint32_t topics);
+int RpcServer_unsubscribe(uint32_t topics);
+int RpcServer_publish(const RpcNotification* notification);
+
+int RpcServer_begin_call(uint64_t id, RpcPendingCall* call);
+void RpcServer_cancel_call(const RpcPendingCall* call);
+int RpcServer_complete(const RpcPendingCall* call, RpcNotificationParamsWriter write_result, const void* arg,
+    size_t arg_size);
+int RpcServer_fail(const RpcPendingCall* call, int32_t code, const char* message);
+
 #ifdef __cplusplus
 }
 #endif
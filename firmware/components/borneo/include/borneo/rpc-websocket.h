@@ -0,0 +1,99 @@
+#pragma once
+
+#include "borneo/common.h"
+#include "borneo/rpc-framer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 浏览器没法直接使用以 '\0' 分隔的 TCP 协议，WebSocket 端口把 RFC 6455 的帧还原成 rpc-framer 认识的字节流，
+// 之后的请求切分、方法调用和原来的 TCP 连接完全一样
+//
+// 连接的第一个数据消息决定编码：
+// 文本消息是 JSON-RPC，每个消息结束时补一个 '\0'；
+// 二进制消息是 CBOR，第一个消息之前补上 CBOR 自描述标签，每个消息前面补上两字节的长度前缀
+// 一个连接上不能混用两种消息，二进制消息不能分片，长度不能超过 65535 字节
+
+#define RPC_WEBSOCKET_MAX_HEADER_SIZE 14
+#define RPC_WEBSOCKET_MAX_CONTROL_PAYLOAD_SIZE 125
+
+// 服务端发送的帧不加掩码，负载不超过 65535 字节时帧头最多 4 个字节
+// 发送缓冲区前面预留这么多字节，负载写完以后直接在它前面填帧头，不用再搬数据
+#define RPC_WEBSOCKET_TX_HEADROOM 4
+
+#ifndef RPC_WEBSOCKET_RAW_BUF_SIZE
+#define RPC_WEBSOCKET_RAW_BUF_SIZE 512
+#endif
+
+// 握手请求的最大长度，浏览器带上 Cookie 等头部一般也不会超过这个长度
+#ifndef RPC_WEBSOCKET_MAX_HANDSHAKE_SIZE
+#define RPC_WEBSOCKET_MAX_HANDSHAKE_SIZE 2048
+#endif
+
+#define RPC_WEBSOCKET_MAX_HANDSHAKE_RESPONSE_SIZE 256
+
+typedef enum {
+    RPC_WEBSOCKET_OPCODE_CONTINUATION = 0x0,
+    RPC_WEBSOCKET_OPCODE_TEXT = 0x1,
+    RPC_WEBSOCKET_OPCODE_BINARY = 0x2,
+    RPC_WEBSOCKET_OPCODE_CLOSE = 0x8,
+    RPC_WEBSOCKET_OPCODE_PING = 0x9,
+    RPC_WEBSOCKET_OPCODE_PONG = 0xA,
+} RpcWebSocketOpcode;
+
+// RFC 6455 7.4.1
+#define RPC_WEBSOCKET_CLOSE_NORMAL 1000
+#define RPC_WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define RPC_WEBSOCKET_CLOSE_UNSUPPORTED_DATA 1003
+
+typedef enum {
+    RPC_WEBSOCKET_DECODE_NONE = 0, // 收到的数据都处理完了，或者 framer 暂时放不下
+    RPC_WEBSOCKET_DECODE_CONTROL = 1, // 收到一个完整的控制帧，处理完以后接着解码
+    RPC_WEBSOCKET_DECODE_ERROR = 2, // 协议错误，应该关闭连接
+} RpcWebSocketDecodeStatus;
+
+typedef struct {
+    uint8_t opcode;
+    const uint8_t* payload;
+    size_t size;
+} RpcWebSocketControl;
+
+typedef struct {
+    uint8_t header[RPC_WEBSOCKET_MAX_HEADER_SIZE]; // 正在接收的帧头
+    size_t header_size;
+    bool is_in_frame; // 帧头已经收完，正在接收负载
+    uint8_t opcode; // 当前帧的操作码
+    bool is_fin;
+    uint8_t mask[4];
+    size_t mask_offset;
+    uint64_t payload_remaining;
+    bool is_in_message; // 一个数据消息的分片还没收完
+    RpcEncoding encoding; // 由第一个数据消息决定
+    uint8_t prefix[RPC_FRAMER_CBOR_MAGIC_SIZE + RPC_FRAMER_LENGTH_PREFIX_SIZE]; // 要补进 framer 的标签、长度前缀或 '\0'
+    size_t prefix_size;
+    size_t prefix_sent;
+    bool is_pending; // raw 里有还没解码的新数据，或者上次解码因为 framer 放不下而停下
+    uint8_t control[RPC_WEBSOCKET_MAX_CONTROL_PAYLOAD_SIZE];
+    size_t control_size;
+    size_t raw_head; // raw 里还没解码的数据
+    size_t raw_tail;
+    uint8_t raw[RPC_WEBSOCKET_RAW_BUF_SIZE]; // 从 socket 收到的原始帧数据
+} RpcWebSocket;
+
+size_t RpcWebSocket_find_request_end(const uint8_t* buf, size_t size);
+size_t RpcWebSocket_handshake(const char* request, size_t request_size, char* response, size_t response_size,
+    bool* is_upgraded);
+
+void RpcWebSocket_init(RpcWebSocket* ws);
+uint8_t* RpcWebSocket_prepare(RpcWebSocket* ws, size_t* available);
+void RpcWebSocket_commit(RpcWebSocket* ws, size_t size);
+RpcWebSocketDecodeStatus RpcWebSocket_decode(RpcWebSocket* ws, RpcFramer* framer, RpcWebSocketControl* control);
+size_t RpcWebSocket_write_header(uint8_t* payload, uint8_t opcode, bool is_fin, size_t payload_size);
+
+inline bool RpcWebSocket_has_pending(const RpcWebSocket* ws) { return ws->is_pending; }
+
+#ifdef __cplusplus
+}
+#endif
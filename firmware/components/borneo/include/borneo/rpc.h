@@ -1,6 +1,8 @@
 #pragma once
 
 #include "borneo/common.h"
+#include "borneo/utils/json-writer.h"
+#include "borneo/rpc-server.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,6 +16,13 @@ enum {
     RPC_ERROR_INVALID_PARAMS = -32602,
     RPC_ERROR_INTERNAL_ERROR = -32603,
     RPC_ERROR_SERVER_ERROR_BEGIN = -32000,
+    // 没有 flush 回调的 writer 放不下响应，比如 UDP 数据报，客户端应该改用 TCP 重新调用
+    RPC_ERROR_RESPONSE_TOO_LARGE = -32001,
+    // 连接上挂起的异步调用太多，等前面的完成以后再调用
+    RPC_ERROR_TOO_MANY_PENDING_CALLS = -32002,
+    // 请求超过接收缓冲区，UDP 上是超过 RPC_SERVER_MAX_DATAGRAM_SIZE，客户端应该改用 TCP 重新调用
+    // TCP 和 WebSocket 上请求超过连接的接收缓冲区也是这个错误，只能拆成多个小的请求
+    RPC_ERROR_REQUEST_TOO_LARGE = -32003,
 };
 
 #define RPC_INVALID_ID __UINT64_MAX__
@@ -33,9 +42,28 @@ typedef struct {
 
 typedef RpcMethodResult (*RpcMethodCallback)(const cJSON* params);
 
+/**
+ * 流式输出结果的方法，成功时把结果（一个 JSON 值）直接写入 result_writer，不需要构造 cJSON 树
+ * 返回失败时已经写入的内容会被丢弃，RpcMethodResult.result 不使用
+ * 结果较大时 result_writer 会边写边发送，所以参数检查等可能失败的操作要在写入之前完成，
+ * 已经发出部分结果之后再返回失败只能关闭连接
+ */
+typedef RpcMethodResult (*RpcMethodWriterCallback)(const cJSON* params, JsonWriter* result_writer);
+
+/**
+ * 异步方法，用于要等很久才有结果的操作，比如等一次投放结束
+ * 方法只做参数检查和启动操作，返回成功以后由其他任务用 RpcServer_complete() 或者 RpcServer_fail() 完成 call，
+ * 每个 call 必须完成且只能完成一次；返回失败时不能再完成 call，错误响应直接按同步方法的方式返回
+ * 等待期间连接继续处理后面的请求，结果完成时单独发送，和其他响应的顺序不一定和请求相同，客户端按 id 对应
+ * 批量调用里的异步方法也是单独发送结果，不占批量响应数组里的位置
+ */
+typedef RpcMethodResult (*RpcMethodAsyncCallback)(const cJSON* params, const RpcPendingCall* call);
+
 typedef struct {
     const char* name; // 方法名
-    const RpcMethodCallback callback; // 方法指针
+    const RpcMethodCallback callback; // 方法指针，返回 cJSON 结果
+    const RpcMethodWriterCallback writer_callback; // 方法指针，流式写入结果，三者只需设置一个
+    const RpcMethodAsyncCallback async_callback; // 方法指针，之后在其他任务里完成
 } RpcMethodEntry;
 
 int Rpc_init(const RpcMethodEntry* rpc_method_table, size_t n);
@@ -7,7 +7,7 @@ extern "C" {
 
 // 系统通用接口
 
-RpcMethodResult RpcMethod_sys_hello(const cJSON* params);
+RpcMethodResult RpcMethod_sys_hello(const cJSON* params, JsonWriter* result_writer);
 
 #ifdef __cplusplus
 }
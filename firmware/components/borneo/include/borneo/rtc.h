@@ -2,6 +2,8 @@
 
 #include <time.h>
 
+#include <esp_event.h>
+
 #include "borneo/common.h"
 
 #ifdef __cplusplus
@@ -9,6 +11,12 @@ extern "C" {
 #endif
 /* Declarations of this file */
 
+ESP_EVENT_DECLARE_BASE(BORNEO_RTC_EVENTS);
+
+enum {
+    BORNEO_EVENT_RTC_TIME_SET = 1, // 时钟被调整过，依赖时间的部件需要重新计算
+};
+
 enum {
     RTC_JAN = 1,
     RTC_FEB = 2,
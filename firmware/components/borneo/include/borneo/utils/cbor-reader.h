@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cJSON.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 把 CBOR（RFC 8949）数据解码成 cJSON 树，这样二进制编码的请求可以直接交给现有的 RPC 方法
+// 只支持 JSON 数据模型能表示的部分：整数、浮点、文本串、数组、键为文本串的映射和 true/false/null
+// 标签会被忽略，字节串和不定长的文本串不支持
+
+#define CBOR_READER_MAX_DEPTH 16
+
+cJSON* CborReader_parse(const void* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cJSON.h>
+
+#include "borneo/utils/buffer-writer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 直接写入缓冲区的流式 JSON 生成器，不分配堆内存
+// 设置了 flush 回调时，缓冲区写满就把数据交给回调（比如发送到 socket）然后继续写，输出大小不受缓冲区限制
+// 任意一次写入失败（缓冲区不够、回调失败或者嵌套过深）之后 error 会一直保持，调用方只需要在最后检查一次
+// 同一套接口也可以输出 CBOR（RFC 8949），数据模型和 JSON 一样，容器都用不定长编码，所以不需要事先知道元素个数
+
+#define JSON_WRITER_MAX_DEPTH 16
+
+typedef enum {
+    JSON_WRITER_FORMAT_JSON = 0,
+    JSON_WRITER_FORMAT_CBOR = 1,
+} JsonWriterFormat;
+
+typedef int (*JsonWriterFlushCallback)(void* context, const void* data, size_t size);
+
+typedef struct {
+    BufferWriter buffer;
+    JsonWriterFlushCallback flush; // NULL 表示只能写入缓冲区
+    void* flush_context;
+    size_t flushed_count; // 已经交给 flush 回调的字节数
+    JsonWriterFormat format;
+    uint8_t depth; // 当前嵌套层数
+    uint32_t has_items; // 位图，第 n 位表示第 n 层容器里已经写过元素，下一个元素前需要逗号
+    bool after_key; // 刚写完对象的键，接下来写值
+    int error;
+} JsonWriter;
+
+int JsonWriter_init(JsonWriter* writer, void* buffer, size_t capacity);
+void JsonWriter_set_flush(JsonWriter* writer, JsonWriterFlushCallback flush, void* context);
+void JsonWriter_set_format(JsonWriter* writer, JsonWriterFormat format);
+void JsonWriter_reset(JsonWriter* writer);
+int JsonWriter_flush(JsonWriter* writer);
+bool JsonWriter_rewind(JsonWriter* writer, const JsonWriter* mark);
+
+int JsonWriter_begin_object(JsonWriter* writer);
+int JsonWriter_end_object(JsonWriter* writer);
+int JsonWriter_begin_array(JsonWriter* writer);
+int JsonWriter_end_array(JsonWriter* writer);
+
+int JsonWriter_key(JsonWriter* writer, const char* key);
+int JsonWriter_string(JsonWriter* writer, const char* value);
+int JsonWriter_int(JsonWriter* writer, int64_t value);
+int JsonWriter_uint(JsonWriter* writer, uint64_t value);
+int JsonWriter_double(JsonWriter* writer, double value);
+int JsonWriter_bool(JsonWriter* writer, bool value);
+int JsonWriter_null(JsonWriter* writer);
+int JsonWriter_cjson(JsonWriter* writer, const cJSON* value);
+int JsonWriter_raw(JsonWriter* writer, const void* buf, size_t size);
+
+int JsonWriter_add_string(JsonWriter* writer, const char* key, const char* value);
+int JsonWriter_add_int(JsonWriter* writer, const char* key, int64_t value);
+int JsonWriter_add_double(JsonWriter* writer, const char* key, double value);
+int JsonWriter_add_bool(JsonWriter* writer, const char* key, bool value);
+
+inline size_t JsonWriter_size(const JsonWriter* writer) { return writer->flushed_count + writer->buffer.written_count; }
+
+inline size_t JsonWriter_buffered(const JsonWriter* writer) { return writer->buffer.written_count; }
+
+inline JsonWriterFormat JsonWriter_format(const JsonWriter* writer) { return writer->format; }
+
+inline bool JsonWriter_has_error(const JsonWriter* writer) { return writer->error != 0; }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "borneo/common.h"
+#include "borneo/broadcast.h"
+#include "borneo/broadcast-beacon.h"
+
+// 这里只有纯计算，广播任务在 broadcast.c 里
+
+/**
+ * 把时间戳左对齐写进 dest 开始预留的 BROADCAST_TIMESTAMP_WIDTH 个字节，剩下的位置填空格
+ * 信标的长度因此固定，每次发送只需要改写这一段
+ */
+void BroadcastBeacon_patch_timestamp(uint8_t* dest, time_t timestamp)
+{
+    char digits[BROADCAST_TIMESTAMP_WIDTH];
+    uint32_t value = timestamp > 0 ? (uint32_t)timestamp : 0;
+    size_t count = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && count < BROADCAST_TIMESTAMP_WIDTH);
+
+    for (size_t i = 0; i < BROADCAST_TIMESTAMP_WIDTH; i++) {
+        dest[i] = i < count ? (uint8_t)digits[count - 1 - i] : ' ';
+    }
+}
+
+/**
+ * 没收到过探测时保持最小间隔，不知道网络里有没有只会等广播的老客户端
+ * 收到过探测以后每发一次信标间隔翻倍
+ */
+uint32_t BroadcastBeacon_next_interval(uint32_t interval_secs, uint32_t probe_count)
+{
+    if (probe_count == 0) {
+        return BROADCAST_MIN_INTERVAL_SECS;
+    }
+    uint32_t next = interval_secs * 2;
+    return next < BROADCAST_PROBED_MAX_INTERVAL_SECS ? next : BROADCAST_PROBED_MAX_INTERVAL_SECS;
+}
@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <esp_event.h>
 #include <esp_log.h>
 #include <esp_system.h>
@@ -5,81 +6,195 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/task.h>
-#include <nvs_flash.h>
 #include <string.h>
 #include <sys/param.h>
-#include <tcpip_adapter.h>
 
-#include <esp32/clk.h>
 #include <lwip/err.h>
 #include <lwip/netdb.h>
 #include <lwip/sockets.h>
 #include <lwip/sys.h>
-#include <lwip/udp.h>
 
 #include "borneo/common.h"
 #include "borneo/broadcast.h"
+#include "borneo/broadcast-beacon.h"
 #include "borneo/device-config.h"
 #include "borneo/rtc.h"
 #include "borneo/serial.h"
 
 static const char* TAG = "UDP";
 
-#define HOST_IP_ADDR "255.255.255.255"
+// 信标在启动时生成一次，之后每次发送只改写时间戳
+// 时间戳预留 10 位数的位置，不够 10 位的后面补空格，JSON 允许数字后面有空白
+#define MSG_PREFIX "{\"MagicWord\":9966,\"Message\":{\"Ts\":"
+#define MSG_SUFFIX_FORMAT ",\"TcpPort\":%d,\"WsPort\":%d,\"Serial\":\"%s\",\"DevName\":\"%s\"}}"
+#define TIMESTAMP_OFFSET (sizeof(MSG_PREFIX) - 1)
 
-const char* MSG_FORMAT = "{\"MagicWord\":9966,\"Message\":{\"Ts\":%d,\"TcpPort\":%d,\"Serial\":\"%"
-                         "s\",\"DevName\":\"%s\"}}";
+#define MAX_PACKET_SIZE 256
 
-#define MAX_PACKET_SIZE 1024
+#define MIN_INTERVAL_TICKS ((TickType_t)(BROADCAST_MIN_INTERVAL_SECS * 1000 / portTICK_PERIOD_MS))
 
-uint8_t s_packet_buf[MAX_PACKET_SIZE];
+static void discovery_task(void* params);
+static int create_socket();
+static void build_template();
+static void send_beacon(int sock);
+static void answer_probe(int sock);
 
-static void udp_client_task(void* params)
+static uint8_t s_packet_buf[MAX_PACKET_SIZE];
+static size_t s_packet_size;
+static uint32_t s_interval_secs;
+static uint32_t s_probe_count;
+static volatile bool s_is_reset_requested;
+static TaskHandle_t s_task;
+
+int Broadcast_init()
 {
-    struct pbuf* p;
+    ESP_LOGI(TAG, "Initailzing UDP broadcasting....");
+    if (s_task == NULL) {
+        build_template();
+        s_interval_secs = BROADCAST_MIN_INTERVAL_SECS;
+        s_probe_count = 0;
+    }
+    return 0;
+}
 
-    struct udp_pcb* udp = udp_new();
+/**
+ * 每次连上 WiFi 都会调用，任务只创建一次，之后的调用让广播间隔恢复到最小值
+ */
+int Broadcast_start()
+{
+    if (s_task != NULL) {
+        s_is_reset_requested = true;
+        return 0;
+    }
+    ESP_LOGI(TAG, "Starting UDP broadcasting....");
 
-    p = pbuf_alloc(PBUF_TRANSPORT, MAX_PACKET_SIZE, PBUF_RAM);
+    s_is_reset_requested = false;
+    xTaskCreate(discovery_task, "udp_client", 4096, NULL, tskIDLE_PRIORITY, &s_task);
+    ESP_LOGI(TAG, "UDP broadcasting started.");
+    return 0;
+}
 
-    const TickType_t freq = 5000 / portTICK_PERIOD_MS;
-    TickType_t last_wake_time = xTaskGetTickCount();
-    for (;;) {
-        memset(s_packet_buf, 0, MAX_PACKET_SIZE);
-        snprintf((char*)s_packet_buf, MAX_PACKET_SIZE - 1, MSG_FORMAT, Rtc_timestamp(), BORNEO_DEVICE_TCP_PORT,
-            Serial_get(), BORNEO_DEVICE_NAME);
+static void discovery_task(void* params)
+{
+    int sock = create_socket();
+    if (sock < 0) {
+        s_task = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
 
-        p->payload = s_packet_buf;
-        p->tot_len = p->len = strlen((const char*)s_packet_buf);
+    TickType_t next_beacon = xTaskGetTickCount();
+    for (;;) {
+        TickType_t now = xTaskGetTickCount();
+        if (s_is_reset_requested) {
+            s_is_reset_requested = false;
+            s_interval_secs = BROADCAST_MIN_INTERVAL_SECS;
+            next_beacon = now;
+        }
+
+        TickType_t remaining = next_beacon - now;
+        if ((int32_t)remaining <= 0) {
+            send_beacon(sock);
+            next_beacon = now + (TickType_t)(s_interval_secs * 1000 / portTICK_PERIOD_MS);
+            s_interval_secs = BroadcastBeacon_next_interval(s_interval_secs, s_probe_count);
+            continue;
+        }
+
+        // 最多等一个最小间隔，重新连上 WiFi 时的重置请求不会被长间隔耽误太久
+        TickType_t wait_ticks = MIN(remaining, MIN_INTERVAL_TICKS);
+        struct timeval timeout = {
+            .tv_sec = (wait_ticks * portTICK_PERIOD_MS) / 1000,
+            .tv_usec = ((wait_ticks * portTICK_PERIOD_MS) % 1000) * 1000,
+        };
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        int ready = select(sock + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0 && errno != EINTR) {
+            ESP_LOGE(TAG, "select() failed: errno %d", errno);
+            vTaskDelay(MIN_INTERVAL_TICKS);
+            continue;
+        }
+        if (ready > 0 && FD_ISSET(sock, &read_fds)) {
+            answer_probe(sock);
+        }
+    }
 
-        // Allocate packet buffer
-        udp_sendto(udp, p, IP_ADDR_BROADCAST, BORNEO_DEVICE_UDP_PORT);
+    close(sock);
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
 
-        vTaskDelayUntil(&last_wake_time, freq);
+/**
+ * 一个套接字既接收探测也发送广播，探测的回复从同一个套接字单播回去
+ */
+static int create_socket()
+{
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return -1;
     }
 
-    vTaskDelete(NULL);
+    int broadcast = 1;
+    setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(BORNEO_DEVICE_PROBE_PORT);
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
 
-    pbuf_free(p); // De-allocate packet buffer
-    udp_remove(udp);
-    vTaskDelete(NULL);
+static void build_template()
+{
+    memcpy(s_packet_buf, MSG_PREFIX, TIMESTAMP_OFFSET);
+    size_t offset = TIMESTAMP_OFFSET + BROADCAST_TIMESTAMP_WIDTH;
+    int n = snprintf((char*)s_packet_buf + offset, MAX_PACKET_SIZE - offset, MSG_SUFFIX_FORMAT,
+        BORNEO_DEVICE_TCP_PORT, BORNEO_DEVICE_WS_PORT, Serial_get(), BORNEO_DEVICE_NAME);
+    assert(n > 0 && offset + n < MAX_PACKET_SIZE);
+    s_packet_size = offset + n;
+    BroadcastBeacon_patch_timestamp(s_packet_buf + TIMESTAMP_OFFSET, 0);
 }
 
-int Broadcast_init()
+static void send_beacon(int sock)
 {
-    ESP_LOGI(TAG, "Initailzing UDP broadcasting....");
-    return 0;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    addr.sin_port = htons(BORNEO_DEVICE_UDP_PORT);
+
+    BroadcastBeacon_patch_timestamp(s_packet_buf + TIMESTAMP_OFFSET, Rtc_timestamp());
+    if (sendto(sock, s_packet_buf, s_packet_size, 0, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ESP_LOGW(TAG, "Failed to send beacon: errno %d", errno);
+    }
 }
 
-int Broadcast_start()
+/**
+ * 探测包以 BORNEO_DISCOVERY_PROBE 开头，其他数据报直接丢掉
+ */
+static void answer_probe(int sock)
 {
-    /* This helper function configures Wi-Fi or Ethernet, as selected in
-     * menuconfig. Read "Establishing Wi-Fi or Ethernet Connection" section in
-     * examples/protocols/README.md for more information about this function.
-     */
-    ESP_LOGI(TAG, "Starting UDP broadcasting....");
+    uint8_t buf[64];
+    struct sockaddr_in source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    ssize_t size = recvfrom(sock, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr*)&source_addr, &addr_len);
+    if (size < (ssize_t)(sizeof(BORNEO_DISCOVERY_PROBE) - 1)
+        || memcmp(buf, BORNEO_DISCOVERY_PROBE, sizeof(BORNEO_DISCOVERY_PROBE) - 1) != 0) {
+        return;
+    }
 
-    xTaskCreate(udp_client_task, "udp_client", 4096, NULL, tskIDLE_PRIORITY, NULL);
-    ESP_LOGI(TAG, "UDP broadcasting started.");
-    return 0;
-}
\ No newline at end of file
+    BroadcastBeacon_patch_timestamp(s_packet_buf + TIMESTAMP_OFFSET, Rtc_timestamp());
+    if (sendto(sock, s_packet_buf, s_packet_size, 0, (struct sockaddr*)&source_addr, addr_len) < 0) {
+        ESP_LOGW(TAG, "Failed to answer probe: errno %d", errno);
+        return;
+    }
+    s_probe_count++;
+}
@@ -4,6 +4,7 @@
 #include "borneo/cron.h"
 #include "borneo/rtc.h"
 #include "borneo/utils/bit-utils.h"
+#include "borneo/utils/json-writer.h"
 
 bool Cron_can_execute(const Cron* cron, const struct tm* rtc)
 {
@@ -13,6 +14,54 @@ bool Cron_can_execute(const Cron* cron, const struct tm* rtc)
     return minute_matched && hour_matched && dow_matched;
 }
 
+/**
+ * 计算 after 之后（不含）最近的一次执行时间，按本地时间计算
+ * 只在 dow 置位的日子里按 hours 位图找小时，最多看到七天之后，每个候选时间只需要一次 mktime()
+ * 没有设置周天或者小时，永远不会执行，返回 -1
+ */
+time_t Cron_next_after(const Cron* cron, time_t after)
+{
+    uint32_t hours = cron->hours & 0x00FFFFFFUL;
+    uint8_t dow = cron->dow & 0x7F;
+    if (hours == 0 || dow == 0 || cron->minute > 59) {
+        return (time_t)-1;
+    }
+
+    struct tm today;
+    localtime_r(&after, &today);
+
+    for (int d = 0; d <= 7; d++) {
+        struct tm day = today;
+        day.tm_mday += d;
+        day.tm_hour = 0;
+        day.tm_min = 0;
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+        // 规范化日期，顺便算出是周几
+        if (mktime(&day) == (time_t)-1) {
+            return (time_t)-1;
+        }
+        if (!get_bit_u8(dow, day.tm_wday)) {
+            continue;
+        }
+
+        // 今天只看当前小时及以后
+        uint32_t candidates = d == 0 ? hours & ~((1UL << today.tm_hour) - 1) : hours;
+        while (candidates != 0) {
+            struct tm fire = day;
+            fire.tm_hour = __builtin_ctz(candidates);
+            fire.tm_min = cron->minute;
+            fire.tm_isdst = -1;
+            time_t fire_time = mktime(&fire);
+            if (fire_time > after) {
+                return fire_time;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return (time_t)-1;
+}
+
 cJSON* Cron_to_json(const Cron* cron)
 {
     cJSON* cron_json = cJSON_CreateObject();
@@ -39,6 +88,34 @@ cJSON* Cron_to_json(const Cron* cron)
     return cron_json;
 }
 
+int Cron_write_json(const Cron* cron, JsonWriter* writer)
+{
+    JsonWriter_begin_object(writer);
+
+    // 添加分钟
+    JsonWriter_add_int(writer, "minute", cron->minute);
+
+    JsonWriter_key(writer, "hours");
+    JsonWriter_begin_array(writer);
+    for (int h = 0; h < 24; h++) {
+        if (get_bit_u32(cron->hours, h)) {
+            JsonWriter_int(writer, h);
+        }
+    }
+    JsonWriter_end_array(writer);
+
+    JsonWriter_key(writer, "dow");
+    JsonWriter_begin_array(writer);
+    for (int dow = 0; dow < 7; dow++) {
+        if (get_bit_u8(cron->dow, dow)) {
+            JsonWriter_int(writer, dow);
+        }
+    }
+    JsonWriter_end_array(writer);
+
+    return JsonWriter_end_object(writer);
+}
+
 int Cron_from_json(Cron* cron, const cJSON* cron_json)
 {
     // 处理分
@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_err.h>
+#include <esp_log.h>
+#include <mdns.h>
+
+#include "borneo/common.h"
+#include "borneo/device-config.h"
+#include "borneo/mdns-service.h"
+#include "borneo/serial.h"
+
+static const char* TAG = "MDNS";
+
+// 主机名和实例名里只带序列号的前几位，够区分同一个网络里的设备
+#define SERIAL_SUFFIX_LENGTH 8
+
+static char s_hostname[32];
+static char s_instance_name[64];
+static char s_tcp_port[8];
+static char s_ws_port[8];
+static bool s_is_started = false;
+
+int MdnsService_init()
+{
+    ESP_LOGI(TAG, "Initializing mDNS service....");
+    const char* serial = Serial_get();
+    snprintf(s_hostname, sizeof(s_hostname), "smartdoser-%.*s", SERIAL_SUFFIX_LENGTH, serial);
+    for (char* p = s_hostname; *p != '\0'; p++) {
+        // 序列号是大写的十六进制，主机名习惯用小写
+        if (*p >= 'A' && *p <= 'Z') {
+            *p = *p - 'A' + 'a';
+        }
+    }
+    snprintf(s_instance_name, sizeof(s_instance_name), "%s %.*s", BORNEO_DEVICE_NAME, SERIAL_SUFFIX_LENGTH, serial);
+    snprintf(s_tcp_port, sizeof(s_tcp_port), "%d", BORNEO_DEVICE_TCP_PORT);
+    snprintf(s_ws_port, sizeof(s_ws_port), "%d", BORNEO_DEVICE_WS_PORT);
+    return 0;
+}
+
+/**
+ * 每次连上 WiFi 都会调用，mDNS 只需要启动一次，之后网络接口的变化由 mDNS 组件自己处理
+ */
+int MdnsService_start()
+{
+    if (s_is_started) {
+        return 0;
+    }
+    ESP_LOGI(TAG, "Starting mDNS service....");
+
+    int error = mdns_init();
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "mdns_init() failed: %d", error);
+        return error;
+    }
+
+    error = mdns_hostname_set(s_hostname);
+    if (error == ESP_OK) {
+        error = mdns_instance_name_set(s_instance_name);
+    }
+    if (error == ESP_OK) {
+        // mdns_service_add() 会复制 TXT 记录，这里用栈上的数组就行
+        mdns_txt_item_t txt[] = {
+            { "serial", Serial_get() },
+            { "model", BORNEO_DEVICE_MODEL_ID },
+            { "compatible", BORNEO_DEVICE_COMPATIBLE },
+            { "port", s_tcp_port },
+            { "ws", s_ws_port },
+        };
+        error = mdns_service_add(NULL, MDNS_SERVICE_TYPE, MDNS_SERVICE_PROTO, BORNEO_DEVICE_TCP_PORT, txt,
+            sizeof(txt) / sizeof(mdns_txt_item_t));
+    }
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register mDNS service: %d", error);
+        mdns_free();
+        return error;
+    }
+
+    s_is_started = true;
+    ESP_LOGI(TAG, "mDNS service started, hostname: %s.local", s_hostname);
+    return 0;
+}
@@ -1,6 +1,7 @@
 // Port from FastPID in C++, Licensed in LGPL 2.0 https://github.com/mike-matera/FastPID
 
 #include <stdint.h>
+#include <string.h>
 
 #include "borneo/pid.h"
 
@@ -64,10 +65,26 @@ bool FastPid_set_output_range(FastPid* pid, int16_t min, int16_t max)
     return !pid->cfg_err;
 }
 
+/**
+ * 限制积分项（和输出同样的单位），积分项饱和以后误差反向时能马上退出饱和
+ */
+bool FastPid_set_integral_range(FastPid* pid, int16_t min, int16_t max)
+{
+    if (min >= max) {
+        FastPid_set_cfg_err(pid);
+        return !pid->cfg_err;
+    }
+    pid->integ_min = (int64_t)(min)*PARAM_MULT;
+    pid->integ_max = (int64_t)(max)*PARAM_MULT;
+    return !pid->cfg_err;
+}
+
 bool FastPid_configure(FastPid* pid, float kp, float ki, float kd, float hz, int bits, bool sign)
 {
     FastPid_reset(pid);
     pid->cfg_err = false;
+    pid->integ_max = INTEG_MAX;
+    pid->integ_min = INTEG_MIN;
     FastPid_set_coefficients(pid, kp, ki, kd, hz);
     FastPid_set_output_config(pid, bits, sign);
     return !pid->cfg_err;
@@ -107,11 +124,11 @@ int16_t FastPid_step(FastPid* pid, int16_t sp, int16_t fb)
         // int17 * int16 = int33
         pid->sum += (int64_t)(err) * (int64_t)(pid->i);
 
-        // Limit sum to 32-bit signed value so that it saturates, never overflows.
-        if (pid->sum > INTEG_MAX) {
-            pid->sum = INTEG_MAX;
-        } else if (pid->sum < INTEG_MIN) {
-            pid->sum = INTEG_MIN;
+        // Limit sum to the configured range (32-bit signed value by default) so that it saturates, never overflows.
+        if (pid->sum > pid->integ_max) {
+            pid->sum = pid->integ_max;
+        } else if (pid->sum < pid->integ_min) {
+            pid->sum = pid->integ_min;
         }
 
         // int32
@@ -156,6 +173,71 @@ int16_t FastPid_step(FastPid* pid, int16_t sp, int16_t fb)
     return rval;
 }
 
+void FastPidBank_init(FastPidBank* bank, size_t count)
+{
+    memset(bank, 0, sizeof(FastPidBank));
+    bank->count = count;
+}
+
+/**
+ * A controller with a configuration error steps like FastPid_step() does, all coefficients are zero.
+ */
+void FastPidBank_load(FastPidBank* bank, size_t index, const FastPid* pid)
+{
+    bank->p[index] = (int32_t)pid->p;
+    bank->i[index] = (int32_t)pid->i;
+    bank->d[index] = (int32_t)pid->d;
+    bank->outmax[index] = (int32_t)pid->outmax;
+    bank->outmin[index] = (int32_t)pid->outmin;
+    bank->integ_max[index] = (int32_t)pid->integ_max;
+    bank->integ_min[index] = (int32_t)pid->integ_min;
+    bank->sum[index] = (int32_t)pid->sum;
+    bank->last_err[index] = pid->last_err;
+    bank->last_sp[index] = pid->last_sp;
+}
+
+void FastPidBank_store(const FastPidBank* bank, size_t index, FastPid* pid)
+{
+    pid->sum = bank->sum[index];
+    pid->last_err = bank->last_err[index];
+    pid->last_sp = bank->last_sp[index];
+}
+
+/**
+ * Same pipeline as FastPid_step(), but the per-term branches are turned into selects so the loop stays straight.
+ * Only the integral accumulation needs 64 bits (int32 + int33); P wraps in 32 bits exactly like the scalar version.
+ */
+void FastPidBank_step(FastPidBank* bank, const int16_t* sp, const int16_t* fb, int16_t* out)
+{
+    for (size_t n = 0; n < bank->count; n++) {
+        int32_t err = (int32_t)(sp[n]) - (int32_t)(fb[n]);
+
+        int32_t P = (int32_t)((uint32_t)bank->p[n] * (uint32_t)err);
+
+        int64_t acc = (int64_t)bank->sum[n] + (int64_t)err * bank->i[n];
+        acc = acc > bank->integ_max[n] ? bank->integ_max[n] : acc;
+        acc = acc < bank->integ_min[n] ? bank->integ_min[n] : acc;
+        bool has_i = bank->i[n] != 0;
+        bank->sum[n] = has_i ? (int32_t)acc : bank->sum[n];
+        int32_t I = has_i ? (int32_t)acc : 0;
+
+        int32_t deriv = (err - bank->last_err[n]) - ((int32_t)(sp[n]) - (int32_t)(bank->last_sp[n]));
+        deriv = deriv > DERIV_MAX ? DERIV_MAX : deriv;
+        deriv = deriv < DERIV_MIN ? DERIV_MIN : deriv;
+        bool has_d = bank->d[n] != 0;
+        bank->last_sp[n] = has_d ? sp[n] : bank->last_sp[n];
+        bank->last_err[n] = has_d ? err : bank->last_err[n];
+        int32_t D = bank->d[n] * deriv;
+
+        int64_t sum = (int64_t)(P) + (int64_t)(I) + (int64_t)(D);
+        sum = sum > bank->outmax[n] ? bank->outmax[n] : sum;
+        sum = sum < bank->outmin[n] ? bank->outmin[n] : sum;
+
+        // Fair rounding without a branch.
+        out[n] = (int16_t)((sum >> PARAM_SHIFT) + ((sum >> (PARAM_SHIFT - 1)) & 1));
+    }
+}
+
 static void FastPid_set_cfg_err(FastPid* pid)
 {
     pid->cfg_err = true;
@@ -0,0 +1,212 @@
+#include <assert.h>
+#include <string.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc-framer.h"
+
+static RpcFrameStatus scan_frame(RpcFramer* framer);
+static RpcFrameStatus scan_delimited_frame(RpcFramer* framer);
+static RpcFrameStatus scan_length_prefixed_frame(RpcFramer* framer);
+static bool detect_encoding(RpcFramer* framer);
+static size_t read_length_prefix(const RpcFramer* framer);
+static void discard(RpcFramer* framer);
+
+static const uint8_t CBOR_MAGIC[RPC_FRAMER_CBOR_MAGIC_SIZE] = { 0xD9, 0xD9, 0xF7 };
+
+int RpcFramer_init(RpcFramer* framer, void* buffer, size_t capacity)
+{
+    assert(framer != NULL);
+    assert(buffer != NULL);
+    assert(capacity > 0);
+
+    framer->buffer = (uint8_t*)buffer;
+    framer->capacity = capacity;
+    RpcFramer_reset(framer);
+    return 0;
+}
+
+void RpcFramer_reset(RpcFramer* framer)
+{
+    framer->head = 0;
+    framer->tail = 0;
+    framer->scanned = 0;
+    framer->frame_end = 0;
+    framer->discard_remaining = 0;
+    framer->encoding = RPC_ENCODING_UNKNOWN;
+    framer->is_discarding = false;
+}
+
+/**
+ * 返回 recv() 可以写入的位置和大小
+ * 之前通过 RpcFramer_next() 取到的帧在这之后就失效了
+ */
+uint8_t* RpcFramer_prepare(RpcFramer* framer, size_t* available)
+{
+    if (framer->head == framer->tail) {
+        // 数据都处理完了，直接回到开头
+        framer->head = 0;
+        framer->tail = 0;
+        framer->scanned = 0;
+        framer->frame_end = 0;
+    } else if (framer->tail == framer->capacity && framer->head > 0) {
+        // 缓冲区尾部写满了，只把剩下的不完整帧搬到开头，每填满一次缓冲区最多搬一次
+        size_t offset = framer->head;
+        memmove(framer->buffer, framer->buffer + offset, framer->tail - offset);
+        framer->head = 0;
+        framer->tail -= offset;
+        framer->scanned -= offset;
+        if (framer->frame_end > 0) {
+            framer->frame_end -= offset;
+        }
+    }
+    *available = framer->capacity - framer->tail;
+    return framer->buffer + framer->tail;
+}
+
+void RpcFramer_commit(RpcFramer* framer, size_t size)
+{
+    assert(framer->tail + size <= framer->capacity);
+    framer->tail += size;
+    if (framer->is_discarding) {
+        discard(framer);
+    }
+}
+
+/**
+ * 取出下一个完整的帧，帧数据留在接收缓冲区里
+ */
+RpcFrameStatus RpcFramer_next(RpcFramer* framer, RpcFrame* frame)
+{
+    RpcFrameStatus status = scan_frame(framer);
+    if (status == RPC_FRAME_NONE) {
+        return RPC_FRAME_NONE;
+    }
+    if (status == RPC_FRAME_OVERSIZE) {
+        // 丢掉这个帧：JSON 一直丢弃到下一个 '\0'，CBOR 按长度前缀丢弃
+        if (framer->encoding == RPC_ENCODING_CBOR) {
+            framer->discard_remaining = RPC_FRAMER_LENGTH_PREFIX_SIZE + read_length_prefix(framer);
+        }
+        framer->is_discarding = true;
+        discard(framer);
+        return RPC_FRAME_OVERSIZE;
+    }
+
+    size_t begin = framer->head;
+    if (framer->encoding == RPC_ENCODING_CBOR) {
+        begin += RPC_FRAMER_LENGTH_PREFIX_SIZE;
+    }
+    frame->data = framer->buffer + begin;
+    frame->size = framer->frame_end - begin;
+    framer->head = framer->frame_end;
+    framer->scanned = framer->frame_end;
+    framer->frame_end = 0;
+    return RPC_FRAME_OK;
+}
+
+bool RpcFramer_has_frame(RpcFramer* framer) { return scan_frame(framer) != RPC_FRAME_NONE; }
+
+static RpcFrameStatus scan_frame(RpcFramer* framer)
+{
+    if (framer->frame_end > 0) {
+        return RPC_FRAME_OK;
+    }
+    if (framer->is_discarding) {
+        return RPC_FRAME_NONE;
+    }
+    if (framer->encoding == RPC_ENCODING_UNKNOWN && !detect_encoding(framer)) {
+        return RPC_FRAME_NONE;
+    }
+    if (framer->encoding == RPC_ENCODING_CBOR) {
+        return scan_length_prefixed_frame(framer);
+    }
+    return scan_delimited_frame(framer);
+}
+
+/**
+ * 只扫描上次没扫描过的数据
+ */
+static RpcFrameStatus scan_delimited_frame(RpcFramer* framer)
+{
+    if (framer->scanned < framer->tail) {
+        const uint8_t* found
+            = (const uint8_t*)memchr(framer->buffer + framer->scanned, 0, framer->tail - framer->scanned);
+        if (found != NULL) {
+            framer->frame_end = found - framer->buffer + 1;
+            return RPC_FRAME_OK;
+        }
+        framer->scanned = framer->tail;
+    }
+    // 整个缓冲区都放不下一个帧
+    return framer->tail - framer->head == framer->capacity ? RPC_FRAME_OVERSIZE : RPC_FRAME_NONE;
+}
+
+static RpcFrameStatus scan_length_prefixed_frame(RpcFramer* framer)
+{
+    size_t size = framer->tail - framer->head;
+    if (size < RPC_FRAMER_LENGTH_PREFIX_SIZE) {
+        return RPC_FRAME_NONE;
+    }
+    size_t frame_size = RPC_FRAMER_LENGTH_PREFIX_SIZE + read_length_prefix(framer);
+    if (frame_size > framer->capacity) {
+        // 有长度前缀，不用等缓冲区写满就知道放不下
+        return RPC_FRAME_OVERSIZE;
+    }
+    if (size < frame_size) {
+        return RPC_FRAME_NONE;
+    }
+    framer->frame_end = framer->head + frame_size;
+    return RPC_FRAME_OK;
+}
+
+/**
+ * 根据连接开头的数据判断编码，数据不够判断时返回 false
+ */
+static bool detect_encoding(RpcFramer* framer)
+{
+    size_t size = framer->tail - framer->head;
+    if (size == 0) {
+        return false;
+    }
+    const uint8_t* data = framer->buffer + framer->head;
+    size_t compared = size < RPC_FRAMER_CBOR_MAGIC_SIZE ? size : RPC_FRAMER_CBOR_MAGIC_SIZE;
+    if (memcmp(data, CBOR_MAGIC, compared) != 0) {
+        framer->encoding = RPC_ENCODING_JSON;
+        return true;
+    }
+    if (compared < RPC_FRAMER_CBOR_MAGIC_SIZE) {
+        return false;
+    }
+    framer->head += RPC_FRAMER_CBOR_MAGIC_SIZE;
+    framer->scanned = framer->head;
+    framer->encoding = RPC_ENCODING_CBOR;
+    return true;
+}
+
+static size_t read_length_prefix(const RpcFramer* framer)
+{
+    const uint8_t* data = framer->buffer + framer->head;
+    return ((size_t)data[0] << 8) | data[1];
+}
+
+static void discard(RpcFramer* framer)
+{
+    if (framer->encoding == RPC_ENCODING_CBOR) {
+        size_t size = framer->tail - framer->head;
+        size_t n = size < framer->discard_remaining ? size : framer->discard_remaining;
+        framer->head += n;
+        framer->scanned = framer->head;
+        framer->discard_remaining -= n;
+        framer->is_discarding = framer->discard_remaining > 0;
+        return;
+    }
+
+    const uint8_t* found = (const uint8_t*)memchr(framer->buffer + framer->head, 0, framer->tail - framer->head);
+    if (found == NULL) {
+        framer->head = framer->tail;
+        framer->scanned = framer->tail;
+        return;
+    }
+    framer->head = found - framer->buffer + 1;
+    framer->scanned = framer->head;
+    framer->is_discarding = false;
+}
@@ -1,8 +1,10 @@
+#include <assert.h>
 #include <esp_event.h>
 #include <esp_log.h>
 #include <esp_system.h>
 #include <esp_wifi.h>
 #include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <string.h>
 #include <sys/param.h>
@@ -12,25 +14,104 @@
 #include <lwip/sockets.h>
 #include <lwip/sys.h>
 
+#include <cJSON.h>
+
 #include "borneo/common.h"
 #include "borneo/device-config.h"
+#include "borneo/rpc.h"
+#include "borneo/rpc-framer.h"
 #include "borneo/rpc-server.h"
+#include "borneo/rpc-websocket.h"
+
+// 基于 select() 的事件循环，同时服务 RPC_SERVER_MAX_CONNECTIONS 个连接
+// 每个连接有自己的收发缓冲区和空闲超时，五分钟不传输数据就关闭连接
+// 发送从不阻塞事件循环，对方接收慢时发不出去的数据积压在连接里，积压期间这个连接暂停处理新的请求
+// 每个连接可以用 JSON 或者 CBOR 编码，由连接开头的数据决定，见 rpc-framer.h
+// 其他任务发布的通知放进订阅者的队列，再通过本机回环的 UDP 套接字唤醒阻塞在 select() 里的服务端任务
+// 浏览器从 BORNEO_DEVICE_WS_PORT 用 WebSocket 连进来，握手之后和 TCP 连接共用同一套请求处理，见 rpc-websocket.h
+// 异步方法的结果由其他任务放进发起调用的连接的队列，和通知一样唤醒服务端任务发送，连接不用等它完成就能处理后面的请求
+// 轮询状态这类小的调用可以用 UDP 端口上的单个数据报完成，省掉建立连接的往返，见 rpc-server.h
 
-// 这里只能支持一个连接，需要改成 select() 的支持两个连接
-// 还有超时，五分钟不传输数据需要关闭连接
+#define SEND_TIMEOUT 5
+#define IDLE_TIMEOUT 300
+#define HANDSHAKE_TIMEOUT 10
 
-#define SEND_TIMEOUT    5
-#define RECV_TIMEOUT    300
+// 每一轮事件循环里单个连接最多处理的请求数，防止流水线发送的客户端饿死其他连接
+#define MAX_REQUESTS_PER_ROUND 4
 
 const char* TAG = "SERVER";
 
-#define MAX_TX_BUF_SIZE (1024 * 8)
+// 响应边生成边发送，发送缓冲区只需要放下一段数据，不需要放下整个响应
+#define MAX_TX_BUF_SIZE (1024 * 2)
 #define MAX_RX_BUF_SIZE (1024 * 8)
 
+#define IDLE_TIMEOUT_TICKS ((TickType_t)(IDLE_TIMEOUT * 1000 / portTICK_PERIOD_MS))
+#define SEND_TIMEOUT_TICKS ((TickType_t)(SEND_TIMEOUT * 1000 / portTICK_PERIOD_MS))
+#define HANDSHAKE_TIMEOUT_TICKS ((TickType_t)(HANDSHAKE_TIMEOUT * 1000 / portTICK_PERIOD_MS))
+
+typedef enum {
+    RPC_TRANSPORT_TCP = 0, // 以 '\0' 或者长度前缀分隔的原始 TCP 连接
+    RPC_TRANSPORT_WEBSOCKET = 1,
+} RpcTransport;
+
+/**
+ * 生成响应的过程中没能马上发出去的数据，按顺序挂在连接上，等 socket 可写时再发
+ */
+typedef struct RpcTxChunkTag {
+    struct RpcTxChunkTag* next;
+    size_t size;
+    size_t sent;
+    uint8_t data[];
+} RpcTxChunk;
+
 typedef struct {
-    RpcRequestHandler* request_handler;
+    int sock;
+    RpcTransport transport;
+    bool is_handshaking; // WebSocket 连接还在接收 HTTP Upgrade 请求
+    size_t handshake_size; // 握手请求已经收到 rx_buf 里的字节数
+    bool is_tx_continued; // WebSocket 连接上正在发送的消息已经发出去了前面的分片
+    RpcFramer framer; // 在 rx_buf 里切分请求帧
+    size_t tx_size; // tx_buf 里待发送的字节数
+    size_t tx_sent; // tx_buf 里已经发送的字节数
+    RpcTxChunk* backlog_head; // 在 tx_buf 之前要发送的数据
+    RpcTxChunk* backlog_tail;
+    size_t backlog_size;
+    TickType_t last_active; // 最后一次收发数据的时间
+    uint32_t subscriptions; // 订阅的通知主题，受 s_context.lock 保护
+    size_t notification_head; // 通知环形队列的开始位置，受 s_context.lock 保护
+    size_t notification_count;
+    RpcNotification notifications[RPC_SERVER_MAX_NOTIFICATIONS];
+    uint16_t generation; // 连接关闭时加一，受 s_context.lock 保护
+    size_t pending_calls; // 还没发出结果的异步调用个数，包括已经在队列里的，受 s_context.lock 保护
+    size_t completion_head; // 异步调用结果环形队列的开始位置，受 s_context.lock 保护
+    size_t completion_count;
+    RpcCompletion completions[RPC_SERVER_MAX_PENDING_CALLS];
     uint8_t tx_buf[MAX_TX_BUF_SIZE];
     uint8_t rx_buf[MAX_RX_BUF_SIZE];
+    RpcWebSocket ws; // 只有 WebSocket 连接使用
+} RpcConnection;
+
+typedef struct {
+    struct sockaddr_in addr; // 请求的来源
+    uint32_t id; // 客户端的请求序号
+    size_t size; // 响应数据报的长度，包括开头的请求序号，为 0 表示这一项没有使用
+    uint8_t data[RPC_SERVER_MAX_DATAGRAM_SIZE];
+} RpcDatagramCacheEntry;
+
+typedef struct {
+    RpcRequestHandler* request_handler;
+    RpcConnection connections[RPC_SERVER_MAX_CONNECTIONS];
+    size_t next_connection; // 轮询起点，保证各连接之间的公平
+    RpcConnection* current_connection; // 正在处理请求的连接，RPC 方法通过它订阅通知
+    int datagram_sock;
+    size_t next_datagram; // 下一个要覆盖的缓存项
+    RpcDatagramCacheEntry datagrams[RPC_SERVER_DATAGRAM_CACHE_SIZE];
+    uint8_t datagram_rx_buf[RPC_SERVER_MAX_DATAGRAM_SIZE + 1]; // 多一个字节给 JSON 请求补结尾的 '\0'
+    SemaphoreHandle_t lock; // 保护各连接的订阅和通知队列，发布通知的是其他任务
+    int wakeup_sock; // 服务端任务接收唤醒的 UDP 套接字
+    int wakeup_tx_sock; // 发布通知时用来发送唤醒的 UDP 套接字，受 lock 保护
+    struct sockaddr_in wakeup_addr;
+    bool is_wakeup_pending; // 已经发送了唤醒还没被处理，不用重复发送
     TaskHandle_t thread;
     bool is_closed;
 } RpcServerContext;
@@ -38,19 +119,82 @@ typedef struct {
 static RpcServerContext s_context;
 
 static void tcp_server_task(void* pvParameters);
-static int handle_buffer(uint8_t* rx_buf, size_t* recv_size, size_t* size_to_send);
+static int create_listen_socket(uint16_t port);
+static int create_datagram_socket(uint16_t port);
+static bool serve_datagram();
+static RpcDatagramCacheEntry* find_datagram(const struct sockaddr_in* addr, uint32_t id);
+static void reject_datagram(const struct sockaddr_in* addr, const uint8_t* request);
+static void send_datagram(const RpcDatagramCacheEntry* entry);
+static void accept_connection(int listen_sock, RpcTransport transport);
+static void close_connection(RpcConnection* conn);
+static int serve_connection(RpcConnection* conn);
+static int receive(RpcConnection* conn);
+static int receive_handshake(RpcConnection* conn);
+static int receive_websocket(RpcConnection* conn);
+static int send_websocket_control(RpcConnection* conn, uint8_t opcode, const void* payload, size_t size);
+static int send_websocket_frame(void* context, const void* data, size_t size);
+static uint8_t websocket_opcode(const RpcConnection* conn);
+static bool has_buffered_input(RpcConnection* conn);
+static int flush_connection(RpcConnection* conn);
+static bool has_pending_output(const RpcConnection* conn);
+static int append_backlog(RpcConnection* conn, const uint8_t* data, size_t size);
+static void free_backlog(RpcConnection* conn);
+static int handle_buffer(RpcConnection* conn, bool* has_more);
+static int send_all(void* context, const void* data, size_t size);
+static void begin_write(RpcConnection* conn, JsonWriter* writer);
+static int end_message(RpcConnection* conn, JsonWriter* writer);
+static void end_write(RpcConnection* conn, const JsonWriter* writer);
+static int send_notifications(RpcConnection* conn);
+static int send_completions(RpcConnection* conn);
+static bool has_notifications(RpcConnection* conn);
+static bool pop_completion(RpcConnection* conn, RpcCompletion* completion);
+static int push_completion(const RpcPendingCall* call, const RpcCompletion* completion);
+static void request_wakeup();
+static bool pop_notification(RpcConnection* conn, RpcNotification* notification);
+static void push_notification(RpcConnection* conn, const RpcNotification* notification);
+static int create_wakeup_sockets();
+static void drain_wakeup_socket();
+static TickType_t connection_timeout(const RpcConnection* conn);
 
+/**
+ * 每次连上 WiFi 都会调用，服务端任务已经在运行时什么都不做，连接和锁都保持原样
+ */
 int RpcServer_init(RpcRequestHandler* request_handler)
 {
+    if (s_context.thread != NULL) {
+        return 0;
+    }
     s_context.request_handler = request_handler;
     s_context.thread = NULL;
     s_context.is_closed = false;
+    s_context.next_connection = 0;
+    s_context.current_connection = NULL;
+    s_context.datagram_sock = -1;
+    s_context.next_datagram = 0;
+    for (size_t i = 0; i < RPC_SERVER_DATAGRAM_CACHE_SIZE; i++) {
+        s_context.datagrams[i].size = 0;
+    }
+    s_context.wakeup_sock = -1;
+    s_context.wakeup_tx_sock = -1;
+    s_context.is_wakeup_pending = false;
+    for (size_t i = 0; i < RPC_SERVER_MAX_CONNECTIONS; i++) {
+        s_context.connections[i].sock = -1;
+    }
+    if (s_context.lock == NULL) {
+        s_context.lock = xSemaphoreCreateMutex();
+        if (s_context.lock == NULL) {
+            return -1;
+        }
+    }
     return 0;
 }
 
 int RpcServer_start()
 {
     assert(!s_context.is_closed);
+    if (s_context.thread != NULL) {
+        return 0;
+    }
     xTaskCreate(tcp_server_task, "rpc-server", 1024 * 8, NULL, tskIDLE_PRIORITY + 5, &s_context.thread);
     return 0;
 }
@@ -71,142 +215,1227 @@ int RpcServer_close()
     return -1;
 }
 
+/**
+ * 让正在处理请求的连接订阅通知，只能在 RPC 方法里调用
+ */
+int RpcServer_subscribe(uint32_t topics)
+{
+    RpcConnection* conn = s_context.current_connection;
+    if (conn == NULL) {
+        return -1;
+    }
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    conn->subscriptions |= topics;
+    xSemaphoreGive(s_context.lock);
+    return 0;
+}
+
+/**
+ * 取消正在处理请求的连接的订阅，队列里已有的这些主题的通知也不会再发送
+ */
+int RpcServer_unsubscribe(uint32_t topics)
+{
+    RpcConnection* conn = s_context.current_connection;
+    if (conn == NULL) {
+        return -1;
+    }
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    conn->subscriptions &= ~topics;
+    xSemaphoreGive(s_context.lock);
+    return 0;
+}
+
+/**
+ * 把通知放进所有订阅了它的连接的队列，可以在任何任务里调用，不会阻塞在网络发送上
+ */
+int RpcServer_publish(const RpcNotification* notification)
+{
+    if (s_context.lock == NULL) {
+        return -1;
+    }
+
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    bool has_subscriber = false;
+    for (size_t i = 0; i < RPC_SERVER_MAX_CONNECTIONS; i++) {
+        RpcConnection* conn = &s_context.connections[i];
+        if ((conn->subscriptions & notification->topic) != 0) {
+            push_notification(conn, notification);
+            has_subscriber = true;
+        }
+    }
+    if (has_subscriber) {
+        request_wakeup();
+    }
+    xSemaphoreGive(s_context.lock);
+    return 0;
+}
+
+/**
+ * 异步方法调用，把正在处理的请求挂起，给这个调用在连接上预留一个结果的位置
+ * 只能在 RPC 方法里调用，返回 -1 表示请求不是从连接上来的（比如 UDP 数据报），-2 表示连接上挂起的调用太多
+ */
+int RpcServer_begin_call(uint64_t id, RpcPendingCall* call)
+{
+    RpcConnection* conn = s_context.current_connection;
+    if (conn == NULL) {
+        return -1;
+    }
+
+    int ret = 0;
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    if (conn->pending_calls < RPC_SERVER_MAX_PENDING_CALLS) {
+        conn->pending_calls++;
+        call->connection = (uint16_t)(conn - s_context.connections);
+        call->generation = conn->generation;
+        call->id = id;
+    } else {
+        ret = -2;
+    }
+    xSemaphoreGive(s_context.lock);
+    return ret;
+}
+
+/**
+ * 方法同步返回失败时释放预留的位置，错误响应直接写在请求的位置上
+ */
+void RpcServer_cancel_call(const RpcPendingCall* call)
+{
+    RpcConnection* conn = &s_context.connections[call->connection];
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    if (conn->generation == call->generation && conn->pending_calls > 0) {
+        conn->pending_calls--;
+    }
+    xSemaphoreGive(s_context.lock);
+}
+
+/**
+ * 完成一个挂起的调用，结果在发送的时候由 write_result 根据 arg 生成
+ * 可以在任何任务里调用，每个挂起的调用只能完成一次；连接已经关闭时结果直接丢掉，返回 -1
+ */
+int RpcServer_complete(const RpcPendingCall* call, RpcNotificationParamsWriter write_result, const void* arg,
+    size_t arg_size)
+{
+    assert(arg_size <= RPC_NOTIFICATION_MAX_ARG_SIZE);
+    RpcCompletion completion = {
+        .id = call->id,
+        .error_code = 0,
+        .error_message = NULL,
+        .write_result = write_result,
+    };
+    if (arg_size > 0) {
+        memcpy(completion.arg, arg, arg_size);
+    }
+    return push_completion(call, &completion);
+}
+
+int RpcServer_fail(const RpcPendingCall* call, int32_t code, const char* message)
+{
+    assert(code != 0);
+    RpcCompletion completion = {
+        .id = call->id,
+        .error_code = code,
+        .error_message = message,
+        .write_result = NULL,
+    };
+    return push_completion(call, &completion);
+}
+
 static void tcp_server_task(void* pvParameters)
 {
-    char addr_str[128];
-    int addr_family;
-    int ip_protocol;
+    int ws_listen_sock = -1;
+    int listen_sock = create_listen_socket(BORNEO_DEVICE_TCP_PORT);
+    if (listen_sock < 0) {
+        s_context.thread = NULL;
+        vTaskDelete(NULL);
+        return;
+    }
+
+    ws_listen_sock = create_listen_socket(BORNEO_DEVICE_WS_PORT);
+    if (ws_listen_sock < 0) {
+        goto __TASK_EXIT;
+    }
+
+    s_context.datagram_sock = create_datagram_socket(BORNEO_DEVICE_RPC_UDP_PORT);
+    if (s_context.datagram_sock < 0) {
+        goto __TASK_EXIT;
+    }
+
+    if (create_wakeup_sockets() != 0) {
+        ESP_LOGE(TAG, "Unable to create wakeup socket: errno %d", errno);
+        goto __TASK_EXIT;
+    }
+
+    while (1) {
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(s_context.wakeup_sock, &read_fds);
+        FD_SET(s_context.datagram_sock, &read_fds);
+        int max_fd = MAX(s_context.wakeup_sock, s_context.datagram_sock);
+        bool has_free_slot = false;
+        bool has_pending = false;
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait_ticks = IDLE_TIMEOUT_TICKS;
+
+        for (size_t i = 0; i < RPC_SERVER_MAX_CONNECTIONS; i++) {
+            RpcConnection* conn = &s_context.connections[i];
+            if (conn->sock < 0) {
+                has_free_slot = true;
+                continue;
+            }
+            if (has_pending_output(conn)) {
+                // 还有没发完的响应，先等可写，暂时不读取新的请求，形成背压
+                FD_SET(conn->sock, &write_fds);
+            } else {
+                FD_SET(conn->sock, &read_fds);
+                has_pending = has_pending || has_buffered_input(conn) || has_notifications(conn);
+            }
+            max_fd = MAX(max_fd, conn->sock);
+
+            // select() 的超时取最早到期的连接超时
+            TickType_t idle_ticks = now - conn->last_active;
+            TickType_t timeout_ticks = connection_timeout(conn);
+            TickType_t remaining = idle_ticks < timeout_ticks ? timeout_ticks - idle_ticks : 0;
+            wait_ticks = MIN(wait_ticks, remaining);
+        }
+
+        // 连接数满了就不再 accept，新连接留在 listen 的队列里等待
+        if (has_free_slot) {
+            FD_SET(listen_sock, &read_fds);
+            FD_SET(ws_listen_sock, &read_fds);
+            max_fd = MAX(max_fd, MAX(listen_sock, ws_listen_sock));
+        }
+
+        // 如果有连接的缓冲区里还留着完整的请求没处理，不能阻塞等待
+        if (has_pending) {
+            wait_ticks = 0;
+        }
+
+        struct timeval timeout = {
+            .tv_sec = (wait_ticks * portTICK_PERIOD_MS) / 1000,
+            .tv_usec = ((wait_ticks * portTICK_PERIOD_MS) % 1000) * 1000,
+        };
+        int ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select() failed: errno %d", errno);
+            break;
+        }
+
+        if (FD_ISSET(s_context.wakeup_sock, &read_fds)) {
+            drain_wakeup_socket();
+        }
+
+        if (FD_ISSET(listen_sock, &read_fds)) {
+            accept_connection(listen_sock, RPC_TRANSPORT_TCP);
+        }
+
+        if (FD_ISSET(ws_listen_sock, &read_fds)) {
+            accept_connection(ws_listen_sock, RPC_TRANSPORT_WEBSOCKET);
+        }
+
+        // 和连接一样每轮最多处理 MAX_REQUESTS_PER_ROUND 个，剩下的数据报下一轮 select() 还会报告可读
+        if (FD_ISSET(s_context.datagram_sock, &read_fds)) {
+            for (size_t n = 0; n < MAX_REQUESTS_PER_ROUND; n++) {
+                if (!serve_datagram()) {
+                    break;
+                }
+            }
+        }
+
+        // 每轮从不同的连接开始轮询，每个连接每轮只收一次数据、最多处理 MAX_REQUESTS_PER_ROUND 个请求
+        size_t first = s_context.next_connection;
+        s_context.next_connection = (s_context.next_connection + 1) % RPC_SERVER_MAX_CONNECTIONS;
+        for (size_t n = 0; n < RPC_SERVER_MAX_CONNECTIONS; n++) {
+            RpcConnection* conn = &s_context.connections[(first + n) % RPC_SERVER_MAX_CONNECTIONS];
+            if (conn->sock < 0) {
+                continue;
+            }
+
+            int error = 0;
+            if (FD_ISSET(conn->sock, &write_fds)) {
+                error = flush_connection(conn);
+            } else if (!has_pending_output(conn)
+                && (FD_ISSET(conn->sock, &read_fds) || has_buffered_input(conn))) {
+                // 响应还没发完的连接不能处理新的请求，否则会覆盖 tx_buf 里没发出去的数据
+                error = serve_connection(conn);
+            }
+
+            // 异步调用的结果和通知只在两个响应之间发送，不会插进一个响应的中间
+            if (error == 0 && !has_pending_output(conn)) {
+                error = send_completions(conn);
+            }
+            if (error == 0 && !has_pending_output(conn)) {
+                error = send_notifications(conn);
+            }
+
+            if (error == 0 && (xTaskGetTickCount() - conn->last_active) >= connection_timeout(conn)) {
+                ESP_LOGI(TAG, "Connection timeout, closing socket %d", conn->sock);
+                error = -1;
+            }
+
+            if (error != 0) {
+                close_connection(conn);
+            }
+        }
+    }
+
+__TASK_EXIT:
+
+    for (size_t i = 0; i < RPC_SERVER_MAX_CONNECTIONS; i++) {
+        if (s_context.connections[i].sock >= 0) {
+            close_connection(&s_context.connections[i]);
+        }
+    }
+    close(listen_sock);
+    if (ws_listen_sock >= 0) {
+        close(ws_listen_sock);
+    }
+    if (s_context.datagram_sock >= 0) {
+        close(s_context.datagram_sock);
+        s_context.datagram_sock = -1;
+    }
+    if (s_context.wakeup_sock >= 0) {
+        close(s_context.wakeup_sock);
+        s_context.wakeup_sock = -1;
+    }
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    if (s_context.wakeup_tx_sock >= 0) {
+        close(s_context.wakeup_tx_sock);
+        s_context.wakeup_tx_sock = -1;
+    }
+    xSemaphoreGive(s_context.lock);
+    // 任务退出以后下次连上 WiFi 可以重新启动
+    s_context.thread = NULL;
+    vTaskDelete(NULL);
+}
 
+static int create_listen_socket(uint16_t port)
+{
     struct sockaddr_in dest_addr;
     dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
     dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(BORNEO_DEVICE_TCP_PORT);
-    addr_family = AF_INET;
-    ip_protocol = IPPROTO_IP;
-    inet_ntoa_r(dest_addr.sin_addr, addr_str, sizeof(addr_str) - 1);
+    dest_addr.sin_port = htons(port);
 
-    int listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
+    int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
     if (listen_sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        return;
+        return -1;
     }
     ESP_LOGI(TAG, "Socket created");
 
-
     int err = bind(listen_sock, (struct sockaddr*)&dest_addr, sizeof(dest_addr));
     if (err != 0) {
         ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
-        goto __TASK_EXIT;
+        close(listen_sock);
+        return -1;
     }
-    ESP_LOGI(TAG, "Socket bound, port %d", BORNEO_DEVICE_TCP_PORT);
+    ESP_LOGI(TAG, "Socket bound, port %d", port);
 
-    err = listen(listen_sock, 1);
+    err = listen(listen_sock, RPC_SERVER_MAX_CONNECTIONS);
     if (err != 0) {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
-        goto __TASK_EXIT;
+        close(listen_sock);
+        return -1;
     }
     ESP_LOGI(TAG, "Socket listening");
+    return listen_sock;
+}
 
-    while (1) {
-        struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
-        uint addr_len = sizeof(source_addr);
-        int client_sock = accept(listen_sock, (struct sockaddr*)&source_addr, &addr_len);
-        if (client_sock < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+static int create_datagram_socket(uint16_t port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create UDP socket: errno %d", errno);
+        return -1;
+    }
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "UDP socket unable to bind: errno %d", errno);
+        close(sock);
+        return -1;
+    }
+    ESP_LOGI(TAG, "UDP socket bound, port %d", port);
+    return sock;
+}
+
+/**
+ * 接收并处理一个数据报，没有数据报可以接收时返回 false
+ * 响应写进缓存项，writer 没有 flush 回调，放不下时 handle_rpc 会把响应换成 RPC_ERROR_RESPONSE_TOO_LARGE 错误
+ */
+static bool serve_datagram()
+{
+    uint8_t* rx_buf = s_context.datagram_rx_buf;
+    struct sockaddr_in source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    // 多接收一个字节，超过 RPC_SERVER_MAX_DATAGRAM_SIZE 的数据报才能和刚好放得下的区分开，不会被截断以后当成请求处理
+    ssize_t size = recvfrom(s_context.datagram_sock, rx_buf, RPC_SERVER_MAX_DATAGRAM_SIZE + 1, MSG_DONTWAIT,
+        (struct sockaddr*)&source_addr, &addr_len);
+    if (size < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ESP_LOGE(TAG, "Error occurred during receiving datagram: errno %d", errno);
+        }
+        return false;
+    }
+    // 连请求序号都没有的数据报没法回复，直接丢掉
+    if (size <= RPC_SERVER_DATAGRAM_HEADER_SIZE || source_addr.sin_family != AF_INET) {
+        return true;
+    }
+
+    uint32_t id = ((uint32_t)rx_buf[0] << 24) | ((uint32_t)rx_buf[1] << 16) | ((uint32_t)rx_buf[2] << 8) | rx_buf[3];
+    if (size > RPC_SERVER_MAX_DATAGRAM_SIZE) {
+        ESP_LOGW(TAG, "Datagram request %u too large", (unsigned)id);
+        reject_datagram(&source_addr, rx_buf);
+        return true;
+    }
+
+    RpcDatagramCacheEntry* entry = find_datagram(&source_addr, id);
+    if (entry != NULL) {
+        // 客户端没收到响应而重发的请求，不再调用一次方法
+        send_datagram(entry);
+        return true;
+    }
+
+    entry = &s_context.datagrams[s_context.next_datagram];
+    s_context.next_datagram = (s_context.next_datagram + 1) % RPC_SERVER_DATAGRAM_CACHE_SIZE;
+    entry->size = 0;
+
+    JsonWriter writer;
+    JsonWriter_init(&writer, entry->data + RPC_SERVER_DATAGRAM_HEADER_SIZE,
+        RPC_SERVER_MAX_DATAGRAM_SIZE - RPC_SERVER_DATAGRAM_HEADER_SIZE);
+
+    uint8_t* request = rx_buf + RPC_SERVER_DATAGRAM_HEADER_SIZE;
+    size_t request_size = (size_t)size - RPC_SERVER_DATAGRAM_HEADER_SIZE;
+    if (request_size > RPC_FRAMER_CBOR_MAGIC_SIZE && request[0] == 0xD9 && request[1] == 0xD9 && request[2] == 0xF7) {
+        JsonWriter_set_format(&writer, JSON_WRITER_FORMAT_CBOR);
+        request += RPC_FRAMER_CBOR_MAGIC_SIZE;
+        request_size -= RPC_FRAMER_CBOR_MAGIC_SIZE;
+    } else {
+        // cJSON 需要结尾的 '\0'，接收缓冲区多留了一个字节
+        request[request_size] = '\0';
+        request_size++;
+    }
+
+    // 没有 current_connection，RPC 方法没法通过数据报订阅通知
+    int ret = s_context.request_handler->handle_rpc(request, request_size, &writer);
+    if (ret != 0 || JsonWriter_has_error(&writer)) {
+        ESP_LOGE(TAG, "Failed to handle datagram request %u", (unsigned)id);
+        return true;
+    }
+
+    memcpy(entry->data, rx_buf, RPC_SERVER_DATAGRAM_HEADER_SIZE);
+    entry->addr = source_addr;
+    entry->id = id;
+    entry->size = RPC_SERVER_DATAGRAM_HEADER_SIZE + JsonWriter_buffered(&writer);
+    send_datagram(entry);
+    return true;
+}
+
+/**
+ * 请求被截断了，连 JSON-RPC 的 id 都拿不到，只能回复带请求序号的错误，让客户端改用 TCP
+ * 错误响应不放进缓存，重发的请求会再被拒绝一次
+ */
+static void reject_datagram(const struct sockaddr_in* addr, const uint8_t* request)
+{
+    uint8_t response[RPC_SERVER_DATAGRAM_HEADER_SIZE + 96];
+    JsonWriter writer;
+    JsonWriter_init(
+        &writer, response + RPC_SERVER_DATAGRAM_HEADER_SIZE, sizeof(response) - RPC_SERVER_DATAGRAM_HEADER_SIZE);
+    const uint8_t* magic = request + RPC_SERVER_DATAGRAM_HEADER_SIZE;
+    if (magic[0] == 0xD9 && magic[1] == 0xD9 && magic[2] == 0xF7) {
+        JsonWriter_set_format(&writer, JSON_WRITER_FORMAT_CBOR);
+    }
+    if (s_context.request_handler->make_error(RPC_ERROR_REQUEST_TOO_LARGE, "Request too large, use TCP", &writer) != 0
+        || JsonWriter_has_error(&writer)) {
+        return;
+    }
+
+    memcpy(response, request, RPC_SERVER_DATAGRAM_HEADER_SIZE);
+    if (sendto(s_context.datagram_sock, response, RPC_SERVER_DATAGRAM_HEADER_SIZE + JsonWriter_buffered(&writer), 0,
+            (const struct sockaddr*)addr, sizeof(*addr))
+        < 0) {
+        ESP_LOGW(TAG, "Failed to send datagram response: errno %d", errno);
+    }
+}
+
+static RpcDatagramCacheEntry* find_datagram(const struct sockaddr_in* addr, uint32_t id)
+{
+    for (size_t i = 0; i < RPC_SERVER_DATAGRAM_CACHE_SIZE; i++) {
+        RpcDatagramCacheEntry* entry = &s_context.datagrams[i];
+        if (entry->size > 0 && entry->id == id && entry->addr.sin_addr.s_addr == addr->sin_addr.s_addr
+            && entry->addr.sin_port == addr->sin_port) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 只有请求序号的响应说明请求都是通知，不用回复
+ * 发送失败也不重试，客户端超时以后会重发请求
+ */
+static void send_datagram(const RpcDatagramCacheEntry* entry)
+{
+    if (entry->size <= RPC_SERVER_DATAGRAM_HEADER_SIZE) {
+        return;
+    }
+    if (sendto(s_context.datagram_sock, entry->data, entry->size, 0, (const struct sockaddr*)&entry->addr,
+            sizeof(entry->addr))
+        < 0) {
+        ESP_LOGW(TAG, "Failed to send datagram response: errno %d", errno);
+    }
+}
+
+static void accept_connection(int listen_sock, RpcTransport transport)
+{
+    char addr_str[128];
+    struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
+    uint addr_len = sizeof(source_addr);
+    int client_sock = accept(listen_sock, (struct sockaddr*)&source_addr, &addr_len);
+    if (client_sock < 0) {
+        ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        return;
+    }
+
+    RpcConnection* conn = NULL;
+    for (size_t i = 0; i < RPC_SERVER_MAX_CONNECTIONS; i++) {
+        if (s_context.connections[i].sock < 0) {
+            conn = &s_context.connections[i];
             break;
         }
-        ESP_LOGI(TAG, "Socket accepted");
+    }
+    if (conn == NULL) {
+        ESP_LOGE(TAG, "Too many connections, rejected");
+        close(client_sock);
+        return;
+    }
 
-        // 设置超时时间
-        struct timeval send_timeout = { SEND_TIMEOUT, 0 }; // 发送超时
-        struct timeval recv_timeout = { RECV_TIMEOUT, 0 }; // 接收超时
-        err = setsockopt(client_sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
-        err = setsockopt(client_sock, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+    // Get the sender's ip address as string
+    if (source_addr.sin6_family == PF_INET) {
+        inet_ntoa_r(((struct sockaddr_in*)&source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
+    } else if (source_addr.sin6_family == PF_INET6) {
+        inet6_ntoa_r(source_addr.sin6_addr, addr_str, sizeof(addr_str) - 1);
+    } else {
+        strcpy(addr_str, "unknown");
+    }
+    ESP_LOGI(TAG, "Socket accepted, remote address: %s", addr_str);
 
-        size_t rxbuf_size = 0;
-        memset(s_context.rx_buf, 0, sizeof(MAX_RX_BUF_SIZE));
-        while (1) {
-            ssize_t received_size = recv(client_sock, s_context.rx_buf + rxbuf_size, MAX_RX_BUF_SIZE - rxbuf_size, 0);
-            // Error occurred during receiving
-            if (received_size < 0) {
-                ESP_LOGE(TAG, "recv() failed: errno %d", errno);
-                break;
-            } else if (received_size == 0) { // 连接正常关闭
+    // 所有连接都是非阻塞的，由 select() 统一调度
+    int flags = fcntl(client_sock, F_GETFL, 0);
+    fcntl(client_sock, F_SETFL, flags | O_NONBLOCK);
+
+    conn->sock = client_sock;
+    conn->transport = transport;
+    conn->is_handshaking = transport == RPC_TRANSPORT_WEBSOCKET;
+    conn->handshake_size = 0;
+    conn->is_tx_continued = false;
+    RpcFramer_init(&conn->framer, conn->rx_buf, MAX_RX_BUF_SIZE);
+    RpcWebSocket_init(&conn->ws);
+    conn->tx_size = 0;
+    conn->tx_sent = 0;
+    conn->backlog_head = NULL;
+    conn->backlog_tail = NULL;
+    conn->backlog_size = 0;
+    conn->last_active = xTaskGetTickCount();
+}
+
+static void close_connection(RpcConnection* conn)
+{
+    ESP_LOGI(TAG, "Closing socket %d", conn->sock);
+    shutdown(conn->sock, 0);
+    close(conn->sock);
+    conn->sock = -1;
+    RpcFramer_reset(&conn->framer);
+    RpcWebSocket_init(&conn->ws);
+    conn->is_handshaking = false;
+    conn->tx_size = 0;
+    conn->tx_sent = 0;
+    free_backlog(conn);
+
+    // 还没完成的异步调用之后完成时对不上代数，结果直接丢掉
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    conn->subscriptions = 0;
+    conn->notification_head = 0;
+    conn->notification_count = 0;
+    conn->generation++;
+    conn->pending_calls = 0;
+    conn->completion_head = 0;
+    conn->completion_count = 0;
+    xSemaphoreGive(s_context.lock);
+}
+
+/**
+ * 有待发送数据的连接按发送超时计算，还没完成握手的按握手超时计算，否则按空闲超时计算
+ */
+static TickType_t connection_timeout(const RpcConnection* conn)
+{
+    if (has_pending_output(conn)) {
+        return SEND_TIMEOUT_TICKS;
+    }
+    return conn->is_handshaking ? HANDSHAKE_TIMEOUT_TICKS : IDLE_TIMEOUT_TICKS;
+}
+
+/**
+ * 不用等 socket 可读就有请求可以处理：framer 里有完整的帧，或者 WebSocket 还有没解码完的数据
+ */
+static bool has_buffered_input(RpcConnection* conn)
+{
+    return RpcFramer_has_frame(&conn->framer)
+        || (conn->transport == RPC_TRANSPORT_WEBSOCKET && RpcWebSocket_has_pending(&conn->ws));
+}
+
+/**
+ * 从连接接收一次数据，处理其中完整的请求并尽量发送响应
+ */
+static int serve_connection(RpcConnection* conn)
+{
+    if (conn->is_handshaking) {
+        return receive_handshake(conn);
+    }
+
+    // 缓冲区里已经有完整的请求就先处理，不急着接收
+    if (!RpcFramer_has_frame(&conn->framer)) {
+        int error = conn->transport == RPC_TRANSPORT_WEBSOCKET ? receive_websocket(conn) : receive(conn);
+        if (error != 0) {
+            return error;
+        }
+    }
+
+    // 收到 \0 我们才认为是一个完整的请求
+    for (size_t i = 0; i < MAX_REQUESTS_PER_ROUND; i++) {
+        bool has_more = false;
+        int error = handle_buffer(conn, &has_more);
+        if (error != 0) {
+            return error;
+        }
+        if (has_pending_output(conn)) {
+            error = flush_connection(conn);
+            if (error != 0) {
+                return error;
+            }
+            // 没发完的等下一轮 select() 可写再发
+            if (has_pending_output(conn)) {
                 break;
             }
-            // Data received
-            else {
-                // Get the sender's ip address as string
-                if (source_addr.sin6_family == PF_INET) {
-                    inet_ntoa_r(((struct sockaddr_in*)&source_addr)->sin_addr.s_addr, addr_str, sizeof(addr_str) - 1);
-                } else if (source_addr.sin6_family == PF_INET6) {
-                    inet6_ntoa_r(source_addr.sin6_addr, addr_str, sizeof(addr_str) - 1);
-                }
+        }
+        if (!has_more) {
+            break;
+        }
+    }
+    return 0;
+}
 
-                // 收到 \0 我们才认为是一个完整的请求
-                rxbuf_size += received_size;
-                size_t size_to_send = 0;
-                ESP_ERROR_CHECK(handle_buffer(s_context.rx_buf, &rxbuf_size, &size_to_send));
-                if (size_to_send > 0) {
-                    err = send(client_sock, s_context.tx_buf, size_to_send, 0);
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                        break;
-                    }
-                }
+/**
+ * 从 TCP 连接接收一次数据，直接收进 framer
+ */
+static int receive(RpcConnection* conn)
+{
+    size_t available = 0;
+    uint8_t* rx_buf = RpcFramer_prepare(&conn->framer, &available);
+    ssize_t received_size = recv(conn->sock, rx_buf, available, 0);
+    if (received_size < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ESP_LOGE(TAG, "recv() failed: errno %d", errno);
+            return -1;
+        }
+    } else if (received_size == 0) { // 连接正常关闭
+        return -1;
+    } else {
+        RpcFramer_commit(&conn->framer, received_size);
+        conn->last_active = xTaskGetTickCount();
+    }
+    return 0;
+}
+
+/**
+ * 把 HTTP Upgrade 请求收进 rx_buf，收完整了就回复握手响应
+ * 握手失败时同步发出错误响应，然后关闭连接
+ */
+static int receive_handshake(RpcConnection* conn)
+{
+    size_t capacity = MIN(MAX_RX_BUF_SIZE, RPC_WEBSOCKET_MAX_HANDSHAKE_SIZE);
+    if (conn->handshake_size == capacity) {
+        ESP_LOGE(TAG, "Handshake request too large on socket %d", conn->sock);
+        return -1;
+    }
+    ssize_t received_size = recv(conn->sock, conn->rx_buf + conn->handshake_size, capacity - conn->handshake_size, 0);
+    if (received_size < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ESP_LOGE(TAG, "recv() failed: errno %d", errno);
+            return -1;
+        }
+        return 0;
+    } else if (received_size == 0) {
+        return -1;
+    }
+    conn->handshake_size += received_size;
+    conn->last_active = xTaskGetTickCount();
+
+    size_t request_size = RpcWebSocket_find_request_end(conn->rx_buf, conn->handshake_size);
+    if (request_size == 0) {
+        return 0;
+    }
+
+    bool is_upgraded = false;
+    size_t response_size = RpcWebSocket_handshake(
+        (const char*)conn->rx_buf, request_size, (char*)conn->tx_buf, MAX_TX_BUF_SIZE, &is_upgraded);
+    if (!is_upgraded) {
+        ESP_LOGE(TAG, "Bad WebSocket handshake on socket %d", conn->sock);
+        send_all(conn, conn->tx_buf, response_size);
+        return -1;
+    }
+
+    // 客户端不等握手响应就发来的帧留给 WebSocket 解码
+    size_t extra_size = conn->handshake_size - request_size;
+    if (extra_size > 0) {
+        size_t available = 0;
+        uint8_t* raw = RpcWebSocket_prepare(&conn->ws, &available);
+        if (extra_size > available) {
+            return -1;
+        }
+        memcpy(raw, conn->rx_buf + request_size, extra_size);
+        RpcWebSocket_commit(&conn->ws, extra_size);
+    }
+    conn->is_handshaking = false;
+    conn->handshake_size = 0;
+    ESP_LOGI(TAG, "WebSocket upgraded on socket %d", conn->sock);
+
+    conn->tx_size = response_size;
+    conn->tx_sent = 0;
+    return flush_connection(conn);
+}
+
+/**
+ * 从 WebSocket 连接接收一次数据，解码进 framer，顺便回应 ping 和 close
+ * raw 里还有没解码完的数据就先解码，不急着接收
+ */
+static int receive_websocket(RpcConnection* conn)
+{
+    if (!RpcWebSocket_has_pending(&conn->ws)) {
+        size_t available = 0;
+        uint8_t* raw = RpcWebSocket_prepare(&conn->ws, &available);
+        ssize_t received_size = recv(conn->sock, raw, available, 0);
+        if (received_size < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGE(TAG, "recv() failed: errno %d", errno);
+                return -1;
+            }
+        } else if (received_size == 0) {
+            return -1;
+        } else {
+            RpcWebSocket_commit(&conn->ws, received_size);
+            conn->last_active = xTaskGetTickCount();
+        }
+    }
+
+    for (;;) {
+        RpcWebSocketControl control;
+        RpcWebSocketDecodeStatus status = RpcWebSocket_decode(&conn->ws, &conn->framer, &control);
+        if (status == RPC_WEBSOCKET_DECODE_NONE) {
+            return 0;
+        }
+        if (status == RPC_WEBSOCKET_DECODE_ERROR) {
+            ESP_LOGE(TAG, "WebSocket protocol error on socket %d", conn->sock);
+            uint8_t code[2] = { RPC_WEBSOCKET_CLOSE_PROTOCOL_ERROR >> 8, RPC_WEBSOCKET_CLOSE_PROTOCOL_ERROR & 0xFF };
+            send_websocket_control(conn, RPC_WEBSOCKET_OPCODE_CLOSE, code, sizeof(code));
+            return -1;
+        }
+        if (control.opcode == RPC_WEBSOCKET_OPCODE_PING) {
+            int error = send_websocket_control(conn, RPC_WEBSOCKET_OPCODE_PONG, control.payload, control.size);
+            if (error != 0) {
+                return error;
             }
+        } else if (control.opcode == RPC_WEBSOCKET_OPCODE_CLOSE) {
+            // 把对方的关闭码原样发回去，完成关闭握手
+            send_websocket_control(conn, RPC_WEBSOCKET_OPCODE_CLOSE, control.payload, MIN(control.size, 2));
+            return -1;
         }
+    }
+}
+
+/**
+ * 控制帧很短，直接发送，这时候 tx_buf 里没有待发送的数据，不会插进别的消息中间
+ */
+static int send_websocket_control(RpcConnection* conn, uint8_t opcode, const void* payload, size_t size)
+{
+    uint8_t frame[RPC_WEBSOCKET_TX_HEADROOM + RPC_WEBSOCKET_MAX_CONTROL_PAYLOAD_SIZE];
+    assert(size <= RPC_WEBSOCKET_MAX_CONTROL_PAYLOAD_SIZE);
+    memcpy(frame + RPC_WEBSOCKET_TX_HEADROOM, payload, size);
+    size_t header_size = RpcWebSocket_write_header(frame + RPC_WEBSOCKET_TX_HEADROOM, opcode, true, size);
+    return send_all(conn, frame + RPC_WEBSOCKET_TX_HEADROOM - header_size, header_size + size);
+}
 
-        if (client_sock != -1) {
-            shutdown(client_sock, 0);
-            close(client_sock);
+/**
+ * 非阻塞地先发送积压的数据，再发送 tx_buf 里剩余的数据
+ */
+static int flush_connection(RpcConnection* conn)
+{
+    while (conn->backlog_head != NULL) {
+        RpcTxChunk* chunk = conn->backlog_head;
+        ssize_t sent = send(conn->sock, chunk->data + chunk->sent, chunk->size - chunk->sent, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            return -1;
+        }
+        chunk->sent += sent;
+        conn->last_active = xTaskGetTickCount();
+        if (chunk->sent == chunk->size) {
+            conn->backlog_head = chunk->next;
+            conn->backlog_size -= chunk->size;
+            free(chunk);
         }
     }
+    conn->backlog_tail = NULL;
 
-__TASK_EXIT:
+    while (conn->tx_sent < conn->tx_size) {
+        ssize_t sent = send(conn->sock, conn->tx_buf + conn->tx_sent, conn->tx_size - conn->tx_sent, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // 对方接收窗口满了，等 socket 可写再发，超过 SEND_TIMEOUT 没有进展就会被关闭
+                return 0;
+            }
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            return -1;
+        }
+        conn->tx_sent += sent;
+        conn->last_active = xTaskGetTickCount();
+    }
+    conn->tx_size = 0;
+    conn->tx_sent = 0;
+    return 0;
+}
 
-    close(listen_sock);
-    vTaskDelete(NULL);
+/**
+ * 处理接收缓冲区里的下一个完整请求
+ * 响应写入 tx_buf，写满时通过 send_all() 发出去，发不出去的部分和最后剩下的部分都交给事件循环非阻塞地发送
+ */
+static int handle_buffer(RpcConnection* conn, bool* has_more)
+{
+    *has_more = false;
+
+    RpcFrame frame;
+    RpcFrameStatus status = RpcFramer_next(&conn->framer, &frame);
+    if (status == RPC_FRAME_NONE) {
+        // 还没收到 '\0'，说明连一个完整的 JSON-RPC 请求都没接收完
+        // 所以不做处理，等着下次继续接收再说
+        return 0;
+    }
+
+    JsonWriter writer;
+    begin_write(conn, &writer);
+
+    int ret = 0;
+    if (status == RPC_FRAME_OVERSIZE) {
+        ESP_LOGE(TAG, "Request too large on socket %d", conn->sock);
+        ret = s_context.request_handler->make_error(RPC_ERROR_REQUEST_TOO_LARGE, "Request too large", &writer);
+    } else {
+        // 帧直接在接收缓冲区里解析，帧里包含结尾的 '\0'
+        s_context.current_connection = conn;
+        ret = s_context.request_handler->handle_rpc(frame.data, frame.size, &writer);
+        s_context.current_connection = NULL;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    // 异步方法的请求这时候没有响应，不能发出一个空消息
+    if (JsonWriter_size(&writer) > 0) {
+        ret = end_message(conn, &writer);
+        if (ret != 0) {
+            return ret;
+        }
+        end_write(conn, &writer);
+    }
+
+    *has_more = RpcFramer_has_frame(&conn->framer);
+    return 0;
 }
 
-static int handle_buffer(uint8_t* rx_buf, size_t* recv_size, size_t* size_to_send)
+/**
+ * JsonWriter 的 flush 回调，在生成响应的过程中把写满的缓冲区发送出去
+ * 从不阻塞：对方接收窗口满时，发不出去的部分复制到连接的积压队列里，等事件循环在 socket 可写时再发
+ * 积压期间这个连接不再处理新的请求，其他连接照常服务
+ */
+static int send_all(void* context, const void* data, size_t size)
 {
-    *size_to_send = 0;
-    uint8_t* tx_buf = s_context.tx_buf;
-    while (*recv_size > 0) {
-        // 查找 '\0' 第一次出现的位置
-        uint8_t* found = (uint8_t*)memchr(rx_buf, 0, *recv_size);
-        if (found == NULL) {
-            // 如果数据里没有 '\0'，说明连一个完整的 JSON-RPC 请求都没接收完
-            // 所以不做处理，等着下次继续接收再说
-            break;
+    RpcConnection* conn = (RpcConnection*)context;
+    const uint8_t* pos = (const uint8_t*)data;
+
+    // 前面还有积压的数据时不能直接发送，否则会插到它们前面
+    while (conn->backlog_head == NULL && size > 0) {
+        ssize_t sent = send(conn->sock, pos, size, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            return -1;
+        }
+        pos += sent;
+        size -= sent;
+        conn->last_active = xTaskGetTickCount();
+    }
+    if (size == 0) {
+        return 0;
+    }
+    return append_backlog(conn, pos, size);
+}
+
+/**
+ * 积压的数据超过 RPC_SERVER_MAX_TX_BACKLOG 说明对方一直不接收，返回错误让服务端关闭连接
+ */
+static int append_backlog(RpcConnection* conn, const uint8_t* data, size_t size)
+{
+    if (conn->backlog_size + size > RPC_SERVER_MAX_TX_BACKLOG) {
+        ESP_LOGE(TAG, "Too much unsent data on socket %d", conn->sock);
+        return -1;
+    }
+    RpcTxChunk* chunk = (RpcTxChunk*)malloc(sizeof(RpcTxChunk) + size);
+    if (chunk == NULL) {
+        ESP_LOGE(TAG, "Out of memory for unsent data on socket %d", conn->sock);
+        return -1;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->sent = 0;
+    memcpy(chunk->data, data, size);
+
+    if (conn->backlog_tail != NULL) {
+        conn->backlog_tail->next = chunk;
+    } else {
+        conn->backlog_head = chunk;
+    }
+    conn->backlog_tail = chunk;
+    conn->backlog_size += size;
+    return 0;
+}
+
+static void free_backlog(RpcConnection* conn)
+{
+    while (conn->backlog_head != NULL) {
+        RpcTxChunk* chunk = conn->backlog_head;
+        conn->backlog_head = chunk->next;
+        free(chunk);
+    }
+    conn->backlog_tail = NULL;
+    conn->backlog_size = 0;
+}
+
+static bool has_pending_output(const RpcConnection* conn)
+{
+    return conn->backlog_head != NULL || conn->tx_sent < conn->tx_size;
+}
+
+/**
+ * 准备把响应或者通知写入 tx_buf，写满时通过 send_all() 发送或者积压
+ */
+static void begin_write(RpcConnection* conn, JsonWriter* writer)
+{
+    if (conn->transport == RPC_TRANSPORT_WEBSOCKET) {
+        // 前面留出帧头的位置，每次写满都把缓冲区封成一个分片发出去
+        JsonWriter_init(writer, conn->tx_buf + RPC_WEBSOCKET_TX_HEADROOM, MAX_TX_BUF_SIZE - RPC_WEBSOCKET_TX_HEADROOM);
+        JsonWriter_set_flush(writer, &send_websocket_frame, conn);
+        conn->is_tx_continued = false;
+    } else {
+        JsonWriter_init(writer, conn->tx_buf, MAX_TX_BUF_SIZE);
+        JsonWriter_set_flush(writer, &send_all, conn);
+    }
+    // 响应和通知都使用和请求相同的编码
+    if (RpcFramer_encoding(&conn->framer) == RPC_ENCODING_CBOR) {
+        JsonWriter_set_format(writer, JSON_WRITER_FORMAT_CBOR);
+    }
+}
+
+/**
+ * JSON 消息以 '\0' 结尾，CBOR 数据项本身就能确定结束位置，不需要分隔符
+ * WebSocket 的帧本身就分隔了消息，也不需要分隔符
+ */
+static int end_message(RpcConnection* conn, JsonWriter* writer)
+{
+    if (conn->transport == RPC_TRANSPORT_TCP && JsonWriter_format(writer) == JSON_WRITER_FORMAT_JSON) {
+        JsonWriter_raw(writer, "", 1);
+    }
+    // 出错时消息可能已经发出去一部分，连接上的数据流已经乱了
+    return JsonWriter_has_error(writer) ? -1 : 0;
+}
+
+/**
+ * 剩下没发出去的部分交给事件循环非阻塞地发送
+ */
+static void end_write(RpcConnection* conn, const JsonWriter* writer)
+{
+    if (conn->transport == RPC_TRANSPORT_WEBSOCKET) {
+        // 剩下的部分是消息的最后一个分片，帧头填在预留的位置上
+        size_t payload_size = JsonWriter_buffered(writer);
+        uint8_t* payload = conn->tx_buf + RPC_WEBSOCKET_TX_HEADROOM;
+        size_t header_size = RpcWebSocket_write_header(payload, websocket_opcode(conn), true, payload_size);
+        conn->tx_sent = RPC_WEBSOCKET_TX_HEADROOM - header_size;
+        conn->tx_size = RPC_WEBSOCKET_TX_HEADROOM + payload_size;
+        conn->is_tx_continued = false;
+        return;
+    }
+    conn->tx_size = JsonWriter_buffered(writer);
+    conn->tx_sent = 0;
+}
+
+/**
+ * JsonWriter 在 WebSocket 连接上的 flush 回调，把写满的缓冲区封成一个没有结束的分片发出去
+ */
+static int send_websocket_frame(void* context, const void* data, size_t size)
+{
+    RpcConnection* conn = (RpcConnection*)context;
+    uint8_t* payload = (uint8_t*)data;
+    assert(payload == conn->tx_buf + RPC_WEBSOCKET_TX_HEADROOM);
+    size_t header_size = RpcWebSocket_write_header(payload, websocket_opcode(conn), false, size);
+    conn->is_tx_continued = true;
+    return send_all(conn, payload - header_size, header_size + size);
+}
+
+/**
+ * 响应和请求的编码相同，JSON 用文本消息，CBOR 用二进制消息
+ */
+static uint8_t websocket_opcode(const RpcConnection* conn)
+{
+    if (conn->is_tx_continued) {
+        return RPC_WEBSOCKET_OPCODE_CONTINUATION;
+    }
+    return RpcFramer_encoding(&conn->framer) == RPC_ENCODING_CBOR ? RPC_WEBSOCKET_OPCODE_BINARY
+                                                                   : RPC_WEBSOCKET_OPCODE_TEXT;
+}
+
+/**
+ * 把队列里的通知写入连接，每轮最多 MAX_REQUESTS_PER_ROUND 个
+ * WebSocket 的每个消息都要单独封帧，每轮只发一个，剩下的留给下一轮
+ */
+static int send_notifications(RpcConnection* conn)
+{
+    if (conn->is_handshaking) {
+        return 0;
+    }
+    RpcNotification notification;
+    if (!pop_notification(conn, &notification)) {
+        return 0;
+    }
+    size_t max_count = conn->transport == RPC_TRANSPORT_WEBSOCKET ? 1 : MAX_REQUESTS_PER_ROUND;
+
+    JsonWriter writer;
+    begin_write(conn, &writer);
+    size_t count = 0;
+    do {
+        int ret = s_context.request_handler->write_notification(&notification, &writer);
+        if (ret == 0) {
+            ret = end_message(conn, &writer);
         }
-        // 收到的包里包含 '\0'，则作为 RPC 请求解析
-        // 如果对方一次发送里包含 '\0' 分割的多个请求，也可以处理，
-        // 多次调用 RPC 处理函数完了一次性发送给客户端
-        size_t request_buf_size = found - rx_buf + 1; // 需要包含结尾 \0
-        size_t tx_size = MAX_TX_BUF_SIZE - *size_to_send;
-        // 下面将提供的缓冲区解析 JSON-RPC 然后执行
-        // 每次执行结果附加到 tx_buf 里，最后一次发送
-        // 下面的 JSON-RPC 响应结果写道 tx_buf 里的数据最后不能包含 '\0'
-        int ret = s_context.request_handler->handle_rpc(rx_buf, request_buf_size, tx_buf, &tx_size);
         if (ret != 0) {
             return ret;
         }
-        tx_buf[tx_size] = '\0';
-        tx_size++; // 留出 \0
-        *size_to_send += tx_size;
-        tx_buf += tx_size;
-        assert(*size_to_send <= MAX_TX_BUF_SIZE);
-        *recv_size -= request_buf_size;
-        if (*recv_size > 0) {
-            // 如果我们已经处理了请求，那么将后面收到的可能完整也可能不完整的请求数据往前移动到缓冲区头
-            // 下次循环再处理
-            memmove(rx_buf, found + 1, *recv_size);
-        }
-        // 如果收到的缓冲区里有多个请求，需要循环处理后面的，这样才能多个 JSON-RPC
-        // 一次响应
-        rx_buf += request_buf_size;
+        count++;
+    } while (count < max_count && pop_notification(conn, &notification));
+    end_write(conn, &writer);
+
+    return flush_connection(conn);
+}
+
+/**
+ * 发送已经完成的异步调用的结果，和 send_notifications() 一样 WebSocket 连接每轮只发一个
+ */
+static int send_completions(RpcConnection* conn)
+{
+    RpcCompletion completion;
+    if (!pop_completion(conn, &completion)) {
+        return 0;
     }
+    size_t max_count = conn->transport == RPC_TRANSPORT_WEBSOCKET ? 1 : MAX_REQUESTS_PER_ROUND;
+
+    JsonWriter writer;
+    begin_write(conn, &writer);
+    size_t count = 0;
+    do {
+        int ret = s_context.request_handler->write_completion(&completion, &writer);
+        if (ret == 0) {
+            ret = end_message(conn, &writer);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        count++;
+    } while (count < max_count && pop_completion(conn, &completion));
+    end_write(conn, &writer);
+
+    return flush_connection(conn);
+}
+
+/**
+ * 队列里有通知或者异步调用的结果等着发送
+ */
+static bool has_notifications(RpcConnection* conn)
+{
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    bool result = conn->notification_count > 0 || conn->completion_count > 0;
+    xSemaphoreGive(s_context.lock);
+    return result;
+}
+
+/**
+ * 取出最早的通知，已经取消订阅的主题直接丢掉
+ */
+static bool pop_notification(RpcConnection* conn, RpcNotification* notification)
+{
+    bool found = false;
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    while (conn->notification_count > 0 && !found) {
+        const RpcNotification* queued = &conn->notifications[conn->notification_head];
+        if ((conn->subscriptions & queued->topic) != 0) {
+            *notification = *queued;
+            found = true;
+        }
+        conn->notification_head = (conn->notification_head + 1) % RPC_SERVER_MAX_NOTIFICATIONS;
+        conn->notification_count--;
+    }
+    xSemaphoreGive(s_context.lock);
+    return found;
+}
+
+/**
+ * 调用方需要持有 s_context.lock
+ * 同一主题、同一 key 的通知还在队列里就直接替换成最新的，客户端跟不上时只会收到最新的状态
+ */
+static void push_notification(RpcConnection* conn, const RpcNotification* notification)
+{
+    for (size_t i = 0; i < conn->notification_count; i++) {
+        RpcNotification* queued
+            = &conn->notifications[(conn->notification_head + i) % RPC_SERVER_MAX_NOTIFICATIONS];
+        if (queued->topic == notification->topic && queued->key == notification->key) {
+            *queued = *notification;
+            return;
+        }
+    }
+
+    if (conn->notification_count == RPC_SERVER_MAX_NOTIFICATIONS) {
+        // 不同的 key 太多把队列占满了，丢掉最旧的
+        ESP_LOGW(TAG, "Notification queue full on socket %d, dropping the oldest", conn->sock);
+        conn->notification_head = (conn->notification_head + 1) % RPC_SERVER_MAX_NOTIFICATIONS;
+        conn->notification_count--;
+    }
+    size_t tail = (conn->notification_head + conn->notification_count) % RPC_SERVER_MAX_NOTIFICATIONS;
+    conn->notifications[tail] = *notification;
+    conn->notification_count++;
+}
+
+/**
+ * 取出的结果马上释放它在连接上预留的位置
+ */
+static bool pop_completion(RpcConnection* conn, RpcCompletion* completion)
+{
+    bool found = false;
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    if (conn->completion_count > 0) {
+        *completion = conn->completions[conn->completion_head];
+        conn->completion_head = (conn->completion_head + 1) % RPC_SERVER_MAX_PENDING_CALLS;
+        conn->completion_count--;
+        conn->pending_calls--;
+        found = true;
+    }
+    xSemaphoreGive(s_context.lock);
+    return found;
+}
+
+/**
+ * 挂起调用时已经预留了位置，只要连接还在队列就不会满
+ */
+static int push_completion(const RpcPendingCall* call, const RpcCompletion* completion)
+{
+    if (s_context.lock == NULL || call->connection >= RPC_SERVER_MAX_CONNECTIONS) {
+        return -1;
+    }
+
+    int ret = 0;
+    RpcConnection* conn = &s_context.connections[call->connection];
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    if (conn->generation == call->generation && conn->completion_count < conn->pending_calls) {
+        size_t tail = (conn->completion_head + conn->completion_count) % RPC_SERVER_MAX_PENDING_CALLS;
+        conn->completions[tail] = *completion;
+        conn->completion_count++;
+        request_wakeup();
+    } else {
+        ret = -1;
+    }
+    xSemaphoreGive(s_context.lock);
+    return ret;
+}
+
+/**
+ * 调用方需要持有 s_context.lock
+ */
+static void request_wakeup()
+{
+    if (!s_context.is_wakeup_pending && s_context.wakeup_tx_sock >= 0) {
+        sendto(s_context.wakeup_tx_sock, "", 1, 0, (struct sockaddr*)&s_context.wakeup_addr,
+            sizeof(s_context.wakeup_addr));
+        s_context.is_wakeup_pending = true;
+    }
+}
+
+/**
+ * 一个绑定在本机回环地址上的 UDP 套接字放进 select()，其他任务往它发一个字节就能唤醒服务端任务
+ */
+static int create_wakeup_sockets()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    int rx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (rx_sock < 0) {
+        return -1;
+    }
+    socklen_t addr_len = sizeof(addr);
+    if (bind(rx_sock, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || getsockname(rx_sock, (struct sockaddr*)&addr, &addr_len) != 0) {
+        close(rx_sock);
+        return -1;
+    }
+    int flags = fcntl(rx_sock, F_GETFL, 0);
+    fcntl(rx_sock, F_SETFL, flags | O_NONBLOCK);
+
+    int tx_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (tx_sock < 0) {
+        close(rx_sock);
+        return -1;
+    }
+    flags = fcntl(tx_sock, F_GETFL, 0);
+    fcntl(tx_sock, F_SETFL, flags | O_NONBLOCK);
+
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    s_context.wakeup_sock = rx_sock;
+    s_context.wakeup_tx_sock = tx_sock;
+    s_context.wakeup_addr = addr;
+    s_context.is_wakeup_pending = false;
+    xSemaphoreGive(s_context.lock);
     return 0;
 }
+
+static void drain_wakeup_socket()
+{
+    // 先清标志再读，清掉之后发布的通知会重新发送唤醒，不会丢
+    xSemaphoreTake(s_context.lock, portMAX_DELAY);
+    s_context.is_wakeup_pending = false;
+    xSemaphoreGive(s_context.lock);
+
+    uint8_t buf[16];
+    while (recv(s_context.wakeup_sock, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
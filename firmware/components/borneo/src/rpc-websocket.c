@@ -0,0 +1,443 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc-framer.h"
+#include "borneo/rpc-websocket.h"
+
+static const char* find_line_end(const char* line, const char* end);
+static const char* match_header(const char* line, const char* eol, const char* name, size_t* value_len);
+static size_t make_accept_key(const char* key, size_t key_len, char* accept, size_t accept_size);
+static size_t header_length(const RpcWebSocket* ws);
+static int read_header(RpcWebSocket* ws);
+static int begin_frame(RpcWebSocket* ws);
+static bool write_prefix(RpcWebSocket* ws, RpcFramer* framer);
+static void unmask(RpcWebSocket* ws, uint8_t* dest, size_t size);
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WEBSOCKET_KEY_LENGTH 24 // 16 字节随机数的 base64
+#define WEBSOCKET_SHA1_SIZE 20
+
+#define FRAME_FIN 0x80
+#define FRAME_RSV 0x70
+#define FRAME_OPCODE 0x0F
+#define FRAME_CONTROL 0x08 // 操作码最高位为 1 的是控制帧
+#define FRAME_MASK 0x80
+#define FRAME_PAYLOAD_LENGTH 0x7F
+#define FRAME_PAYLOAD_LENGTH_16 126
+#define FRAME_PAYLOAD_LENGTH_64 127
+
+static const uint8_t CBOR_MAGIC[RPC_FRAMER_CBOR_MAGIC_SIZE] = { 0xD9, 0xD9, 0xF7 };
+
+static const char* RESPONSE_SWITCHING = "HTTP/1.1 101 Switching Protocols\r\n"
+                                       "Upgrade: websocket\r\n"
+                                       "Connection: Upgrade\r\n"
+                                       "Sec-WebSocket-Accept: %s\r\n"
+                                       "\r\n";
+
+static const char* RESPONSE_BAD_REQUEST = "HTTP/1.1 400 Bad Request\r\n"
+                                          "Content-Length: 0\r\n"
+                                          "Connection: close\r\n"
+                                          "\r\n";
+
+static const char* RESPONSE_UPGRADE_REQUIRED = "HTTP/1.1 426 Upgrade Required\r\n"
+                                               "Sec-WebSocket-Version: 13\r\n"
+                                               "Content-Length: 0\r\n"
+                                               "Connection: close\r\n"
+                                               "\r\n";
+
+/**
+ * 返回 HTTP 请求头结束（空行之后）的位置，还没收完时返回 0
+ */
+size_t RpcWebSocket_find_request_end(const uint8_t* buf, size_t size)
+{
+    for (size_t i = 3; i < size; i++) {
+        if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 处理 HTTP Upgrade 请求，生成要发回去的响应，返回响应的长度
+ * 不是合法的 WebSocket 握手时生成错误响应，is_upgraded 为 false，发完响应就应该关闭连接
+ * 请求路径不做检查，这个端口上只有 RPC 一个服务
+ */
+size_t RpcWebSocket_handshake(
+    const char* request, size_t request_size, char* response, size_t response_size, bool* is_upgraded)
+{
+    assert(response_size >= RPC_WEBSOCKET_MAX_HANDSHAKE_RESPONSE_SIZE);
+    *is_upgraded = false;
+
+    const char* end = request + request_size;
+    const char* eol = find_line_end(request, end);
+    if (eol == NULL || eol - request < 4 || strncmp(request, "GET ", 4) != 0) {
+        return snprintf(response, response_size, "%s", RESPONSE_BAD_REQUEST);
+    }
+
+    bool is_websocket = false;
+    bool is_version_supported = false;
+    const char* key = NULL;
+    size_t key_len = 0;
+    for (const char* line = eol + 2; line < end; line = eol + 2) {
+        eol = find_line_end(line, end);
+        if (eol == NULL || eol == line) {
+            break;
+        }
+        size_t value_len = 0;
+        const char* value = NULL;
+        if ((value = match_header(line, eol, "Upgrade", &value_len)) != NULL) {
+            is_websocket = value_len == 9 && strncasecmp(value, "websocket", 9) == 0;
+        } else if ((value = match_header(line, eol, "Sec-WebSocket-Version", &value_len)) != NULL) {
+            is_version_supported = value_len == 2 && strncmp(value, "13", 2) == 0;
+        } else if ((value = match_header(line, eol, "Sec-WebSocket-Key", &value_len)) != NULL) {
+            key = value;
+            key_len = value_len;
+        }
+    }
+
+    if (!is_websocket || key == NULL || key_len != WEBSOCKET_KEY_LENGTH) {
+        return snprintf(response, response_size, "%s", RESPONSE_BAD_REQUEST);
+    }
+    if (!is_version_supported) {
+        return snprintf(response, response_size, "%s", RESPONSE_UPGRADE_REQUIRED);
+    }
+
+    char accept[32];
+    if (make_accept_key(key, key_len, accept, sizeof(accept)) == 0) {
+        return snprintf(response, response_size, "%s", RESPONSE_BAD_REQUEST);
+    }
+    *is_upgraded = true;
+    return snprintf(response, response_size, RESPONSE_SWITCHING, accept);
+}
+
+void RpcWebSocket_init(RpcWebSocket* ws)
+{
+    ws->header_size = 0;
+    ws->is_in_frame = false;
+    ws->opcode = 0;
+    ws->is_fin = false;
+    ws->mask_offset = 0;
+    ws->payload_remaining = 0;
+    ws->is_in_message = false;
+    ws->encoding = RPC_ENCODING_UNKNOWN;
+    ws->prefix_size = 0;
+    ws->prefix_sent = 0;
+    ws->is_pending = false;
+    ws->control_size = 0;
+    ws->raw_head = 0;
+    ws->raw_tail = 0;
+}
+
+/**
+ * 返回 recv() 可以写入的位置和大小，没解码完的数据会被搬到开头
+ */
+uint8_t* RpcWebSocket_prepare(RpcWebSocket* ws, size_t* available)
+{
+    if (ws->raw_head == ws->raw_tail) {
+        ws->raw_head = 0;
+        ws->raw_tail = 0;
+    } else if (ws->raw_head > 0) {
+        // raw 很小，剩下的最多是一个帧头或者 framer 暂时放不下的一段负载
+        memmove(ws->raw, ws->raw + ws->raw_head, ws->raw_tail - ws->raw_head);
+        ws->raw_tail -= ws->raw_head;
+        ws->raw_head = 0;
+    }
+    *available = RPC_WEBSOCKET_RAW_BUF_SIZE - ws->raw_tail;
+    return ws->raw + ws->raw_tail;
+}
+
+void RpcWebSocket_commit(RpcWebSocket* ws, size_t size)
+{
+    assert(ws->raw_tail + size <= RPC_WEBSOCKET_RAW_BUF_SIZE);
+    ws->raw_tail += size;
+    ws->is_pending = true;
+}
+
+/**
+ * 把 raw 里的帧解码进 framer，数据帧的负载去掉掩码后原样写入，控制帧的负载收齐后交给调用方处理
+ * 返回 RPC_WEBSOCKET_DECODE_CONTROL 时 control 指向的数据在下次调用之前有效
+ */
+RpcWebSocketDecodeStatus RpcWebSocket_decode(RpcWebSocket* ws, RpcFramer* framer, RpcWebSocketControl* control)
+{
+    ws->is_pending = false;
+    for (;;) {
+        if (ws->prefix_sent < ws->prefix_size) {
+            if (!write_prefix(ws, framer)) {
+                ws->is_pending = true;
+                return RPC_WEBSOCKET_DECODE_NONE;
+            }
+            continue;
+        }
+
+        if (!ws->is_in_frame) {
+            int ret = read_header(ws);
+            if (ret < 0 || (ret > 0 && begin_frame(ws) != 0)) {
+                return RPC_WEBSOCKET_DECODE_ERROR;
+            }
+            if (ret == 0) {
+                return RPC_WEBSOCKET_DECODE_NONE;
+            }
+            // 先把 begin_frame() 准备好的标签和长度前缀写进 framer
+            continue;
+        }
+
+        if (ws->payload_remaining > 0) {
+            size_t size = MIN((uint64_t)(ws->raw_tail - ws->raw_head), ws->payload_remaining);
+            if (size == 0) {
+                return RPC_WEBSOCKET_DECODE_NONE;
+            }
+            if ((ws->opcode & FRAME_CONTROL) != 0) {
+                unmask(ws, ws->control + ws->control_size, size);
+                ws->control_size += size;
+            } else {
+                size_t available = 0;
+                uint8_t* dest = RpcFramer_prepare(framer, &available);
+                if (available == 0) {
+                    ws->is_pending = true;
+                    return RPC_WEBSOCKET_DECODE_NONE;
+                }
+                size = MIN(size, available);
+                unmask(ws, dest, size);
+                RpcFramer_commit(framer, size);
+            }
+            ws->payload_remaining -= size;
+            if (ws->payload_remaining > 0) {
+                continue;
+            }
+        }
+
+        // 一个帧收完了
+        ws->is_in_frame = false;
+        if ((ws->opcode & FRAME_CONTROL) != 0) {
+            control->opcode = ws->opcode;
+            control->payload = ws->control;
+            control->size = ws->control_size;
+            return RPC_WEBSOCKET_DECODE_CONTROL;
+        }
+        if (ws->is_fin) {
+            ws->is_in_message = false;
+            if (ws->encoding == RPC_ENCODING_JSON) {
+                // 文本消息结束，补上 rpc-framer 用来分隔 JSON 请求的 '\0'
+                ws->prefix[0] = 0;
+                ws->prefix_size = 1;
+                ws->prefix_sent = 0;
+            }
+        }
+    }
+}
+
+/**
+ * 在 payload 前面填上服务端的帧头（不加掩码），返回帧头的长度
+ * payload 前面至少要留 RPC_WEBSOCKET_TX_HEADROOM 个字节
+ */
+size_t RpcWebSocket_write_header(uint8_t* payload, uint8_t opcode, bool is_fin, size_t payload_size)
+{
+    uint8_t* head;
+    if (payload_size < FRAME_PAYLOAD_LENGTH_16) {
+        head = payload - 2;
+        head[1] = (uint8_t)payload_size;
+    } else {
+        assert(payload_size <= UINT16_MAX);
+        head = payload - 4;
+        head[1] = FRAME_PAYLOAD_LENGTH_16;
+        head[2] = (uint8_t)(payload_size >> 8);
+        head[3] = (uint8_t)payload_size;
+    }
+    head[0] = (is_fin ? FRAME_FIN : 0) | (opcode & FRAME_OPCODE);
+    return payload - head;
+}
+
+static const char* find_line_end(const char* line, const char* end)
+{
+    for (const char* p = line; p + 1 < end; p++) {
+        if (p[0] == '\r' && p[1] == '\n') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 头部名字不区分大小写，匹配时返回去掉两端空格的值
+ */
+static const char* match_header(const char* line, const char* eol, const char* name, size_t* value_len)
+{
+    size_t name_len = strlen(name);
+    if ((size_t)(eol - line) <= name_len || line[name_len] != ':' || strncasecmp(line, name, name_len) != 0) {
+        return NULL;
+    }
+    const char* value = line + name_len + 1;
+    while (value < eol && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    const char* value_end = eol;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        value_end--;
+    }
+    *value_len = value_end - value;
+    return value;
+}
+
+/**
+ * Sec-WebSocket-Accept = base64(SHA1(key + GUID))，返回生成的长度，失败返回 0
+ */
+static size_t make_accept_key(const char* key, size_t key_len, char* accept, size_t accept_size)
+{
+    uint8_t digest[WEBSOCKET_SHA1_SIZE];
+    mbedtls_sha1_context ctx;
+    mbedtls_sha1_init(&ctx);
+    int ret = mbedtls_sha1_starts_ret(&ctx);
+    if (ret == 0) {
+        ret = mbedtls_sha1_update_ret(&ctx, (const unsigned char*)key, key_len);
+    }
+    if (ret == 0) {
+        ret = mbedtls_sha1_update_ret(&ctx, (const unsigned char*)WEBSOCKET_GUID, strlen(WEBSOCKET_GUID));
+    }
+    if (ret == 0) {
+        ret = mbedtls_sha1_finish_ret(&ctx, digest);
+    }
+    mbedtls_sha1_free(&ctx);
+    if (ret != 0) {
+        return 0;
+    }
+
+    size_t written = 0;
+    if (mbedtls_base64_encode((unsigned char*)accept, accept_size, &written, digest, sizeof(digest)) != 0) {
+        return 0;
+    }
+    return written;
+}
+
+/**
+ * 帧头可能被拆在两次 recv() 里，先攒进 header，收齐了再解析
+ * 返回 1 表示帧头解析完了，0 表示数据不够，-1 表示协议错误
+ */
+static int read_header(RpcWebSocket* ws)
+{
+    size_t length;
+    while (ws->header_size < (length = header_length(ws))) {
+        if (ws->raw_head == ws->raw_tail) {
+            return 0;
+        }
+        ws->header[ws->header_size++] = ws->raw[ws->raw_head++];
+        // 扩展位都没有协商，客户端发来的帧必须带掩码
+        if (ws->header_size == 2 && ((ws->header[0] & FRAME_RSV) != 0 || (ws->header[1] & FRAME_MASK) == 0)) {
+            return -1;
+        }
+    }
+
+    const uint8_t* p = ws->header + 2;
+    uint64_t payload_size = ws->header[1] & FRAME_PAYLOAD_LENGTH;
+    if (payload_size == FRAME_PAYLOAD_LENGTH_16) {
+        payload_size = ((uint64_t)p[0] << 8) | p[1];
+        p += 2;
+    } else if (payload_size == FRAME_PAYLOAD_LENGTH_64) {
+        payload_size = 0;
+        for (size_t i = 0; i < 8; i++) {
+            payload_size = (payload_size << 8) | p[i];
+        }
+        p += 8;
+        if ((payload_size >> 63) != 0) {
+            return -1;
+        }
+    }
+    memcpy(ws->mask, p, sizeof(ws->mask));
+
+    ws->is_fin = (ws->header[0] & FRAME_FIN) != 0;
+    ws->opcode = ws->header[0] & FRAME_OPCODE;
+    ws->payload_remaining = payload_size;
+    ws->mask_offset = 0;
+    ws->header_size = 0;
+    ws->is_in_frame = true;
+    return 1;
+}
+
+static size_t header_length(const RpcWebSocket* ws)
+{
+    if (ws->header_size < 2) {
+        return 2;
+    }
+    uint8_t length = ws->header[1] & FRAME_PAYLOAD_LENGTH;
+    size_t extended = length == FRAME_PAYLOAD_LENGTH_16 ? 2 : (length == FRAME_PAYLOAD_LENGTH_64 ? 8 : 0);
+    return 2 + extended + sizeof(((RpcWebSocket*)NULL)->mask);
+}
+
+/**
+ * 检查帧是否符合协议和这里的限制，并准备好要补进 framer 的数据
+ */
+static int begin_frame(RpcWebSocket* ws)
+{
+    if ((ws->opcode & FRAME_CONTROL) != 0) {
+        // 控制帧不能分片，负载不超过 125 字节，可以插在一个分片消息的中间
+        if (ws->opcode > RPC_WEBSOCKET_OPCODE_PONG || !ws->is_fin
+            || ws->payload_remaining > RPC_WEBSOCKET_MAX_CONTROL_PAYLOAD_SIZE) {
+            return -1;
+        }
+        ws->control_size = 0;
+        return 0;
+    }
+
+    if (ws->opcode == RPC_WEBSOCKET_OPCODE_CONTINUATION) {
+        return ws->is_in_message ? 0 : -1;
+    }
+    if ((ws->opcode != RPC_WEBSOCKET_OPCODE_TEXT && ws->opcode != RPC_WEBSOCKET_OPCODE_BINARY) || ws->is_in_message) {
+        return -1;
+    }
+
+    RpcEncoding encoding = ws->opcode == RPC_WEBSOCKET_OPCODE_TEXT ? RPC_ENCODING_JSON : RPC_ENCODING_CBOR;
+    if (ws->encoding != RPC_ENCODING_UNKNOWN && ws->encoding != encoding) {
+        return -1;
+    }
+    ws->prefix_size = 0;
+    ws->prefix_sent = 0;
+    if (encoding == RPC_ENCODING_CBOR) {
+        // 长度前缀要在收到负载之前写出去，所以二进制消息不能分片
+        if (!ws->is_fin || ws->payload_remaining > UINT16_MAX) {
+            return -1;
+        }
+        if (ws->encoding == RPC_ENCODING_UNKNOWN) {
+            memcpy(ws->prefix, CBOR_MAGIC, RPC_FRAMER_CBOR_MAGIC_SIZE);
+            ws->prefix_size = RPC_FRAMER_CBOR_MAGIC_SIZE;
+        }
+        ws->prefix[ws->prefix_size++] = (uint8_t)(ws->payload_remaining >> 8);
+        ws->prefix[ws->prefix_size++] = (uint8_t)ws->payload_remaining;
+    }
+    ws->encoding = encoding;
+    ws->is_in_message = true;
+    return 0;
+}
+
+/**
+ * framer 一点空间都没有时返回 false
+ */
+static bool write_prefix(RpcWebSocket* ws, RpcFramer* framer)
+{
+    size_t available = 0;
+    uint8_t* dest = RpcFramer_prepare(framer, &available);
+    size_t size = MIN(available, ws->prefix_size - ws->prefix_sent);
+    if (size == 0) {
+        return false;
+    }
+    memcpy(dest, ws->prefix + ws->prefix_sent, size);
+    RpcFramer_commit(framer, size);
+    ws->prefix_sent += size;
+    return true;
+}
+
+static void unmask(RpcWebSocket* ws, uint8_t* dest, size_t size)
+{
+    const uint8_t* src = ws->raw + ws->raw_head;
+    for (size_t i = 0; i < size; i++) {
+        dest[i] = src[i] ^ ws->mask[(ws->mask_offset + i) & 3];
+    }
+    ws->raw_head += size;
+    ws->mask_offset += size;
+}
@@ -10,6 +10,8 @@
 
 #include "borneo/common.h"
 #include "borneo/utils/buffer-writer.h"
+#include "borneo/utils/cbor-reader.h"
+#include "borneo/utils/json-writer.h"
 #include "borneo/device-config.h"
 #include "borneo/rpc-server.h"
 #include "borneo/rpc.h"
@@ -17,24 +19,62 @@
 
 static const char* TAG = "RPC";
 
-static int make_response_result(uint8_t* tx_buf, size_t* tx_buf_size, cJSON* result, uint64_t id);
-static int make_response_error(uint8_t* tx_buf, size_t* tx_buf_size, int code, const char* message, uint64_t id);
-static int handle_single_request(const cJSON* root, uint8_t* tx_buf, size_t* tx_buf_size);
-static int invoke_rpc_method(uint8_t* tx_buf, size_t* tx_buf_size, const char* method_name, cJSON* params, uint64_t id);
-static int handle_rpc(const void* rxbuf, size_t rxbuf_size, void* txbuf, size_t* txbuf_size);
+static int write_response_head(JsonWriter* writer, uint64_t id);
+static int write_response_end(JsonWriter* writer);
+static int write_response_error(JsonWriter* writer, int code, const char* message, uint64_t id);
+static int handle_single_request(const cJSON* root, JsonWriter* writer);
+static int handle_single_cbor_request(const cJSON* root, JsonWriter* writer);
+static bool is_batch_request(const cJSON* root, JsonWriterFormat format);
+static int invoke_rpc_method(JsonWriter* writer, const char* method_name, const cJSON* params, uint64_t id);
+static int invoke_async_method(JsonWriter* writer, const RpcMethodEntry* entry, const cJSON* params, uint64_t id);
+static int handle_rpc(const void* rxbuf, size_t rxbuf_size, JsonWriter* writer);
+static int make_error(int code, const char* message, JsonWriter* writer);
+static int write_notification(const RpcNotification* notification, JsonWriter* writer);
+static int write_completion(const RpcCompletion* completion, JsonWriter* writer);
+static int build_method_index();
+static const RpcMethodEntry* find_rpc_method(const char* method_name);
+static uint32_t hash_method_name(const char* name);
+
+#define METHOD_SLOT_EMPTY UINT16_MAX
+
+/**
+ * 方法名哈希索引的槽位，开放寻址、线性探测
+ */
+typedef struct {
+    uint32_t hash;
+    uint16_t index; // 方法在 s_rpc_methods 里的下标，METHOD_SLOT_EMPTY 表示空槽
+} RpcMethodSlot;
 
 static const RpcMethodEntry* s_rpc_methods;
 static size_t s_rpc_method_count;
+static RpcMethodSlot* s_method_slots;
+static size_t s_method_slot_mask;
 
 const RpcRequestHandler REQUEST_HANDLER = {
     .handle_rpc = &handle_rpc,
+    .make_error = &make_error,
+    .write_notification = &write_notification,
+    .write_completion = &write_completion,
 };
 
 int Rpc_init(const RpcMethodEntry* rpc_method_table, size_t n)
 {
     ESP_LOGI(TAG, "Initializing RPC server....");
-    s_rpc_methods = rpc_method_table;
-    s_rpc_method_count = n;
+    // 每次连上 WiFi 都会调用，这时服务端任务可能正在通过索引查找方法，所以索引只建立一次，之后不再释放
+    if (s_method_slots != NULL) {
+        if (s_rpc_methods != rpc_method_table || s_rpc_method_count != n) {
+            ESP_LOGE(TAG, "RPC method table can not be replaced");
+            return -1;
+        }
+    } else {
+        s_rpc_methods = rpc_method_table;
+        s_rpc_method_count = n;
+
+        int error = build_method_index();
+        if (error != 0) {
+            return error;
+        }
+    }
 
     ESP_ERROR_CHECK(RpcServer_init((RpcRequestHandler*)(&REQUEST_HANDLER)));
     return 0;
@@ -49,81 +89,214 @@ int Rpc_start()
 }
 
 /**
- * 生成 JSON-RPC 正常返回响应
+ * FNV-1a 哈希
  */
-static int make_response_result(uint8_t* tx_buf, size_t* tx_buf_size, cJSON* result, uint64_t id)
+static uint32_t hash_method_name(const char* name)
 {
-    int ret = 0;
+    uint32_t hash = 2166136261UL;
+    for (const uint8_t* p = (const uint8_t*)name; *p != 0; p++) {
+        hash ^= *p;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+/**
+ * 初始化时给方法表建立哈希索引，之后每次调用按方法名查找都是 O(1)
+ * 方法名重复说明方法表写错了，直接返回错误
+ */
+static int build_method_index()
+{
+    if (s_rpc_method_count >= METHOD_SLOT_EMPTY) {
+        ESP_LOGE(TAG, "Too many RPC methods: %u", (unsigned)s_rpc_method_count);
+        return -1;
+    }
 
-    cJSON* result_root = cJSON_CreateObject();
+    // 槽位数取 2 的幂，并保证装载率不超过 50%
+    size_t slot_count = 4;
+    while (slot_count < s_rpc_method_count * 2) {
+        slot_count <<= 1;
+    }
 
-    cJSON_AddStringToObject(result_root, "jsonrpc", "2.0");
-    cJSON_AddNumberToObject(result_root, "id", (double)id);
-    if (result != NULL) {
-        cJSON_AddItemToObject(result_root, "result", result);
-    } else {
-        cJSON_AddItemToObject(result_root, "result", cJSON_CreateNull());
+    s_method_slots = (RpcMethodSlot*)malloc(sizeof(RpcMethodSlot) * slot_count);
+    if (s_method_slots == NULL) {
+        return -1;
+    }
+    s_method_slot_mask = slot_count - 1;
+    for (size_t i = 0; i < slot_count; i++) {
+        s_method_slots[i].hash = 0;
+        s_method_slots[i].index = METHOD_SLOT_EMPTY;
     }
 
-    cJSON_PrintPreallocated(result_root, (char*)tx_buf, *tx_buf_size, 0);
-    cJSON_Delete(result_root);
-    size_t json_len = strnlen((const char*)tx_buf, *tx_buf_size);
-    if (json_len > *tx_buf_size) {
-        ret = -1;
-    } else {
-        *tx_buf_size = json_len;
+    for (size_t i = 0; i < s_rpc_method_count; i++) {
+        const char* name = s_rpc_methods[i].name;
+        uint32_t hash = hash_method_name(name);
+        size_t pos = hash & s_method_slot_mask;
+        while (s_method_slots[pos].index != METHOD_SLOT_EMPTY) {
+            const RpcMethodSlot* slot = &s_method_slots[pos];
+            if (slot->hash == hash && strcmp(s_rpc_methods[slot->index].name, name) == 0) {
+                ESP_LOGE(TAG, "Duplicated RPC method: %s", name);
+                free(s_method_slots);
+                s_method_slots = NULL;
+                return -1;
+            }
+            pos = (pos + 1) & s_method_slot_mask;
+        }
+        s_method_slots[pos].hash = hash;
+        s_method_slots[pos].index = (uint16_t)i;
     }
-    return ret;
+    return 0;
+}
+
+static const RpcMethodEntry* find_rpc_method(const char* method_name)
+{
+    uint32_t hash = hash_method_name(method_name);
+    size_t pos = hash & s_method_slot_mask;
+    while (s_method_slots[pos].index != METHOD_SLOT_EMPTY) {
+        const RpcMethodSlot* slot = &s_method_slots[pos];
+        if (slot->hash == hash && strcmp(s_rpc_methods[slot->index].name, method_name) == 0) {
+            return &s_rpc_methods[slot->index];
+        }
+        pos = (pos + 1) & s_method_slot_mask;
+    }
+    return NULL;
 }
 
 /**
- * 生成 JSON-RPC 错误响应
+ * 写入 JSON-RPC 响应的开头部分，不包括 result 或 error
+ * CBOR 编码的响应是数组：成功时为 [id, result]，失败时为 [id, code, message]，没有 id 时为 null
  */
-static int make_response_error(uint8_t* tx_buf, size_t* tx_buf_size, int code, const char* message, uint64_t id)
+static int write_response_head(JsonWriter* writer, uint64_t id)
 {
-    int ret = 0;
-    cJSON* result_root = cJSON_CreateObject();
-
-    cJSON_AddStringToObject(result_root, "jsonrpc", "2.0");
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_CBOR) {
+        JsonWriter_begin_array(writer);
+        if (id != RPC_INVALID_ID) {
+            JsonWriter_uint(writer, id);
+        } else {
+            JsonWriter_null(writer);
+        }
+        return JsonWriter_has_error(writer) ? -1 : 0;
+    }
 
+    JsonWriter_begin_object(writer);
+    JsonWriter_add_string(writer, "jsonrpc", "2.0");
     if (id != RPC_INVALID_ID) {
-        cJSON_AddNumberToObject(result_root, "id", (double)id);
+        JsonWriter_key(writer, "id");
+        JsonWriter_uint(writer, id);
     }
+    return JsonWriter_has_error(writer) ? -1 : 0;
+}
 
-    cJSON* error_node = cJSON_CreateObject();
-    cJSON_AddNumberToObject(error_node, "code", code);
-    cJSON_AddStringToObject(error_node, "message", message);
+static int write_response_end(JsonWriter* writer)
+{
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_CBOR) {
+        return JsonWriter_end_array(writer);
+    }
+    return JsonWriter_end_object(writer);
+}
 
-    cJSON_AddItemToObject(result_root, "error", error_node);
-    cJSON_PrintPreallocated(result_root, (char*)tx_buf, *tx_buf_size, 0);
+/**
+ * 生成 JSON-RPC 错误响应
+ */
+static int write_response_error(JsonWriter* writer, int code, const char* message, uint64_t id)
+{
+    write_response_head(writer, id);
 
-    cJSON_Delete(result_root);
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_CBOR) {
+        JsonWriter_int(writer, code);
+        JsonWriter_string(writer, message);
+        write_response_end(writer);
+        return JsonWriter_has_error(writer) ? -1 : 0;
+    }
 
-    *tx_buf_size = strlen((const char*)tx_buf);
+    JsonWriter_key(writer, "error");
+    JsonWriter_begin_object(writer);
+    JsonWriter_add_int(writer, "code", code);
+    JsonWriter_add_string(writer, "message", message);
+    JsonWriter_end_object(writer);
 
-    return ret;
+    JsonWriter_end_object(writer);
+    return JsonWriter_has_error(writer) ? -1 : 0;
 }
 
-static int invoke_rpc_method(uint8_t* tx_buf, size_t* tx_buf_size, const char* method_name, cJSON* params, uint64_t id)
+/**
+ * 调用方法并生成 JSON-RPC 正常返回响应，结果直接写入发送缓冲区
+ */
+static int invoke_rpc_method(JsonWriter* writer, const char* method_name, const cJSON* params, uint64_t id)
 {
-    for (size_t i = 0; i < s_rpc_method_count; i++) {
-        const RpcMethodEntry* entry = &s_rpc_methods[i];
-        if (strcmp(method_name, entry->name) == 0) {
-            RpcMethodResult result = entry->callback(params);
-            if (result.is_succeed) {
-                return make_response_result(tx_buf, tx_buf_size, (cJSON*)result.result, id);
-            } else {
-                return make_response_error(tx_buf, tx_buf_size, result.error.code, result.error.message, id);
+    const RpcMethodEntry* entry = find_rpc_method(method_name);
+    if (entry == NULL) {
+        return write_response_error(writer, RPC_ERROR_METHOD_NOT_FOUND, "Method not found", id);
+    }
+    if (entry->async_callback != NULL) {
+        return invoke_async_method(writer, entry, params, id);
+    }
+
+    // 方法失败或者结果超出缓冲区时，回退到这个响应开始的位置改写成错误响应
+    JsonWriter mark = *writer;
+
+    write_response_head(writer, id);
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_JSON) {
+        JsonWriter_key(writer, "result");
+    }
+
+    RpcMethodResult result;
+    if (entry->writer_callback != NULL) {
+        result = entry->writer_callback(params, writer);
+    } else {
+        result = entry->callback(params);
+        if (result.is_succeed) {
+            JsonWriter_cjson(writer, (const cJSON*)result.result);
+            if (result.result != NULL) {
+                cJSON_Delete((cJSON*)result.result);
             }
         }
     }
-    return make_response_error(tx_buf, tx_buf_size, RPC_ERROR_METHOD_NOT_FOUND, "Method not found", id);
+
+    if (!result.is_succeed) {
+        if (!JsonWriter_rewind(writer, &mark)) {
+            ESP_LOGE(TAG, "RPC method failed after its result was partially sent: %s", method_name);
+            return -1;
+        }
+        return write_response_error(writer, result.error.code, result.error.message, id);
+    }
+
+    write_response_end(writer);
+    if (JsonWriter_has_error(writer)) {
+        if (!JsonWriter_rewind(writer, &mark)) {
+            return -1;
+        }
+        return write_response_error(writer, RPC_ERROR_RESPONSE_TOO_LARGE, "Response too large", id);
+    }
+    return 0;
+}
+
+/**
+ * 调用异步方法，成功时这里什么都不写，响应等方法完成以后由服务端单独发送
+ */
+static int invoke_async_method(JsonWriter* writer, const RpcMethodEntry* entry, const cJSON* params, uint64_t id)
+{
+    RpcPendingCall call;
+    int ret = RpcServer_begin_call(id, &call);
+    if (ret == -1) {
+        return write_response_error(
+            writer, RPC_ERROR_INVALID_REQUEST, "Asynchronous method requires a connection", id);
+    } else if (ret != 0) {
+        return write_response_error(writer, RPC_ERROR_TOO_MANY_PENDING_CALLS, "Too many pending calls", id);
+    }
+
+    RpcMethodResult result = entry->async_callback(params, &call);
+    if (!result.is_succeed) {
+        RpcServer_cancel_call(&call);
+        return write_response_error(writer, result.error.code, result.error.message, id);
+    }
+    return 0;
 }
 
 /**
  * 处理 JSON-RPC 请求
  */
-static int handle_single_request(const cJSON* root, uint8_t* txbuf, size_t* txbuf_size)
+static int handle_single_request(const cJSON* root, JsonWriter* writer)
 {
     int ret = 0;
     uint64_t id;
@@ -143,65 +316,168 @@ static int handle_single_request(const cJSON* root, uint8_t* txbuf, size_t* txbu
     if (root_ok && jsonrpc_ok && method_name_ok && params_ok && id_ok) {
         ESP_LOGI(TAG, "Calling RPC method: %s", method_json->valuestring);
         id = (uint64_t)id_json->valuedouble;
-        ret = invoke_rpc_method(txbuf, txbuf_size, method_json->valuestring, params_json, id);
+        ret = invoke_rpc_method(writer, method_json->valuestring, params_json, id);
     } else { // 格式解析错误，返回错误消息
-        id = id_ok ? id : -1;
-        ret = make_response_error(txbuf, txbuf_size, RPC_ERROR_INVALID_REQUEST, "Invalid request", id);
+        id = id_ok ? (uint64_t)id_json->valuedouble : RPC_INVALID_ID;
+        ret = write_response_error(writer, RPC_ERROR_INVALID_REQUEST, "Invalid request", id);
     }
 
     return ret;
 }
 
-static int handle_rpc(const void* rxbuf, size_t rxbuf_size, void* txbuf, size_t* txbuf_size)
+/**
+ * 处理 CBOR 编码的请求，请求是数组 [id, method, params]
+ */
+static int handle_single_cbor_request(const cJSON* root, JsonWriter* writer)
 {
-    memset(txbuf, 0, *txbuf_size);
-    // 解析 JSON
-    // 这里需要确保有结束零，否则可能崩溃
-    cJSON* root = cJSON_Parse(rxbuf);
+    if (!cJSON_IsArray(root)) {
+        return write_response_error(writer, RPC_ERROR_INVALID_REQUEST, "Invalid request", RPC_INVALID_ID);
+    }
 
-    // 这里检查是否是单个调用还是批量调用
-    if (cJSON_IsArray(root)) { // 多个调用
-        int method_count = cJSON_GetArraySize(root);
-        if (method_count <= 0) {
-            ESP_ERROR_CHECK(
-                make_response_error(txbuf, txbuf_size, RPC_ERROR_INVALID_REQUEST, "Invalid request", RPC_INVALID_ID));
-            goto __BAD_REQUEST_EXIT;
-        }
+    const cJSON* id_item = cJSON_GetArrayItem(root, 0);
+    const cJSON* method_item = cJSON_GetArrayItem(root, 1);
+    const cJSON* params_item = cJSON_GetArrayItem(root, 2);
+
+    bool id_ok = id_item != NULL && cJSON_IsNumber(id_item);
+    uint64_t id = id_ok ? (uint64_t)id_item->valuedouble : RPC_INVALID_ID;
+
+    if (cJSON_GetArraySize(root) == 3 && id_ok && cJSON_IsString(method_item) && cJSON_IsArray(params_item)) {
+        ESP_LOGI(TAG, "Calling RPC method: %s", method_item->valuestring);
+        return invoke_rpc_method(writer, method_item->valuestring, params_item, id);
+    }
+    return write_response_error(writer, RPC_ERROR_INVALID_REQUEST, "Invalid request", id);
+}
 
-        // 为了方便简单，多个调用组包这里不经过 cJSON
-        BufferWriter bw;
-        BufferWriter_init(&bw, txbuf, *txbuf_size);
-
-        // 先写入开头的 '['
-        BufferWriter_write_char(&bw, '[');
-
-        cJSON* single_rpc = NULL;
-        size_t method_index = 0;
-        cJSON_ArrayForEach(single_rpc, root)
-        {
-            // 执行批量里的单个调用并写入发送缓冲区
-            size_t single_tx_size = BufferWriter_available(&bw);
-            uint8_t* available_buffer = BufferWriter_available_buffer(&bw);
-            ESP_ERROR_CHECK(handle_single_request(single_rpc, available_buffer, &single_tx_size));
-            BufferWriter_advance(&bw, single_tx_size);
-
-            method_index++;
-            if (method_index < method_count) {
-                // 写入每个结构之后的逗号分割
-                BufferWriter_write_char(&bw, ',');
+/**
+ * JSON 的批量调用是请求对象的数组，CBOR 的批量调用是请求数组的数组
+ */
+static bool is_batch_request(const cJSON* root, JsonWriterFormat format)
+{
+    if (!cJSON_IsArray(root)) {
+        return false;
+    }
+    if (format == JSON_WRITER_FORMAT_CBOR) {
+        return cJSON_IsArray(root->child);
+    }
+    return true;
+}
+
+static int handle_rpc(const void* rxbuf, size_t rxbuf_size, JsonWriter* writer)
+{
+    int ret = 0;
+    // 响应直接写入发送缓冲区，整个过程不为响应分配堆内存
+    JsonWriter mark = *writer;
+    // 请求和响应使用相同的编码，由服务端根据连接设置 writer 的格式
+    JsonWriterFormat format = JsonWriter_format(writer);
+
+    cJSON* root = NULL;
+    if (format == JSON_WRITER_FORMAT_CBOR) {
+        root = CborReader_parse(rxbuf, rxbuf_size);
+    } else {
+        // 解析 JSON
+        // 这里需要确保有结束零，否则可能崩溃
+        root = cJSON_Parse(rxbuf);
+    }
+
+    // 这里检查是否是单个调用还是批量调用
+    if (root == NULL) {
+        ret = write_response_error(writer, RPC_ERROR_PARSE_ERROR, "Parse error", RPC_INVALID_ID);
+    } else if (is_batch_request(root, format)) { // 多个调用
+        if (cJSON_GetArraySize(root) <= 0) {
+            ret = write_response_error(writer, RPC_ERROR_INVALID_REQUEST, "Invalid request", RPC_INVALID_ID);
+        } else {
+            JsonWriter_begin_array(writer);
+            size_t array_begin = JsonWriter_size(writer);
+            cJSON* single_rpc = NULL;
+            cJSON_ArrayForEach(single_rpc, root)
+            {
+                // 执行批量里的单个调用并写入发送缓冲区
+                if (format == JSON_WRITER_FORMAT_CBOR) {
+                    ret = handle_single_cbor_request(single_rpc, writer);
+                } else {
+                    ret = handle_single_request(single_rpc, writer);
+                }
+                if (ret != 0) {
+                    break;
+                }
+                // 每个调用的结果产生后马上发出去，不等整批执行完
+                if (JsonWriter_size(writer) > array_begin) {
+                    JsonWriter_flush(writer);
+                }
+            }
+            // 全是通知或者异步调用时没有一个元素写了响应，规范要求什么都不返回，而不是空数组
+            // 这时候还什么都没有发出去，回退到开头，服务端发现响应为空就不发送
+            if (ret == 0 && JsonWriter_size(writer) == array_begin && JsonWriter_rewind(writer, &mark)) {
+                goto __EXIT;
             }
+            JsonWriter_end_array(writer);
         }
-        // 最后写入结束的 ']'，并完成
-        BufferWriter_write_char(&bw, ']');
-        *txbuf_size = bw.written_count;
+    } else if (format == JSON_WRITER_FORMAT_CBOR) {
+        ret = handle_single_cbor_request(root, writer);
     } else {
-        ESP_ERROR_CHECK(handle_single_request(root, txbuf, txbuf_size));
+        ret = handle_single_request(root, writer);
     }
 
-__BAD_REQUEST_EXIT:
+    // 没有 flush 回调时，批量调用的结果放不下发送缓冲区就只能整个返回错误
+    if (ret == 0 && JsonWriter_has_error(writer)) {
+        if (JsonWriter_rewind(writer, &mark)) {
+            ret = write_response_error(writer, RPC_ERROR_RESPONSE_TOO_LARGE, "Response too large", RPC_INVALID_ID);
+        } else {
+            ret = -1;
+        }
+    }
 
+__EXIT:
     if (root != NULL) {
         cJSON_Delete(root);
     }
-    return 0;
-}
\ No newline at end of file
+    return ret;
+}
+
+static int make_error(int code, const char* message, JsonWriter* writer)
+{
+    return write_response_error(writer, code, message, RPC_INVALID_ID);
+}
+
+/**
+ * 生成 JSON-RPC 通知，CBOR 编码的通知是数组 [method, params]，第一个元素是文本串，和响应区分开
+ */
+static int write_notification(const RpcNotification* notification, JsonWriter* writer)
+{
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_CBOR) {
+        JsonWriter_begin_array(writer);
+        JsonWriter_string(writer, notification->method);
+        notification->write_params(notification->arg, writer);
+        JsonWriter_end_array(writer);
+    } else {
+        JsonWriter_begin_object(writer);
+        JsonWriter_add_string(writer, "jsonrpc", "2.0");
+        JsonWriter_add_string(writer, "method", notification->method);
+        JsonWriter_key(writer, "params");
+        notification->write_params(notification->arg, writer);
+        JsonWriter_end_object(writer);
+    }
+    return JsonWriter_has_error(writer) ? -1 : 0;
+}
+
+/**
+ * 生成异步调用完成时的响应，格式和同步方法的响应相同
+ */
+static int write_completion(const RpcCompletion* completion, JsonWriter* writer)
+{
+    if (completion->error_code != 0) {
+        return write_response_error(writer, completion->error_code, completion->error_message, completion->id);
+    }
+
+    write_response_head(writer, completion->id);
+    if (JsonWriter_format(writer) == JSON_WRITER_FORMAT_JSON) {
+        JsonWriter_key(writer, "result");
+    }
+    if (completion->write_result != NULL) {
+        completion->write_result(completion->arg, writer);
+    } else {
+        JsonWriter_null(writer);
+    }
+    write_response_end(writer);
+    return JsonWriter_has_error(writer) ? -1 : 0;
+}
@@ -8,27 +8,31 @@
 
 #include "borneo/rpc/sys.h"
 
-RpcMethodResult RpcMethod_sys_hello(const cJSON* params)
+RpcMethodResult RpcMethod_sys_hello(const cJSON* params, JsonWriter* result_writer)
 {
-    cJSON* result_json = cJSON_CreateObject();
-    cJSON_AddItemToObject(result_json, "name", cJSON_CreateString(BORNEO_DEVICE_NAME));
-    cJSON_AddItemToObject(result_json, "manufacturerName", cJSON_CreateString(BORNEO_DEVICE_MANUFACTURER_NAME));
-    cJSON_AddItemToObject(result_json, "manufacturerID", cJSON_CreateString(BORNEO_DEVICE_MANUFACTURER_ID));
-    cJSON_AddItemToObject(result_json, "modelName", cJSON_CreateString(BORNEO_DEVICE_MODEL_NAME));
-    cJSON_AddItemToObject(result_json, "modelID", cJSON_CreateString(BORNEO_DEVICE_MODEL_ID));
-    cJSON_AddItemToObject(result_json, "compatible", cJSON_CreateString(BORNEO_DEVICE_COMPATIBLE));
-    cJSON_AddItemToObject(result_json, "hardwareVersion", cJSON_CreateString("1.0.0.0"));
-    cJSON_AddItemToObject(result_json, "firmwareVersion", cJSON_CreateString("1.0.0.0"));
-    cJSON_AddItemToObject(result_json, "kind", cJSON_CreateString("doser"));
-    cJSON_AddItemToObject(result_json, "serialNumber", cJSON_CreateString(Serial_get()));
-
-    cJSON* properties_node = cJSON_CreateArray();
-    cJSON_AddItemToObject(result_json, "properties", properties_node);
-
-    cJSON* commands_node = cJSON_CreateArray();
-    cJSON_AddItemToObject(result_json, "commands", commands_node);
-
-    RpcMethodResult rpc_result = { .is_succeed = true, .result = result_json };
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_string(result_writer, "name", BORNEO_DEVICE_NAME);
+    JsonWriter_add_string(result_writer, "manufacturerName", BORNEO_DEVICE_MANUFACTURER_NAME);
+    JsonWriter_add_string(result_writer, "manufacturerID", BORNEO_DEVICE_MANUFACTURER_ID);
+    JsonWriter_add_string(result_writer, "modelName", BORNEO_DEVICE_MODEL_NAME);
+    JsonWriter_add_string(result_writer, "modelID", BORNEO_DEVICE_MODEL_ID);
+    JsonWriter_add_string(result_writer, "compatible", BORNEO_DEVICE_COMPATIBLE);
+    JsonWriter_add_string(result_writer, "hardwareVersion", "1.0.0.0");
+    JsonWriter_add_string(result_writer, "firmwareVersion", "1.0.0.0");
+    JsonWriter_add_string(result_writer, "kind", "doser");
+    JsonWriter_add_string(result_writer, "serialNumber", Serial_get());
+
+    JsonWriter_key(result_writer, "properties");
+    JsonWriter_begin_array(result_writer);
+    JsonWriter_end_array(result_writer);
+
+    JsonWriter_key(result_writer, "commands");
+    JsonWriter_begin_array(result_writer);
+    JsonWriter_end_array(result_writer);
+
+    JsonWriter_end_object(result_writer);
+
+    RpcMethodResult rpc_result = { .is_succeed = true, .result = NULL };
 
     return rpc_result;
-}
\ No newline at end of file
+}
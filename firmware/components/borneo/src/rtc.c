@@ -16,14 +16,19 @@
 #include "borneo/devices/ds1302.h"
 
 static void rtc_task();
+static void refresh_now();
 
 static struct tm s_now;
+static time_t s_timestamp; // 和 s_now 一起刷新，读时间戳不用每次都调用 mktime()
+
+ESP_EVENT_DEFINE_BASE(BORNEO_RTC_EVENTS);
 
 #define TAG "RTC"
 
 int Rtc_init()
 {
     memset(&s_now, 0, sizeof(s_now));
+    s_timestamp = 0;
     return DS1302_init();
 }
 
@@ -35,17 +40,15 @@ int Rtc_start()
 
 struct tm Rtc_local_now() { return s_now; }
 
-time_t Rtc_timestamp()
-{
-    // 返回当前时间 timestamp
-    ESP_LOGI(TAG, ">>>>>>>>>>>>>>>>>>>>>> %d", (int)mktime(&s_now));
-    return mktime(&s_now);
-}
+time_t Rtc_timestamp() { return s_timestamp; }
 
 void Rtc_set_datetime(const struct tm* dt)
 {
     assert(dt != NULL);
     DS1302_set_datetime(dt);
+    // 马上读回来，不用等 rtc_task 的下一次刷新
+    refresh_now();
+    esp_event_post(BORNEO_RTC_EVENTS, BORNEO_EVENT_RTC_TIME_SET, NULL, 0, portMAX_DELAY);
 }
 
 static void rtc_task()
@@ -53,9 +56,22 @@ static void rtc_task()
     const TickType_t freq = 500 / portTICK_PERIOD_MS;
     TickType_t last_wake_time = xTaskGetTickCount();
     for (;;) {
-        DS1302_now(&s_now);
+        refresh_now();
         vTaskDelayUntil(&last_wake_time, freq);
     }
 
     vTaskDelete(NULL);
+}
+
+/**
+ * mktime() 会修改传进去的结构体，在副本上计算，s_now 保持 DS1302 读出来的原样
+ */
+static void refresh_now()
+{
+    struct tm now;
+    DS1302_now(&now);
+    struct tm copy = now;
+    time_t timestamp = mktime(&copy);
+    s_now = now;
+    s_timestamp = timestamp;
 }
\ No newline at end of file
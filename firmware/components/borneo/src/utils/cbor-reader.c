@@ -0,0 +1,308 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/utils/cbor-reader.h"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGINT 1
+#define CBOR_MAJOR_BYTES 2
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK 0xFF
+
+// 短的文本串在栈上补结尾零，长的才分配内存
+#define SHORT_TEXT_SIZE 64
+
+typedef struct {
+    const uint8_t* pos;
+    const uint8_t* end;
+    int depth;
+} CborReader;
+
+static cJSON* parse_item(CborReader* reader);
+static int read_head(CborReader* reader, uint8_t* major_type, uint8_t* info, uint64_t* argument);
+static char* read_text(CborReader* reader, uint64_t len, char* short_buf);
+static cJSON* parse_array(CborReader* reader, uint8_t info, uint64_t count);
+static cJSON* parse_map(CborReader* reader, uint8_t info, uint64_t count);
+static cJSON* parse_simple(uint8_t info, uint64_t argument);
+static double decode_half(uint16_t half);
+static bool is_break(const CborReader* reader);
+
+/**
+ * 解码一个完整的 CBOR 数据项，数据有错误或者后面还有多余的数据都返回 NULL
+ */
+cJSON* CborReader_parse(const void* data, size_t size)
+{
+    CborReader reader = {
+        .pos = (const uint8_t*)data,
+        .end = (const uint8_t*)data + size,
+        .depth = 0,
+    };
+    cJSON* root = parse_item(&reader);
+    if (root != NULL && reader.pos != reader.end) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    return root;
+}
+
+static cJSON* parse_item(CborReader* reader)
+{
+    uint8_t major_type;
+    uint8_t info;
+    uint64_t argument;
+    if (read_head(reader, &major_type, &info, &argument) != 0) {
+        return NULL;
+    }
+
+    // 标签只是语义提示（比如自描述标签 55799），跳过之后直接解码被标记的数据项
+    // 在循环里跳过而不是递归，一长串标签不会耗尽栈
+    while (major_type == CBOR_MAJOR_TAG) {
+        if (info == CBOR_INDEFINITE || read_head(reader, &major_type, &info, &argument) != 0) {
+            return NULL;
+        }
+    }
+
+    switch (major_type) {
+    case CBOR_MAJOR_UINT:
+        return cJSON_CreateNumber((double)argument);
+
+    case CBOR_MAJOR_NEGINT:
+        return cJSON_CreateNumber(-1.0 - (double)argument);
+
+    case CBOR_MAJOR_TEXT: {
+        if (info == CBOR_INDEFINITE) {
+            return NULL;
+        }
+        char short_buf[SHORT_TEXT_SIZE];
+        char* text = read_text(reader, argument, short_buf);
+        if (text == NULL) {
+            return NULL;
+        }
+        cJSON* item = cJSON_CreateString(text);
+        if (text != short_buf) {
+            free(text);
+        }
+        return item;
+    }
+
+    case CBOR_MAJOR_ARRAY:
+        return parse_array(reader, info, argument);
+
+    case CBOR_MAJOR_MAP:
+        return parse_map(reader, info, argument);
+
+    case CBOR_MAJOR_SIMPLE:
+        return parse_simple(info, argument);
+
+    default: // 字节串
+        return NULL;
+    }
+}
+
+/**
+ * 读取数据项头部，argument 是长度、个数或者整数值，浮点数时是原始的位
+ */
+static int read_head(CborReader* reader, uint8_t* major_type, uint8_t* info, uint64_t* argument)
+{
+    if (reader->pos >= reader->end) {
+        return -1;
+    }
+    uint8_t initial = *reader->pos++;
+    *major_type = initial >> 5;
+    *info = initial & 0x1F;
+
+    size_t len;
+    if (*info < 24) {
+        *argument = *info;
+        return 0;
+    } else if (*info == 24) {
+        len = 1;
+    } else if (*info == 25) {
+        len = 2;
+    } else if (*info == 26) {
+        len = 4;
+    } else if (*info == 27) {
+        len = 8;
+    } else if (*info == CBOR_INDEFINITE) {
+        *argument = 0;
+        return 0;
+    } else {
+        return -1;
+    }
+
+    if ((size_t)(reader->end - reader->pos) < len) {
+        return -1;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        value = (value << 8) | *reader->pos++;
+    }
+    *argument = value;
+    return 0;
+}
+
+/**
+ * 读取文本串并补上结尾零，返回值不是 short_buf 时需要调用方释放
+ */
+static char* read_text(CborReader* reader, uint64_t len, char* short_buf)
+{
+    if ((uint64_t)(reader->end - reader->pos) < len) {
+        return NULL;
+    }
+    char* text = short_buf;
+    if (len >= SHORT_TEXT_SIZE) {
+        text = (char*)malloc((size_t)len + 1);
+        if (text == NULL) {
+            return NULL;
+        }
+    }
+    memcpy(text, reader->pos, (size_t)len);
+    text[len] = '\0';
+    reader->pos += len;
+    return text;
+}
+
+static cJSON* parse_array(CborReader* reader, uint8_t info, uint64_t count)
+{
+    if (reader->depth >= CBOR_READER_MAX_DEPTH) {
+        return NULL;
+    }
+    // 每个元素至少一个字节，个数超过剩余数据长度肯定是错误数据
+    if (info != CBOR_INDEFINITE && count > (uint64_t)(reader->end - reader->pos)) {
+        return NULL;
+    }
+
+    cJSON* array = cJSON_CreateArray();
+    if (array == NULL) {
+        return NULL;
+    }
+    reader->depth++;
+    for (uint64_t i = 0; info == CBOR_INDEFINITE || i < count; i++) {
+        if (info == CBOR_INDEFINITE && is_break(reader)) {
+            reader->pos++;
+            break;
+        }
+        cJSON* item = parse_item(reader);
+        if (item == NULL) {
+            goto __FAILED_EXIT;
+        }
+        cJSON_AddItemToArray(array, item);
+    }
+    reader->depth--;
+    return array;
+
+__FAILED_EXIT:
+    cJSON_Delete(array);
+    return NULL;
+}
+
+static cJSON* parse_map(CborReader* reader, uint8_t info, uint64_t count)
+{
+    if (reader->depth >= CBOR_READER_MAX_DEPTH) {
+        return NULL;
+    }
+    if (info != CBOR_INDEFINITE && count > (uint64_t)(reader->end - reader->pos) / 2) {
+        return NULL;
+    }
+
+    cJSON* object = cJSON_CreateObject();
+    if (object == NULL) {
+        return NULL;
+    }
+    reader->depth++;
+    for (uint64_t i = 0; info == CBOR_INDEFINITE || i < count; i++) {
+        if (info == CBOR_INDEFINITE && is_break(reader)) {
+            reader->pos++;
+            break;
+        }
+
+        // 键只能是定长的文本串
+        uint8_t key_type;
+        uint8_t key_info;
+        uint64_t key_len;
+        if (read_head(reader, &key_type, &key_info, &key_len) != 0 || key_type != CBOR_MAJOR_TEXT
+            || key_info == CBOR_INDEFINITE) {
+            goto __FAILED_EXIT;
+        }
+        char short_buf[SHORT_TEXT_SIZE];
+        char* key = read_text(reader, key_len, short_buf);
+        if (key == NULL) {
+            goto __FAILED_EXIT;
+        }
+
+        cJSON* item = parse_item(reader);
+        if (item != NULL) {
+            cJSON_AddItemToObject(object, key, item);
+        }
+        if (key != short_buf) {
+            free(key);
+        }
+        if (item == NULL) {
+            goto __FAILED_EXIT;
+        }
+    }
+    reader->depth--;
+    return object;
+
+__FAILED_EXIT:
+    cJSON_Delete(object);
+    return NULL;
+}
+
+static cJSON* parse_simple(uint8_t info, uint64_t argument)
+{
+    switch (info) {
+    case 20:
+        return cJSON_CreateFalse();
+    case 21:
+        return cJSON_CreateTrue();
+    case 22: // null
+    case 23: // undefined
+        return cJSON_CreateNull();
+    case 25:
+        return cJSON_CreateNumber(decode_half((uint16_t)argument));
+    case 26: {
+        uint32_t bits = (uint32_t)argument;
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return cJSON_CreateNumber(value);
+    }
+    case 27: {
+        double value;
+        memcpy(&value, &argument, sizeof(value));
+        return cJSON_CreateNumber(value);
+    }
+    default:
+        return NULL;
+    }
+}
+
+/**
+ * 半精度浮点，RFC 8949 附录 D
+ */
+static double decode_half(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent != 31) {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    } else {
+        value = mantissa == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+static bool is_break(const CborReader* reader) { return reader->pos < reader->end && *reader->pos == CBOR_BREAK; }
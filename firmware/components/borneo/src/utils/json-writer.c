@@ -0,0 +1,588 @@
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/utils/buffer-writer.h"
+#include "borneo/utils/json-writer.h"
+
+static int write_raw(JsonWriter* writer, const void* buf, size_t size);
+static int write_char(JsonWriter* writer, char ch);
+static int begin_value(JsonWriter* writer);
+static int write_escaped(JsonWriter* writer, const char* str);
+static int write_uint_digits(JsonWriter* writer, uint64_t value);
+static int flush_buffer(JsonWriter* writer);
+static int write_cbor_head(JsonWriter* writer, uint8_t major_type, uint64_t value);
+static int write_cbor_double(JsonWriter* writer, double value);
+static int write_cbor_tree(JsonWriter* writer, const cJSON* value);
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGINT 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_FLOAT32 0xFA
+#define CBOR_FLOAT64 0xFB
+#define CBOR_BREAK 0xFF
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+int JsonWriter_init(JsonWriter* writer, void* buffer, size_t capacity)
+{
+    assert(writer != NULL);
+
+    memset(writer, 0, sizeof(JsonWriter));
+    return BufferWriter_init(&writer->buffer, buffer, capacity);
+}
+
+void JsonWriter_set_flush(JsonWriter* writer, JsonWriterFlushCallback flush, void* context)
+{
+    writer->flush = flush;
+    writer->flush_context = context;
+}
+
+/**
+ * 切换输出格式，只能在写入任何内容之前调用
+ */
+void JsonWriter_set_format(JsonWriter* writer, JsonWriterFormat format)
+{
+    assert(JsonWriter_size(writer) == 0);
+    writer->format = format;
+}
+
+void JsonWriter_reset(JsonWriter* writer)
+{
+    BufferWriter_clear(&writer->buffer);
+    writer->flushed_count = 0;
+    writer->depth = 0;
+    writer->has_items = 0;
+    writer->after_key = false;
+    writer->error = 0;
+}
+
+/**
+ * 把缓冲区里的数据交给 flush 回调，没有设置回调时什么都不做
+ */
+int JsonWriter_flush(JsonWriter* writer)
+{
+    if (writer->error != 0) {
+        return -1;
+    }
+    if (writer->flush == NULL || writer->buffer.written_count == 0) {
+        return 0;
+    }
+    return flush_buffer(writer);
+}
+
+/**
+ * 回退到之前用结构体拷贝保存的状态，mark 之后写的内容如果已经交给 flush 回调了就没法回退
+ */
+bool JsonWriter_rewind(JsonWriter* writer, const JsonWriter* mark)
+{
+    if (writer->flushed_count != mark->flushed_count) {
+        return false;
+    }
+    *writer = *mark;
+    return true;
+}
+
+int JsonWriter_begin_object(JsonWriter* writer)
+{
+    char head = writer->format == JSON_WRITER_FORMAT_CBOR ? (char)((CBOR_MAJOR_MAP << 5) | CBOR_INDEFINITE) : '{';
+    if (begin_value(writer) != 0 || write_char(writer, head) != 0) {
+        return -1;
+    }
+    if (writer->depth >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = -1;
+        return -1;
+    }
+    writer->depth++;
+    writer->has_items &= ~(1U << writer->depth);
+    return 0;
+}
+
+int JsonWriter_end_object(JsonWriter* writer)
+{
+    // 出错以后 begin 没有增加层数，这里也不能减
+    if (writer->error != 0) {
+        return -1;
+    }
+    assert(writer->depth > 0 && !writer->after_key);
+    writer->depth--;
+    return write_char(writer, writer->format == JSON_WRITER_FORMAT_CBOR ? (char)CBOR_BREAK : '}');
+}
+
+int JsonWriter_begin_array(JsonWriter* writer)
+{
+    char head = writer->format == JSON_WRITER_FORMAT_CBOR ? (char)((CBOR_MAJOR_ARRAY << 5) | CBOR_INDEFINITE) : '[';
+    if (begin_value(writer) != 0 || write_char(writer, head) != 0) {
+        return -1;
+    }
+    if (writer->depth >= JSON_WRITER_MAX_DEPTH) {
+        writer->error = -1;
+        return -1;
+    }
+    writer->depth++;
+    writer->has_items &= ~(1U << writer->depth);
+    return 0;
+}
+
+int JsonWriter_end_array(JsonWriter* writer)
+{
+    // 出错以后 begin 没有增加层数，这里也不能减
+    if (writer->error != 0) {
+        return -1;
+    }
+    assert(writer->depth > 0 && !writer->after_key);
+    writer->depth--;
+    return write_char(writer, writer->format == JSON_WRITER_FORMAT_CBOR ? (char)CBOR_BREAK : ']');
+}
+
+int JsonWriter_key(JsonWriter* writer, const char* key)
+{
+    if (writer->error != 0) {
+        return -1;
+    }
+    assert(!writer->after_key);
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        size_t len = strlen(key);
+        if (write_cbor_head(writer, CBOR_MAJOR_TEXT, len) != 0 || write_raw(writer, key, len) != 0) {
+            return -1;
+        }
+    } else if (write_escaped(writer, key) != 0 || write_char(writer, ':') != 0) {
+        return -1;
+    }
+    writer->after_key = true;
+    return 0;
+}
+
+int JsonWriter_string(JsonWriter* writer, const char* value)
+{
+    if (value == NULL) {
+        return JsonWriter_null(writer);
+    }
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        // CBOR 的文本串就是原样的 UTF-8，不需要转义
+        size_t len = strlen(value);
+        if (write_cbor_head(writer, CBOR_MAJOR_TEXT, len) != 0) {
+            return -1;
+        }
+        return write_raw(writer, value, len);
+    }
+    return write_escaped(writer, value);
+}
+
+int JsonWriter_int(JsonWriter* writer, int64_t value)
+{
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        // CBOR 负整数编码的是 -1 - value
+        return value < 0 ? write_cbor_head(writer, CBOR_MAJOR_NEGINT, (uint64_t)(-(value + 1)))
+                         : write_cbor_head(writer, CBOR_MAJOR_UINT, (uint64_t)value);
+    }
+    if (value < 0) {
+        if (write_char(writer, '-') != 0) {
+            return -1;
+        }
+        return write_uint_digits(writer, (uint64_t)(-(value + 1)) + 1);
+    }
+    return write_uint_digits(writer, (uint64_t)value);
+}
+
+int JsonWriter_uint(JsonWriter* writer, uint64_t value)
+{
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        return write_cbor_head(writer, CBOR_MAJOR_UINT, value);
+    }
+    return write_uint_digits(writer, value);
+}
+
+int JsonWriter_double(JsonWriter* writer, double value)
+{
+    // JSON 里没有 NaN 和无穷，跟 cJSON 一样输出 null，CBOR 也保持一致
+    if (!isfinite(value)) {
+        return JsonWriter_null(writer);
+    }
+
+    // 整数值走整数路径，比 snprintf 快得多
+    if (fabs(value) < 1.0e15 && value == (double)(int64_t)value) {
+        return JsonWriter_int(writer, (int64_t)value);
+    }
+
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        return write_cbor_double(writer, value);
+    }
+
+    // 与 cJSON 相同：先尝试 15 位有效数字，不能精确还原就用 17 位
+    char number_buf[32];
+    int len = snprintf(number_buf, sizeof(number_buf), "%1.15g", value);
+    if (strtod(number_buf, NULL) != value) {
+        len = snprintf(number_buf, sizeof(number_buf), "%1.17g", value);
+    }
+    if (len <= 0 || len >= (int)sizeof(number_buf)) {
+        writer->error = -1;
+        return -1;
+    }
+    return write_raw(writer, number_buf, len);
+}
+
+int JsonWriter_bool(JsonWriter* writer, bool value)
+{
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        return write_char(writer, (char)(value ? CBOR_TRUE : CBOR_FALSE));
+    }
+    return value ? write_raw(writer, "true", 4) : write_raw(writer, "false", 5);
+}
+
+int JsonWriter_null(JsonWriter* writer)
+{
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        return write_char(writer, (char)CBOR_NULL);
+    }
+    return write_raw(writer, "null", 4);
+}
+
+/**
+ * 把 cJSON 树直接打印到缓冲区里，用于兼容还在返回 cJSON 的旧接口
+ */
+int JsonWriter_cjson(JsonWriter* writer, const cJSON* value)
+{
+    if (value == NULL) {
+        return JsonWriter_null(writer);
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        return write_cbor_tree(writer, value);
+    }
+    if (begin_value(writer) != 0) {
+        return -1;
+    }
+
+    size_t available = BufferWriter_available(&writer->buffer);
+    char* buf = (char*)BufferWriter_available_buffer(&writer->buffer);
+    if (available > 0 && cJSON_PrintPreallocated((cJSON*)value, buf, (int)available, 0)) {
+        BufferWriter_advance(&writer->buffer, strnlen(buf, available));
+        return 0;
+    }
+    if (writer->flush == NULL) {
+        writer->error = -1;
+        return -1;
+    }
+
+    // 剩余空间不够，先把缓冲区交出去再试一次
+    if (writer->buffer.written_count > 0) {
+        if (flush_buffer(writer) != 0) {
+            return -1;
+        }
+        available = BufferWriter_available(&writer->buffer);
+        buf = (char*)BufferWriter_available_buffer(&writer->buffer);
+        if (cJSON_PrintPreallocated((cJSON*)value, buf, (int)available, 0)) {
+            BufferWriter_advance(&writer->buffer, strnlen(buf, available));
+            return 0;
+        }
+    }
+
+    // 整个缓冲区都放不下，只能让 cJSON 分配内存打印再分段写出
+    char* printed = cJSON_PrintUnformatted(value);
+    if (printed == NULL) {
+        writer->error = -1;
+        return -1;
+    }
+    int ret = write_raw(writer, printed, strlen(printed));
+    cJSON_free(printed);
+    return ret;
+}
+
+/**
+ * 原样写入，不处理逗号，用于分帧等非 JSON 数据
+ */
+int JsonWriter_raw(JsonWriter* writer, const void* buf, size_t size) { return write_raw(writer, buf, size); }
+
+int JsonWriter_add_string(JsonWriter* writer, const char* key, const char* value)
+{
+    JsonWriter_key(writer, key);
+    return JsonWriter_string(writer, value);
+}
+
+int JsonWriter_add_int(JsonWriter* writer, const char* key, int64_t value)
+{
+    JsonWriter_key(writer, key);
+    return JsonWriter_int(writer, value);
+}
+
+int JsonWriter_add_double(JsonWriter* writer, const char* key, double value)
+{
+    JsonWriter_key(writer, key);
+    return JsonWriter_double(writer, value);
+}
+
+int JsonWriter_add_bool(JsonWriter* writer, const char* key, bool value)
+{
+    JsonWriter_key(writer, key);
+    return JsonWriter_bool(writer, value);
+}
+
+static int write_raw(JsonWriter* writer, const void* buf, size_t size)
+{
+    if (writer->error != 0) {
+        return -1;
+    }
+
+    const uint8_t* pos = (const uint8_t*)buf;
+    while (size > 0) {
+        size_t available = BufferWriter_available(&writer->buffer);
+        if (available == 0) {
+            // 缓冲区满了，没有 flush 回调就是溢出
+            if (writer->flush == NULL) {
+                writer->error = -1;
+                return -1;
+            }
+            if (flush_buffer(writer) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        size_t n = size < available ? size : available;
+        BufferWriter_write(&writer->buffer, pos, n);
+        pos += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int write_char(JsonWriter* writer, char ch)
+{
+    if (writer->error == 0 && BufferWriter_available(&writer->buffer) > 0) {
+        BufferWriter_write_char(&writer->buffer, ch);
+        return 0;
+    }
+    return write_raw(writer, &ch, 1);
+}
+
+static int flush_buffer(JsonWriter* writer)
+{
+    size_t size = writer->buffer.written_count;
+    if (writer->flush(writer->flush_context, writer->buffer.buffer, size) != 0) {
+        writer->error = -1;
+        return -1;
+    }
+    writer->flushed_count += size;
+    BufferWriter_clear(&writer->buffer);
+    return 0;
+}
+
+/**
+ * 写任何值或者键之前调用，负责容器元素之间的逗号
+ */
+static int begin_value(JsonWriter* writer)
+{
+    if (writer->error != 0) {
+        return -1;
+    }
+    if (writer->after_key) {
+        writer->after_key = false;
+        return 0;
+    }
+    if (writer->format == JSON_WRITER_FORMAT_CBOR) {
+        // CBOR 的元素之间没有分隔符
+        return 0;
+    }
+    uint32_t bit = 1U << writer->depth;
+    if (writer->depth > 0 && (writer->has_items & bit)) {
+        return write_char(writer, ',');
+    }
+    writer->has_items |= bit;
+    return 0;
+}
+
+static int write_escaped(JsonWriter* writer, const char* str)
+{
+    if (write_char(writer, '"') != 0) {
+        return -1;
+    }
+
+    // 不需要转义的连续字符一次性拷贝
+    const char* run = str;
+    for (const char* p = str; *p != '\0'; p++) {
+        uint8_t ch = (uint8_t)*p;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+        if (write_raw(writer, run, p - run) != 0) {
+            return -1;
+        }
+        run = p + 1;
+
+        char escaped[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t escaped_len = 2;
+        switch (ch) {
+        case '"':
+            escaped[1] = '"';
+            break;
+        case '\\':
+            escaped[1] = '\\';
+            break;
+        case '\b':
+            escaped[1] = 'b';
+            break;
+        case '\f':
+            escaped[1] = 'f';
+            break;
+        case '\n':
+            escaped[1] = 'n';
+            break;
+        case '\r':
+            escaped[1] = 'r';
+            break;
+        case '\t':
+            escaped[1] = 't';
+            break;
+        default:
+            escaped[1] = 'u';
+            escaped[2] = '0';
+            escaped[3] = '0';
+            escaped[4] = HEX_DIGITS[ch >> 4];
+            escaped[5] = HEX_DIGITS[ch & 0x0F];
+            escaped_len = 6;
+            break;
+        }
+        if (write_raw(writer, escaped, escaped_len) != 0) {
+            return -1;
+        }
+    }
+    if (write_raw(writer, run, strlen(run)) != 0) {
+        return -1;
+    }
+    return write_char(writer, '"');
+}
+
+static int write_uint_digits(JsonWriter* writer, uint64_t value)
+{
+    char digits[20];
+    size_t pos = sizeof(digits);
+    do {
+        digits[--pos] = (char)('0' + (value % 10));
+        value /= 10;
+    } while (value != 0);
+    return write_raw(writer, &digits[pos], sizeof(digits) - pos);
+}
+
+/**
+ * 写入 CBOR 数据项的头部：主类型和参数，参数用最短的编码
+ */
+static int write_cbor_head(JsonWriter* writer, uint8_t major_type, uint64_t value)
+{
+    uint8_t head[9];
+    size_t len;
+    major_type <<= 5;
+    if (value < 24) {
+        head[0] = major_type | (uint8_t)value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major_type | 24;
+        head[1] = (uint8_t)value;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major_type | 25;
+        head[1] = (uint8_t)(value >> 8);
+        head[2] = (uint8_t)value;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major_type | 26;
+        for (size_t i = 0; i < 4; i++) {
+            head[1 + i] = (uint8_t)(value >> (24 - i * 8));
+        }
+        len = 5;
+    } else {
+        head[0] = major_type | 27;
+        for (size_t i = 0; i < 8; i++) {
+            head[1 + i] = (uint8_t)(value >> (56 - i * 8));
+        }
+        len = 9;
+    }
+    return write_raw(writer, head, len);
+}
+
+/**
+ * 能用单精度无损表示的就用单精度，传感器读数之类的值大多可以省下 4 个字节
+ */
+static int write_cbor_double(JsonWriter* writer, double value)
+{
+    uint8_t buf[9];
+    float single = (float)value;
+    if ((double)single == value) {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        buf[0] = CBOR_FLOAT32;
+        for (size_t i = 0; i < 4; i++) {
+            buf[1 + i] = (uint8_t)(bits >> (24 - i * 8));
+        }
+        return write_raw(writer, buf, 5);
+    }
+
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buf[0] = CBOR_FLOAT64;
+    for (size_t i = 0; i < 8; i++) {
+        buf[1 + i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    return write_raw(writer, buf, 9);
+}
+
+/**
+ * 把 cJSON 树编码成 CBOR，深度跟 cJSON 树一样
+ */
+static int write_cbor_tree(JsonWriter* writer, const cJSON* value)
+{
+    if (cJSON_IsObject(value)) {
+        JsonWriter_begin_object(writer);
+        const cJSON* child = NULL;
+        cJSON_ArrayForEach(child, value)
+        {
+            JsonWriter_key(writer, child->string);
+            write_cbor_tree(writer, child);
+        }
+        return JsonWriter_end_object(writer);
+    } else if (cJSON_IsArray(value)) {
+        JsonWriter_begin_array(writer);
+        const cJSON* child = NULL;
+        cJSON_ArrayForEach(child, value) { write_cbor_tree(writer, child); }
+        return JsonWriter_end_array(writer);
+    } else if (cJSON_IsString(value)) {
+        return JsonWriter_string(writer, value->valuestring);
+    } else if (cJSON_IsNumber(value)) {
+        return JsonWriter_double(writer, value->valuedouble);
+    } else if (cJSON_IsBool(value)) {
+        return JsonWriter_bool(writer, cJSON_IsTrue(value));
+    }
+    return JsonWriter_null(writer);
+}
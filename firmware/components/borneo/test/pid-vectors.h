@@ -0,0 +1,306 @@
+#pragma once
+
+// 由 scripts/gen-pid-vectors.py 生成，不要手工修改
+// 每组配置从复位状态开始连续执行 PID_VECTOR_STEPS 步，out 是期望的输出
+
+#define PID_VECTOR_STEPS 128
+#define PID_VECTOR_CONFIGS 8
+
+typedef struct {
+    float kp, ki, kd, hz;
+    int bits;
+    bool sign;
+    bool has_integral_range;
+    int16_t integral_min, integral_max;
+    uint32_t p, i, d; // 换算以后的定点参数
+} PidVectorConfig;
+
+typedef struct {
+    int16_t sp, fb, out;
+} PidVectorStep;
+
+static const PidVectorConfig PID_VECTOR_CONFIG_TABLE[PID_VECTOR_CONFIGS] = {
+    { 1.0f, 0.0f, 0.0f, 20.0f, 16, true, false, 0, 0, 256, 0, 0 },
+    { 0.5f, 2.0f, 0.0f, 20.0f, 16, true, false, 0, 0, 128, 25, 0 },
+    { 0.8f, 1.5f, 0.02f, 20.0f, 16, true, true, -2000, 2000, 204, 19, 102 },
+    { 2.0f, 0.4f, 0.01f, 20.0f, 16, true, true, 100, 3000, 512, 5, 51 },
+    { 255.0f, 0.0f, 0.0f, 20.0f, 16, true, false, 0, 0, 65280, 0, 0 },
+    { 0.1f, 5.0f, 0.5f, 50.0f, 12, false, false, 0, 0, 25, 25, 6400 },
+    { 3.3f, 0.7f, 0.05f, 20.0f, 8, true, true, -100, 100, 844, 8, 256 },
+    { 0.0f, 0.0f, 0.0f, 20.0f, 16, true, false, 0, 0, 0, 0, 0 },
+};
+
+static const PidVectorStep PID_VECTOR_STEP_TABLE[PID_VECTOR_CONFIGS][PID_VECTOR_STEPS] = {
+    {
+        { 1851, 1789, 62 }, { 1851, 1736, 115 }, { 1851, 1684, 167 }, { 1851, 1537, 314 },
+        { 1851, 1532, 319 }, { 1851, 1684, 167 }, { 0, 1684, -1684 }, { 0, 1180, -1180 },
+        { 0, 975, -975 }, { 0, 546, -546 }, { 0, 474, -474 }, { 0, 367, -367 },
+        { 0, 104, -104 }, { 0, -80, 80 }, { 0, -207, 207 }, { -21048, -207, -20841 },
+        { -21048, -5493, -15555 }, { -21048, -9402, -11646 }, { -21048, -32768, 11720 }, { -21048, -29953, 8905 },
+        { -21048, -27633, 6585 }, { -21048, -26046, 4998 }, { -21048, -24635, 3587 }, { -21048, -23617, 2569 },
+        { -21048, -22978, 1930 }, { -21048, -22625, 1577 }, { -21048, -22173, 1125 }, { -21048, -21973, 925 },
+        { -21048, -21829, 781 }, { -21048, -21569, 521 }, { -21048, -21310, 262 }, { -21048, -21412, 364 },
+        { -21048, -21204, 156 }, { 20606, -21204, 32767 }, { 20606, -10861, 31467 }, { 20606, -2841, 23447 },
+        { 20606, 2964, 17642 }, { 20606, 7354, 13252 }, { 20606, 10650, 9956 }, { 20606, 13254, 7352 },
+        { 20606, 15157, 5449 }, { 20606, 16668, 3938 }, { 0, 16668, -16668 }, { 0, 12405, -12405 },
+        { -28099, 12405, -32768 }, { -28099, 2396, -30495 }, { -28099, -5178, -22921 }, { -28099, -10943, -17156 },
+        { -28099, -15291, -12808 }, { -28099, -18615, -9484 }, { -28099, -20840, -7259 }, { -28099, -22463, -5636 },
+        { -28099, -23914, -4185 }, { -28099, -24806, -3293 }, { -28099, -25571, -2528 }, { 4727, -25571, 30298 },
+        { 4727, -18192, 22919 }, { 4727, -12421, 17148 }, { 4727, -8000, 12727 }, { 4727, -4796, 9523 },
+        { 4727, 0, 4727 }, { 4727, 1065, 3662 }, { 4727, 2101, 2626 }, { 4727, 2675, 2052 },
+        { 4727, 3358, 1369 }, { 4727, 3731, 996 }, { 1512, 3731, -2219 }, { 1512, 3131, -1619 },
+        { 1512, 2663, -1151 }, { 1512, 32767, -31255 }, { 1512, 24790, -23278 }, { 1512, 18925, -17413 },
+        { 1512, 14706, -13194 }, { 1512, 11280, -9768 }, { 1512, 8689, -7177 }, { 1512, 6725, -5213 },
+        { 1512, 5560, -4048 }, { 1512, 4627, -3115 }, { 1512, 3768, -2256 }, { 1512, 3308, -1796 },
+        { 1512, 2921, -1409 }, { 1512, 2761, -1249 }, { 1512, 2382, -870 }, { 1512, 2245, -733 },
+        { 1512, 2086, -574 }, { 1512, 2075, -563 }, { 1512, 2023, -511 }, { 1512, 1792, -280 },
+        { 1512, 1615, -103 }, { 1512, 1745, -233 }, { 1512, 1614, -102 }, { 1512, 1539, -27 },
+        { 1512, 1569, -57 }, { 1512, 1515, -3 }, { 1512, 1369, 143 }, { 1512, 1408, 104 },
+        { 1512, 1556, -44 }, { 1512, 1399, 113 }, { 1512, 1412, 100 }, { 1512, 1530, -18 },
+        { 1512, 1518, -6 }, { 1512, 1616, -104 }, { 1512, 1558, -46 }, { 1512, 1498, 14 },
+        { 1512, 1646, -134 }, { 1512, 1560, -48 }, { 1512, 1580, -68 }, { -1919, 1580, -3499 },
+        { -1919, 508, -2427 }, { -1919, -8, -1911 }, { -1919, -316, -1603 }, { -537, -316, -221 },
+        { -537, -272, -265 }, { -537, -148, -389 }, { -537, -273, -264 }, { -537, -527, -10 },
+        { 25225, -527, 25752 }, { 25225, 5791, 19434 }, { 25225, 10776, 14449 }, { 25225, 14295, 10930 },
+        { 25225, 16935, 8290 }, { 25225, 19190, 6035 }, { -32768, 19190, -32768 }, { -32768, 6049, -32768 },
+        { -32768, -3590, -29178 }, { -32768, -10726, -22042 }, { -27088, -10726, -16362 }, { -27088, -14861, -12227 },
+    },
+    {
+        { 453, 285, 100 }, { -2841, 285, -1852 }, { 32767, 285, 19124 }, { 32767, 8532, 17367 },
+        { 32767, 14648, 16079 }, { 32767, 32767, 7019 }, { 32767, 32683, 7070 }, { 32767, 32641, 7103 },
+        { -22978, 32641, -26201 }, { -22978, 18611, -23248 }, { -22978, 8201, -21087 }, { -22978, 473, -19514 },
+        { -22978, -5525, -18219 }, { 0, -5525, -6190 }, { 0, -4167, -6462 }, { 0, -3113, -6685 },
+        { 0, -2388, -6815 }, { 0, -1858, -6898 }, { 0, -1421, -6978 }, { 0, -878, -7164 },
+        { 0, -536, -7282 }, { 0, -239, -7408 }, { 0, -54, -7495 }, { 0, 115, -7591 },
+        { 32767, 115, 11982 }, { 32767, 8291, 10284 }, { 32767, 14523, 8949 }, { 32767, 19130, 7978 },
+        { 32767, 22570, 7253 }, { 9593, 22570, -5601 }, { 9593, 19394, -4970 }, { 9593, 17070, -4538 },
+        { -31094, 17070, -29585 }, { -31094, 4847, -26983 }, { -31094, -3965, -25227 }, { -31094, -10836, -23770 },
+        { -31094, -16044, -22635 }, { -31094, -19747, -21892 }, { -31094, -22389, -21421 }, { -31094, -24656, -20916 },
+        { -31094, -26144, -20656 }, { -31094, -27228, -20491 }, { -13788, -27228, -10526 }, { -13788, -23928, -11185 },
+        { -13788, -21491, -11652 }, { -13788, -32768, -4160 }, { -13788, -27958, -5181 }, { -13788, -24306, -5980 },
+        { -13788, -21815, -6441 }, { -13788, -19705, -6919 }, { -13788, -18424, -7106 }, { -13788, -17393, -7270 },
+        { -13788, -16312, -7564 }, { -13788, -15603, -7741 }, { 21794, -15603, 13702 }, { 21794, -6284, 11785 },
+        { 21794, 772, 10309 }, { 21794, 5988, 9245 }, { 32767, 5988, 17347 }, { 32767, 12579, 16023 },
+        { 32767, 17456, 15079 }, { 32767, 21434, 14197 }, { 32767, 24195, 13654 }, { 32767, 26146, 13325 },
+        { 32767, 27878, 12936 }, { 32767, 28902, 12802 }, { -32768, 28902, -25988 }, { -32768, 13292, -22681 },
+        { -32768, 32767, -32768 }, { -32768, 16486, -32768 }, { -32768, 4286, -32768 }, { -32768, -4815, -31186 },
+        { -32768, -11725, -29786 }, { -32768, -17001, -28688 }, { -32768, -20884, -27907 }, { 11077, -20884, -2863 },
+        { 8944, -20884, -1017 }, { 8944, -13401, -2576 }, { 8944, -7924, -3667 }, { 8944, -3620, -4592 },
+        { 8944, -654, -5138 }, { 8944, 1553, -5520 }, { 8944, 3316, -5852 }, { 8944, 4909, -6254 },
+        { 8944, 5993, -6508 }, { 8944, 6753, -6674 }, { 8944, 7376, -6832 }, { 8944, 7625, -6828 },
+        { 0, 7625, -12045 }, { 0, 0, -8232 }, { 0, 162, -8329 }, { 0, 248, -8396 },
+        { 0, 242, -8417 }, { 0, 144, -8382 }, { 14350, 144, 180 }, { 14350, 3652, -529 },
+        { 14350, 32767, -16885 }, { 14350, 28173, -15938 }, { 14350, 24697, -15210 }, { 14350, 22039, -14632 },
+        { 14350, 20009, -14170 }, { 14350, 18459, -13796 }, { 14350, 17587, -13676 }, { 14350, 16726, -13478 },
+        { 14544, 16726, -13594 }, { 14544, 16228, -13509 }, { 14544, 15846, -13445 }, { 14544, 15506, -13369 },
+        { 14544, 15438, -13423 }, { 14544, 15077, -13294 }, { 14544, 14875, -13226 }, { 14544, 14879, -13260 },
+        { 14544, 14916, -13315 }, { 14544, 14989, -13395 }, { -2188, 14989, -23438 }, { -2188, 10646, -22520 },
+        { -2188, 7391, -21828 }, { -2188, 5185, -21445 }, { -2188, 3359, -21074 }, { -2188, 2145, -20890 },
+        { -2188, 1232, -20768 }, { -21281, 1232, -32513 }, { -21281, -4217, -31455 }, { -21281, -8361, -30644 },
+        { -21281, -11671, -29928 }, { -21281, -14073, -29431 }, { -21281, -15750, -29132 }, { -21281, -16963, -28947 },
+    },
+    {
+        { -27, 0, -24 }, { -27, 0, -26 }, { -27, -205, 233 }, { -32768, -205, -27949 },
+        { -32768, -8513, -18018 }, { -32768, -14486, -14189 }, { -32768, -18914, -11276 }, { -32768, -22239, -9065 },
+        { -32768, -24790, -7341 }, { -32768, -26892, -5845 }, { -32768, -26892, -6682 }, { -32768, -28244, -5066 },
+        { -32768, -29423, -4196 }, { -32768, -30444, -3445 }, { -32768, -30853, -3363 }, { -32768, 0, -32768 },
+        { -32768, 0, -28112 }, { -32768, -8088, -18444 }, { -32768, -14114, -14464 }, { -32768, -18769, -11301 },
+        { -32768, -22423, -8788 }, { -32768, -25104, -7039 }, { -32768, -27065, -5763 }, { -32768, -28348, -5011 },
+        { -32768, -29409, -4254 }, { -32768, -30078, -3877 }, { -32768, -30726, -3369 }, { -32768, -31221, -3036 },
+        { -32768, -31737, -2616 }, { -32768, -32155, -2322 }, { -32768, -32235, -2393 }, { -32768, -32187, -2482 },
+        { 7350, -32187, 32440 }, { 7350, -22150, 21509 }, { 7350, -14817, 16743 }, { 7350, -9087, 12815 },
+        { 7350, -4894, 10086 }, { 7350, -1715, 7957 }, { 7350, 386, 6712 }, { 7350, 2148, 5443 },
+        { 7350, 3552, 4467 }, { -15842, 3552, -14894 }, { -15842, -1390, -10059 }, { -15842, -5056, -8447 },
+        { -15842, -7596, -7484 }, { -15842, 32767, -32768 }, { -15842, 20619, -26215 }, { 14864, 20619, -6586 },
+        { 14864, 19148, -4828 }, { -32768, 19148, -32768 }, { 24825, 19148, 2945 }, { 24825, 20467, 1692 },
+        { 24825, 21367, 1398 }, { 24825, 22261, 879 }, { 24825, 22712, 853 }, { 24825, 23133, 655 },
+        { 24825, 23745, 171 }, { 24825, 23988, 187 }, { 24825, 24222, 48 }, { 24825, 24467, -125 },
+        { 24825, 24636, -215 }, { 24825, 24679, -188 }, { 24825, 24632, -101 }, { -4847, 24632, -25491 },
+        { -4847, 17397, -16843 }, { -4847, 11703, -12920 }, { 32767, 11703, 16349 }, { 7382, 11703, -4201 },
+        { 7382, 10516, -3014 }, { 7382, 9762, -2763 }, { 7382, 9299, -2652 }, { 7382, 8942, -2526 },
+        { 7382, 8613, -2366 }, { 7382, 8486, -2427 }, { 7382, 8042, -1996 }, { 7382, 7725, -1819 },
+        { 7382, 7792, -2056 }, { 7382, 7609, -1828 }, { 7382, 7546, -1837 }, { 7382, 7490, -1804 },
+        { 7382, 7393, -1711 }, { 7382, 7467, -1844 }, { 7382, 7247, -1542 }, { 7382, -32768, 32767 },
+        { 7382, -32768, 32767 }, { 7382, -22640, 21888 }, { 7382, -15079, 16886 }, { 7382, -9455, 13176 },
+        { 7382, -5423, 10597 }, { 0, -5423, 6321 }, { 0, -3899, 4500 }, { 0, -2856, 3860 },
+        { 32767, -2856, 30387 }, { 32767, 6097, 19685 }, { 32767, 12768, 15279 }, { 32767, 17883, 11823 },
+        { 32767, 21708, 9289 }, { 32767, 24354, 7650 }, { 32767, 26503, 6135 }, { 32767, 28183, 4984 },
+        { 32767, 29477, 4106 }, { 32767, 30495, 3405 }, { 32767, 30495, 3811 }, { 32767, 30959, 3256 },
+        { 32767, 31318, 3012 }, { 32767, 31576, 2846 }, { 32767, 31987, 2458 }, { 11379, 31987, -15951 },
+        { 11379, 26637, -10689 }, { 11379, 23015, -9355 }, { 7469, 23015, -14388 }, { 7469, 18932, -9508 },
+        { 7469, 16220, -7893 }, { 7469, -32768, 32767 }, { 7469, -32768, 32767 }, { 8737, -32768, 32767 },
+        { 8737, -22220, 22466 }, { 8737, -14532, 17479 }, { 8737, -8839, 13738 }, { 8737, -4373, 10668 },
+        { 8737, -947, 8352 }, { 8737, 1276, 7060 }, { 8737, 2977, 5912 }, { 8737, 4359, 4938 },
+        { 8737, 5640, 3958 }, { 8737, 6227, 3766 }, { 8737, 7000, 3076 }, { 8737, 7603, 2663 },
+    },
+    {
+        { 21894, -1276, 32767 }, { 21894, 4378, 32767 }, { 21894, 8861, 26222 }, { 21894, 12300, 19739 },
+        { 21894, 14642, 15416 }, { -29469, 14642, -32768 }, { -29469, 3564, -32768 }, { -29469, -4607, -32768 },
+        { -29469, -10693, -32768 }, { -29469, -15371, -27164 }, { -29469, -18992, -20133 }, { 14919, -18992, 32767 },
+        { 14919, -10422, 32767 }, { 14919, -3897, 32767 }, { 14919, 810, 29181 }, { 14919, 4486, 22238 },
+        { 14919, 6954, 17698 }, { -9190, 6954, -30344 }, { -9190, 2871, -21600 }, { -9190, -122, -16008 },
+        { -9190, -2298, -11953 }, { -9190, -3867, -9040 }, { -9190, -5340, -6189 }, { -9190, -6386, -4236 },
+        { -9190, -7190, -2716 }, { -9190, -32768, 32767 }, { -13521, -32768, 32767 }, { -13521, -28130, 30540 },
+        { -13521, -24368, 23402 }, { -13521, -21485, 17967 }, { -13521, -19662, 14652 }, { -13521, -18052, 11563 },
+        { 31407, -18052, 32767 }, { -23349, -18052, -7697 }, { -23349, -19398, -4814 }, { -23349, -20436, -2857 },
+        { -23349, -21047, -1765 }, { 15282, -21047, 32767 }, { 15282, -11828, 32767 }, { 15282, -5079, 32767 },
+        { 15282, -157, 32767 }, { 15282, 3666, 25470 }, { 15282, 6644, 19683 }, { 15282, 0, 32767 },
+        { 15282, 3791, 25227 }, { 15282, 6610, 19782 }, { 13195, 6610, 16170 }, { 13195, 8097, 12900 },
+        { 13195, 9189, 10794 }, { 23036, 9189, 30694 }, { 23036, 12500, 23412 }, { 26747, 12500, 31494 },
+        { 26747, 16104, 23568 }, { 26747, 18592, 18814 }, { 0, 18592, -32768 }, { 28933, 18592, 23521 },
+        { 28933, 21279, 17761 }, { 28933, 23006, 14510 }, { 28933, 24457, 11663 }, { 28933, 25487, 9687 },
+        { 28933, 26374, 7941 }, { 28933, 26995, 6752 }, { 28933, 27517, 5728 }, { 28933, 27843, 5115 },
+        { 28933, 28124, 4562 }, { 28933, 28513, 3763 }, { 28933, 28604, 3640 }, { 28933, 28712, 3420 },
+        { 28933, 28804, 3240 }, { 28933, 28937, 2965 }, { 28933, 28803, 3287 }, { 28933, 29028, 2763 },
+        { 3891, 29028, -32768 }, { 3891, 22681, -32768 }, { -25272, 22681, -32768 }, { -25272, 10838, -32768 },
+        { -25272, 1914, -32768 }, { -25272, -4770, -32768 }, { -25272, -9910, -29600 }, { -25272, -13692, -22307 },
+        { -3808, -13692, 20061 }, { -28050, -13692, -28616 }, { -28050, -32768, 13428 }, { -28050, -31511, 6931 },
+        { -28050, -30719, 5492 }, { -28050, -30097, 4322 }, { -28050, -29587, 3354 }, { -28050, -29353, 2967 },
+        { -28050, 32767, -32768 }, { -28050, 17384, -32768 }, { -28050, 6197, -32768 }, { -28050, -2563, -32768 },
+        { -28050, 32767, -32768 }, { -28050, 17697, -32768 }, { -28050, 6444, -32768 }, { -28050, -2071, -32768 },
+        { -28050, -8560, -32768 }, { -28050, -13385, -28269 }, { -28050, -17165, -20917 }, { -28050, -20018, -15396 },
+        { 26646, -20018, 32767 }, { -13378, -20018, 14421 }, { -13378, -18481, 11141 }, { -13378, -17387, 9119 },
+        { -13378, -16373, 7166 }, { -13378, -15785, 6121 }, { -13378, -15143, 4861 }, { -13378, -32768, 32767 },
+        { 0, -32768, 32767 }, { 0, -24647, 32767 }, { 0, -18317, 32767 }, { 0, -13560, 29172 },
+        { 32767, -13560, 32767 }, { 23183, -13560, 32767 }, { 23183, -4249, 32767 }, { 23183, 32767, -22883 },
+        { 23183, 30283, -11031 }, { 23183, 28446, -7589 }, { 23183, 27183, -5255 }, { 23183, 26280, -3581 },
+        { 5358, 26280, -32768 }, { 21974, 26280, -6672 }, { 21974, 25010, -3938 }, { 21974, 24222, -2502 },
+        { 21974, 23464, -1021 }, { 21974, 23183, -578 }, { 21974, 22685, 447 }, { 21974, 22324, 1135 },
+    },
+    {
+        { 1544, 1545, -255 }, { 1544, 1543, 255 }, { 1544, 1672, -32640 }, { 1544, 1491, 13515 },
+        { 1544, 1476, 17340 }, { 1544, 1661, -29835 }, { 1544, 1507, 9435 }, { 1544, 1579, -8925 },
+        { 1544, 1481, 16065 }, { 1544, 1515, 7395 }, { 1544, 1635, -23205 }, { -16267, 1635, -32768 },
+        { -16267, -3038, -32768 }, { -16267, -6514, -32768 }, { -16267, -9054, -32768 }, { -16267, -11042, -32768 },
+        { -16267, -12434, -32768 }, { -16267, -13496, -32768 }, { -16267, -14055, -32768 }, { -16267, -14646, -32768 },
+        { -16267, -14944, -32768 }, { -16267, -15426, -32768 }, { -16267, -15652, -32768 }, { -16267, -15797, -32768 },
+        { -16267, -15897, -32768 }, { -16267, -15887, -32768 }, { -16267, -16020, -32768 }, { -16267, -15893, -32768 },
+        { -16267, -16117, -32768 }, { -16267, -16141, -32130 }, { -16267, -16185, -20910 }, { -16267, -16283, 4080 },
+        { 19854, -16283, -32768 }, { 19854, -7408, 32767 }, { 32097, -7408, -32768 }, { 32097, 2404, 32767 },
+        { 32097, 9681, 32767 }, { 32097, 15225, 32767 }, { 32097, 19299, 32767 }, { 22401, 19299, 32767 },
+        { 22401, 20129, 32767 }, { 31075, 20129, 32767 }, { 31075, 32767, -32768 }, { 31075, 32486, -32768 },
+        { -11877, 32486, 32767 }, { 5181, 32486, -32768 }, { 5181, 25505, -32768 }, { 5181, 20372, -32768 },
+        { 5181, 16704, -32768 }, { 5181, 13714, -32768 }, { 5181, 11422, -32768 }, { 5181, 9693, -32768 },
+        { -9050, 9693, -32768 }, { -21464, 9693, -32768 }, { -21464, 1770, -32768 }, { -21464, -3860, -32768 },
+        { -21464, -8428, -32768 }, { -21464, 32767, 32767 }, { -21464, 19210, 32767 }, { -21464, 32767, 32767 },
+        { -21464, 19230, 32767 }, { -21464, 9247, -32768 }, { -21464, 1571, -32768 }, { -21464, -4139, -32768 },
+        { -21464, -8424, -32768 }, { -21464, -11570, -32768 }, { -21464, -14086, -32768 }, { -21464, -15948, -32768 },
+        { 19070, -15948, -32768 }, { 19070, -7151, 32767 }, { 19070, -600, 32767 }, { 19070, 4495, 32767 },
+        { 19070, 8047, 32767 }, { 19070, 10984, 32767 }, { -32768, 10984, 32767 }, { -32768, 15, -32768 },
+        { -32768, -8163, -32768 }, { 12579, -8163, 32767 }, { 12579, -3132, 32767 }, { 12579, 0, 32767 },
+        { 12579, 3199, 32767 }, { 12579, 5467, 32767 }, { 12579, 7085, 32767 }, { 12579, 8340, 32767 },
+        { 12579, 9500, 32767 }, { 12579, 10223, 32767 }, { 12579, 10715, 32767 }, { 12579, 11072, 32767 },
+        { -1308, 11072, -32768 }, { -1308, 7787, -32768 }, { -1308, 5348, -32768 }, { -1308, 3788, -32768 },
+        { -1308, 2684, -32768 }, { -1308, 1783, -32768 }, { -1308, 890, -32768 }, { -1308, 170, -32768 },
+        { -1308, -238, -32768 }, { -1308, -405, -32768 }, { -1308, -577, -32768 }, { -1308, -579, -32768 },
+        { 30703, -579, 32767 }, { 30703, 7331, 32767 }, { 30703, 13000, 32767 }, { 30703, 17621, 32767 },
+        { 30703, 20737, 32767 }, { 30703, 23145, 32767 }, { 30703, 25005, 32767 }, { 30703, 26285, 32767 },
+        { 30703, 27567, 32767 }, { 30703, 28499, 32767 }, { 0, 28499, -32768 }, { 0, 21220, -32768 },
+        { 0, 16076, -32768 }, { 0, 11931, -32768 }, { 0, 9068, -32768 }, { 0, 6647, -32768 },
+        { 0, 5180, -32768 }, { 0, 4053, -32768 }, { 0, 2855, -32768 }, { 0, 2160, -32768 },
+        { 0, 1610, -32768 }, { 0, 1143, -32768 }, { 0, 675, -32768 }, { 0, 698, -32768 },
+        { 0, 363, -32768 }, { -3480, 363, -32768 }, { -3480, -554, -32768 }, { -3480, -1468, -32768 },
+    },
+    {
+        { 601, 722, 0 }, { 601, 504, 4095 }, { 601, 604, 0 }, { 601, 717, 0 },
+        { 601, 770, 0 }, { 601, 897, 0 }, { 601, 631, 4095 }, { 601, 627, 33 },
+        { 601, 450, 4095 }, { 601, 563, 0 }, { -28998, 563, 0 }, { -28998, -6969, 4095 },
+        { -28998, -12449, 4095 }, { -28998, -16433, 4095 }, { -28998, -19573, 4095 }, { -28998, -21789, 4095 },
+        { -28998, -23454, 4095 }, { -28998, -25023, 4095 }, { -28998, -25830, 4095 }, { -28998, -26622, 4095 },
+        { -28998, -27164, 2169 }, { -28998, -27602, 0 }, { -28998, -27798, 0 }, { -28998, -28295, 832 },
+        { -28998, -28648, 0 }, { 32767, -28648, 437 }, { 16843, -28648, 3324 }, { 16843, -17247, 0 },
+        { 16843, -8782, 0 }, { 11716, -8782, 4095 }, { 11716, -3466, 0 }, { 11716, 206, 0 },
+        { 11716, 3118, 0 }, { 11716, 5351, 0 }, { 11716, 6945, 0 }, { 11716, 8219, 0 },
+        { 11716, 32767, 0 }, { 11716, 27467, 4095 }, { 11716, 23672, 4095 }, { 11716, 20560, 4095 },
+        { -3648, 20560, 1237 }, { -3648, 14359, 4095 }, { -3648, 9944, 4095 }, { -3648, 32767, 0 },
+        { -3648, 23514, 4095 }, { -3648, 16806, 4095 }, { 32767, 16806, 0 }, { 32767, 20608, 0 },
+        { 32767, 23844, 0 }, { 32767, 26039, 0 }, { 32767, 27871, 0 }, { 32767, 29144, 0 },
+        { 32767, 30053, 0 }, { 32767, 30854, 0 }, { 32767, 31357, 0 }, { -32700, 31357, 0 },
+        { -24371, 31357, 0 }, { -24371, 17410, 4095 }, { -24371, 7021, 4095 }, { -24371, -907, 4095 },
+        { -24371, -6883, 4095 }, { -24371, -11359, 4095 }, { -24371, -14525, 4095 }, { -24371, -16930, 4095 },
+        { -24371, -18592, 4095 }, { -24371, -20213, 4095 }, { 22201, -20213, 0 }, { -26962, -20213, 0 },
+        { -26962, -22037, 4095 }, { -26962, -23161, 1592 }, { -26962, -23999, 0 }, { -26962, -24868, 0 },
+        { -26962, -25299, 0 }, { -26962, -25686, 0 }, { -26962, -25994, 0 }, { -26962, -26141, 0 },
+        { -26962, -26383, 0 }, { -26962, -26527, 0 }, { -26962, -26819, 0 }, { -26962, -26838, 0 },
+        { -26962, -26830, 0 }, { -26962, -27011, 0 }, { -26962, -27074, 0 }, { 26472, -27074, 0 },
+        { 26472, -13537, 0 }, { 26472, -3703, 0 }, { 0, -3703, 0 }, { 0, 32767, 0 },
+        { 0, 24452, 4095 }, { 0, 18437, 4095 }, { 0, 13725, 4095 }, { 0, 10364, 4095 },
+        { -13475, 10364, 0 }, { -13475, 4423, 4095 }, { -13475, -36, 4095 }, { -13475, -3321, 4095 },
+        { -13475, -5715, 4095 }, { -32768, -5715, 0 }, { 9341, -5715, 0 }, { 9341, -1772, 0 },
+        { 30743, -1772, 0 }, { 30743, 6181, 0 }, { 30743, 12483, 0 }, { 30743, 16870, 0 },
+        { 30743, 20220, 0 }, { 30743, 23045, 0 }, { 30743, 25136, 0 }, { 30743, 26673, 0 },
+        { 30743, 27598, 0 }, { 30743, 28462, 0 }, { 30743, -32768, 4095 }, { 30743, -16707, 0 },
+        { 30743, -4685, 0 }, { 30743, 3992, 0 }, { 30743, 10829, 0 }, { 30743, 15703, 0 },
+        { 30743, 19378, 0 }, { -32768, 19378, 0 }, { -32768, 6408, 4095 }, { -32768, -3324, 4095 },
+        { -32768, -10842, 4095 }, { -32768, -16425, 4095 }, { -32768, -20561, 4095 }, { -32768, -20561, 0 },
+        { 3708, -20561, 0 }, { 3708, -14662, 0 }, { 29725, -14662, 0 }, { 29725, -3460, 0 },
+    },
+    {
+        { -591, -656, 255 }, { -591, -32768, 255 }, { -591, -24736, 255 }, { -591, -18684, 255 },
+        { -591, -14196, 255 }, { -591, -10962, 255 }, { -591, -8328, 255 }, { -591, -6463, 255 },
+        { -591, -5003, 255 }, { -591, -4092, 255 }, { -591, -3114, 255 }, { -591, -2392, 255 },
+        { -591, -1990, 255 }, { -591, -1678, 255 }, { -32768, -1678, -128 }, { 0, -1678, 255 },
+        { 0, -1177, 255 }, { 0, -892, 255 }, { 0, -540, 255 }, { 0, -242, 255 },
+        { 0, -129, 255 }, { 12268, -129, 255 }, { 12268, 2791, 255 }, { 12268, 5071, 255 },
+        { 12268, 6885, 255 }, { 12268, 8058, 255 }, { 12268, 9185, 255 }, { 12268, 9877, 255 },
+        { 12268, 10523, 255 }, { 12268, 10966, 255 }, { 12268, 11474, 255 }, { 12268, 11678, 255 },
+        { 12268, 11823, 255 }, { 12268, 12059, 255 }, { 12268, 12037, 255 }, { 12268, 12002, 255 },
+        { 12268, 11871, 255 }, { 12268, 12094, 255 }, { 12268, 11964, 255 }, { -8121, 11964, -128 },
+        { -8121, 6894, -128 }, { -8121, 3022, -128 }, { -8121, -32768, 255 }, { -8121, -26574, 255 },
+        { -10135, -26574, 255 }, { -10135, -22514, 255 }, { -10135, -19265, 255 }, { 25580, -19265, 255 },
+        { 25580, -8007, 255 }, { 25580, 469, 255 }, { 25580, 6770, 255 }, { 25580, 11588, 255 },
+        { 25580, 15144, 255 }, { 25580, 17610, 255 }, { 25580, 19441, 255 }, { 25580, 21162, 255 },
+        { 25580, 22077, 255 }, { 18496, 22077, -128 }, { 18496, 21087, -128 }, { 18496, 20500, -128 },
+        { 18496, 20056, -128 }, { 18496, 19736, -128 }, { 18496, 19586, -128 }, { 18496, 19141, -128 },
+        { 18496, 18884, -128 }, { 18496, 18976, -128 }, { 18496, 18750, -128 }, { 18496, 18764, -128 },
+        { 18496, 18751, -128 }, { 18496, 18612, -128 }, { 3984, 18612, -128 }, { 3984, 15048, -128 },
+        { 3984, 12083, -128 }, { 3984, 10132, -128 }, { 3984, 8436, -128 }, { 3984, 7405, -128 },
+        { 3984, 6533, -128 }, { 3984, 6012, -128 }, { 3984, 5632, -128 }, { 3984, 5166, -128 },
+        { 3984, 5027, -128 }, { 3984, 4965, -128 }, { 3984, 4913, -128 }, { 3984, 4635, -128 },
+        { 30627, 4635, 255 }, { 30627, 11061, 255 }, { 30627, 16088, 255 }, { 30627, 0, 255 },
+        { 30627, 7845, 255 }, { 30627, 13511, 255 }, { 30627, 17909, 255 }, { 30627, 21275, 255 },
+        { 30627, 23533, 255 }, { 30627, 25461, 255 }, { 25438, 25461, 23 }, { 25438, 25521, -128 },
+        { 25438, 25569, -128 }, { 25438, 25380, 255 }, { 25438, 25303, 255 }, { 25438, 25302, 255 },
+        { -8057, 25302, -128 }, { -8057, 16958, -128 }, { -8057, 10763, -128 }, { -8057, 6130, -128 },
+        { -8057, 2540, -128 }, { 9548, 2540, 255 }, { 9548, 4384, 255 }, { -26766, 4384, -128 },
+        { -26766, -3510, -128 }, { -26766, -9170, -128 }, { -26766, -13499, -128 }, { -26766, -16909, -128 },
+        { -26766, -19181, -128 }, { -26766, -20943, -128 }, { -26766, -22246, -128 }, { -25795, -22246, -128 },
+        { -25795, -22994, -128 }, { -25795, -23600, -128 }, { 32767, -23600, 255 }, { 32767, 32767, -128 },
+        { 32767, 32729, 255 }, { 32767, 32767, 62 }, { 32767, 32686, 255 }, { 32767, 32594, 255 },
+        { 32767, 32513, 255 }, { 32767, 32688, 185 }, { -8591, 32688, -128 }, { -8591, 22481, -128 },
+    },
+    {
+        { -1199, -1058, 0 }, { -1199, -1193, 0 }, { -1199, -1249, 0 }, { -1199, -1300, 0 },
+        { -1199, -1163, 0 }, { -1199, -1347, 0 }, { -1199, -1126, 0 }, { -1199, -1255, 0 },
+        { -1199, -1309, 0 }, { -1199, -1199, 0 }, { -1199, -1310, 0 }, { -1199, -1133, 0 },
+        { -1199, -1289, 0 }, { -1199, -1375, 0 }, { -1199, -1375, 0 }, { -1199, -1172, 0 },
+        { 7876, -1172, 0 }, { 7876, 1227, 0 }, { 7876, 2972, 0 }, { 7876, 4195, 0 },
+        { 7876, 5018, 0 }, { 7876, 5821, 0 }, { 7876, 6330, 0 }, { 7876, 6861, 0 },
+        { 7876, 7027, 0 }, { 32767, 7027, 0 }, { -18024, 7027, 0 }, { -18024, 661, 0 },
+        { -18024, -3950, 0 }, { -18024, -7351, 0 }, { -18024, -10032, 0 }, { -18024, -12171, 0 },
+        { -18024, -13466, 0 }, { -18024, -14719, 0 }, { 32767, -14719, 0 }, { 32767, -3041, 0 },
+        { 32767, 5747, 0 }, { 32767, 12347, 0 }, { 32767, 17617, 0 }, { 32767, 21312, 0 },
+        { 32767, 24135, 0 }, { 24840, 24135, 0 }, { 24840, -32768, 0 }, { 24840, -18315, 0 },
+        { 24840, -7362, 0 }, { 24840, 547, 0 }, { 24840, 6559, 0 }, { 24840, 11008, 0 },
+        { 24840, 14384, 0 }, { -19673, 14384, 0 }, { -19673, 32767, 0 }, { -1834, 32767, 0 },
+        { -1834, 24109, 0 }, { -1834, 17646, 0 }, { -1834, 12578, 0 }, { -1834, 9134, 0 },
+        { -1834, 6241, 0 }, { -1834, 4321, 0 }, { -1834, 2965, 0 }, { -1834, 1857, 0 },
+        { -1834, 847, 0 }, { -1834, 320, 0 }, { -1834, -65, 0 }, { -1834, -483, 0 },
+        { 8243, -483, 0 }, { 8243, 1625, 0 }, { 8243, 32767, 0 }, { 8243, 26764, 0 },
+        { 8243, 22112, 0 }, { 8243, 18754, 0 }, { 8243, 16047, 0 }, { 8243, 14252, 0 },
+        { 8243, 12799, 0 }, { 8243, 11558, 0 }, { 8243, 10534, 0 }, { 0, 10534, 0 },
+        { 0, 10534, 0 }, { 0, 7997, 0 }, { 0, 6184, 0 }, { 0, 4537, 0 },
+        { 0, 3401, 0 }, { 0, 2401, 0 }, { 0, 1673, 0 }, { 0, 1072, 0 },
+        { 0, 883, 0 }, { 0, 829, 0 }, { 0, 651, 0 }, { 0, 0, 0 },
+        { 0, 84, 0 }, { 0, 214, 0 }, { 0, 218, 0 }, { 0, 103, 0 },
+        { -6427, 103, 0 }, { -6427, -1400, 0 }, { -6427, -2519, 0 }, { -11682, -2519, 0 },
+        { -11682, 32767, 0 }, { -11682, 21574, 0 }, { -11682, 13248, 0 }, { -11682, 6858, 0 },
+        { -11682, 2126, 0 }, { -11682, -1480, 0 }, { -11682, -3956, 0 }, { -11682, -5756, 0 },
+        { -11682, -7143, 0 }, { -11682, -8137, 0 }, { -11682, -8959, 0 }, { -11682, -9450, 0 },
+        { 32767, -9450, 0 }, { 0, -9450, 0 }, { 0, -7136, 0 }, { 0, -5218, 0 },
+        { 0, -3872, 0 }, { 0, -2867, 0 }, { 0, 0, 0 }, { 0, 2, 0 },
+        { 0, 32, 0 }, { 0, 141, 0 }, { 0, -84, 0 }, { 0, -169, 0 },
+        { 0, -32768, 0 }, { 0, -24542, 0 }, { 0, -18320, 0 }, { 0, -13549, 0 },
+        { 29923, -13549, 0 }, { 29923, -2504, 0 }, { 32767, -2504, 0 }, { 32767, 6421, 0 },
+    },
+};
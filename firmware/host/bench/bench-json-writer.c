@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/utils/json-writer.h"
+
+// 生成一个 doser.status 那样大小的 JSON-RPC 响应，对比原来的 cJSON 建树再 cJSON_PrintPreallocated() 和 JsonWriter
+// 直接写发送缓冲区的耗时和堆分配，分配通过 cJSON_InitHooks() 统计
+// 只是在 PC 上比较两种写法的相对快慢，ESP32 上的绝对耗时要在设备上测
+// 用法：bench-json-writer [响应个数]
+
+#define DEFAULT_RESPONSES 1000000
+#define TX_BUF_SIZE (1024 * 8)
+#define CHANNELS_COUNT 4
+
+typedef struct {
+    const char* name;
+    double speed;
+    int duty;
+    double effective_speed;
+    bool is_calibrated;
+    bool is_busy;
+    int completed_count;
+    int queue_depth;
+} BenchChannel;
+
+static const BenchChannel CHANNELS[CHANNELS_COUNT] = {
+    { "P1", 12.0, 100, 12.0, true, false, 318, 0 },
+    { "P2", 12.5, 80, 10.0, false, true, 97, 1 },
+    { "P3", 24.0, 100, 24.0, false, false, 1412, 0 },
+    { "P4", 6.25, 60, 3.75, true, false, 1468, 2 },
+};
+
+static size_t s_alloc_count = 0;
+static size_t s_alloc_bytes = 0;
+
+static char s_cjson_buf[TX_BUF_SIZE];
+static char s_writer_buf[TX_BUF_SIZE];
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void* counting_malloc(size_t size)
+{
+    s_alloc_count++;
+    s_alloc_bytes += size;
+    return malloc(size);
+}
+
+/**
+ * 改成 JsonWriter 之前 rpc.c 的做法：结果和外层都建成 cJSON 树，打印到发送缓冲区再量长度
+ */
+static size_t build_with_cjson(uint64_t id, char* buf)
+{
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddStringToObject(root, "jsonrpc", "2.0");
+    cJSON_AddNumberToObject(root, "id", (double)id);
+
+    cJSON* result = cJSON_CreateObject();
+    cJSON_AddBoolToObject(result, "powered", true);
+    cJSON_AddNumberToObject(result, "timestamp", 1704067200.0 + (double)id);
+    cJSON_AddNumberToObject(result, "maxRunning", 2);
+    cJSON* channels = cJSON_CreateArray();
+    for (size_t i = 0; i < CHANNELS_COUNT; i++) {
+        const BenchChannel* ch = &CHANNELS[i];
+        cJSON* item = cJSON_CreateObject();
+        cJSON_AddStringToObject(item, "name", ch->name);
+        cJSON_AddNumberToObject(item, "speed", ch->speed);
+        cJSON_AddNumberToObject(item, "duty", ch->duty);
+        cJSON_AddNumberToObject(item, "effectiveSpeed", ch->effective_speed);
+        cJSON_AddBoolToObject(item, "isCalibrated", ch->is_calibrated);
+        cJSON_AddBoolToObject(item, "isBusy", ch->is_busy);
+        cJSON_AddNumberToObject(item, "completedCount", ch->completed_count);
+        cJSON_AddNumberToObject(item, "queueDepth", ch->queue_depth);
+        cJSON_AddItemToArray(channels, item);
+    }
+    cJSON_AddItemToObject(result, "channels", channels);
+    cJSON_AddItemToObject(root, "result", result);
+
+    cJSON_PrintPreallocated(root, buf, TX_BUF_SIZE, 0);
+    cJSON_Delete(root);
+    return strnlen(buf, TX_BUF_SIZE);
+}
+
+static size_t build_with_writer(uint64_t id, char* buf)
+{
+    JsonWriter writer;
+    JsonWriter_init(&writer, buf, TX_BUF_SIZE);
+    JsonWriter_begin_object(&writer);
+    JsonWriter_add_string(&writer, "jsonrpc", "2.0");
+    JsonWriter_key(&writer, "id");
+    JsonWriter_uint(&writer, id);
+
+    JsonWriter_key(&writer, "result");
+    JsonWriter_begin_object(&writer);
+    JsonWriter_add_bool(&writer, "powered", true);
+    JsonWriter_add_int(&writer, "timestamp", 1704067200LL + (int64_t)id);
+    JsonWriter_add_int(&writer, "maxRunning", 2);
+    JsonWriter_key(&writer, "channels");
+    JsonWriter_begin_array(&writer);
+    for (size_t i = 0; i < CHANNELS_COUNT; i++) {
+        const BenchChannel* ch = &CHANNELS[i];
+        JsonWriter_begin_object(&writer);
+        JsonWriter_add_string(&writer, "name", ch->name);
+        JsonWriter_add_double(&writer, "speed", ch->speed);
+        JsonWriter_add_int(&writer, "duty", ch->duty);
+        JsonWriter_add_double(&writer, "effectiveSpeed", ch->effective_speed);
+        JsonWriter_add_bool(&writer, "isCalibrated", ch->is_calibrated);
+        JsonWriter_add_bool(&writer, "isBusy", ch->is_busy);
+        JsonWriter_add_int(&writer, "completedCount", ch->completed_count);
+        JsonWriter_add_int(&writer, "queueDepth", ch->queue_depth);
+        JsonWriter_end_object(&writer);
+    }
+    JsonWriter_end_array(&writer);
+    JsonWriter_end_object(&writer);
+
+    JsonWriter_end_object(&writer);
+    return JsonWriter_has_error(&writer) ? 0 : JsonWriter_size(&writer);
+}
+
+int main(int argc, char* argv[])
+{
+    long responses = argc > 1 ? atol(argv[1]) : DEFAULT_RESPONSES;
+
+    cJSON_Hooks hooks = { .malloc_fn = &counting_malloc, .free_fn = &free };
+    cJSON_InitHooks(&hooks);
+
+    size_t cjson_size = 0;
+    double begin = now_ns();
+    for (long i = 0; i < responses; i++) {
+        cjson_size = build_with_cjson((uint64_t)i, s_cjson_buf);
+    }
+    double cjson_ns = (now_ns() - begin) / (double)responses;
+    size_t cjson_count = s_alloc_count;
+    size_t cjson_bytes = s_alloc_bytes;
+
+    s_alloc_count = 0;
+    s_alloc_bytes = 0;
+    size_t writer_size = 0;
+    begin = now_ns();
+    for (long i = 0; i < responses; i++) {
+        writer_size = build_with_writer((uint64_t)i, s_writer_buf);
+    }
+    double writer_ns = (now_ns() - begin) / (double)responses;
+
+    printf("%ld responses of %u bytes\n", responses, (unsigned)writer_size);
+    printf("cJSON:      %8.1f ns/response, %5.1f allocations/response, %7.1f bytes allocated/response\n", cjson_ns,
+        (double)cjson_count / responses, (double)cjson_bytes / responses);
+    printf("JsonWriter: %8.1f ns/response, %5.1f allocations/response, %7.1f bytes allocated/response\n", writer_ns,
+        (double)s_alloc_count / responses, (double)s_alloc_bytes / responses);
+    // 两种写法的输出不一样的话，基准的数字也就没有意义了
+    if (responses > 0 && (cjson_size != writer_size || memcmp(s_cjson_buf, s_writer_buf, writer_size) != 0)) {
+        printf("Output mismatch:\n  %.*s\n  %.*s\n", (int)cjson_size, s_cjson_buf, (int)writer_size, s_writer_buf);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "borneo/common.h"
+#include "borneo/pid.h"
+
+// FastPid_step() 逐个计算和 FastPidBank_step() 一起计算的耗时对比，输入和流量控制一样是每个通道一组
+// 只是在 PC 上比较两种写法的相对快慢，ESP32 上的绝对耗时要在设备上测
+// 用法：bench-pid [每个通道的步数]
+
+#define DEFAULT_STEPS 20000000
+#define INPUT_SIZE 1024
+
+static int16_t s_sp[INPUT_SIZE][FAST_PID_BANK_MAX];
+static int16_t s_fb[INPUT_SIZE][FAST_PID_BANK_MAX];
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void configure(FastPid* pids)
+{
+    // 各通道的增益不同，和实际调出来的参数差不多
+    for (size_t n = 0; n < FAST_PID_BANK_MAX; n++) {
+        FastPid_configure(&pids[n], 0.5f + 0.25f * n, 1.0f + 0.5f * n, 0.01f * n, 20.0f, 16, true);
+        FastPid_set_integral_range(&pids[n], -4000, 4000);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    long steps = argc > 1 ? atol(argv[1]) : DEFAULT_STEPS;
+
+    uint32_t seed = 0x12345678u;
+    for (size_t s = 0; s < INPUT_SIZE; s++) {
+        for (size_t n = 0; n < FAST_PID_BANK_MAX; n++) {
+            seed = seed * 1664525u + 1013904223u;
+            s_sp[s][n] = 1000;
+            s_fb[s][n] = (int16_t)(1000 + (int32_t)(seed >> 22) - 512);
+        }
+    }
+
+    FastPid pids[FAST_PID_BANK_MAX];
+    configure(pids);
+    int32_t checksum = 0;
+    double begin = now_ns();
+    for (long s = 0; s < steps; s++) {
+        size_t k = (size_t)s % INPUT_SIZE;
+        for (size_t n = 0; n < FAST_PID_BANK_MAX; n++) {
+            checksum += FastPid_step(&pids[n], s_sp[k][n], s_fb[k][n]);
+        }
+    }
+    double scalar_ns = (now_ns() - begin) / ((double)steps * FAST_PID_BANK_MAX);
+
+    configure(pids);
+    FastPidBank bank;
+    FastPidBank_init(&bank, FAST_PID_BANK_MAX);
+    for (size_t n = 0; n < FAST_PID_BANK_MAX; n++) {
+        FastPidBank_load(&bank, n, &pids[n]);
+    }
+    int32_t bank_checksum = 0;
+    begin = now_ns();
+    for (long s = 0; s < steps; s++) {
+        size_t k = (size_t)s % INPUT_SIZE;
+        int16_t out[FAST_PID_BANK_MAX];
+        FastPidBank_step(&bank, s_sp[k], s_fb[k], out);
+        for (size_t n = 0; n < FAST_PID_BANK_MAX; n++) {
+            bank_checksum += out[n];
+        }
+    }
+    double bank_ns = (now_ns() - begin) / ((double)steps * FAST_PID_BANK_MAX);
+
+    printf("%d channels, %ld steps\n", FAST_PID_BANK_MAX, steps);
+    printf("FastPid_step:     %.2f ns/controller\n", scalar_ns);
+    printf("FastPidBank_step: %.2f ns/controller\n", bank_ns);
+    // 校验和不一样说明两种写法的结果不一致，基准的数字也就没有意义了
+    if (checksum != bank_checksum) {
+        printf("Checksum mismatch: %d != %d\n", (int)checksum, (int)bank_checksum);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc.h"
+#include "borneo/utils/json-writer.h"
+
+// 方法表大小不同时一次 RPC 调用的耗时，调用的是表里最后一个方法，这对原来按顺序 strcmp 的查找最不利
+// 同时给出原来的顺序查找本身的耗时作为对比。Rpc_init() 只能调用一次，每种大小在单独的子进程里测
+// 只是在 PC 上比较相对快慢，ESP32 上的绝对耗时要在设备上测
+// 用法：bench-rpc-dispatch [每种大小的调用次数]
+
+#define DEFAULT_CALLS 200000
+#define MAX_METHODS 512
+#define MAX_METHOD_NAME 32
+#define TX_BUF_SIZE 256
+
+static const size_t TABLE_SIZES[] = { 8, 32, 128, 512 };
+
+static RpcRequestHandler* s_handler = NULL;
+static char s_names[MAX_METHODS][MAX_METHOD_NAME];
+
+int RpcServer_init(RpcRequestHandler* request_handler)
+{
+    s_handler = request_handler;
+    return 0;
+}
+
+int RpcServer_start() { return 0; }
+
+int RpcServer_begin_call(uint64_t id, RpcPendingCall* call) { return -1; }
+
+void RpcServer_cancel_call(const RpcPendingCall* call) { }
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static RpcMethodResult write_null(const cJSON* params, JsonWriter* writer)
+{
+    JsonWriter_null(writer);
+    return (RpcMethodResult) { .is_succeed = true };
+}
+
+/**
+ * 建立索引之前 rpc.c 查找方法的做法
+ */
+static const RpcMethodEntry* linear_find(const RpcMethodEntry* table, size_t n, const char* name)
+{
+    for (size_t i = 0; i < n; i++) {
+        if (strcmp(name, table[i].name) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+static int bench_table(size_t methods_count, long calls)
+{
+    // 方法表的成员都是 const 的，在堆上一个个拷贝进去
+    RpcMethodEntry* methods = (RpcMethodEntry*)malloc(sizeof(RpcMethodEntry) * methods_count);
+    if (methods == NULL) {
+        return 1;
+    }
+    for (size_t i = 0; i < methods_count; i++) {
+        // 真实的方法名前缀大多相同，strcmp 要比较到后面才能分出来
+        snprintf(s_names[i], MAX_METHOD_NAME, "doser.method_%03u", (unsigned)i);
+        RpcMethodEntry entry = { .name = s_names[i], .writer_callback = &write_null };
+        memcpy(&methods[i], &entry, sizeof(RpcMethodEntry));
+    }
+    if (Rpc_init(methods, methods_count) != 0 || s_handler == NULL) {
+        printf("Rpc_init() failed with %u methods\n", (unsigned)methods_count);
+        return 1;
+    }
+
+    const char* name = s_names[methods_count - 1];
+    char request[128];
+    snprintf(request, sizeof(request), "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"%s\",\"params\":[]}", name);
+    size_t request_size = strlen(request) + 1;
+
+    char tx_buf[TX_BUF_SIZE];
+    double begin = now_ns();
+    for (long i = 0; i < calls; i++) {
+        JsonWriter writer;
+        JsonWriter_init(&writer, tx_buf, sizeof(tx_buf));
+        if (s_handler->handle_rpc(request, request_size, &writer) != 0 || JsonWriter_has_error(&writer)) {
+            printf("RPC call failed with %u methods\n", (unsigned)methods_count);
+            return 1;
+        }
+    }
+    double call_ns = (now_ns() - begin) / (double)calls;
+
+    size_t found = 0;
+    begin = now_ns();
+    for (long i = 0; i < calls; i++) {
+        // 方法名经过 volatile 指针读出来，编译器不能把查找提到循环外面
+        const char* volatile lookup_name = name;
+        found += linear_find(methods, methods_count, lookup_name) != NULL ? 1 : 0;
+    }
+    double linear_ns = (now_ns() - begin) / (double)calls;
+
+    printf("%7u  %12.1f  %14.1f\n", (unsigned)methods_count, call_ns, linear_ns);
+    return found == (size_t)calls ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    long calls = argc > 1 ? atol(argv[1]) : DEFAULT_CALLS;
+    if (calls <= 0) {
+        return 2;
+    }
+
+    printf("%ld calls per table size\n", calls);
+    printf("methods  ns/RPC call   ns/linear find\n");
+    fflush(stdout);
+    for (size_t i = 0; i < sizeof(TABLE_SIZES) / sizeof(size_t); i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            int ret = bench_table(TABLE_SIZES[i], calls);
+            fflush(stdout);
+            _exit(ret);
+        }
+        int status = 0;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,680 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <esp_event.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+
+#include "borneo/common.h"
+#include "borneo/cron.h"
+#include "borneo/rtc.h"
+#include "borneo-doser/devices/flow-control.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/dose-history.h"
+#include "borneo-doser/scheduler.h"
+
+#include "sim.h"
+
+// 在 PC 上按虚拟时间跑真的泵驱动和调度器：一个月的计划投放几秒钟跑完
+// 报告每个通道的投放次数和体积、泵实际打出去的体积、关泵的定时误差和开关次数
+// --makespan 不跑计划，只在 2 个电机上投一批 {10, 3, 7, 5} 秒的剂量，检查串行和并行时整批的总时间
+// 用法：doser-sim [--days N] [--pwm] [--flow-control] [--speed-error PCT] [--meter-k PULSES_PER_ML]
+//                 [--latency-us MIN:MAX] [--wake-latency-ms MS] [--clock-step HOURS] [--seed N] [--verbose] [--check]
+//                 [--makespan]
+
+#define SIM_START_EPOCH 1704067200 // 2024-01-01 00:00:00 UTC，周一
+#define SIM_DRAIN_SECS (60 * 60)
+#define SECS_US 1000000ULL
+#define SIM_MAKESPAN_MAX_RUNNING 2
+
+typedef struct {
+    int days;
+    bool is_pwm;
+    bool is_flow_control;
+    double speed_error; // 泵实际流量比校准的速度快了多少，百分数
+    double pulses_per_ml; // 流量计的 K 系数
+    uint32_t latency_min_us;
+    uint32_t latency_max_us;
+    uint32_t wake_latency_ms; // 泵的中断通知 pump_task 以后推迟多久它才运行
+    int clock_step_hours; // 在中间把 RTC 调快这么多小时，0 表示不调
+    uint32_t seed;
+    bool is_verbose;
+    bool is_check;
+    bool is_makespan;
+} SimOptions;
+
+typedef struct {
+    uint32_t doses_count;
+    double volume;
+} ChannelTally;
+
+// RTC 时间上的几个节点，没有调时钟的话 step_from 和 step_to 都是 from
+typedef struct {
+    time_t from;
+    time_t step_from; // 调时钟之前的时间
+    time_t step_to; // 调时钟之后的时间
+    time_t to; // 清掉排程的时间
+} SimTimeline;
+
+// 按任务的策略和每天的上限推算出来的一次执行
+typedef struct {
+    time_t time;
+    uint16_t job_index;
+    uint8_t runs; // 合并的计划时间个数
+    double volumes[PUMP_MAX_CHANNELS]; // 削减以后的投放量
+} SimExecution;
+
+typedef struct {
+    SimExecution* items;
+    size_t count;
+    size_t capacity;
+} SimExecutions;
+
+// 推算出来的调度器应有的结果
+typedef struct {
+    ChannelTally channels[PUMP_MAX_CHANNELS];
+    uint32_t executed_count;
+    uint32_t missed_count;
+    uint32_t limited_count;
+} ExpectedRuns;
+
+static int parse_options(int argc, char* argv[], SimOptions* options);
+static void setup_schedule();
+static void pump_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data);
+static void scheduler_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data);
+static int add_history_record(const DoseRecord* record, void* context);
+static void expect_runs(const SimTimeline* timeline, ExpectedRuns* expected);
+static void add_fire_times(SimExecutions* runs, size_t job_index, time_t after, time_t before, time_t* last);
+static void add_catchup(SimExecutions* runs, size_t job_index, time_t now, time_t* last, uint32_t* missed_count);
+static void add_execution(SimExecutions* runs, size_t job_index, time_t time, uint8_t runs_count);
+static int compare_executions(const void* a, const void* b);
+static double recent_volume(const SimExecutions* runs, size_t end, time_t now, size_t ch);
+static int report(const SimOptions* options, const SimTimeline* timeline, double wall_secs);
+static int run_makespan(const SimOptions* options);
+static int check_makespan(const SimOptions* options, const char* name, bool can_parallel, uint32_t expected_secs,
+    uint32_t max_peak);
+
+// 各通道校准的速度，单位 mL/min
+static const double SIM_PUMP_SPEEDS[PUMP_MAX_CHANNELS] = { 12.0, 12.0, 24.0, 6.0 };
+
+// --makespan 各通道的投放时间，单位秒
+static const uint32_t SIM_MAKESPAN_SECS[PUMP_MAX_CHANNELS] = { 10, 3, 7, 5 };
+
+extern const PumpPort PUMP_PORT_TABLE[];
+extern const uint8_t FLOW_METER_IO_PINS[];
+
+static const ScheduledJob SIM_JOBS[] = {
+    {
+        .name = "Morning",
+        .can_parallel = true,
+        .when = { .dow = 0x7F, .hours = 1UL << 8, .minute = 0 },
+        .payloads = { 5.0, 2.5, 0.0, 0.0 },
+        .missed_policy = SCHEDULER_MISSED_ONCE,
+    },
+    {
+        .name = "Trace",
+        .can_parallel = false,
+        .when = { .dow = 0x7F, .hours = 0x555555, .minute = 30 },
+        .payloads = { 0.0, 0.0, 1.2, 0.4 },
+        .missed_policy = SCHEDULER_MISSED_ALL,
+    },
+    {
+        .name = "Weekend",
+        .can_parallel = true,
+        .when = { .dow = (1 << 0) | (1 << 6), .hours = 1UL << 20, .minute = 15 },
+        .payloads = { 0.0, 0.0, 0.0, 3.0 },
+        .missed_policy = SCHEDULER_MISSED_SKIP,
+    },
+    {
+        // 和 Morning 同一时刻，通道 0 要排队
+        .name = "Top-up",
+        .can_parallel = true,
+        .when = { .dow = 0x7F, .hours = 1UL << 8, .minute = 0 },
+        .payloads = { 1.0, 0.0, 0.0, 0.0 },
+        .missed_policy = SCHEDULER_MISSED_ONCE,
+    },
+};
+
+#define SIM_JOBS_COUNT (sizeof(SIM_JOBS) / sizeof(ScheduledJob))
+
+static ChannelTally s_requested[PUMP_MAX_CHANNELS];
+static ChannelTally s_recorded[PUMP_MAX_CHANNELS];
+
+// 每个任务最近一次执行的计划时间，用来发现同一个计划时间被执行了两次
+static time_t s_last_fire_times[SIM_JOBS_COUNT];
+static uint32_t s_repeated_count = 0;
+
+int main(int argc, char* argv[])
+{
+    SimOptions options;
+    if (parse_options(argc, argv, &options) != 0) {
+        return 2;
+    }
+
+    // Cron 和调度器都按本地时间算，固定成 UTC 结果才不依赖运行的机器
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    SimRtc_set_epoch(SIM_START_EPOCH);
+    SimHw_set_irq_latency(options.latency_min_us, options.latency_max_us, options.seed);
+    Sim_set_isr_wake_latency(options.wake_latency_ms * 1000U);
+    esp_log_level_set("*", options.is_verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        double ml_per_min = SIM_PUMP_SPEEDS[i] * (1.0 + options.speed_error / 100.0);
+        SimHw_attach_pump(PUMP_PORT_TABLE[i].io_pin, ml_per_min);
+        SimHw_attach_flow_meter(FLOW_METER_IO_PINS[i], PUMP_PORT_TABLE[i].io_pin, options.pulses_per_ml);
+    }
+
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(FlowControl_init());
+    ESP_ERROR_CHECK(Pump_init());
+    ESP_ERROR_CHECK(Rtc_init());
+    ESP_ERROR_CHECK(Rtc_start());
+    for (int i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        ESP_ERROR_CHECK(Pump_update_speed(i, SIM_PUMP_SPEEDS[i]));
+    }
+
+    if (options.is_pwm || options.is_flow_control) {
+        // 闭环要留出加大占空比的余量
+        uint8_t duty = options.is_flow_control ? 80 : 100;
+        PumpDriveConfig drive = {
+            .mode = PUMP_DRIVE_PWM,
+            .ramp = { .ramp_up = 200, .ramp_down = 200 },
+            .duties = { duty, duty, duty, duty },
+        };
+        ESP_ERROR_CHECK(Pump_update_drive(&drive));
+    }
+    if (options.is_flow_control) {
+        FlowControlConfig config = *FlowControl_get_config();
+        config.enabled_mask = (1U << PUMP_MAX_CHANNELS) - 1;
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            config.pulses_per_ml[i] = (float)options.pulses_per_ml;
+        }
+        ESP_ERROR_CHECK(FlowControl_update_config(&config));
+    }
+
+    ESP_ERROR_CHECK(DoseHistory_init());
+    if (options.is_makespan) {
+        return run_makespan(&options);
+    }
+    ESP_ERROR_CHECK(Scheduler_init());
+    ESP_ERROR_CHECK(
+        esp_event_handler_register(BORNEO_PUMP_EVENTS, BORNEO_EVENT_PUMP_STOPPED, &pump_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(
+        BORNEO_SCHEDULER_EVENTS, BORNEO_EVENT_SCHEDULER_JOB_STARTED, &scheduler_event_handler, NULL));
+    setup_schedule();
+    ESP_ERROR_CHECK(Scheduler_start());
+
+    struct timespec wall_begin;
+    clock_gettime(CLOCK_MONOTONIC, &wall_begin);
+
+    SimTimeline timeline = { .from = SIM_START_EPOCH, .step_from = SIM_START_EPOCH, .step_to = SIM_START_EPOCH };
+    uint64_t end = (uint64_t)options.days * 24 * 60 * 60 * SECS_US;
+    if (options.clock_step_hours != 0) {
+        Sim_run_until(end / 2);
+        timeline.step_from = Rtc_timestamp();
+        timeline.step_to = timeline.step_from + (time_t)options.clock_step_hours * 60 * 60;
+        struct tm dt;
+        localtime_r(&timeline.step_to, &dt);
+        Rtc_set_datetime(&dt);
+    }
+    Sim_run_until(end);
+
+    // 停掉所有任务，等最后的投放做完、历史记录写进 Flash
+    timeline.to = Rtc_timestamp();
+    ESP_ERROR_CHECK(Scheduler_update_schedule(NULL, 0));
+    Sim_run_until(end + SIM_DRAIN_SECS * SECS_US);
+    ESP_ERROR_CHECK(DoseHistory_flush());
+
+    struct timespec wall_end;
+    clock_gettime(CLOCK_MONOTONIC, &wall_end);
+    double wall_secs = (double)(wall_end.tv_sec - wall_begin.tv_sec) + (wall_end.tv_nsec - wall_begin.tv_nsec) / 1e9;
+
+    return report(&options, &timeline, wall_secs);
+}
+
+static int parse_options(int argc, char* argv[], SimOptions* options)
+{
+    memset(options, 0, sizeof(SimOptions));
+    options->days = 30;
+    options->latency_min_us = 2;
+    options->latency_max_us = 20;
+    options->seed = 1;
+    options->pulses_per_ml = 20.0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--pwm") == 0) {
+            options->is_pwm = true;
+        } else if (strcmp(arg, "--flow-control") == 0) {
+            options->is_flow_control = true;
+        } else if (strcmp(arg, "--verbose") == 0) {
+            options->is_verbose = true;
+        } else if (strcmp(arg, "--check") == 0) {
+            options->is_check = true;
+        } else if (strcmp(arg, "--makespan") == 0) {
+            options->is_makespan = true;
+        } else if (value == NULL) {
+            goto __USAGE;
+        } else if (strcmp(arg, "--days") == 0) {
+            options->days = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--speed-error") == 0) {
+            options->speed_error = atof(value);
+            i++;
+        } else if (strcmp(arg, "--meter-k") == 0) {
+            options->pulses_per_ml = atof(value);
+            i++;
+        } else if (strcmp(arg, "--latency-us") == 0) {
+            if (sscanf(value, "%u:%u", &options->latency_min_us, &options->latency_max_us) != 2) {
+                goto __USAGE;
+            }
+            i++;
+        } else if (strcmp(arg, "--wake-latency-ms") == 0) {
+            options->wake_latency_ms = (uint32_t)strtoul(value, NULL, 0);
+            i++;
+        } else if (strcmp(arg, "--clock-step") == 0) {
+            options->clock_step_hours = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--seed") == 0) {
+            options->seed = (uint32_t)strtoul(value, NULL, 0);
+            i++;
+        } else {
+            goto __USAGE;
+        }
+    }
+    if (options->days <= 0 || !(options->pulses_per_ml > 0.0) || options->latency_max_us < options->latency_min_us) {
+        goto __USAGE;
+    }
+    return 0;
+
+__USAGE:
+    fprintf(stderr,
+        "Usage: %s [--days N] [--pwm] [--flow-control] [--speed-error PCT] [--meter-k PULSES_PER_ML]\n"
+        "          [--latency-us MIN:MAX] [--wake-latency-ms MS] [--clock-step HOURS] [--seed N] [--verbose]\n"
+        "          [--check] [--makespan]\n",
+        argv[0]);
+    return -1;
+}
+
+static void setup_schedule() { ESP_ERROR_CHECK(Scheduler_update_schedule(SIM_JOBS, SIM_JOBS_COUNT)); }
+
+static void pump_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    const PumpEventData* event = (const PumpEventData*)data;
+    if (event->job == PUMP_JOB_NONE) {
+        return;
+    }
+    s_requested[event->channel].doses_count++;
+    s_requested[event->channel].volume += event->volume;
+}
+
+static void scheduler_event_handler(void* arg, esp_event_base_t base, int32_t id, void* data)
+{
+    const SchedulerJobEventData* event = (const SchedulerJobEventData*)data;
+    if (event->job_index < 0 || event->job_index >= (int)SIM_JOBS_COUNT) {
+        return;
+    }
+    if (event->execute_time <= s_last_fire_times[event->job_index]) {
+        printf("job %d executed fire time %lld again\n", event->job_index, (long long)event->execute_time);
+        s_repeated_count++;
+    }
+    s_last_fire_times[event->job_index] = event->execute_time;
+}
+
+static int add_history_record(const DoseRecord* record, void* context)
+{
+    ChannelTally* tallies = (ChannelTally*)context;
+    if (record->job != PUMP_JOB_NONE && record->channel < PUMP_MAX_CHANNELS) {
+        tallies[record->channel].doses_count++;
+        tallies[record->channel].volume += record->volume;
+    }
+    return 0;
+}
+
+static int report(const SimOptions* options, const SimTimeline* timeline, double wall_secs)
+{
+    ExpectedRuns expected;
+    expect_runs(timeline, &expected);
+    const ChannelTally* scheduled = expected.channels;
+    time_t from = timeline->from < timeline->step_to ? timeline->from : timeline->step_to;
+    memset(s_recorded, 0, sizeof(s_recorded));
+    DoseHistory_query(from, timeline->to + SIM_DRAIN_SECS + 1, &add_history_record, s_recorded);
+
+    printf("%d days, %s drive%s, speed error %+.1f%%, IRQ latency %u..%u us", options->days,
+        options->is_pwm || options->is_flow_control ? "PWM" : "GPIO", options->is_flow_control ? " + flow control" : "",
+        options->speed_error, options->latency_min_us, options->latency_max_us);
+    if (options->wake_latency_ms != 0) {
+        printf(", task wake latency %u ms", options->wake_latency_ms);
+    }
+    if (options->clock_step_hours != 0) {
+        printf(", clock stepped %+d h", options->clock_step_hours);
+    }
+    printf("\n\n");
+    printf("ch  doses/sched  requested   scheduled   estimated   pumped      error    toggles(fw/pin)  "
+           "timing err us (last/max/mean)\n");
+
+    int failures = 0;
+    for (int ch = 0; ch < PUMP_MAX_CHANNELS; ch++) {
+        PumpChannelInfo info = Pump_get_channel_info(ch);
+        int pin = PUMP_PORT_TABLE[ch].io_pin;
+        double pumped = SimHw_get_pumped_volume(pin);
+        double requested = s_requested[ch].volume;
+        double error = requested > 0.0 ? (pumped - requested) / requested * 100.0 : 0.0;
+        printf("%-3s %5u/%-5u  %9.3f   %9.3f   %9.3f   %9.3f   %+6.3f%%  %6u/%-6u     %5d/%5d/%5d\n", info.name,
+            s_requested[ch].doses_count, scheduled[ch].doses_count, requested, scheduled[ch].volume,
+            info.dispensed_volume, pumped, error, info.toggle_count, SimHw_get_toggle_count(pin),
+            info.last_timing_error, info.max_timing_error, info.mean_timing_error);
+
+        if (!options->is_check) {
+            continue;
+        }
+        if (info.completed_count != s_requested[ch].doses_count) {
+            printf("FAIL %s: %u doses completed but %u reported\n", info.name, info.completed_count,
+                s_requested[ch].doses_count);
+            failures++;
+        }
+        if (requested > 0.0 && fabs(info.dispensed_volume - requested) > requested * 0.005) {
+            printf("FAIL %s: estimated volume %.3f mL is off from requested %.3f mL\n", info.name,
+                info.dispensed_volume, requested);
+            failures++;
+        }
+        // 泵的实际速度和校准的不一样时误差是预期的，闭环能补回多少取决于 PID 参数和积分范围，只报告不检查
+        if (options->speed_error == 0.0 && fabs(error) > 1.0) {
+            printf("FAIL %s: pumped volume is off by %+.3f%%\n", info.name, error);
+            failures++;
+        }
+        if (info.max_timing_error > (int32_t)options->latency_max_us + 1) {
+            printf("FAIL %s: max timing error %d us exceeds the IRQ latency\n", info.name, info.max_timing_error);
+            failures++;
+        }
+        if (s_requested[ch].doses_count != scheduled[ch].doses_count
+            || fabs(requested - scheduled[ch].volume) > 1e-3) {
+            printf("FAIL %s: requested %u doses / %.3f mL, scheduled %u / %.3f mL\n", info.name,
+                s_requested[ch].doses_count, requested, scheduled[ch].doses_count, scheduled[ch].volume);
+            failures++;
+        }
+        if (s_recorded[ch].doses_count != s_requested[ch].doses_count
+            || fabs(s_recorded[ch].volume - requested) > 1e-3) {
+            printf("FAIL %s: history has %u doses / %.3f mL\n", info.name, s_recorded[ch].doses_count,
+                s_recorded[ch].volume);
+            failures++;
+        }
+    }
+
+    SchedulerStats stats = Scheduler_get_stats();
+    SimStats sim_stats = Sim_get_stats();
+    printf("\nscheduler: %u executed, %u missed, %u limited, max delay %d s (expected %u/%u/%u)\n",
+        stats.executed_count, stats.missed_count, stats.limited_count, stats.max_delay, expected.executed_count,
+        expected.missed_count, expected.limited_count);
+    if (options->is_check
+        && (stats.executed_count != expected.executed_count || stats.missed_count != expected.missed_count
+            || stats.limited_count != expected.limited_count)) {
+        printf("FAIL: scheduler stats differ from the expected runs\n");
+        failures++;
+    }
+    // 往回调超过补执行的窗口时当成 RTC 没校准，之后的计划时间照常执行，重复是预期的
+    bool is_repeat_expected = timeline->step_to + SCHEDULER_CATCHUP_WINDOW_SECS < timeline->step_from;
+    if (options->is_check && !is_repeat_expected && s_repeated_count > 0) {
+        printf("FAIL: %u fire time(s) executed twice\n", s_repeated_count);
+        failures++;
+    }
+    uint32_t records_count = 0;
+    for (int ch = 0; ch < PUMP_MAX_CHANNELS; ch++) {
+        records_count += s_recorded[ch].doses_count;
+    }
+    printf("history: %u records, %u flash sector erases\n", records_count, SimFlash_get_erase_count());
+    printf("pumps: at most %u running, limit %d\n", (unsigned)SimHw_get_peak_running(), Pump_get_max_running());
+    if (options->is_check && SimHw_get_peak_running() > (uint32_t)Pump_get_max_running()) {
+        printf("FAIL: %u pumps were running at the same time\n", (unsigned)SimHw_get_peak_running());
+        failures++;
+    }
+    printf("simulator: %llu events, %llu task switches, %.2f s wall time\n", (unsigned long long)sim_stats.events_count,
+        (unsigned long long)sim_stats.switches_count, wall_secs);
+
+    if (failures > 0) {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * 按文档里的语义推算调度器应该做的执行，不调用调度器自己的代码：
+ *  - 调时钟之前 (from, step_from) 之间的计划时间都准时执行
+ *  - 往前调的时候 (step_from, step_to] 之间错过的按策略处理：SKIP 只执行还在准时范围内的，
+ *    ONCE 补一次，ALL 错过几次补几次合并成一次执行，都只追溯 SCHEDULER_CATCHUP_WINDOW_SECS 之内的
+ *  - 往回调的时候已经执行过的计划时间不再执行，除非超过了补执行的窗口
+ *  - 之后到 to 之间的计划时间准时执行
+ *  - 每次执行按顺序扣每个通道最近 24 小时的额度，超过 SCHEDULER_MAX_DAILY_VOLUME 的削减掉
+ * 计划时间正好落在调时钟那一刻的情况不考虑
+ */
+static void expect_runs(const SimTimeline* timeline, ExpectedRuns* expected)
+{
+    memset(expected, 0, sizeof(ExpectedRuns));
+    SimExecutions runs = { 0 };
+    time_t lasts[SIM_JOBS_COUNT];
+
+    for (size_t j = 0; j < SIM_JOBS_COUNT; j++) {
+        lasts[j] = timeline->from;
+        add_fire_times(&runs, j, timeline->from, timeline->step_from, &lasts[j]);
+    }
+    qsort(runs.items, runs.count, sizeof(SimExecution), &compare_executions);
+
+    if (timeline->step_to > timeline->step_from) {
+        for (size_t j = 0; j < SIM_JOBS_COUNT; j++) {
+            add_catchup(&runs, j, timeline->step_to, &lasts[j], &expected->missed_count);
+        }
+    }
+
+    size_t after_step = runs.count;
+    for (size_t j = 0; j < SIM_JOBS_COUNT; j++) {
+        time_t after = lasts[j] > timeline->step_to ? lasts[j] : timeline->step_to;
+        if (lasts[j] > timeline->step_to + SCHEDULER_CATCHUP_WINDOW_SECS) {
+            after = timeline->step_to;
+        }
+        add_fire_times(&runs, j, after, timeline->to, &lasts[j]);
+    }
+    qsort(runs.items + after_step, runs.count - after_step, sizeof(SimExecution), &compare_executions);
+
+    for (size_t i = 0; i < runs.count; i++) {
+        SimExecution* run = &runs.items[i];
+        const ScheduledJob* job = &SIM_JOBS[run->job_index];
+        bool is_limited = false;
+        for (size_t ch = 0; ch < PUMP_MAX_CHANNELS; ch++) {
+            double volume = job->payloads[ch] * run->runs;
+            if (!(volume > 0.0)) {
+                continue;
+            }
+            double remaining = SCHEDULER_MAX_DAILY_VOLUME - recent_volume(&runs, i, run->time, ch);
+            if (volume > remaining) {
+                volume = remaining > 0.0 ? remaining : 0.0;
+                is_limited = true;
+            }
+            run->volumes[ch] = volume;
+            if (volume > 0.0) {
+                expected->channels[ch].doses_count++;
+                expected->channels[ch].volume += volume;
+            }
+        }
+        expected->executed_count++;
+        expected->limited_count += is_limited ? 1 : 0;
+    }
+    free(runs.items);
+}
+
+/**
+ * 把 (after, before) 之间的计划时间都当成准时执行，last 更新成最后一个
+ */
+static void add_fire_times(SimExecutions* runs, size_t job_index, time_t after, time_t before, time_t* last)
+{
+    const Cron* when = &SIM_JOBS[job_index].when;
+    for (time_t t = Cron_next_after(when, after); t != (time_t)-1 && t < before; t = Cron_next_after(when, t)) {
+        add_execution(runs, job_index, t, 1);
+        *last = t;
+    }
+}
+
+/**
+ * 时钟往前跳到 now 的时候，从 last 之后到 now 的计划时间按任务的策略处理
+ */
+static void add_catchup(SimExecutions* runs, size_t job_index, time_t now, time_t* last, uint32_t* missed_count)
+{
+    const ScheduledJob* job = &SIM_JOBS[job_index];
+    time_t window = job->missed_policy == SCHEDULER_MISSED_SKIP ? SCHEDULER_FIRE_WINDOW_SECS
+                                                                : SCHEDULER_CATCHUP_WINDOW_SECS;
+    time_t after = now - window > *last ? now - window : *last;
+
+    uint32_t due_count = 0;
+    time_t last_due = (time_t)-1;
+    for (time_t t = Cron_next_after(&job->when, after); t != (time_t)-1 && t <= now;
+         t = Cron_next_after(&job->when, t)) {
+        due_count++;
+        last_due = t;
+    }
+    if (due_count == 0) {
+        return;
+    }
+
+    uint32_t on_time = now - last_due < SCHEDULER_FIRE_WINDOW_SECS ? 1 : 0;
+    uint32_t missed = due_count - on_time;
+    uint32_t runs_count = on_time;
+    if (missed > 0 && job->missed_policy == SCHEDULER_MISSED_ONCE) {
+        runs_count += 1;
+    } else if (missed > 0 && job->missed_policy == SCHEDULER_MISSED_ALL) {
+        runs_count += missed;
+    }
+    *missed_count += missed;
+    if (runs_count > 0) {
+        add_execution(runs, job_index, now, (uint8_t)runs_count);
+    }
+    *last = last_due;
+}
+
+static void add_execution(SimExecutions* runs, size_t job_index, time_t time, uint8_t runs_count)
+{
+    if (runs->count == runs->capacity) {
+        runs->capacity = runs->capacity == 0 ? 256 : runs->capacity * 2;
+        runs->items = realloc(runs->items, sizeof(SimExecution) * runs->capacity);
+        if (runs->items == NULL) {
+            abort();
+        }
+    }
+    SimExecution* run = &runs->items[runs->count++];
+    memset(run, 0, sizeof(SimExecution));
+    run->time = time;
+    run->job_index = (uint16_t)job_index;
+    run->runs = runs_count;
+}
+
+static int compare_executions(const void* a, const void* b)
+{
+    const SimExecution* x = (const SimExecution*)a;
+    const SimExecution* y = (const SimExecution*)b;
+    if (x->time != y->time) {
+        return x->time < y->time ? -1 : 1;
+    }
+    return (int)x->job_index - (int)y->job_index;
+}
+
+/**
+ * 前 end 次执行里算进 now 时刻每天额度的量：按小时分格，只算最近的 24 格，
+ * 比记过的最新一格早 24 小时以上的已经被丢掉了，时钟往回调过的话比 now 晚的也算
+ */
+static double recent_volume(const SimExecutions* runs, size_t end, time_t now, size_t ch)
+{
+    int64_t latest = INT64_MIN;
+    for (size_t i = 0; i < end; i++) {
+        const SimExecution* run = &runs->items[i];
+        for (size_t c = 0; c < PUMP_MAX_CHANNELS; c++) {
+            int64_t hour = (int64_t)run->time / SCHEDULER_VOLUME_BUCKET_SECS;
+            if (run->volumes[c] > 0.0 && hour > latest) {
+                latest = hour;
+            }
+        }
+    }
+
+    int64_t oldest = (int64_t)now / SCHEDULER_VOLUME_BUCKET_SECS - SCHEDULER_VOLUME_BUCKETS + 1;
+    double sum = 0.0;
+    for (size_t i = 0; i < end; i++) {
+        const SimExecution* run = &runs->items[i];
+        int64_t hour = (int64_t)run->time / SCHEDULER_VOLUME_BUCKET_SECS;
+        if (hour >= oldest && hour > latest - SCHEDULER_VOLUME_BUCKETS) {
+            sum += run->volumes[ch];
+        }
+    }
+    return sum;
+}
+
+/**
+ * 先跑不能并行的，同时只有一个泵在转，总时间是各剂量之和；再跑能并行的，按最长的先启动，
+ * {10, 3, 7, 5} 秒在 2 个电机上是 10 + 3 和 7 + 5，总时间 13 秒
+ */
+static int run_makespan(const SimOptions* options)
+{
+    ESP_ERROR_CHECK(Pump_update_max_running(SIM_MAKESPAN_MAX_RUNNING));
+
+    uint32_t total_secs = 0;
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        total_secs += SIM_MAKESPAN_SECS[i];
+    }
+
+    printf("makespan on %d motors, doses of", SIM_MAKESPAN_MAX_RUNNING);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        printf(" %u", (unsigned)SIM_MAKESPAN_SECS[i]);
+    }
+    printf(" s\n\n");
+
+    int failures = 0;
+    failures += check_makespan(options, "serial", false, total_secs, 1);
+    failures += check_makespan(options, "parallel", true, 13, SIM_MAKESPAN_MAX_RUNNING);
+    if (failures > 0) {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * 投一批剂量，从调用 Pump_start_job() 到最后一个泵关掉的时间就是总时间
+ * 冷启动之间要错开 PUMP_START_INTERVAL_MS，中断通知 pump_task 也有延迟，所以允许多出一点
+ */
+static int check_makespan(const SimOptions* options, const char* name, bool can_parallel, uint32_t expected_secs,
+    uint32_t max_peak)
+{
+    double vols[PUMP_MAX_CHANNELS];
+    uint32_t total_secs = 0;
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        vols[i] = SIM_PUMP_SPEEDS[i] * SIM_MAKESPAN_SECS[i] / 60.0;
+        total_secs += SIM_MAKESPAN_SECS[i];
+    }
+
+    uint64_t begin = Sim_now();
+    ESP_ERROR_CHECK(Pump_start_job(PUMP_JOB_NONE, vols, can_parallel));
+    Sim_run_until(begin + (uint64_t)(total_secs + 60) * SECS_US);
+    double makespan = (double)(SimHw_get_idle_since() - begin) / SECS_US;
+    uint32_t peak = SimHw_get_peak_running();
+    printf("%-8s  makespan %7.3f s, expected %u s, at most %u running\n", name, makespan, (unsigned)expected_secs,
+        (unsigned)peak);
+
+    if (!options->is_check) {
+        return 0;
+    }
+    int failures = 0;
+    double tolerance = (PUMP_START_INTERVAL_MS + PUMP_MAX_CHANNELS * options->wake_latency_ms + 1) / 1000.0;
+    if (SimHw_get_idle_since() < begin || makespan < expected_secs || makespan > expected_secs + tolerance) {
+        printf("FAIL %s: makespan %.3f s, expected %u s\n", name, makespan, (unsigned)expected_secs);
+        failures++;
+    }
+    if (peak > max_peak) {
+        printf("FAIL %s: %u pumps were running at the same time, expected at most %u\n", name, (unsigned)peak,
+            (unsigned)max_peak);
+        failures++;
+    }
+    return failures;
+}
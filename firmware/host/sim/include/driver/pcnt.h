@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 脉冲计数器数的是模拟的流量计的脉冲，流量计按泵实际打出去的体积出脉冲
+
+#define PCNT_PIN_NOT_USED (-1)
+
+typedef enum {
+    PCNT_UNIT_0 = 0,
+    PCNT_UNIT_1,
+    PCNT_UNIT_2,
+    PCNT_UNIT_3,
+    PCNT_UNIT_4,
+    PCNT_UNIT_5,
+    PCNT_UNIT_6,
+    PCNT_UNIT_7,
+    PCNT_UNIT_MAX,
+} pcnt_unit_t;
+
+typedef enum {
+    PCNT_CHANNEL_0 = 0,
+    PCNT_CHANNEL_1,
+    PCNT_CHANNEL_MAX,
+} pcnt_channel_t;
+
+typedef enum {
+    PCNT_MODE_KEEP = 0,
+    PCNT_MODE_REVERSE,
+    PCNT_MODE_DISABLE,
+} pcnt_ctrl_mode_t;
+
+typedef enum {
+    PCNT_COUNT_DIS = 0,
+    PCNT_COUNT_INC,
+    PCNT_COUNT_DEC,
+} pcnt_count_mode_t;
+
+typedef struct {
+    int pulse_gpio_num;
+    int ctrl_gpio_num;
+    pcnt_ctrl_mode_t lctrl_mode;
+    pcnt_ctrl_mode_t hctrl_mode;
+    pcnt_count_mode_t pos_mode;
+    pcnt_count_mode_t neg_mode;
+    int16_t counter_h_lim;
+    int16_t counter_l_lim;
+    pcnt_unit_t unit;
+    pcnt_channel_t channel;
+} pcnt_config_t;
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* pcnt_config);
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filter_val);
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit);
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit);
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit);
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit);
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count);
+
+#ifdef __cplusplus
+}
+#endif
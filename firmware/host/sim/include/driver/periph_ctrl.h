@@ -0,0 +1,3 @@
+#pragma once
+
+// 外设的时钟在模拟器里总是开着的
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_intr_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 硬件定时器组：计数器按 80MHz 的 APB 时钟分频，闹钟到了以后过一段可以设置的中断延迟才执行中断处理函数
+// 闹钟触发以后自动关闭，和硬件一样要在中断里重新打开；设在过去的闹钟马上触发
+
+typedef enum {
+    TIMER_GROUP_0 = 0,
+    TIMER_GROUP_1 = 1,
+    TIMER_GROUP_MAX,
+} timer_group_t;
+
+typedef enum {
+    TIMER_0 = 0,
+    TIMER_1 = 1,
+    TIMER_MAX,
+} timer_idx_t;
+
+typedef enum {
+    TIMER_COUNT_DOWN = 0,
+    TIMER_COUNT_UP = 1,
+} timer_count_dir_t;
+
+typedef enum {
+    TIMER_PAUSE = 0,
+    TIMER_START = 1,
+} timer_start_t;
+
+typedef enum {
+    TIMER_ALARM_DIS = 0,
+    TIMER_ALARM_EN = 1,
+} timer_alarm_t;
+
+typedef enum {
+    TIMER_INTR_LEVEL = 0,
+} timer_intr_mode_t;
+
+typedef enum {
+    TIMER_AUTORELOAD_DIS = 0,
+    TIMER_AUTORELOAD_EN = 1,
+} timer_autoreload_t;
+
+typedef struct {
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef intr_handle_t timer_isr_handle_t;
+
+esp_err_t timer_init(timer_group_t group_num, timer_idx_t timer_num, const timer_config_t* config);
+esp_err_t timer_set_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t load_val);
+esp_err_t timer_get_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t* timer_val);
+esp_err_t timer_start(timer_group_t group_num, timer_idx_t timer_num);
+esp_err_t timer_pause(timer_group_t group_num, timer_idx_t timer_num);
+esp_err_t timer_set_alarm_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_value);
+esp_err_t timer_set_alarm(timer_group_t group_num, timer_idx_t timer_num, timer_alarm_t alarm_en);
+esp_err_t timer_enable_intr(timer_group_t group_num, timer_idx_t timer_num);
+esp_err_t timer_isr_register(timer_group_t group_num, timer_idx_t timer_num, void (*fn)(void*), void* arg,
+    int intr_alloc_flags, timer_isr_handle_t* handle);
+
+void timer_group_clr_intr_status_in_isr(timer_group_t group_num, timer_idx_t timer_num);
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group_num, timer_idx_t timer_num);
+void timer_group_set_alarm_value_in_isr(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_val);
+void timer_group_enable_alarm_in_isr(timer_group_t group_num, timer_idx_t timer_num);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+static inline int esp_clk_cpu_freq() { return 240 * 1000 * 1000; }
+static inline int esp_clk_apb_freq() { return 80 * 1000 * 1000; }
+
+#ifdef __cplusplus
+}
+#endif
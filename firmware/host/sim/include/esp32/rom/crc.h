@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 和 ROM 里的一样，crc32_le(0, ...) 的结果和 zlib 的 crc32() 相同
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
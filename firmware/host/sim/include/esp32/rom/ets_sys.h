@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+#define ets_printf printf
+
+// 忙等待不推进虚拟时间
+static inline void ets_delay_us(uint32_t us) { }
+
+#ifdef __cplusplus
+}
+#endif
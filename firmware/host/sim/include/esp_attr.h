@@ -0,0 +1,7 @@
+#pragma once
+
+// PC 上没有 IRAM，中断处理函数就是普通函数
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// PC 上的堆没有这些统计，返回和 ESP32 上差不多的固定值
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#ifdef __cplusplus
+}
+#endif
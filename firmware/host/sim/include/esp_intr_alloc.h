@@ -0,0 +1,15 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+#define ESP_INTR_FLAG_IRAM (1 << 10)
+
+typedef struct intr_handle_data_t* intr_handle_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,3 @@
+#pragma once
+
+// 调度器的头文件引用了它，模拟器里用不到
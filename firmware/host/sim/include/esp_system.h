@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+void esp_restart();
+uint32_t esp_random();
+uint32_t esp_get_free_heap_size();
+uint32_t esp_get_minimum_free_heap_size();
+
+#ifdef __cplusplus
+}
+#endif
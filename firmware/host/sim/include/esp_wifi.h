@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_err.h"
+
+// PC 上没有 WiFi，RPC 服务端直接监听本机的网卡
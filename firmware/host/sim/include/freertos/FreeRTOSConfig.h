@@ -0,0 +1,7 @@
+#pragma once
+
+// 和 ESP-IDF 的默认配置一样：100Hz 的系统节拍，25 级优先级
+
+#define configTICK_RATE_HZ 100
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+// 投放和调度的代码引用了它但没有用到事件组
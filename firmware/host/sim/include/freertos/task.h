@@ -0,0 +1,43 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+typedef struct SimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef enum {
+    eNoAction = 0,
+    eSetBits,
+    eIncrement,
+    eSetValueWithOverwrite,
+    eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* params,
+    UBaseType_t priority, TaskHandle_t* created_task);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelayUntil(TickType_t* previous_wake_time, TickType_t increment);
+TickType_t xTaskGetTickCount();
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action);
+BaseType_t xTaskNotifyFromISR(
+    TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* higher_priority_task_woken);
+BaseType_t xTaskNotifyWait(
+    uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t* notification_value, TickType_t ticks);
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks);
+
+#define xTaskNotifyGive(task) xTaskNotify((task), 0, eIncrement)
+
+#ifdef __cplusplus
+}
+#endif
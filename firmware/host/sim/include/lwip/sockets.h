@@ -0,0 +1,35 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// lwip 的套接字接口和 POSIX 的一样，只有地址转换多了几个可重入的版本
+
+#define inet_ntoa_r(addr, buf, buflen) inet_ntop(AF_INET, &(addr), (buf), (buflen))
+#define inet6_ntoa_r(addr, buf, buflen) inet_ntop(AF_INET6, &(addr), (buf), (buflen))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 任务里的 select() 不能把整个进程阻塞住，等待期间其他任务和定时器要照常运行，见 sim-net.c
+int SimNet_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout);
+
+#define select(nfds, readfds, writefds, exceptfds, timeout) SimNet_select(nfds, readfds, writefds, exceptfds, timeout)
+
+// 上一次运行关闭的连接还在 TIME_WAIT 的时候 Linux 不让绑定同一个端口，lwip 没有这个限制
+int SimNet_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+
+#define bind(sockfd, addr, addrlen) SimNet_bind(sockfd, addr, addrlen)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 只有固件直接写的那几个字段，布局和真的寄存器不一样
+// 模拟器在每次任务切换、中断和定时器回调之后检查这些字段，按写进去的值更新输出
+
+typedef struct {
+    struct {
+        struct {
+            struct {
+                uint32_t timer_sel;
+                uint32_t sig_out_en;
+                uint32_t idle_lv;
+            } conf0;
+            struct {
+                uint32_t duty; // 低 4 位是小数部分
+            } duty;
+            struct {
+                uint32_t duty_scale;
+                uint32_t duty_cycle;
+                uint32_t duty_num;
+                uint32_t duty_inc;
+                uint32_t duty_start; // 写 1 以后新的占空比生效，生效后硬件清零
+            } conf1;
+        } channel[8];
+    } channel_group[2];
+} ledc_dev_t;
+
+extern ledc_dev_t LEDC;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 只模拟了 GPIO 输出的置位、清零寄存器，写进去的电平变化由模拟器记录
+
+void SimGpio_write_reg(uint32_t reg, uint32_t value);
+uint32_t SimGpio_read_reg(uint32_t reg);
+
+#define REG_WRITE(reg, value) SimGpio_write_reg((uint32_t)(reg), (uint32_t)(value))
+#define REG_READ(reg) SimGpio_read_reg((uint32_t)(reg))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,87 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <cJSON.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <nvs_flash.h>
+
+#include "borneo/common.h"
+#include "borneo/cron.h"
+#include "borneo/device-config.h"
+#include "borneo/rpc.h"
+#include "borneo/rtc.h"
+#include "borneo/serial.h"
+#include "borneo-doser/devices/flow-control.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/dose-history.h"
+#include "borneo-doser/rpc/doser.h"
+#include "borneo-doser/scheduler.h"
+
+#include "sim.h"
+
+// 在 PC 上运行的 RPC 服务端：固件的服务端、RPC 方法、泵驱动和调度器原样编译，泵和 Flash 用模拟器的
+// 时间是实时的，scripts/load-test.py 这些脚本可以直接连本机测试，不需要设备
+// 用法：rpc-host [--verbose]，然后 scripts/load-test.py --host 127.0.0.1 --port <BORNEO_DEVICE_TCP_PORT>
+
+// PC 上没有 eFuse 里的 MAC 地址，序列号固定
+static const char* HOST_SERIAL = "00000000000000000000000000000000";
+
+// 各通道校准的速度，单位 mL/min
+static const double HOST_PUMP_SPEEDS[PUMP_MAX_CHANNELS] = { 12.0, 12.0, 24.0, 6.0 };
+
+extern const PumpPort PUMP_PORT_TABLE[];
+extern const uint8_t FLOW_METER_IO_PINS[];
+
+int Serial_init() { return 0; }
+
+char* Serial_get() { return (char*)HOST_SERIAL; }
+
+int main(int argc, char* argv[])
+{
+    bool is_verbose = argc > 1 && strcmp(argv[1], "--verbose") == 0;
+    esp_log_level_set("*", is_verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+    // 输出到管道（比如 ctest）的时候也按行输出，进程被结束时日志不会丢
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    // 客户端断开的时候 send() 不能把进程结束掉
+    signal(SIGPIPE, SIG_IGN);
+
+    SimRtc_set_epoch(time(NULL));
+    SimHw_set_irq_latency(2, 20, 1);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        SimHw_attach_pump(PUMP_PORT_TABLE[i].io_pin, HOST_PUMP_SPEEDS[i]);
+        SimHw_attach_flow_meter(FLOW_METER_IO_PINS[i], PUMP_PORT_TABLE[i].io_pin, 20.0);
+    }
+    Sim_set_realtime();
+
+    // 和 app-main.c 的顺序一样，只是没有 WiFi 和其他网络服务
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    ESP_ERROR_CHECK(Serial_init());
+    ESP_ERROR_CHECK(FlowControl_init());
+    ESP_ERROR_CHECK(Pump_init());
+    for (int i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        ESP_ERROR_CHECK(Pump_update_speed(i, HOST_PUMP_SPEEDS[i]));
+    }
+    ESP_ERROR_CHECK(Rtc_init());
+    ESP_ERROR_CHECK(Rtc_start());
+    ESP_ERROR_CHECK(DoseHistory_init());
+    ESP_ERROR_CHECK(Scheduler_init());
+    ESP_ERROR_CHECK(Scheduler_start());
+
+    ESP_ERROR_CHECK(Rpc_init(RPC_METHOD_TABLE, RPC_METHOD_TABLE_SIZE));
+    ESP_ERROR_CHECK(Rpc_start());
+    ESP_ERROR_CHECK(DoserRpc_init());
+    ESP_ERROR_CHECK(DoserRpc_dose_init());
+
+    printf("RPC server listening on TCP/UDP port %d, WebSocket port %d\n", BORNEO_DEVICE_TCP_PORT,
+        BORNEO_DEVICE_WS_PORT);
+    fflush(stdout);
+
+    // 调度器和定时器一直有事件，不会返回，用 Ctrl-C 结束
+    Sim_run_until(SIM_NEVER);
+    return 0;
+}
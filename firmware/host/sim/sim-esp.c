@@ -0,0 +1,636 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <esp32/rom/crc.h>
+#include <esp_err.h>
+#include <esp_event.h>
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "sim.h"
+
+// ESP-IDF 系统服务的模拟：esp_timer、默认事件循环、日志、NVS、Flash 分区
+
+// 和 ESP-IDF 的任务优先级一样，定时器任务最高，事件循环其次
+#define ESP_TIMER_TASK_PRIORITY 22
+#define EVENT_LOOP_TASK_PRIORITY 20
+
+#define NVS_MAX_NAMESPACES 16
+#define NVS_MAX_HANDLES 16
+
+struct esp_timer {
+    SimTimer timer;
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t period; // 0 表示单次
+    bool is_expired; // 到期了，回调还没在定时器任务里执行
+    uint64_t expired_seq;
+};
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void* arg;
+} EventHandlerEntry;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void* data;
+} EventItem;
+
+typedef enum {
+    NVS_TYPE_U8,
+    NVS_TYPE_BLOB,
+} NvsType;
+
+typedef struct NvsEntry {
+    uint8_t ns; // 命名空间的序号
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    NvsType type;
+    size_t size;
+    uint8_t* data;
+    struct NvsEntry* next;
+} NvsEntry;
+
+typedef struct {
+    bool is_open;
+    uint8_t ns;
+    nvs_open_mode_t mode;
+} NvsHandleEntry;
+
+typedef struct {
+    esp_partition_t info;
+    uint8_t* data;
+} SimPartition;
+
+static void esp_timer_expired(void* arg);
+static void esp_timer_task(void* params);
+static void event_loop_task(void* params);
+static NvsEntry* nvs_find(const NvsHandleEntry* handle, const char* key);
+static esp_err_t nvs_check(nvs_handle_t handle, const char* key, bool is_write, NvsHandleEntry** out_handle);
+static esp_err_t nvs_set(nvs_handle_t handle, const char* key, NvsType type, const void* value, size_t length);
+
+static TaskHandle_t s_esp_timer_task = NULL;
+static uint64_t s_expired_seq = 0;
+static esp_timer_handle_t* s_esp_timers = NULL;
+static size_t s_esp_timers_count = 0;
+
+static QueueHandle_t s_event_queue = NULL;
+static EventHandlerEntry* s_event_handlers = NULL;
+static size_t s_event_handlers_count = 0;
+
+static esp_log_level_t s_log_level = ESP_LOG_WARN;
+
+static bool s_is_nvs_initialized = false;
+static char s_nvs_namespaces[NVS_MAX_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+static size_t s_nvs_namespaces_count = 0;
+static NvsHandleEntry s_nvs_handles[NVS_MAX_HANDLES];
+static NvsEntry* s_nvs_entries = NULL;
+
+// 和 partitions.csv 里的一样
+static SimPartition s_partitions[] = {
+    { .info = { .type = ESP_PARTITION_TYPE_DATA, .subtype = 0x40, .address = 0x110000, .size = 128 * 1024,
+          .label = "history" } },
+};
+static uint32_t s_erase_count = 0;
+
+static uint32_t s_random_state = 0x9E3779B9u;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+    if (s_esp_timer_task == NULL) {
+        xTaskCreate(&esp_timer_task, "esp_timer", 4096, NULL, ESP_TIMER_TASK_PRIORITY, &s_esp_timer_task);
+    }
+
+    esp_timer_handle_t timer = calloc(1, sizeof(struct esp_timer));
+    esp_timer_handle_t* timers = realloc(s_esp_timers, sizeof(esp_timer_handle_t) * (s_esp_timers_count + 1));
+    if (timer == NULL || timers == NULL) {
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    s_esp_timers = timers;
+    s_esp_timers[s_esp_timers_count++] = timer;
+
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    SimTimer_init(&timer->timer, &esp_timer_expired, timer);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    if (timer->timer.is_armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period = 0;
+    SimTimer_arm(&timer->timer, Sim_now() + timeout_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    if (timer->timer.is_armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period = period;
+    SimTimer_arm(&timer->timer, Sim_now() + period);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (!timer->timer.is_armed && !timer->is_expired) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    SimTimer_disarm(&timer->timer);
+    timer->is_expired = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer->timer.is_armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // SimTimer 还挂在调度器的链表上，只是不再使用
+    timer->callback = NULL;
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time() { return (int64_t)Sim_now(); }
+
+esp_err_t esp_event_loop_create_default()
+{
+    if (s_event_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_queue = xQueueCreate(CONFIG_ESP_SYSTEM_EVENT_QUEUE_SIZE, sizeof(EventItem));
+    if (s_event_queue == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    xTaskCreate(&event_loop_task, "sys_evt", 2304, NULL, EVENT_LOOP_TASK_PRIORITY, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(
+    esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler, void* event_handler_arg)
+{
+    EventHandlerEntry* handlers
+        = realloc(s_event_handlers, sizeof(EventHandlerEntry) * (s_event_handlers_count + 1));
+    if (handlers == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_event_handlers = handlers;
+    EventHandlerEntry* entry = &s_event_handlers[s_event_handlers_count++];
+    entry->base = event_base;
+    entry->id = event_id;
+    entry->handler = event_handler;
+    entry->arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base, int32_t event_id, esp_event_handler_t event_handler)
+{
+    for (size_t i = 0; i < s_event_handlers_count; i++) {
+        EventHandlerEntry* entry = &s_event_handlers[i];
+        if (entry->base == event_base && entry->id == event_id && entry->handler == event_handler) {
+            memmove(entry, entry + 1, sizeof(EventHandlerEntry) * (s_event_handlers_count - i - 1));
+            s_event_handlers_count--;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * 和 ESP-IDF 一样复制一份事件数据，队列满了等 ticks_to_wait，等不到就失败
+ */
+esp_err_t esp_event_post(
+    esp_event_base_t event_base, int32_t event_id, void* event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    if (s_event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    EventItem item = { .base = event_base, .id = event_id, .data = NULL };
+    if (event_data != NULL && event_data_size > 0) {
+        item.data = malloc(event_data_size);
+        if (item.data == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(item.data, event_data, event_data_size);
+    }
+    if (xQueueSend(s_event_queue, &item, ticks_to_wait) != pdTRUE) {
+        free(item.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char LEVEL_LETTERS[] = "NEWIDV";
+    if (level > s_log_level) {
+        return;
+    }
+    // 和 ESP-IDF 一样打印开机以来的毫秒数，这里是虚拟时间
+    printf("%c (%llu) %s: ", LEVEL_LETTERS[level], (unsigned long long)(Sim_now() / 1000ULL), tag);
+    va_list args;
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) { s_log_level = level; }
+
+esp_err_t nvs_flash_init()
+{
+    s_is_nvs_initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase()
+{
+    while (s_nvs_entries != NULL) {
+        NvsEntry* entry = s_nvs_entries;
+        s_nvs_entries = entry->next;
+        free(entry->data);
+        free(entry);
+    }
+    s_nvs_namespaces_count = 0;
+    return ESP_OK;
+}
+
+/**
+ * 和真的 NVS 一样，只读打开不存在的命名空间返回 ESP_ERR_NVS_NOT_FOUND
+ */
+esp_err_t nvs_open(const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle)
+{
+    if (!s_is_nvs_initialized) {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (strlen(name) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    size_t ns = 0;
+    while (ns < s_nvs_namespaces_count && strcmp(s_nvs_namespaces[ns], name) != 0) {
+        ns++;
+    }
+    if (ns == s_nvs_namespaces_count) {
+        if (open_mode == NVS_READONLY) {
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        if (s_nvs_namespaces_count == NVS_MAX_NAMESPACES) {
+            return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+        }
+        strcpy(s_nvs_namespaces[s_nvs_namespaces_count++], name);
+    }
+
+    for (size_t i = 0; i < NVS_MAX_HANDLES; i++) {
+        if (!s_nvs_handles[i].is_open) {
+            s_nvs_handles[i].is_open = true;
+            s_nvs_handles[i].ns = (uint8_t)ns;
+            s_nvs_handles[i].mode = open_mode;
+            // 0 不是有效的句柄
+            *out_handle = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES) {
+        s_nvs_handles[handle - 1].is_open = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return nvs_check(handle, NULL, false, NULL); }
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key)
+{
+    NvsHandleEntry* h = NULL;
+    esp_err_t err = nvs_check(handle, key, true, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (NvsEntry** p = &s_nvs_entries; *p != NULL; p = &(*p)->next) {
+        NvsEntry* entry = *p;
+        if (entry->ns == h->ns && strcmp(entry->key, key) == 0) {
+            *p = entry->next;
+            free(entry->data);
+            free(entry);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    NvsHandleEntry* h = NULL;
+    esp_err_t err = nvs_check(handle, NULL, true, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    NvsEntry** p = &s_nvs_entries;
+    while (*p != NULL) {
+        NvsEntry* entry = *p;
+        if (entry->ns == h->ns) {
+            *p = entry->next;
+            free(entry->data);
+            free(entry);
+        } else {
+            p = &entry->next;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char* key, uint8_t value)
+{
+    return nvs_set(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char* key, uint8_t* out_value)
+{
+    NvsHandleEntry* h = NULL;
+    esp_err_t err = nvs_check(handle, key, false, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    NvsEntry* entry = nvs_find(h, key);
+    if (entry == NULL || entry->type != NVS_TYPE_U8) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out_value = entry->data[0];
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length)
+{
+    return nvs_set(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+/**
+ * out_value 为 NULL 时只返回大小，缓冲区不够大返回 ESP_ERR_NVS_INVALID_LENGTH
+ */
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length)
+{
+    NvsHandleEntry* h = NULL;
+    esp_err_t err = nvs_check(handle, key, false, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+    NvsEntry* entry = nvs_find(h, key);
+    if (entry == NULL || entry->type != NVS_TYPE_BLOB) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out_value == NULL) {
+        *length = entry->size;
+        return ESP_OK;
+    }
+    if (*length < entry->size) {
+        *length = entry->size;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->data, entry->size);
+    *length = entry->size;
+    return ESP_OK;
+}
+
+const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+    for (size_t i = 0; i < sizeof(s_partitions) / sizeof(SimPartition); i++) {
+        SimPartition* part = &s_partitions[i];
+        if (part->info.type != type || (subtype != ESP_PARTITION_SUBTYPE_ANY && part->info.subtype != subtype)
+            || (label != NULL && strcmp(part->info.label, label) != 0)) {
+            continue;
+        }
+        if (part->data == NULL) {
+            part->data = malloc(part->info.size);
+            if (part->data == NULL) {
+                return NULL;
+            }
+            memset(part->data, 0xFF, part->info.size);
+        }
+        return &part->info;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+    const SimPartition* part = (const SimPartition*)partition;
+    if (src_offset > part->info.size || size > part->info.size - src_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, &part->data[src_offset], size);
+    return ESP_OK;
+}
+
+/**
+ * NOR Flash 只能把 1 写成 0，没擦除就重写的话结果是新旧数据按位与
+ */
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size)
+{
+    SimPartition* part = (SimPartition*)partition;
+    if (dst_offset > part->info.size || size > part->info.size - dst_offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < size; i++) {
+        part->data[dst_offset + i] &= bytes[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size)
+{
+    SimPartition* part = (SimPartition*)partition;
+    if (offset > part->info.size || size > part->info.size - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memset(&part->data[offset], 0xFF, size);
+    s_erase_count += (uint32_t)(size / SPI_FLASH_SEC_SIZE);
+    return ESP_OK;
+}
+
+uint32_t SimFlash_get_erase_count() { return s_erase_count; }
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t esp_random()
+{
+    s_random_state ^= s_random_state << 13;
+    s_random_state ^= s_random_state >> 17;
+    s_random_state ^= s_random_state << 5;
+    return s_random_state;
+}
+
+// ESP32 上设备正常运行时大概的值
+uint32_t esp_get_free_heap_size() { return 160 * 1024; }
+
+uint32_t esp_get_minimum_free_heap_size() { return 120 * 1024; }
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return 110 * 1024; }
+
+void esp_restart()
+{
+    fprintf(stderr, "esp_restart() called at %llu us\n", (unsigned long long)Sim_now());
+    abort();
+}
+
+static void esp_timer_expired(void* arg)
+{
+    esp_timer_handle_t timer = (esp_timer_handle_t)arg;
+    if (timer->callback == NULL) {
+        return;
+    }
+    if (timer->period > 0) {
+        // 周期定时器按到期的时间重新设置，不受回调执行时间的影响
+        SimTimer_arm(&timer->timer, timer->timer.deadline + timer->period);
+    }
+    timer->is_expired = true;
+    timer->expired_seq = ++s_expired_seq;
+    xTaskNotifyGive(s_esp_timer_task);
+}
+
+/**
+ * 按到期的先后执行回调，回调里停掉的定时器不再执行
+ */
+static void esp_timer_task(void* params)
+{
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        for (;;) {
+            esp_timer_handle_t next = NULL;
+            for (size_t i = 0; i < s_esp_timers_count; i++) {
+                esp_timer_handle_t timer = s_esp_timers[i];
+                if (timer->is_expired && (next == NULL || timer->expired_seq < next->expired_seq)) {
+                    next = timer;
+                }
+            }
+            if (next == NULL) {
+                break;
+            }
+            next->is_expired = false;
+            if (next->callback != NULL) {
+                next->callback(next->arg);
+            }
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static void event_loop_task(void* params)
+{
+    for (;;) {
+        EventItem item;
+        xQueueReceive(s_event_queue, &item, portMAX_DELAY);
+        // 处理函数可能在处理的时候注册新的处理函数，所以每次都用下标访问
+        for (size_t i = 0; i < s_event_handlers_count; i++) {
+            const EventHandlerEntry* entry = &s_event_handlers[i];
+            if ((entry->base == ESP_EVENT_ANY_BASE || entry->base == item.base)
+                && (entry->id == ESP_EVENT_ANY_ID || entry->id == item.id)) {
+                entry->handler(entry->arg, item.base, item.id, item.data);
+            }
+        }
+        free(item.data);
+    }
+    vTaskDelete(NULL);
+}
+
+static NvsEntry* nvs_find(const NvsHandleEntry* handle, const char* key)
+{
+    for (NvsEntry* entry = s_nvs_entries; entry != NULL; entry = entry->next) {
+        if (entry->ns == handle->ns && strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t nvs_check(nvs_handle_t handle, const char* key, bool is_write, NvsHandleEntry** out_handle)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !s_nvs_handles[handle - 1].is_open) {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    NvsHandleEntry* h = &s_nvs_handles[handle - 1];
+    if (is_write && h->mode == NVS_READONLY) {
+        return ESP_ERR_NVS_READ_ONLY;
+    }
+    if (key != NULL && strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    if (out_handle != NULL) {
+        *out_handle = h;
+    }
+    return ESP_OK;
+}
+
+/**
+ * 同一个键只有一个值，换了类型的话旧的值被替换掉
+ */
+static esp_err_t nvs_set(nvs_handle_t handle, const char* key, NvsType type, const void* value, size_t length)
+{
+    NvsHandleEntry* h = NULL;
+    esp_err_t err = nvs_check(handle, key, true, &h);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    uint8_t* data = malloc(length > 0 ? length : 1);
+    if (data == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(data, value, length);
+
+    NvsEntry* entry = nvs_find(h, key);
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(NvsEntry));
+        if (entry == NULL) {
+            free(data);
+            return ESP_ERR_NO_MEM;
+        }
+        entry->ns = h->ns;
+        strcpy(entry->key, key);
+        entry->next = s_nvs_entries;
+        s_nvs_entries = entry;
+    }
+    free(entry->data);
+    entry->type = type;
+    entry->size = length;
+    entry->data = data;
+    return ESP_OK;
+}
@@ -0,0 +1,712 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <driver/gpio.h>
+#include <driver/ledc.h>
+#include <driver/pcnt.h>
+#include <driver/timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <soc/gpio_reg.h>
+#include <soc/ledc_struct.h>
+#include <soc/soc.h>
+
+#include "sim.h"
+
+// 外设的模拟：GPIO 输出、LEDC 的 PWM 和渐变、硬件定时器组、脉冲计数器
+// 引脚上可以接泵，泵的流量按引脚的驱动（GPIO 电平或者 LEDC 占空比）积分成实际打出去的体积
+// 驱动只在寄存器被写的时刻变化，两次变化之间是常数或者线性的渐变，积分是精确的
+
+#define SIM_GPIO_COUNT 40
+#define SIM_LEDC_CHANNELS 8
+#define SIM_APB_CLK_MHZ 80
+
+typedef struct {
+    bool is_attached;
+    double ml_per_min; // 驱动满额时的流量
+    double volume; // 到 last_time 为止打出去的体积
+    uint64_t last_time;
+    bool is_on;
+    uint32_t toggle_count;
+} SimPump;
+
+typedef struct {
+    bool is_attached;
+    int pump_pin;
+    double pulses_per_ml;
+} SimFlowMeter;
+
+// LEDC 通道的输出，寄存器被写以后在 SimHw_sync() 里同步过来
+typedef struct {
+    int gpio_num; // -1 表示没有配置
+    bool is_out_enabled;
+    uint32_t idle_level;
+    // 占空比从 fade_start 的 duty_from 线性变到 fade_end 的 duty_to，之后保持 duty_to
+    uint64_t fade_start;
+    uint64_t fade_end;
+    double duty_from;
+    double duty_to;
+    // ledc_set_fade_with_time() 设置、ledc_fade_start() 开始的渐变
+    uint32_t pending_target;
+    int pending_fade_ms;
+    bool has_pending_fade;
+} SimLedcChannel;
+
+typedef struct {
+    bool is_initialized;
+    bool is_running;
+    bool is_alarm_enabled;
+    uint32_t divider;
+    uint64_t base_count; // base_time 时的计数
+    uint64_t base_time;
+    uint64_t alarm_value;
+    void (*isr)(void*);
+    void* isr_arg;
+    SimTimer alarm_timer;
+} SimHwTimer;
+
+typedef struct {
+    bool is_configured;
+    int pulse_gpio_num;
+    int16_t counter_h_lim;
+    bool is_paused;
+    int64_t base_pulses; // 计数为 0 时流量计的累计脉冲数
+    int16_t paused_count;
+} SimPcntUnit;
+
+static double pin_drive_at(int pin, uint64_t time);
+static void advance_pin(int pin);
+static void update_pin_state(int pin);
+static double integrate_drive(int pin, uint64_t from, uint64_t to);
+static double ledc_duty_at(const SimLedcChannel* ch, uint64_t time);
+static double ledc_max_duty();
+static int ledc_channel_of_pin(int pin);
+static void start_ledc_fade(int channel, uint32_t target, int fade_ms);
+static void arm_alarm(SimHwTimer* timer);
+static uint64_t counter_at(const SimHwTimer* timer, uint64_t time);
+static void alarm_expired(void* arg);
+static int64_t meter_pulses(int meter_pin);
+static int16_t pcnt_count(const SimPcntUnit* unit);
+
+ledc_dev_t LEDC;
+
+static uint64_t s_gpio_levels = 0;
+static bool s_pin_is_ledc[SIM_GPIO_COUNT];
+static SimPump s_pumps[SIM_GPIO_COUNT];
+static SimFlowMeter s_meters[SIM_GPIO_COUNT];
+static SimLedcChannel s_ledc_channels[SIM_LEDC_CHANNELS];
+static uint32_t s_ledc_resolution = 13;
+static bool s_is_ledc_initialized = false;
+static SimHwTimer s_timers[TIMER_GROUP_MAX][TIMER_MAX];
+static SimPcntUnit s_pcnt_units[PCNT_UNIT_MAX];
+
+// 同时开着的泵的个数，用来检查固件的并行限制
+static uint32_t s_running_count = 0;
+static uint32_t s_peak_running = 0;
+static uint64_t s_idle_since = 0;
+
+static uint32_t s_latency_min_us = 0;
+static uint32_t s_latency_max_us = 0;
+static uint32_t s_latency_seed = 1;
+
+void SimHw_set_irq_latency(uint32_t min_us, uint32_t max_us, uint32_t seed)
+{
+    s_latency_min_us = min_us;
+    s_latency_max_us = max_us < min_us ? min_us : max_us;
+    s_latency_seed = seed != 0 ? seed : 1;
+}
+
+void SimHw_attach_pump(int pin, double ml_per_min)
+{
+    SimPump* pump = &s_pumps[pin];
+    memset(pump, 0, sizeof(SimPump));
+    pump->is_attached = true;
+    pump->ml_per_min = ml_per_min;
+    pump->last_time = Sim_now();
+}
+
+void SimHw_attach_flow_meter(int meter_pin, int pump_pin, double pulses_per_ml)
+{
+    s_meters[meter_pin].is_attached = true;
+    s_meters[meter_pin].pump_pin = pump_pin;
+    s_meters[meter_pin].pulses_per_ml = pulses_per_ml;
+}
+
+double SimHw_get_pumped_volume(int pin)
+{
+    advance_pin(pin);
+    return s_pumps[pin].volume;
+}
+
+uint32_t SimHw_get_toggle_count(int pin) { return s_pumps[pin].toggle_count; }
+
+uint32_t SimHw_get_peak_running() { return s_peak_running; }
+
+uint64_t SimHw_get_idle_since() { return s_idle_since; }
+
+/**
+ * 固件直接写了 LEDC 寄存器的话，先把旧的输出积分到现在，再按新的寄存器值输出
+ */
+void SimHw_sync()
+{
+    if (!s_is_ledc_initialized) {
+        return;
+    }
+    for (int i = 0; i < SIM_LEDC_CHANNELS; i++) {
+        SimLedcChannel* ch = &s_ledc_channels[i];
+        if (ch->gpio_num < 0) {
+            continue;
+        }
+        typeof(LEDC.channel_group[0].channel[0])* regs = &LEDC.channel_group[LEDC_HIGH_SPEED_MODE].channel[i];
+        bool is_out_enabled = regs->conf0.sig_out_en != 0;
+        if (is_out_enabled == ch->is_out_enabled && regs->conf0.idle_lv == ch->idle_level && !regs->conf1.duty_start) {
+            continue;
+        }
+
+        advance_pin(ch->gpio_num);
+        ch->is_out_enabled = is_out_enabled;
+        ch->idle_level = regs->conf0.idle_lv;
+        if (regs->conf1.duty_start) {
+            // 新的占空比马上生效，正在进行的渐变被打断
+            regs->conf1.duty_start = 0;
+            ch->fade_start = ch->fade_end = Sim_now();
+            ch->duty_from = ch->duty_to = (double)(regs->duty.duty >> 4);
+        }
+        update_pin_state(ch->gpio_num);
+    }
+}
+
+void SimGpio_write_reg(uint32_t reg, uint32_t value)
+{
+    uint64_t levels = s_gpio_levels;
+    switch (reg) {
+    case GPIO_OUT_W1TS_REG:
+        levels |= value;
+        break;
+    case GPIO_OUT_W1TC_REG:
+        levels &= ~(uint64_t)value;
+        break;
+    case GPIO_OUT1_W1TS_REG:
+        levels |= (uint64_t)value << 32;
+        break;
+    case GPIO_OUT1_W1TC_REG:
+        levels &= ~((uint64_t)value << 32);
+        break;
+    case GPIO_OUT_REG:
+        levels = (levels & 0xFFFFFFFF00000000ULL) | value;
+        break;
+    case GPIO_OUT1_REG:
+        levels = (levels & 0xFFFFFFFFULL) | ((uint64_t)value << 32);
+        break;
+    default:
+        fprintf(stderr, "SimGpio_write_reg: unsupported register 0x%08X\n", reg);
+        abort();
+    }
+
+    uint64_t changed = levels ^ s_gpio_levels;
+    for (int pin = 0; pin < SIM_GPIO_COUNT; pin++) {
+        if ((changed & (1ULL << pin)) != 0) {
+            advance_pin(pin);
+        }
+    }
+    s_gpio_levels = levels;
+    for (int pin = 0; pin < SIM_GPIO_COUNT; pin++) {
+        if ((changed & (1ULL << pin)) != 0) {
+            update_pin_state(pin);
+        }
+    }
+}
+
+uint32_t SimGpio_read_reg(uint32_t reg)
+{
+    switch (reg) {
+    case GPIO_OUT_REG:
+        return (uint32_t)s_gpio_levels;
+    case GPIO_OUT1_REG:
+        return (uint32_t)(s_gpio_levels >> 32);
+    default:
+        return 0;
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t* config)
+{
+    for (int pin = 0; pin < SIM_GPIO_COUNT; pin++) {
+        if ((config->pin_bit_mask & (1ULL << pin)) == 0) {
+            continue;
+        }
+        advance_pin(pin);
+        s_pin_is_ledc[pin] = false;
+        s_gpio_levels &= ~(1ULL << pin);
+        update_pin_state(pin);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (gpio_num < 32) {
+        SimGpio_write_reg(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1UL << gpio_num);
+    } else {
+        SimGpio_write_reg(level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, 1UL << (gpio_num - 32));
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) { return (int)((s_gpio_levels >> gpio_num) & 1); }
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* timer_conf)
+{
+    s_ledc_resolution = timer_conf->duty_resolution;
+    return ESP_OK;
+}
+
+/**
+ * 引脚交给 LEDC，输出按 duty 开始
+ */
+esp_err_t ledc_channel_config(const ledc_channel_config_t* ledc_conf)
+{
+    if (ledc_conf->channel >= SIM_LEDC_CHANNELS || ledc_conf->gpio_num < 0 || ledc_conf->gpio_num >= SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_is_ledc_initialized) {
+        for (int i = 0; i < SIM_LEDC_CHANNELS; i++) {
+            s_ledc_channels[i].gpio_num = -1;
+        }
+        s_is_ledc_initialized = true;
+    }
+
+    int pin = ledc_conf->gpio_num;
+    advance_pin(pin);
+    SimLedcChannel* ch = &s_ledc_channels[ledc_conf->channel];
+    memset(ch, 0, sizeof(SimLedcChannel));
+    ch->gpio_num = pin;
+    ch->is_out_enabled = true;
+    ch->fade_start = ch->fade_end = Sim_now();
+    ch->duty_from = ch->duty_to = ledc_conf->duty;
+    s_pin_is_ledc[pin] = true;
+
+    typeof(LEDC.channel_group[0].channel[0])* regs = &LEDC.channel_group[ledc_conf->speed_mode].channel[ledc_conf->channel];
+    memset(regs, 0, sizeof(*regs));
+    regs->conf0.timer_sel = ledc_conf->timer_sel;
+    regs->conf0.sig_out_en = 1;
+    regs->duty.duty = ledc_conf->duty << 4;
+    update_pin_state(pin);
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) { return ESP_OK; }
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty)
+{
+    LEDC.channel_group[speed_mode].channel[channel].duty.duty = duty << 4;
+    return ESP_OK;
+}
+
+/**
+ * 和 ESP-IDF 一样会重新打开输出
+ */
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    LEDC.channel_group[speed_mode].channel[channel].conf0.sig_out_en = 1;
+    LEDC.channel_group[speed_mode].channel[channel].conf1.duty_start = 1;
+    SimHw_sync();
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    return (uint32_t)lround(ledc_duty_at(&s_ledc_channels[channel], Sim_now()));
+}
+
+/**
+ * 上一个渐变还没结束的话，和 ESP-IDF 一样等它结束
+ */
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms)
+{
+    SimLedcChannel* ch = &s_ledc_channels[channel];
+    if (ch->fade_end > Sim_now()) {
+        uint64_t wait_us = ch->fade_end - Sim_now();
+        vTaskDelay((TickType_t)((wait_us + portTICK_PERIOD_MS * 1000ULL - 1) / (portTICK_PERIOD_MS * 1000ULL)));
+    }
+    ch->pending_target = target_duty;
+    ch->pending_fade_ms = max_fade_time_ms;
+    ch->has_pending_fade = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode)
+{
+    SimLedcChannel* ch = &s_ledc_channels[channel];
+    if (!ch->has_pending_fade) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    ch->has_pending_fade = false;
+    // 渐变也会重新打开输出，先把寄存器的变化同步过来
+    SimHw_sync();
+    LEDC.channel_group[speed_mode].channel[channel].conf0.sig_out_en = 1;
+    start_ledc_fade(channel, ch->pending_target, ch->pending_fade_ms);
+    if (fade_mode == LEDC_FADE_WAIT_DONE && ch->fade_end > Sim_now()) {
+        uint64_t wait_us = ch->fade_end - Sim_now();
+        vTaskDelay((TickType_t)((wait_us + portTICK_PERIOD_MS * 1000ULL - 1) / (portTICK_PERIOD_MS * 1000ULL)));
+    }
+    return ESP_OK;
+}
+
+esp_err_t timer_init(timer_group_t group_num, timer_idx_t timer_num, const timer_config_t* config)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    if (!timer->is_initialized) {
+        SimTimer_init(&timer->alarm_timer, &alarm_expired, timer);
+    }
+    timer->is_initialized = true;
+    timer->divider = config->divider;
+    timer->is_running = config->counter_en == TIMER_START;
+    timer->is_alarm_enabled = config->alarm_en == TIMER_ALARM_EN;
+    timer->base_count = 0;
+    timer->base_time = Sim_now();
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t load_val)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->base_count = load_val;
+    timer->base_time = Sim_now();
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_get_counter_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t* timer_val)
+{
+    *timer_val = counter_at(&s_timers[group_num][timer_num], Sim_now());
+    return ESP_OK;
+}
+
+esp_err_t timer_start(timer_group_t group_num, timer_idx_t timer_num)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->base_count = counter_at(timer, Sim_now());
+    timer->base_time = Sim_now();
+    timer->is_running = true;
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_pause(timer_group_t group_num, timer_idx_t timer_num)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->base_count = counter_at(timer, Sim_now());
+    timer->base_time = Sim_now();
+    timer->is_running = false;
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_value)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->alarm_value = alarm_value;
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_set_alarm(timer_group_t group_num, timer_idx_t timer_num, timer_alarm_t alarm_en)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->is_alarm_enabled = alarm_en == TIMER_ALARM_EN;
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+esp_err_t timer_enable_intr(timer_group_t group_num, timer_idx_t timer_num) { return ESP_OK; }
+
+esp_err_t timer_isr_register(timer_group_t group_num, timer_idx_t timer_num, void (*fn)(void*), void* arg,
+    int intr_alloc_flags, timer_isr_handle_t* handle)
+{
+    SimHwTimer* timer = &s_timers[group_num][timer_num];
+    timer->isr = fn;
+    timer->isr_arg = arg;
+    arm_alarm(timer);
+    return ESP_OK;
+}
+
+void timer_group_clr_intr_status_in_isr(timer_group_t group_num, timer_idx_t timer_num) { }
+
+uint64_t timer_group_get_counter_value_in_isr(timer_group_t group_num, timer_idx_t timer_num)
+{
+    return counter_at(&s_timers[group_num][timer_num], Sim_now());
+}
+
+void timer_group_set_alarm_value_in_isr(timer_group_t group_num, timer_idx_t timer_num, uint64_t alarm_val)
+{
+    timer_set_alarm_value(group_num, timer_num, alarm_val);
+}
+
+void timer_group_enable_alarm_in_isr(timer_group_t group_num, timer_idx_t timer_num)
+{
+    timer_set_alarm(group_num, timer_num, TIMER_ALARM_EN);
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* pcnt_config)
+{
+    if (pcnt_config->unit >= PCNT_UNIT_MAX || pcnt_config->pulse_gpio_num < 0
+        || pcnt_config->pulse_gpio_num >= SIM_GPIO_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    SimPcntUnit* unit = &s_pcnt_units[pcnt_config->unit];
+    unit->is_configured = true;
+    unit->pulse_gpio_num = pcnt_config->pulse_gpio_num;
+    unit->counter_h_lim = pcnt_config->counter_h_lim;
+    unit->is_paused = false;
+    unit->base_pulses = meter_pulses(unit->pulse_gpio_num);
+    return ESP_OK;
+}
+
+// 流量计的脉冲都很宽，滤波不影响计数
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filter_val) { return ESP_OK; }
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) { return ESP_OK; }
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit)
+{
+    SimPcntUnit* u = &s_pcnt_units[unit];
+    u->paused_count = pcnt_count(u);
+    u->is_paused = true;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit)
+{
+    SimPcntUnit* u = &s_pcnt_units[unit];
+    if (u->is_paused) {
+        u->base_pulses = meter_pulses(u->pulse_gpio_num) - u->paused_count;
+        u->is_paused = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit)
+{
+    SimPcntUnit* u = &s_pcnt_units[unit];
+    u->paused_count = 0;
+    u->base_pulses = meter_pulses(u->pulse_gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count)
+{
+    *count = pcnt_count(&s_pcnt_units[unit]);
+    return ESP_OK;
+}
+
+/**
+ * 驱动的比例，0 是关，1 是满额
+ */
+static double pin_drive_at(int pin, uint64_t time)
+{
+    if (!s_pin_is_ledc[pin]) {
+        return (double)((s_gpio_levels >> pin) & 1);
+    }
+    int channel = ledc_channel_of_pin(pin);
+    if (channel < 0) {
+        return 0.0;
+    }
+    const SimLedcChannel* ch = &s_ledc_channels[channel];
+    if (!ch->is_out_enabled) {
+        return (double)ch->idle_level;
+    }
+    return ledc_duty_at(ch, time) / ledc_max_duty();
+}
+
+/**
+ * 按当前的驱动把泵打出去的体积积分到现在，驱动变化之前调用
+ */
+static void advance_pin(int pin)
+{
+    SimPump* pump = &s_pumps[pin];
+    if (!pump->is_attached) {
+        return;
+    }
+    uint64_t now = Sim_now();
+    if (now > pump->last_time) {
+        pump->volume += pump->ml_per_min * integrate_drive(pin, pump->last_time, now) / (60.0 * 1000.0 * 1000.0);
+        pump->last_time = now;
+    }
+}
+
+/**
+ * 驱动变化之后调用，记下泵开关的次数和同时开着的个数。占空比从 0 开始渐变的也算打开
+ */
+static void update_pin_state(int pin)
+{
+    SimPump* pump = &s_pumps[pin];
+    if (!pump->is_attached) {
+        return;
+    }
+    bool is_on;
+    if (s_pin_is_ledc[pin]) {
+        int channel = ledc_channel_of_pin(pin);
+        const SimLedcChannel* ch = channel >= 0 ? &s_ledc_channels[channel] : NULL;
+        is_on = ch != NULL
+            && (ch->is_out_enabled ? (ch->duty_from > 0.0 || ch->duty_to > 0.0) : ch->idle_level != 0);
+    } else {
+        is_on = ((s_gpio_levels >> pin) & 1) != 0;
+    }
+    if (is_on != pump->is_on) {
+        pump->toggle_count++;
+        pump->is_on = is_on;
+        if (is_on) {
+            s_running_count++;
+            s_peak_running = s_running_count > s_peak_running ? s_running_count : s_peak_running;
+        } else if (--s_running_count == 0) {
+            s_idle_since = Sim_now();
+        }
+    }
+}
+
+/**
+ * [from, to] 之间驱动比例的积分，单位是微秒
+ */
+static double integrate_drive(int pin, uint64_t from, uint64_t to)
+{
+    if (!s_pin_is_ledc[pin]) {
+        return pin_drive_at(pin, from) * (double)(to - from);
+    }
+    int channel = ledc_channel_of_pin(pin);
+    if (channel < 0 || !s_ledc_channels[channel].is_out_enabled) {
+        return pin_drive_at(pin, from) * (double)(to - from);
+    }
+
+    // 渐变的部分是梯形，之后是矩形
+    const SimLedcChannel* ch = &s_ledc_channels[channel];
+    double sum = 0.0;
+    uint64_t t = from;
+    if (t < ch->fade_end) {
+        uint64_t end = to < ch->fade_end ? to : ch->fade_end;
+        sum += (ledc_duty_at(ch, t) + ledc_duty_at(ch, end)) / 2.0 * (double)(end - t);
+        t = end;
+    }
+    if (t < to) {
+        sum += ch->duty_to * (double)(to - t);
+    }
+    return sum / ledc_max_duty();
+}
+
+static double ledc_duty_at(const SimLedcChannel* ch, uint64_t time)
+{
+    if (time >= ch->fade_end) {
+        return ch->duty_to;
+    }
+    if (time <= ch->fade_start) {
+        return ch->duty_from;
+    }
+    double k = (double)(time - ch->fade_start) / (double)(ch->fade_end - ch->fade_start);
+    return ch->duty_from + (ch->duty_to - ch->duty_from) * k;
+}
+
+static double ledc_max_duty() { return (double)((1UL << s_ledc_resolution) - 1); }
+
+static int ledc_channel_of_pin(int pin)
+{
+    for (int i = 0; i < SIM_LEDC_CHANNELS; i++) {
+        if (s_ledc_channels[i].gpio_num == pin) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 从现在的占空比开始渐变，LEDC 的渐变是按步进的，这里当成连续的
+ */
+static void start_ledc_fade(int channel, uint32_t target, int fade_ms)
+{
+    SimLedcChannel* ch = &s_ledc_channels[channel];
+    int pin = ch->gpio_num;
+    advance_pin(pin);
+    uint64_t now = Sim_now();
+    double from = ch->is_out_enabled ? ledc_duty_at(ch, now) : 0.0;
+    ch->is_out_enabled = true;
+    ch->fade_start = now;
+    ch->fade_end = now + (uint64_t)(fade_ms > 0 ? fade_ms : 0) * 1000ULL;
+    ch->duty_from = fade_ms > 0 ? from : (double)target;
+    ch->duty_to = (double)target;
+    LEDC.channel_group[LEDC_HIGH_SPEED_MODE].channel[channel].duty.duty = target << 4;
+    update_pin_state(pin);
+}
+
+/**
+ * 按现在的计数、闹钟和中断延迟重新安排中断，设在过去的闹钟马上触发
+ */
+static void arm_alarm(SimHwTimer* timer)
+{
+    if (!timer->is_running || !timer->is_alarm_enabled || timer->isr == NULL) {
+        SimTimer_disarm(&timer->alarm_timer);
+        return;
+    }
+
+    uint64_t now = Sim_now();
+    uint64_t count = counter_at(timer, now);
+    uint64_t alarm_time = now;
+    if (timer->alarm_value > count) {
+        // 向上取整到计数到达闹钟值的那一微秒
+        uint64_t ticks = timer->alarm_value - timer->base_count;
+        alarm_time = timer->base_time + (ticks * timer->divider + SIM_APB_CLK_MHZ - 1) / SIM_APB_CLK_MHZ;
+    }
+
+    uint32_t latency = s_latency_min_us;
+    if (s_latency_max_us > s_latency_min_us) {
+        s_latency_seed ^= s_latency_seed << 13;
+        s_latency_seed ^= s_latency_seed >> 17;
+        s_latency_seed ^= s_latency_seed << 5;
+        latency += s_latency_seed % (s_latency_max_us - s_latency_min_us + 1);
+    }
+    SimTimer_arm(&timer->alarm_timer, alarm_time + latency);
+}
+
+static uint64_t counter_at(const SimHwTimer* timer, uint64_t time)
+{
+    if (!timer->is_running || timer->divider == 0) {
+        return timer->base_count;
+    }
+    return timer->base_count + (time - timer->base_time) * SIM_APB_CLK_MHZ / timer->divider;
+}
+
+/**
+ * 闹钟触发以后硬件自动关掉闹钟，中断处理函数里要重新打开
+ */
+static void alarm_expired(void* arg)
+{
+    SimHwTimer* timer = (SimHwTimer*)arg;
+    timer->is_alarm_enabled = false;
+    timer->isr(timer->isr_arg);
+}
+
+static int64_t meter_pulses(int meter_pin)
+{
+    const SimFlowMeter* meter = &s_meters[meter_pin];
+    if (!meter->is_attached) {
+        return 0;
+    }
+    return (int64_t)floor(SimHw_get_pumped_volume(meter->pump_pin) * meter->pulses_per_ml);
+}
+
+static int16_t pcnt_count(const SimPcntUnit* unit)
+{
+    if (!unit->is_configured) {
+        return 0;
+    }
+    if (unit->is_paused) {
+        return unit->paused_count;
+    }
+    int64_t count = meter_pulses(unit->pulse_gpio_num) - unit->base_pulses;
+    // 到了上限计数器回到 0
+    return (int16_t)(unit->counter_h_lim > 0 ? count % unit->counter_h_lim : count);
+}
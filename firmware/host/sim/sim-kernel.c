@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "sim.h"
+
+// FreeRTOS 的任务用 ucontext 协程实现，任务只在阻塞、延时或者删除自己的时候让出
+// 让出以后回到调度器：先运行所有就绪的任务，都阻塞了再处理下一个事件，所以任务不会被抢占
+// 优先级只决定同一时刻就绪的任务谁先运行，同一优先级按就绪的先后
+// 实时模式下时间跟着系统的单调时钟走，没有事件的时候真的睡眠，任务里可以直接用阻塞的系统调用，比如 select()
+
+// PC 上的库函数比 ESP32 上费栈，任务的栈一律按这个大小分配
+#define SIM_TASK_STACK_SIZE (256 * 1024)
+
+typedef struct SimTask {
+    ucontext_t context;
+    void* stack;
+    TaskFunction_t function;
+    void* params;
+    char name[16];
+    UBaseType_t priority;
+    bool is_ready;
+    bool is_deleted;
+    bool is_timed_out;
+    uint64_t ready_seq; // 就绪的先后
+    const void* waiting_on; // 等待的对象，用来唤醒
+    uint64_t wake_time; // 等待超时的时间，SIM_NEVER 表示一直等
+    uint64_t wake_seq;
+    uint32_t notify_value;
+    bool is_notified;
+    SimTimer isr_wake_timer; // 中断里通知的任务推迟这么久才被唤醒，见 Sim_set_isr_wake_latency()
+    struct SimTask* next;
+} SimTask;
+
+struct SimSemaphore {
+    UBaseType_t count;
+    UBaseType_t max_count;
+    bool is_mutex;
+    SimTask* holder;
+};
+
+struct SimQueue {
+    uint8_t* items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static bool wait_on(const void* object, uint64_t deadline);
+static void make_ready(SimTask* task);
+static SimTask* current_task(const char* caller);
+static uint64_t deadline_of(TickType_t ticks);
+static void run_ready_tasks();
+static void task_entry();
+static uint64_t monotonic_us();
+static bool sleep_until(uint64_t time);
+static void isr_wake_expired(void* arg);
+
+static uint64_t s_now = 0;
+static uint64_t s_seq = 0;
+static SimTask* s_tasks = NULL;
+static SimTask* s_current = NULL;
+static SimTimer* s_timers = NULL;
+static ucontext_t s_kernel_context;
+static SimStats s_stats;
+static bool s_is_realtime = false;
+static uint64_t s_realtime_base = 0; // 单调时钟减去这个值就是现在的时间
+static uint64_t s_isr_wake_latency = 0;
+
+// vTaskDelay() 等的对象，没有人会唤醒它
+static const char s_delay_object = 0;
+
+uint64_t Sim_now()
+{
+    if (s_is_realtime) {
+        uint64_t now = monotonic_us() - s_realtime_base;
+        s_now = now > s_now ? now : s_now;
+    }
+    return s_now;
+}
+
+/**
+ * 从现在的时间接着走，之后的时间不会再跳
+ */
+void Sim_set_realtime()
+{
+    s_realtime_base = monotonic_us() - s_now;
+    s_is_realtime = true;
+}
+
+/**
+ * 中断里通知的任务过 latency_us 才开始运行，相当于任务被更高优先级的任务（比如 WiFi）占住了 CPU
+ */
+void Sim_set_isr_wake_latency(uint32_t latency_us) { s_isr_wake_latency = latency_us; }
+
+bool Sim_is_in_task() { return s_current != NULL; }
+
+SimStats Sim_get_stats() { return s_stats; }
+
+/**
+ * 一直运行到 time，time 之前没有事件的话虚拟时间直接跳到 time
+ */
+void Sim_run_until(uint64_t time)
+{
+    for (;;) {
+        run_ready_tasks();
+
+        // 找最早的事件，时间相同的按设置的先后
+        SimTimer* next_timer = NULL;
+        SimTask* next_task = NULL;
+        uint64_t next_time = SIM_NEVER;
+        uint64_t next_seq = UINT64_MAX;
+        for (SimTimer* timer = s_timers; timer != NULL; timer = timer->next) {
+            if (timer->is_armed
+                && (timer->deadline < next_time || (timer->deadline == next_time && timer->seq < next_seq))) {
+                next_timer = timer;
+                next_time = timer->deadline;
+                next_seq = timer->seq;
+            }
+        }
+        for (SimTask* task = s_tasks; task != NULL; task = task->next) {
+            if (!task->is_ready && !task->is_deleted && task->wake_time != SIM_NEVER
+                && (task->wake_time < next_time || (task->wake_time == next_time && task->wake_seq < next_seq))) {
+                next_timer = NULL;
+                next_task = task;
+                next_time = task->wake_time;
+                next_seq = task->wake_seq;
+            }
+        }
+
+        // 实时模式下有任务在等套接字的话，没有事件也要等下去
+        uint64_t target = next_time < time ? next_time : time;
+        if ((target != SIM_NEVER || SimNet_is_waiting()) && target > Sim_now() && !sleep_until(target)) {
+            continue;
+        }
+        if (next_time == SIM_NEVER || next_time > time) {
+            return;
+        }
+
+        s_stats.events_count++;
+        if (next_timer != NULL) {
+            next_timer->is_armed = false;
+            next_timer->callback(next_timer->arg);
+        } else {
+            next_task->is_timed_out = true;
+            make_ready(next_task);
+        }
+        SimHw_sync();
+    }
+}
+
+void SimTimer_init(SimTimer* timer, void (*callback)(void*), void* arg)
+{
+    memset(timer, 0, sizeof(SimTimer));
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->next = s_timers;
+    s_timers = timer;
+}
+
+void SimTimer_arm(SimTimer* timer, uint64_t deadline)
+{
+    timer->deadline = deadline < Sim_now() ? s_now : deadline;
+    timer->seq = ++s_seq;
+    timer->is_armed = true;
+}
+
+void SimTimer_disarm(SimTimer* timer) { timer->is_armed = false; }
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* params,
+    UBaseType_t priority, TaskHandle_t* created_task)
+{
+    SimTask* task = calloc(1, sizeof(SimTask));
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->stack = malloc(SIM_TASK_STACK_SIZE);
+    if (task->stack == NULL) {
+        free(task);
+        return pdFAIL;
+    }
+    task->function = function;
+    task->params = params;
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->priority = priority;
+    task->wake_time = SIM_NEVER;
+    SimTimer_init(&task->isr_wake_timer, &isr_wake_expired, task);
+
+    getcontext(&task->context);
+    task->context.uc_stack.ss_sp = task->stack;
+    task->context.uc_stack.ss_size = SIM_TASK_STACK_SIZE;
+    task->context.uc_link = &s_kernel_context;
+    makecontext(&task->context, &task_entry, 0);
+
+    task->next = s_tasks;
+    s_tasks = task;
+    make_ready(task);
+    if (created_task != NULL) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+/**
+ * 只能删除自己，删掉的任务不再运行，栈留到进程结束
+ */
+void vTaskDelete(TaskHandle_t task)
+{
+    SimTask* self = current_task("vTaskDelete");
+    if (task != NULL && task != self) {
+        fprintf(stderr, "vTaskDelete: deleting another task is not supported\n");
+        abort();
+    }
+    self->is_deleted = true;
+    self->is_ready = false;
+    swapcontext(&self->context, &s_kernel_context);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() { return s_current; }
+
+void vTaskDelay(TickType_t ticks)
+{
+    SimTask* task = current_task("vTaskDelay");
+    if (ticks == 0) {
+        // 让同一优先级的其他任务先运行
+        make_ready(task);
+        swapcontext(&task->context, &s_kernel_context);
+        return;
+    }
+    wait_on(&s_delay_object, deadline_of(ticks));
+}
+
+void vTaskDelayUntil(TickType_t* previous_wake_time, TickType_t increment)
+{
+    *previous_wake_time += increment;
+    uint64_t wake_time = (uint64_t)*previous_wake_time * portTICK_PERIOD_MS * 1000ULL;
+    if (wake_time > Sim_now()) {
+        wait_on(&s_delay_object, wake_time);
+    }
+}
+
+TickType_t xTaskGetTickCount() { return (TickType_t)(Sim_now() / (portTICK_PERIOD_MS * 1000ULL)); }
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+    switch (action) {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->is_notified) {
+            return pdFAIL;
+        }
+        task->notify_value = value;
+        break;
+    default:
+        break;
+    }
+    task->is_notified = true;
+    if (task->waiting_on == task) {
+        make_ready(task);
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(
+    TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* higher_priority_task_woken)
+{
+    if (higher_priority_task_woken != NULL) {
+        *higher_priority_task_woken = pdFALSE;
+    }
+    if (s_isr_wake_latency == 0) {
+        return xTaskNotify(task, value, action);
+    }
+
+    // 先记下通知的值，唤醒推迟到定时器到期，期间再来的通知合并到一起
+    bool is_waiting = task->waiting_on == task;
+    task->waiting_on = NULL;
+    BaseType_t ret = xTaskNotify(task, value, action);
+    task->waiting_on = is_waiting ? task : task->waiting_on;
+    if (is_waiting && !task->isr_wake_timer.is_armed) {
+        SimTimer_arm(&task->isr_wake_timer, Sim_now() + s_isr_wake_latency);
+    }
+    return ret;
+}
+
+BaseType_t xTaskNotifyWait(
+    uint32_t bits_to_clear_on_entry, uint32_t bits_to_clear_on_exit, uint32_t* notification_value, TickType_t ticks)
+{
+    SimTask* task = current_task("xTaskNotifyWait");
+    if (!task->is_notified) {
+        task->notify_value &= ~bits_to_clear_on_entry;
+        if (ticks != 0) {
+            wait_on(task, deadline_of(ticks));
+        }
+    }
+
+    if (notification_value != NULL) {
+        *notification_value = task->notify_value;
+    }
+    if (!task->is_notified) {
+        return pdFALSE;
+    }
+    task->notify_value &= ~bits_to_clear_on_exit;
+    task->is_notified = false;
+    return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks)
+{
+    SimTask* task = current_task("ulTaskNotifyTake");
+    if (task->notify_value == 0 && ticks != 0) {
+        wait_on(task, deadline_of(ticks));
+    }
+
+    uint32_t value = task->notify_value;
+    if (value != 0) {
+        task->notify_value = clear_count_on_exit ? 0 : value - 1;
+    }
+    task->is_notified = false;
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    SemaphoreHandle_t sem = xSemaphoreCreateCounting(1, 1);
+    if (sem != NULL) {
+        sem->is_mutex = true;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xSemaphoreCreateCounting(1, 0); }
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = calloc(1, sizeof(struct SimSemaphore));
+    if (sem != NULL) {
+        sem->max_count = max_count;
+        sem->count = initial_count;
+    }
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) { free(sem); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    if (sem->is_mutex && sem->count == 0 && sem->holder != NULL && sem->holder == s_current) {
+        // 普通的互斥锁不能重入，真的设备上会死锁
+        fprintf(stderr, "xSemaphoreTake: task '%s' takes a mutex it already holds\n", s_current->name);
+        abort();
+    }
+
+    uint64_t deadline = deadline_of(ticks);
+    while (sem->count == 0) {
+        if (ticks == 0) {
+            return pdFALSE;
+        }
+        current_task("xSemaphoreTake");
+        if (!wait_on(sem, deadline) && sem->count == 0) {
+            return pdFALSE;
+        }
+    }
+    sem->count--;
+    sem->holder = s_current;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->count >= sem->max_count) {
+        return pdFALSE;
+    }
+    sem->count++;
+    sem->holder = NULL;
+    for (SimTask* task = s_tasks; task != NULL; task = task->next) {
+        if (task->waiting_on == sem) {
+            make_ready(task);
+        }
+    }
+    return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct SimQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    queue->items = malloc((size_t)length * item_size);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+/**
+ * 不在任务里调用（比如模拟器的主程序）的时候不能等，队列满了直接失败
+ */
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    uint64_t deadline = deadline_of(ticks);
+    while (queue->count == queue->length) {
+        if (ticks == 0 || s_current == NULL) {
+            return pdFALSE;
+        }
+        if (!wait_on(queue, deadline) && queue->count == queue->length) {
+            return pdFALSE;
+        }
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[(size_t)tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    for (SimTask* task = s_tasks; task != NULL; task = task->next) {
+        if (task->waiting_on == queue) {
+            make_ready(task);
+        }
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks)
+{
+    uint64_t deadline = deadline_of(ticks);
+    while (queue->count == 0) {
+        if (ticks == 0) {
+            return pdFALSE;
+        }
+        current_task("xQueueReceive");
+        if (!wait_on(queue, deadline) && queue->count == 0) {
+            return pdFALSE;
+        }
+    }
+    memcpy(buffer, &queue->items[(size_t)queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    for (SimTask* task = s_tasks; task != NULL; task = task->next) {
+        if (task->waiting_on == queue) {
+            make_ready(task);
+        }
+    }
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->count; }
+
+/**
+ * 当前任务等 object 被唤醒或者等到 deadline，超时返回 false
+ */
+static bool wait_on(const void* object, uint64_t deadline)
+{
+    SimTask* task = s_current;
+    task->is_ready = false;
+    task->is_timed_out = false;
+    task->waiting_on = object;
+    task->wake_time = deadline;
+    task->wake_seq = ++s_seq;
+    swapcontext(&task->context, &s_kernel_context);
+    task->waiting_on = NULL;
+    return !task->is_timed_out;
+}
+
+static void make_ready(SimTask* task)
+{
+    if (task->is_deleted) {
+        return;
+    }
+    if (!task->is_ready) {
+        task->is_ready = true;
+        task->ready_seq = ++s_seq;
+    }
+    task->wake_time = SIM_NEVER;
+}
+
+static SimTask* current_task(const char* caller)
+{
+    if (s_current == NULL) {
+        // 主程序和定时器回调相当于中断，不能阻塞
+        fprintf(stderr, "%s: blocking call outside of a task\n", caller);
+        abort();
+    }
+    return s_current;
+}
+
+static uint64_t deadline_of(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY) {
+        return SIM_NEVER;
+    }
+    return Sim_now() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000ULL;
+}
+
+static void run_ready_tasks()
+{
+    for (;;) {
+        SimTask* next = NULL;
+        for (SimTask* task = s_tasks; task != NULL; task = task->next) {
+            if (task->is_ready
+                && (next == NULL || task->priority > next->priority
+                    || (task->priority == next->priority && task->ready_seq < next->ready_seq))) {
+                next = task;
+            }
+        }
+        if (next == NULL) {
+            return;
+        }
+
+        // 运行中的任务不算就绪，让出的时候要么在等待，要么重新排到就绪的最后
+        next->is_ready = false;
+        s_current = next;
+        s_stats.switches_count++;
+        swapcontext(&s_kernel_context, &next->context);
+        s_current = NULL;
+        SimHw_sync();
+    }
+}
+
+static void task_entry()
+{
+    SimTask* task = s_current;
+    task->function(task->params);
+    // FreeRTOS 的任务函数不能返回
+    fprintf(stderr, "Task '%s' returned without deleting itself\n", task->name);
+    abort();
+}
+
+static uint64_t monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/**
+ * 虚拟时间直接跳到 time，实时模式下睡到 time，中途有任务等到了套接字就提前返回 false
+ */
+static bool sleep_until(uint64_t time)
+{
+    if (!s_is_realtime) {
+        s_now = time;
+        return true;
+    }
+    while (Sim_now() < time) {
+        if (SimNet_wait(time)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void isr_wake_expired(void* arg)
+{
+    SimTask* task = (SimTask*)arg;
+    if (task->waiting_on == task && task->is_notified) {
+        make_ready(task);
+    }
+}
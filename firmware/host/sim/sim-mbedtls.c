@@ -0,0 +1,134 @@
+#include <string.h>
+
+#include <mbedtls/base64.h>
+#include <mbedtls/sha1.h>
+
+// mbedtls 里 WebSocket 握手用到的 SHA-1 和 Base64，按 FIPS 180-4 和 RFC 4648 实现
+
+static void sha1_process(mbedtls_sha1_context* ctx, const uint8_t block[64]);
+
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+void mbedtls_sha1_init(mbedtls_sha1_context* ctx) { memset(ctx, 0, sizeof(mbedtls_sha1_context)); }
+
+void mbedtls_sha1_free(mbedtls_sha1_context* ctx) { memset(ctx, 0, sizeof(mbedtls_sha1_context)); }
+
+int mbedtls_sha1_starts_ret(mbedtls_sha1_context* ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha1_update_ret(mbedtls_sha1_context* ctx, const unsigned char* input, size_t ilen)
+{
+    for (size_t i = 0; i < ilen; i++) {
+        ctx->buffer[ctx->total % 64] = input[i];
+        ctx->total++;
+        if (ctx->total % 64 == 0) {
+            sha1_process(ctx, ctx->buffer);
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha1_finish_ret(mbedtls_sha1_context* ctx, unsigned char output[20])
+{
+    uint64_t bits = ctx->total * 8;
+    const uint8_t pad = 0x80;
+    const uint8_t zero = 0;
+    mbedtls_sha1_update_ret(ctx, &pad, 1);
+    while (ctx->total % 64 != 56) {
+        mbedtls_sha1_update_ret(ctx, &zero, 1);
+    }
+    uint8_t length[8];
+    for (int i = 0; i < 8; i++) {
+        length[i] = (uint8_t)(bits >> (56 - i * 8));
+    }
+    mbedtls_sha1_update_ret(ctx, length, sizeof(length));
+
+    for (int i = 0; i < 5; i++) {
+        output[i * 4] = (uint8_t)(ctx->state[i] >> 24);
+        output[i * 4 + 1] = (uint8_t)(ctx->state[i] >> 16);
+        output[i * 4 + 2] = (uint8_t)(ctx->state[i] >> 8);
+        output[i * 4 + 3] = (uint8_t)ctx->state[i];
+    }
+    return 0;
+}
+
+/**
+ * 和 mbedtls 一样，dst 放不下结果和结尾的 '\0' 时 olen 返回需要的大小
+ */
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen)
+{
+    size_t size = (slen + 2) / 3 * 4;
+    if (dst == NULL || dlen < size + 1) {
+        *olen = size + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char* p = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        uint32_t n = (uint32_t)src[i] << 16;
+        n |= i + 1 < slen ? (uint32_t)src[i + 1] << 8 : 0;
+        n |= i + 2 < slen ? (uint32_t)src[i + 2] : 0;
+        *p++ = BASE64_ALPHABET[(n >> 18) & 0x3F];
+        *p++ = BASE64_ALPHABET[(n >> 12) & 0x3F];
+        *p++ = i + 1 < slen ? BASE64_ALPHABET[(n >> 6) & 0x3F] : '=';
+        *p++ = i + 2 < slen ? BASE64_ALPHABET[n & 0x3F] : '=';
+    }
+    *p = '\0';
+    *olen = size;
+    return 0;
+}
+
+static void sha1_process(mbedtls_sha1_context* ctx, const uint8_t block[64])
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8
+            | (uint32_t)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 80; i++) {
+        uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+        w[i] = (x << 1) | (x >> 31);
+    }
+
+    uint32_t a = ctx->state[0];
+    uint32_t b = ctx->state[1];
+    uint32_t c = ctx->state[2];
+    uint32_t d = ctx->state[3];
+    uint32_t e = ctx->state[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = (b << 30) | (b >> 2);
+        b = a;
+        a = temp;
+    }
+    ctx->state[0] += a;
+    ctx->state[1] += b;
+    ctx->state[2] += c;
+    ctx->state[3] += d;
+    ctx->state[4] += e;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "sim.h"
+
+// 任务里调用的 select()：套接字没有准备好的话任务在信号量上等，让出给其他任务和定时器
+// 调度器空闲的时候用真的 select() 等这些套接字，等到了就唤醒任务，所以不需要轮询
+// 只有 RPC 服务端一个任务会 select()，只支持一个等待的任务
+
+typedef struct {
+    TaskHandle_t task;
+    int nfds;
+    fd_set read_fds;
+    fd_set write_fds;
+    bool has_read_fds;
+    bool has_write_fds;
+} SimNetWaiter;
+
+static int select_now(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds);
+
+static SimNetWaiter s_waiter;
+static SemaphoreHandle_t s_ready_sem = NULL;
+
+int SimNet_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout)
+{
+    if (!Sim_is_in_task()) {
+        return select(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    if (s_waiter.task != NULL) {
+        fprintf(stderr, "SimNet_select: only one task can wait in select()\n");
+        abort();
+    }
+    if (s_ready_sem == NULL) {
+        s_ready_sem = xSemaphoreCreateBinary();
+    }
+
+    uint64_t deadline = SIM_NEVER;
+    if (timeout != NULL) {
+        deadline = Sim_now() + (uint64_t)timeout->tv_sec * 1000000ULL + (uint64_t)timeout->tv_usec;
+    }
+    for (;;) {
+        int ready = select_now(nfds, readfds, writefds, exceptfds);
+        if (ready != 0) {
+            return ready;
+        }
+        if (Sim_now() >= deadline) {
+            // 和 select() 一样，超时的时候集合都清空
+            if (readfds != NULL) {
+                FD_ZERO(readfds);
+            }
+            if (writefds != NULL) {
+                FD_ZERO(writefds);
+            }
+            if (exceptfds != NULL) {
+                FD_ZERO(exceptfds);
+            }
+            return 0;
+        }
+
+        s_waiter.task = xTaskGetCurrentTaskHandle();
+        s_waiter.nfds = nfds;
+        s_waiter.has_read_fds = readfds != NULL;
+        s_waiter.has_write_fds = writefds != NULL;
+        if (readfds != NULL) {
+            s_waiter.read_fds = *readfds;
+        }
+        if (writefds != NULL) {
+            s_waiter.write_fds = *writefds;
+        }
+        TickType_t ticks = portMAX_DELAY;
+        if (deadline != SIM_NEVER) {
+            uint64_t tick_us = portTICK_PERIOD_MS * 1000ULL;
+            ticks = (TickType_t)((deadline - Sim_now() + tick_us - 1) / tick_us);
+        }
+        xSemaphoreTake(s_ready_sem, ticks);
+        s_waiter.task = NULL;
+    }
+}
+
+int SimNet_bind(int sockfd, const struct sockaddr* addr, socklen_t addrlen)
+{
+    int reuse = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    return bind(sockfd, addr, addrlen);
+}
+
+/**
+ * 实时模式下调度器空闲时调用，最多等到 deadline
+ * 有任务在 select() 的话等它的套接字，准备好了就唤醒它，返回 true；否则直接睡眠
+ */
+bool SimNet_wait(uint64_t deadline)
+{
+    uint64_t now = Sim_now();
+    uint64_t wait_us = deadline > now ? deadline - now : 0;
+    if (s_waiter.task == NULL) {
+        struct timespec ts = {
+            .tv_sec = (time_t)(wait_us / 1000000ULL),
+            .tv_nsec = (long)(wait_us % 1000000ULL) * 1000L,
+        };
+        nanosleep(&ts, NULL);
+        return false;
+    }
+
+    fd_set read_fds = s_waiter.read_fds;
+    fd_set write_fds = s_waiter.write_fds;
+    struct timeval timeout = {
+        .tv_sec = (time_t)(wait_us / 1000000ULL),
+        .tv_usec = (suseconds_t)(wait_us % 1000000ULL),
+    };
+    int ready = select(s_waiter.nfds, s_waiter.has_read_fds ? &read_fds : NULL,
+        s_waiter.has_write_fds ? &write_fds : NULL, NULL, deadline == SIM_NEVER ? NULL : &timeout);
+    if (ready == 0) {
+        return false;
+    }
+    // 出错也唤醒，让任务自己的 select() 把错误报出来
+    s_waiter.task = NULL;
+    xSemaphoreGive(s_ready_sem);
+    return true;
+}
+
+bool SimNet_is_waiting() { return s_waiter.task != NULL; }
+
+/**
+ * 不阻塞地检查一次，和 select() 一样只在有结果的时候改写传进来的集合
+ */
+static int select_now(int nfds, fd_set* readfds, fd_set* writefds, fd_set* exceptfds)
+{
+    fd_set read_fds;
+    fd_set write_fds;
+    fd_set except_fds;
+    if (readfds != NULL) {
+        read_fds = *readfds;
+    }
+    if (writefds != NULL) {
+        write_fds = *writefds;
+    }
+    if (exceptfds != NULL) {
+        except_fds = *exceptfds;
+    }
+    struct timeval zero = { .tv_sec = 0, .tv_usec = 0 };
+    int ready = select(nfds, readfds != NULL ? &read_fds : NULL, writefds != NULL ? &write_fds : NULL,
+        exceptfds != NULL ? &except_fds : NULL, &zero);
+    if (ready != 0) {
+        if (readfds != NULL) {
+            *readfds = read_fds;
+        }
+        if (writefds != NULL) {
+            *writefds = write_fds;
+        }
+        if (exceptfds != NULL) {
+            *exceptfds = except_fds;
+        }
+    }
+    return ready;
+}
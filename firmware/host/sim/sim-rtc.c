@@ -0,0 +1,44 @@
+#include <assert.h>
+#include <time.h>
+
+#include <esp_event.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+#include "borneo/common.h"
+#include "borneo/rtc.h"
+
+#include "sim.h"
+
+// 代替 rtc.c 和 DS1302：RTC 时间跟着虚拟时间走，精度是秒
+// 时区按进程的 TZ 环境变量，模拟器里设成 UTC
+
+ESP_EVENT_DEFINE_BASE(BORNEO_RTC_EVENTS);
+
+static time_t s_epoch = 0;
+static time_t s_offset = 0; // Rtc_set_datetime() 调整的量
+
+void SimRtc_set_epoch(time_t epoch) { s_epoch = epoch; }
+
+int Rtc_init() { return 0; }
+
+int Rtc_start() { return 0; }
+
+struct tm Rtc_local_now()
+{
+    struct tm now;
+    time_t timestamp = Rtc_timestamp();
+    localtime_r(&timestamp, &now);
+    return now;
+}
+
+time_t Rtc_timestamp() { return s_epoch + (time_t)(esp_timer_get_time() / 1000000LL) + s_offset; }
+
+void Rtc_set_datetime(const struct tm* dt)
+{
+    assert(dt != NULL);
+    struct tm copy = *dt;
+    time_t target = mktime(&copy);
+    s_offset += target - Rtc_timestamp();
+    esp_event_post(BORNEO_RTC_EVENTS, BORNEO_EVENT_RTC_TIME_SET, NULL, 0, portMAX_DELAY);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 虚拟时间的离散事件模拟器：固件的任务是单线程轮流执行的协程，没有就绪的任务时时间直接跳到下一个事件
+// 事件是定时器到期和任务的等待超时，同一时刻的事件按设置的先后顺序处理
+// 时间的单位是微秒，从 0 开始，也就是 esp_timer_get_time() 的值
+
+#define SIM_NEVER UINT64_MAX
+
+// 到期时在调度器里调用回调，回调里不能阻塞，相当于中断
+typedef struct SimTimer {
+    uint64_t deadline;
+    uint64_t seq;
+    bool is_armed;
+    void (*callback)(void* arg);
+    void* arg;
+    struct SimTimer* next;
+} SimTimer;
+
+// 运行统计
+typedef struct {
+    uint64_t events_count; // 处理过的定时器到期和等待超时
+    uint64_t switches_count; // 任务切换的次数
+} SimStats;
+
+uint64_t Sim_now();
+bool Sim_is_in_task();
+void Sim_run_until(uint64_t time);
+// 切换到实时模式，给要和外面真实交互的程序用，比如在 PC 上跑 RPC 服务端
+void Sim_set_realtime();
+// 中断里用 xTaskNotifyFromISR() 唤醒的任务推迟这么久才运行，模拟任务来不及处理中断的情况，默认是 0
+void Sim_set_isr_wake_latency(uint32_t latency_us);
+SimStats Sim_get_stats();
+
+void SimTimer_init(SimTimer* timer, void (*callback)(void*), void* arg);
+void SimTimer_arm(SimTimer* timer, uint64_t deadline);
+void SimTimer_disarm(SimTimer* timer);
+
+// 每个任务运行完一段、每个定时器回调之后调用，硬件模型在这里检查固件直接写的寄存器
+void SimHw_sync();
+
+// 定时器中断的延迟在 [min_us, max_us] 之间随机
+void SimHw_set_irq_latency(uint32_t min_us, uint32_t max_us, uint32_t seed);
+
+// 引脚上接一个泵，驱动满额时（GPIO 高电平或者 100% 占空比）流量是 ml_per_min，流量和占空比成正比
+void SimHw_attach_pump(int pin, double ml_per_min);
+
+// 流量计接在 meter_pin 上，按 pump_pin 上的泵实际打出去的体积出脉冲
+void SimHw_attach_flow_meter(int meter_pin, int pump_pin, double pulses_per_ml);
+
+// 泵实际打出去的体积，单位 mL
+double SimHw_get_pumped_volume(int pin);
+
+// 泵开关的次数：GPIO 方式是引脚电平的变化，PWM 方式是 LEDC 输出的打开和关闭
+uint32_t SimHw_get_toggle_count(int pin);
+
+// 同时开着的泵最多有几个
+uint32_t SimHw_get_peak_running();
+
+// 最后一个泵关掉的虚拟时间
+uint64_t SimHw_get_idle_since();
+
+// 实时模式下调度器空闲时等待 select() 里的任务的套接字，最多等到 deadline，有任务被唤醒返回 true
+bool SimNet_wait(uint64_t deadline);
+bool SimNet_is_waiting();
+
+// 虚拟时间 0 对应的 RTC 时间
+void SimRtc_set_epoch(time_t epoch);
+
+// Flash 分区擦除扇区的次数
+uint32_t SimFlash_get_erase_count();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// 测试用的断言，不受 NDEBUG 影响，失败时打印位置并以非零状态退出
+
+#define CHECK(cond)                                                                                                    \
+    do {                                                                                                               \
+        if (!(cond)) {                                                                                                 \
+            fprintf(stderr, "\n%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);                                 \
+            exit(1);                                                                                                   \
+        }                                                                                                              \
+    } while (0)
+
+// 固定种子的 xorshift32，失败时可以按打印出来的种子重现
+static inline uint32_t test_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
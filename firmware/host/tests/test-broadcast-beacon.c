@@ -0,0 +1,74 @@
+#include <string.h>
+
+#include "borneo/common.h"
+#include "borneo/broadcast.h"
+#include "borneo/broadcast-beacon.h"
+
+#include "host-test.h"
+
+// 信标的时间戳和广播间隔：时间戳左对齐补空格，刚好 10 位的也不能截断或者写出预留的位置；
+// 没收到过探测时间隔一直是最小值，收到以后每次翻倍，到最大值为止
+
+#define GUARD 0xA5
+
+static void check_timestamp(time_t timestamp, const char* expected)
+{
+    uint8_t buf[BROADCAST_TIMESTAMP_WIDTH + 2];
+    memset(buf, GUARD, sizeof(buf));
+    BroadcastBeacon_patch_timestamp(buf + 1, timestamp);
+    CHECK(memcmp(buf + 1, expected, BROADCAST_TIMESTAMP_WIDTH) == 0);
+    CHECK(buf[0] == GUARD && buf[BROADCAST_TIMESTAMP_WIDTH + 1] == GUARD);
+}
+
+static void test_timestamp()
+{
+    check_timestamp(0, "0         ");
+    check_timestamp(7, "7         ");
+    check_timestamp(42, "42        ");
+    check_timestamp(123456789, "123456789 ");
+    // RTC 还没校准时的负数按 0 写
+    check_timestamp(-1, "0         ");
+
+    check_timestamp(1000000000, "1000000000");
+    check_timestamp(1704067200, "1704067200");
+    check_timestamp(UINT32_MAX, "4294967295");
+
+    // 改写的时候旧的数字要全部盖掉
+    uint8_t buf[BROADCAST_TIMESTAMP_WIDTH];
+    BroadcastBeacon_patch_timestamp(buf, 1704067200);
+    BroadcastBeacon_patch_timestamp(buf, 99);
+    CHECK(memcmp(buf, "99        ", BROADCAST_TIMESTAMP_WIDTH) == 0);
+}
+
+static void test_interval()
+{
+    // 没收到过探测之前不管发了多少次都保持最小间隔
+    uint32_t interval = BROADCAST_MIN_INTERVAL_SECS;
+    for (int i = 0; i < 100; i++) {
+        interval = BroadcastBeacon_next_interval(interval, 0);
+        CHECK(interval == BROADCAST_MIN_INTERVAL_SECS);
+    }
+    CHECK(BroadcastBeacon_next_interval(BROADCAST_PROBED_MAX_INTERVAL_SECS, 0) == BROADCAST_MIN_INTERVAL_SECS);
+
+    // 第一次探测以后从最小间隔开始翻倍
+    uint32_t expected = BROADCAST_MIN_INTERVAL_SECS;
+    for (int i = 0; i < 32; i++) {
+        expected *= 2;
+        if (expected > BROADCAST_PROBED_MAX_INTERVAL_SECS) {
+            expected = BROADCAST_PROBED_MAX_INTERVAL_SECS;
+        }
+        interval = BroadcastBeacon_next_interval(interval, 1 + i);
+        CHECK(interval == expected);
+        CHECK(interval <= BROADCAST_PROBED_MAX_INTERVAL_SECS);
+    }
+    CHECK(interval == BROADCAST_PROBED_MAX_INTERVAL_SECS);
+    CHECK(BroadcastBeacon_next_interval(BROADCAST_PROBED_MAX_INTERVAL_SECS, 1) == BROADCAST_PROBED_MAX_INTERVAL_SECS);
+}
+
+int main()
+{
+    test_timestamp();
+    test_interval();
+    printf("broadcast-beacon: ok\n");
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/utils/cbor-reader.h"
+
+#include "host-test.h"
+
+// CborReader 的回归测试：基本的数据类型、嵌套深度限制，以及一长串标签不会耗尽栈
+
+// 远远超过任何任务栈能承受的递归深度
+#define TAG_RUN_SIZE (1024 * 1024)
+
+static void test_basic_items()
+{
+    // {"a": [1, -2, 1.5], "b": "hi", "c": true, "d": null}，1.5 用半精度
+    static const uint8_t data[] = {
+        0xA4, 0x61, 'a', 0x83, 0x01, 0x21, 0xF9, 0x3E, 0x00, 0x61, 'b', 0x62, 'h', 'i',
+        0x61, 'c', 0xF5, 0x61, 'd', 0xF6,
+    };
+    cJSON* root = CborReader_parse(data, sizeof(data));
+    CHECK(cJSON_IsObject(root));
+
+    const cJSON* a = cJSON_GetObjectItemCaseSensitive(root, "a");
+    CHECK(cJSON_IsArray(a) && cJSON_GetArraySize(a) == 3);
+    CHECK(cJSON_GetArrayItem(a, 0)->valuedouble == 1.0);
+    CHECK(cJSON_GetArrayItem(a, 1)->valuedouble == -2.0);
+    CHECK(cJSON_GetArrayItem(a, 2)->valuedouble == 1.5);
+
+    const cJSON* b = cJSON_GetObjectItemCaseSensitive(root, "b");
+    CHECK(cJSON_IsString(b) && strcmp(b->valuestring, "hi") == 0);
+    CHECK(cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(root, "c")));
+    CHECK(cJSON_IsNull(cJSON_GetObjectItemCaseSensitive(root, "d")));
+    cJSON_Delete(root);
+
+    // 后面有多余的数据
+    static const uint8_t trailing[] = { 0x01, 0x02 };
+    CHECK(CborReader_parse(trailing, sizeof(trailing)) == NULL);
+}
+
+static void test_depth_limit()
+{
+    uint8_t data[CBOR_READER_MAX_DEPTH + 2];
+
+    // 刚好 CBOR_READER_MAX_DEPTH 层数组
+    memset(data, 0x81, CBOR_READER_MAX_DEPTH);
+    data[CBOR_READER_MAX_DEPTH] = 0x00;
+    cJSON* root = CborReader_parse(data, CBOR_READER_MAX_DEPTH + 1);
+    CHECK(root != NULL);
+    cJSON_Delete(root);
+
+    // 多一层
+    memset(data, 0x81, CBOR_READER_MAX_DEPTH + 1);
+    data[CBOR_READER_MAX_DEPTH + 1] = 0x00;
+    CHECK(CborReader_parse(data, CBOR_READER_MAX_DEPTH + 2) == NULL);
+}
+
+static void test_tag_run()
+{
+    uint8_t* data = (uint8_t*)malloc(TAG_RUN_SIZE + 1);
+    CHECK(data != NULL);
+
+    // 一长串标签 0 后面是整数 7，标签被跳过
+    memset(data, 0xC0, TAG_RUN_SIZE);
+    data[TAG_RUN_SIZE] = 0x07;
+    cJSON* root = CborReader_parse(data, TAG_RUN_SIZE + 1);
+    CHECK(cJSON_IsNumber(root) && root->valuedouble == 7.0);
+    cJSON_Delete(root);
+
+    // 只有标签没有数据项
+    CHECK(CborReader_parse(data, TAG_RUN_SIZE) == NULL);
+
+    // 数组元素前的一长串标签，两字节参数的标签 55799 也一样
+    data[0] = 0x81;
+    for (size_t i = 1; i + 3 <= TAG_RUN_SIZE; i += 3) {
+        data[i] = 0xD9;
+        data[i + 1] = 0xD9;
+        data[i + 2] = 0xF7;
+    }
+    size_t size = 1 + (TAG_RUN_SIZE - 1) / 3 * 3;
+    data[size] = 0xF4;
+    root = CborReader_parse(data, size + 1);
+    CHECK(cJSON_IsArray(root) && cJSON_GetArraySize(root) == 1);
+    CHECK(cJSON_IsBool(cJSON_GetArrayItem(root, 0)) && !cJSON_IsTrue(cJSON_GetArrayItem(root, 0)));
+    cJSON_Delete(root);
+
+    // 不定长的标签头是错误数据
+    data[0] = 0xC0;
+    data[1] = 0xDF;
+    data[2] = 0x00;
+    CHECK(CborReader_parse(data, 3) == NULL);
+
+    free(data);
+}
+
+int main()
+{
+    test_basic_items();
+    test_depth_limit();
+    test_tag_run();
+    printf("cbor-reader: passed\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <string.h>
+
+#include "borneo/common.h"
+#include "borneo/pid.h"
+
+#include "host-test.h"
+#include "pid-vectors.h"
+
+// FastPid_step() 和 FastPidBank_step() 都要逐位重现 scripts/gen-pid-vectors.py 生成的黄金向量
+// 向量里的配置有 P 项回绕、积分范围不含 0、无符号输出和全 0 系数这些边界情况
+
+static void configure(FastPid* pid, const PidVectorConfig* config)
+{
+    CHECK(FastPid_configure(pid, config->kp, config->ki, config->kd, config->hz, config->bits, config->sign));
+    if (config->has_integral_range) {
+        CHECK(FastPid_set_integral_range(pid, config->integral_min, config->integral_max));
+    }
+    CHECK(pid->p == config->p && pid->i == config->i && pid->d == config->d);
+}
+
+static void test_scalar()
+{
+    for (size_t c = 0; c < PID_VECTOR_CONFIGS; c++) {
+        FastPid pid;
+        configure(&pid, &PID_VECTOR_CONFIG_TABLE[c]);
+        for (size_t s = 0; s < PID_VECTOR_STEPS; s++) {
+            const PidVectorStep* step = &PID_VECTOR_STEP_TABLE[c][s];
+            int16_t out = FastPid_step(&pid, step->sp, step->fb);
+            if (out != step->out) {
+                fprintf(stderr, "config %zu step %zu: %d != %d\n", c, s, out, step->out);
+            }
+            CHECK(out == step->out);
+        }
+    }
+}
+
+/**
+ * 配置按 FAST_PID_BANK_MAX 个一组放进 bank 里一起计算，每一组也试一下比 FAST_PID_BANK_MAX 少的个数
+ */
+static void test_bank(size_t lanes)
+{
+    for (size_t first = 0; first < PID_VECTOR_CONFIGS; first += lanes) {
+        size_t count = PID_VECTOR_CONFIGS - first < lanes ? PID_VECTOR_CONFIGS - first : lanes;
+        FastPidBank bank;
+        FastPidBank_init(&bank, count);
+        for (size_t n = 0; n < count; n++) {
+            FastPid pid;
+            configure(&pid, &PID_VECTOR_CONFIG_TABLE[first + n]);
+            FastPidBank_load(&bank, n, &pid);
+        }
+
+        for (size_t s = 0; s < PID_VECTOR_STEPS; s++) {
+            int16_t sp[FAST_PID_BANK_MAX];
+            int16_t fb[FAST_PID_BANK_MAX];
+            int16_t out[FAST_PID_BANK_MAX];
+            for (size_t n = 0; n < count; n++) {
+                sp[n] = PID_VECTOR_STEP_TABLE[first + n][s].sp;
+                fb[n] = PID_VECTOR_STEP_TABLE[first + n][s].fb;
+            }
+            FastPidBank_step(&bank, sp, fb, out);
+            for (size_t n = 0; n < count; n++) {
+                CHECK(out[n] == PID_VECTOR_STEP_TABLE[first + n][s].out);
+            }
+        }
+    }
+}
+
+/**
+ * 中途把状态存回 FastPid 再载入，接着计算的结果不变
+ */
+static void test_bank_store()
+{
+    const PidVectorConfig* config = &PID_VECTOR_CONFIG_TABLE[2];
+    FastPid pid;
+    configure(&pid, config);
+    FastPidBank bank;
+    FastPidBank_init(&bank, 1);
+    FastPidBank_load(&bank, 0, &pid);
+
+    for (size_t s = 0; s < PID_VECTOR_STEPS; s++) {
+        const PidVectorStep* step = &PID_VECTOR_STEP_TABLE[2][s];
+        int16_t out;
+        FastPidBank_step(&bank, &step->sp, &step->fb, &out);
+        CHECK(out == step->out);
+        if (s == PID_VECTOR_STEPS / 2) {
+            FastPidBank_store(&bank, 0, &pid);
+            FastPidBank_init(&bank, 1);
+            FastPidBank_load(&bank, 0, &pid);
+        }
+    }
+}
+
+int main()
+{
+    test_scalar();
+    for (size_t lanes = 1; lanes <= FAST_PID_BANK_MAX; lanes++) {
+        test_bank(lanes);
+    }
+    test_bank_store();
+    printf("pid: %d configs x %d steps passed\n", PID_VECTOR_CONFIGS, PID_VECTOR_STEPS);
+    return 0;
+}
@@ -0,0 +1,129 @@
+#include <math.h>
+
+#include "borneo/common.h"
+#include "borneo-doser/devices/pump-ramp.h"
+
+#include "host-test.h"
+
+// 加减速曲线的测试：按体积规划的曲线算回来的体积要和要求的一致，短投放峰值小于 1，没有加减速时直接开关
+// 时间都取整到毫秒，所以体积最多差设定速度下半毫秒的量
+
+#define ML_PER_MS(speed) ((speed) / (60.0 * 1000.0))
+#define ITERATIONS 200000
+
+static bool is_close(double a, double b, double tolerance) { return fabs(a - b) <= tolerance + 1e-9 * fabs(b); }
+
+static double random_unit(uint32_t* seed) { return (double)test_random(seed) / UINT32_MAX; }
+
+static void check_volume_plan(const PumpRampProfile* profile, double speed, double volume)
+{
+    PumpRampPlan plan;
+    PumpRamp_plan_for_volume(profile, speed, volume, &plan);
+
+    CHECK(is_close(PumpRamp_volume(&plan, speed), volume, ML_PER_MS(speed) * 0.5));
+    CHECK(plan.peak > 0.0 && plan.peak <= 1.0);
+    CHECK(plan.ramp_up <= profile->ramp_up && plan.ramp_down <= profile->ramp_down);
+    if (plan.peak < 1.0) {
+        // 加速还没到设定速度就开始减速
+        CHECK(plan.hold == 0);
+        CHECK(plan.ramp_up + plan.ramp_down > 0);
+    } else if (plan.hold > 0) {
+        CHECK(plan.ramp_up == profile->ramp_up || plan.ramp_up + plan.ramp_down == 0);
+    }
+
+    // 实际运行时间 = 按设定速度运行的时间 + 加减速损失的时间
+    double full_speed_us = PumpRamp_volume(&plan, speed) / ML_PER_MS(speed) * 1000.0;
+    CHECK(is_close(PumpRamp_total_ms(&plan) * 1000.0, full_speed_us + PumpRamp_deficit_us(&plan), 0.5));
+}
+
+static void test_round_trips()
+{
+    uint32_t seed = 0x2545F491u;
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        PumpRampProfile profile = {
+            .ramp_up = (uint16_t)(test_random(&seed) % (PUMP_RAMP_MAX_MS + 1)),
+            .ramp_down = (uint16_t)(test_random(&seed) % (PUMP_RAMP_MAX_MS + 1)),
+        };
+        // 0.1～1000 mL/min，0.0001～1000 mL，按数量级均匀分布，短投放和长投放都能覆盖到
+        double speed = pow(10.0, -1.0 + 4.0 * random_unit(&seed));
+        double volume = pow(10.0, -4.0 + 7.0 * random_unit(&seed));
+        check_volume_plan(&profile, speed, volume);
+    }
+}
+
+static void test_short_dose()
+{
+    // 1 mL/s，加减速各 1 秒，0.1 mL 按设定速度只要 100 毫秒
+    PumpRampProfile profile = { .ramp_up = 1000, .ramp_down = 1000 };
+    PumpRampPlan plan;
+    PumpRamp_plan_for_volume(&profile, 60.0, 0.1, &plan);
+    CHECK(plan.hold == 0);
+    CHECK(plan.ramp_up == 316 && plan.ramp_down == 316);
+    CHECK(plan.peak < 1.0 && is_close(plan.peak, sqrt(0.1), 0.001));
+    CHECK(is_close(PumpRamp_volume(&plan, 60.0), 0.1, 0.0));
+
+    // 刚好够加速到设定速度
+    PumpRamp_plan_for_volume(&profile, 60.0, 1.0, &plan);
+    CHECK(plan.peak == 1.0 && plan.hold == 0 && plan.ramp_up == 1000 && plan.ramp_down == 1000);
+
+    // 短到加减速取整以后都是 0，直接开关
+    profile.ramp_up = 1;
+    profile.ramp_down = 1;
+    PumpRamp_plan_for_volume(&profile, 60.0, 0.0001, &plan);
+    CHECK(plan.ramp_up == 0 && plan.ramp_down == 0 && plan.peak == 1.0);
+    check_volume_plan(&profile, 60.0, 0.0001);
+}
+
+static void test_zero_length_ramps()
+{
+    PumpRampProfile profile = { .ramp_up = 0, .ramp_down = 0 };
+    PumpRampPlan plan;
+    PumpRamp_plan_for_volume(&profile, 60.0, 2.5, &plan);
+    CHECK(plan.ramp_up == 0 && plan.ramp_down == 0 && plan.hold == 2500 && plan.peak == 1.0);
+    CHECK(PumpRamp_deficit_us(&plan) == 0);
+
+    PumpRamp_plan_for_duration(&profile, 1234, &plan);
+    CHECK(plan.hold == 1234 && plan.peak == 1.0 && PumpRamp_total_ms(&plan) == 1234);
+
+    // 只有一边有加减速
+    profile.ramp_down = 500;
+    PumpRamp_plan_for_volume(&profile, 60.0, 2.5, &plan);
+    CHECK(plan.ramp_up == 0 && plan.ramp_down == 500 && plan.hold == 2250);
+    CHECK(PumpRamp_deficit_us(&plan) == 250000);
+    PumpRamp_plan_for_volume(&profile, 60.0, 0.01, &plan);
+    CHECK(plan.ramp_up == 0 && plan.hold == 0 && plan.peak < 1.0);
+    check_volume_plan(&profile, 60.0, 0.01);
+}
+
+static void test_duration_plans()
+{
+    uint32_t seed = 0x6C078965u;
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        PumpRampProfile profile = {
+            .ramp_up = (uint16_t)(test_random(&seed) % (PUMP_RAMP_MAX_MS + 1)),
+            .ramp_down = (uint16_t)(test_random(&seed) % (PUMP_RAMP_MAX_MS + 1)),
+        };
+        uint32_t duration = test_random(&seed) % (PUMP_RAMP_MAX_MS * 4);
+        PumpRampPlan plan;
+        PumpRamp_plan_for_duration(&profile, duration, &plan);
+        // 按时间运行时加减速包含在 duration 里，总时间不变
+        CHECK(PumpRamp_total_ms(&plan) == duration);
+        CHECK(plan.peak >= 0.0 && plan.peak <= 1.0);
+        CHECK(plan.peak == 1.0 || plan.hold == 0);
+    }
+
+    PumpRampProfile profile = { .ramp_up = 1000, .ramp_down = 1000 };
+    PumpRampPlan plan;
+    PumpRamp_plan_for_duration(&profile, 0, &plan);
+    CHECK(PumpRamp_total_ms(&plan) == 0 && PumpRamp_volume(&plan, 60.0) == 0.0);
+}
+
+int main()
+{
+    test_round_trips();
+    test_short_dose();
+    test_zero_length_ramps();
+    test_duration_plans();
+    printf("pump-ramp: passed\n");
+    return 0;
+}
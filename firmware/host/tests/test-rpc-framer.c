@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc-framer.h"
+
+#include "host-test.h"
+
+// 随机生成一串请求，按随机的块大小喂给 RpcFramer，检查取出的帧和发送的请求一一对应
+// 超过缓冲区的请求应该恰好报告一次 RPC_FRAME_OVERSIZE，后面的请求不受影响
+
+#define CAPACITY 64
+#define MAX_MESSAGES 64
+#define MAX_STREAM_SIZE (MAX_MESSAGES * (CAPACITY * 3) + RPC_FRAMER_CBOR_MAGIC_SIZE)
+#define ITERATIONS 20000
+
+typedef struct {
+    size_t offset; // 帧的内容在数据流里的位置
+    size_t size; // JSON 包括结尾的 '\0'，CBOR 不包括长度前缀
+    bool is_oversize;
+} Message;
+
+typedef struct {
+    uint8_t stream[MAX_STREAM_SIZE];
+    size_t stream_size;
+    Message messages[MAX_MESSAGES];
+    size_t count;
+} Script;
+
+static size_t random_size(uint32_t* seed)
+{
+    // 大部分请求放得下，也经常出现刚好放得下、刚好放不下和远远放不下的
+    switch (test_random(seed) % 8) {
+    case 0:
+        return CAPACITY - 1 + test_random(seed) % 3;
+    case 1:
+        return CAPACITY + 1 + test_random(seed) % (CAPACITY * 2);
+    default:
+        return test_random(seed) % CAPACITY;
+    }
+}
+
+static void make_json_script(Script* script, uint32_t* seed)
+{
+    script->stream_size = 0;
+    script->count = 1 + test_random(seed) % MAX_MESSAGES;
+    for (size_t i = 0; i < script->count; i++) {
+        size_t size = random_size(seed) + 1;
+        Message* message = &script->messages[i];
+        message->offset = script->stream_size;
+        message->size = size;
+        message->is_oversize = size > CAPACITY;
+        for (size_t j = 0; j + 1 < size; j++) {
+            // JSON 里不会出现 '\0'，第一个字节也不会是 0xD9
+            script->stream[script->stream_size++] = (uint8_t)(' ' + test_random(seed) % 95);
+        }
+        script->stream[script->stream_size++] = '\0';
+    }
+}
+
+static void make_cbor_script(Script* script, uint32_t* seed)
+{
+    static const uint8_t MAGIC[RPC_FRAMER_CBOR_MAGIC_SIZE] = { 0xD9, 0xD9, 0xF7 };
+    memcpy(script->stream, MAGIC, sizeof(MAGIC));
+    script->stream_size = sizeof(MAGIC);
+    script->count = 1 + test_random(seed) % MAX_MESSAGES;
+    for (size_t i = 0; i < script->count; i++) {
+        size_t size = random_size(seed);
+        script->stream[script->stream_size++] = (uint8_t)(size >> 8);
+        script->stream[script->stream_size++] = (uint8_t)size;
+        Message* message = &script->messages[i];
+        message->offset = script->stream_size;
+        message->size = size;
+        message->is_oversize = size + RPC_FRAMER_LENGTH_PREFIX_SIZE > CAPACITY;
+        for (size_t j = 0; j < size; j++) {
+            // CBOR 帧里任何字节都可能出现，包括 '\0'
+            script->stream[script->stream_size++] = (uint8_t)test_random(seed);
+        }
+    }
+}
+
+static void check_frame(const Script* script, size_t index, RpcFrameStatus status, const RpcFrame* frame)
+{
+    CHECK(index < script->count);
+    const Message* message = &script->messages[index];
+    if (message->is_oversize) {
+        CHECK(status == RPC_FRAME_OVERSIZE);
+        return;
+    }
+    CHECK(status == RPC_FRAME_OK);
+    CHECK(frame->size == message->size);
+    CHECK(memcmp(frame->data, script->stream + message->offset, message->size) == 0);
+}
+
+static void run_script(const Script* script, RpcEncoding encoding, uint32_t* seed)
+{
+    static uint8_t buffer[CAPACITY];
+    RpcFramer framer;
+    RpcFramer_init(&framer, buffer, sizeof(buffer));
+
+    // 块大小有时是 1 字节，有时一次填满缓冲区能放下的部分
+    size_t max_chunk = 1 + test_random(seed) % (CAPACITY * 2);
+    size_t sent = 0;
+    size_t received = 0;
+    while (sent < script->stream_size) {
+        size_t available = 0;
+        uint8_t* rx_buf = RpcFramer_prepare(&framer, &available);
+        CHECK(available > 0);
+        size_t chunk = 1 + test_random(seed) % max_chunk;
+        chunk = chunk < available ? chunk : available;
+        chunk = chunk < script->stream_size - sent ? chunk : script->stream_size - sent;
+        memcpy(rx_buf, script->stream + sent, chunk);
+        RpcFramer_commit(&framer, chunk);
+        sent += chunk;
+
+        RpcFrame frame;
+        RpcFrameStatus status;
+        while ((status = RpcFramer_next(&framer, &frame)) != RPC_FRAME_NONE) {
+            check_frame(script, received, status, &frame);
+            received++;
+        }
+        CHECK(!RpcFramer_has_frame(&framer));
+    }
+    CHECK(received == script->count);
+    CHECK(RpcFramer_encoding(&framer) == encoding);
+}
+
+int main()
+{
+    static Script script;
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        uint32_t seed = 0x9E3779B9u + i;
+        fprintf(stderr, "\rseed %08x", (unsigned)seed);
+        if (i % 2 == 0) {
+            make_json_script(&script, &seed);
+            run_script(&script, RPC_ENCODING_JSON, &seed);
+        } else {
+            make_cbor_script(&script, &seed);
+            run_script(&script, RPC_ENCODING_CBOR, &seed);
+        }
+    }
+    fprintf(stderr, "\n");
+    printf("rpc-framer: %d scripts passed\n", ITERATIONS);
+    return 0;
+}
@@ -0,0 +1,267 @@
+import argparse
+import json
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+# 启动 host/build/rpc-host，通过 TCP 和 UDP 调用 RPC 方法，检查服务端和方法在协议层面的行为
+# 用法：test-rpc-host.py <rpc-host 路径> --port <TCP/UDP 端口>
+
+ERROR_INVALID_PARAMS = -32602
+ERROR_RESPONSE_TOO_LARGE = -32001
+ERROR_REQUEST_TOO_LARGE = -32003
+
+MAX_DATAGRAM_SIZE = 1024
+MAX_RX_BUF_SIZE = 1024 * 8
+
+
+def make_jsonrpc(id, method, params):
+    jsonrpc = {
+        'jsonrpc':      '2.0',
+        'id':           id,
+        'method':       method,
+        'params':       params
+    }
+    return bytes(json.dumps(jsonrpc), 'utf-8')
+
+
+class Client:
+
+    def __init__(self, port):
+        self.port = port
+        self.next_id = 1
+        self.tcp = socket.create_connection(('127.0.0.1', port), timeout=10)
+        self.rx_buf = b''
+        self.udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.udp.connect(('127.0.0.1', port))
+        self.udp.settimeout(10)
+
+    def close(self):
+        self.tcp.close()
+        self.udp.close()
+
+    def send_raw(self, data):
+        self.tcp.sendall(data + b'\0')
+        while b'\0' not in self.rx_buf:
+            data = self.tcp.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed by server')
+            self.rx_buf += data
+        end = self.rx_buf.find(b'\0')
+        response = json.loads(self.rx_buf[:end].decode())
+        self.rx_buf = self.rx_buf[end + 1:]
+        return response
+
+    def call(self, method, params):
+        id = self.next_id
+        self.next_id += 1
+        response = self.send_raw(make_jsonrpc(id, method, params))
+        check(response.get('id') == id, 'id mismatch: {}'.format(response))
+        return response
+
+    def call_datagram(self, method, params):
+        id = self.next_id
+        self.next_id += 1
+        return self.send_datagram(make_jsonrpc(id, method, params))
+
+    def send_datagram(self, payload):
+        request_id = self.next_id
+        self.next_id += 1
+        self.udp.send(struct.pack('!I', request_id) + payload)
+        data = self.udp.recv(MAX_DATAGRAM_SIZE * 2)
+        check(struct.unpack_from('!I', data)[0] == request_id, 'datagram request id mismatch')
+        return json.loads(data[4:].decode())
+
+
+def check(cond, message):
+    if not cond:
+        print('CHECK failed: {}'.format(message))
+        sys.exit(1)
+
+
+def error_code(response):
+    return response.get('error', {}).get('code')
+
+
+def expect_result(response):
+    check('result' in response, 'unexpected error: {}'.format(response))
+    return response['result']
+
+
+def make_job(index):
+    return {
+        'name':         'job {:02d} with a fairly long name'.format(index),
+        'canParallel':  True,
+        'when':         {'minute': index, 'hours': [8, 20], 'dow': [0, 1, 2, 3, 4, 5, 6]},
+        'payloads':     [1.5, 2.5, 0, 0],
+        'missedPolicy': 'skip',
+    }
+
+
+def test_datagram_too_large(client):
+    """
+    结果超过一个数据报时应该返回 -32001，而不是让服务端崩溃；请求超过一个数据报时返回 -32003
+    """
+    expect_result(client.call('doser.schedule_set', [make_job(i) for i in range(10)]))
+    schedule = expect_result(client.call('doser.schedule_get', []))
+    check(len(json.dumps(schedule)) > MAX_DATAGRAM_SIZE, 'schedule too small to overflow a datagram')
+
+    response = client.call_datagram('doser.schedule_get', [])
+    check(error_code(response) == ERROR_RESPONSE_TOO_LARGE, 'expected -32001: {}'.format(response))
+
+    response = client.call_datagram('sys.hello', ['x' * MAX_DATAGRAM_SIZE])
+    check(error_code(response) == ERROR_REQUEST_TOO_LARGE, 'expected -32003: {}'.format(response))
+
+    # 服务端还活着，TCP 上可以拿到完整的结果
+    check(expect_result(client.call('doser.schedule_get', [])) == schedule, 'schedule changed')
+    expect_result(client.call_datagram('sys.hello', []))
+
+
+def test_history(client):
+    """
+    doser.history 和其他方法一样用位置参数 [from, to, limit]，都可以省略
+    """
+    begin = int(time.time()) - 1
+    for volume in (0.1, 0.2):
+        expect_result(client.call('doser.dose', [2, volume]))
+
+    records = expect_result(client.call('doser.history', []))['records']
+    check(len(records) >= 2, 'missing history records: {}'.format(records))
+    check([[r[2], round(r[3], 3)] for r in records[-2:]] == [[2, 0.1], [2, 0.2]], 'unexpected records: {}'.format(records))
+
+    result = expect_result(client.call('doser.history', [begin, 2000000000, 1]))
+    check(len(result['records']) == 1 and result['more'], 'limit not applied: {}'.format(result))
+    check(round(result['records'][0][3], 3) == 0.1, 'records not in time order: {}'.format(result))
+
+    result = expect_result(client.call('doser.history', [None, None, 10]))
+    check(len(result['records']) == len(records), 'null params not defaulted: {}'.format(result))
+    result = expect_result(client.call('doser.history', [2000000000]))
+    check(result['records'] == [] and not result['more'], 'from not applied: {}'.format(result))
+
+    for params in (['x'], [0, 1, 0], [0, 1, 2, 3]):
+        response = client.call('doser.history', params)
+        check(error_code(response) == ERROR_INVALID_PARAMS, 'expected -32602 for {}: {}'.format(params, response))
+
+
+def test_drive_set(client):
+    """
+    doser.drive_set 用位置参数 [mode, rampUp, rampDown, duties]，省略或者为 null 的保持原来的值
+    """
+    expect_result(client.call('doser.drive_set', ['pwm', 200, 100, [100, 80, 100, 100]]))
+    status = expect_result(client.call('doser.status', []))
+    check(status['drive'] == {'mode': 'pwm', 'rampUp': 200, 'rampDown': 100}, 'drive not set: {}'.format(status))
+    check([c['duty'] for c in status['channels']] == [100, 80, 100, 100], 'duties not set: {}'.format(status))
+
+    # PWM 加减速下也能正常投放
+    expect_result(client.call('doser.dose', [2, 0.2]))
+
+    expect_result(client.call('doser.drive_set', [None, 0]))
+    status = expect_result(client.call('doser.status', []))
+    check(status['drive'] == {'mode': 'pwm', 'rampUp': 0, 'rampDown': 100}, 'null not kept: {}'.format(status))
+
+    for params in (['bad'], [None, -1], [None, None, None, [100]], ['gpio', 0, 0, None, 1]):
+        response = client.call('doser.drive_set', params)
+        check(error_code(response) == ERROR_INVALID_PARAMS, 'expected -32602 for {}: {}'.format(params, response))
+
+    expect_result(client.call('doser.drive_set', ['gpio', 0, 0, [100, 100, 100, 100]]))
+    status = expect_result(client.call('doser.status', []))
+    check(status['drive']['mode'] == 'gpio', 'drive not restored: {}'.format(status))
+
+
+def test_flow_control_set(client):
+    """
+    doser.flow_control_set 用位置参数 [enabled, pulsesPerMl, kp, ki, kd, integralMin, integralMax]
+    """
+    before = expect_result(client.call('doser.flow_control_get', []))
+    expect_result(client.call('doser.flow_control_set', [[True, False, False, False], None, 0.25, None, None, -300, 300]))
+    config = expect_result(client.call('doser.flow_control_get', []))
+    check(config['enabled'] == [True, False, False, False], 'enabled not set: {}'.format(config))
+    check(config['kp'] == 0.25 and config['ki'] == before['ki'], 'gains not set: {}'.format(config))
+    check(config['integralMin'] == -300 and config['integralMax'] == 300, 'integral range not set: {}'.format(config))
+    check(config['pulsesPerMl'] == before['pulsesPerMl'], 'null not kept: {}'.format(config))
+
+    # 闭环模式下也能正常投放
+    expect_result(client.call('doser.dose', [0, 0.2]))
+
+    for params in ([[True]], [None, None, 'x'], [None, None, None, None, None, 100000], [None] * 8):
+        response = client.call('doser.flow_control_set', params)
+        check(error_code(response) == ERROR_INVALID_PARAMS, 'expected -32602 for {}: {}'.format(params, response))
+
+    expect_result(client.call('doser.flow_control_set', [before['enabled'], None, before['kp']]))
+
+
+def test_schedule_names(client):
+    """
+    复用的任务槽位不能留下之前任务的名字，包括删掉以后再加回来的
+    """
+    jobs = [make_job(0), make_job(1)]
+    expect_result(client.call('doser.schedule_set', jobs))
+    jobs[1]['name'] = ''
+    expect_result(client.call('doser.schedule_set', jobs))
+    names = [job['name'] for job in expect_result(client.call('doser.schedule_get', []))['jobs']]
+    check(names == [jobs[0]['name'], ''], 'stale name after rename: {}'.format(names))
+
+    expect_result(client.call('doser.schedule_set', [make_job(2), make_job(3)]))
+    expect_result(client.call('doser.schedule_set', [make_job(2)]))
+    job = make_job(4)
+    job['name'] = ''
+    expect_result(client.call('doser.schedule_set', [make_job(2), job]))
+    names = [job['name'] for job in expect_result(client.call('doser.schedule_get', []))['jobs']]
+    check(names == [make_job(2)['name'], ''], 'stale name after delete: {}'.format(names))
+
+
+def test_request_too_large(client):
+    """
+    TCP 上请求超过接收缓冲区时和 UDP 一样返回 -32003，连接还能继续用
+    """
+    response = client.send_raw(make_jsonrpc(1, 'sys.hello', ['x' * MAX_RX_BUF_SIZE]))
+    check(error_code(response) == ERROR_REQUEST_TOO_LARGE, 'expected -32003: {}'.format(response))
+    expect_result(client.call('sys.hello', []))
+
+
+TESTS = [
+    test_datagram_too_large,
+    test_request_too_large,
+    test_history,
+    test_drive_set,
+    test_flow_control_set,
+    test_schedule_names,
+]
+
+
+def wait_for_server(port, server):
+    deadline = time.monotonic() + 10
+    while time.monotonic() < deadline:
+        check(server.poll() is None, 'rpc-host exited with {}'.format(server.returncode))
+        try:
+            socket.create_connection(('127.0.0.1', port), timeout=1).close()
+            return
+        except OSError:
+            time.sleep(0.05)
+    check(False, 'rpc-host is not listening on port {}'.format(port))
+
+
+def main(args):
+    server = subprocess.Popen([args.rpc_host])
+    try:
+        wait_for_server(args.port, server)
+        client = Client(args.port)
+        try:
+            for test in TESTS:
+                test(client)
+                check(server.poll() is None, '{}: rpc-host exited with {}'.format(test.__name__, server.returncode))
+                print('{}: ok'.format(test.__name__))
+        finally:
+            client.close()
+    finally:
+        server.kill()
+        server.wait()
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Protocol tests against rpc-host')
+    parser.add_argument('rpc_host')
+    parser.add_argument('--port', type=int, default=11022)
+    main(parser.parse_args())
@@ -0,0 +1,154 @@
+#include <string.h>
+
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc.h"
+#include "borneo/utils/json-writer.h"
+
+#include "host-test.h"
+
+// 直接调用 rpc.c 的请求处理函数，服务端用假的代替，响应写在没有 flush 回调的缓冲区里，和 UDP 数据报一样
+// 结果放不下缓冲区的时候 JsonWriter 出错，要能回退改写成 RPC_ERROR_RESPONSE_TOO_LARGE，不能触发断言
+
+#define SMALL_CAPACITY 256
+#define LARGE_CAPACITY 4096
+
+static RpcRequestHandler* s_handler = NULL;
+
+int RpcServer_init(RpcRequestHandler* request_handler)
+{
+    s_handler = request_handler;
+    return 0;
+}
+
+int RpcServer_start() { return 0; }
+
+int RpcServer_begin_call(uint64_t id, RpcPendingCall* call) { return -1; }
+
+void RpcServer_cancel_call(const RpcPendingCall* call) { }
+
+/**
+ * 多层嵌套的结果，大小由 params[0] 决定，每个元素一个对象，对象里还有数组
+ */
+static RpcMethodResult write_nested(const cJSON* params, JsonWriter* writer)
+{
+    int count = cJSON_GetArrayItem(params, 0)->valueint;
+    JsonWriter_begin_object(writer);
+    JsonWriter_key(writer, "items");
+    JsonWriter_begin_array(writer);
+    for (int i = 0; i < count; i++) {
+        JsonWriter_begin_object(writer);
+        JsonWriter_add_int(writer, "index", i);
+        JsonWriter_add_string(writer, "name", "nested item");
+        JsonWriter_key(writer, "values");
+        JsonWriter_begin_array(writer);
+        for (int j = 0; j < 4; j++) {
+            JsonWriter_int(writer, i * j);
+        }
+        JsonWriter_end_array(writer);
+        JsonWriter_end_object(writer);
+    }
+    JsonWriter_end_array(writer);
+    JsonWriter_end_object(writer);
+    return (RpcMethodResult) { .is_succeed = true };
+}
+
+static const RpcMethodEntry METHOD_TABLE[] = {
+    { .name = "test.nested", .writer_callback = &write_nested },
+};
+
+// 名字重复的方法表，Rpc_init() 要失败
+static const RpcMethodEntry DUPLICATE_METHOD_TABLE[] = {
+    { .name = "test.nested", .writer_callback = &write_nested },
+    { .name = "test.other", .writer_callback = &write_nested },
+    { .name = "test.nested", .writer_callback = &write_nested },
+};
+
+static void call(const char* request, char* buf, size_t capacity)
+{
+    JsonWriter writer;
+    CHECK(JsonWriter_init(&writer, buf, capacity - 1) == 0);
+    CHECK(s_handler->handle_rpc(request, strlen(request) + 1, &writer) == 0);
+    CHECK(!JsonWriter_has_error(&writer));
+    buf[JsonWriter_size(&writer)] = '\0';
+}
+
+static int error_code(const char* response)
+{
+    cJSON* root = cJSON_Parse(response);
+    CHECK(root != NULL);
+    cJSON* error = cJSON_GetObjectItemCaseSensitive(root, "error");
+    int code = 0;
+    if (error != NULL) {
+        code = cJSON_GetObjectItemCaseSensitive(error, "code")->valueint;
+    }
+    cJSON_Delete(root);
+    return code;
+}
+
+/**
+ * 出错以后容器的开始和结束都直接失败，层数保持不变
+ */
+static void test_writer_after_error()
+{
+    char buf[16];
+    JsonWriter writer;
+    CHECK(JsonWriter_init(&writer, buf, sizeof(buf)) == 0);
+    JsonWriter_begin_object(&writer);
+    JsonWriter_key(&writer, "a");
+    JsonWriter_begin_array(&writer);
+    uint8_t depth = writer.depth;
+    JsonWriter_string(&writer, "longer than the buffer");
+    CHECK(JsonWriter_has_error(&writer));
+    CHECK(JsonWriter_begin_object(&writer) != 0);
+    CHECK(JsonWriter_key(&writer, "b") != 0);
+    CHECK(JsonWriter_end_object(&writer) != 0);
+    CHECK(JsonWriter_end_array(&writer) != 0);
+    CHECK(JsonWriter_end_object(&writer) != 0);
+    CHECK(writer.depth == depth);
+}
+
+/**
+ * 方法名重复时 Rpc_init() 失败，也不会把请求处理函数交给服务端，之后还能用正确的方法表初始化
+ */
+static void test_duplicate_method()
+{
+    CHECK(Rpc_init(DUPLICATE_METHOD_TABLE, sizeof(DUPLICATE_METHOD_TABLE) / sizeof(RpcMethodEntry)) != 0);
+    CHECK(s_handler == NULL);
+}
+
+static void test_response_too_large()
+{
+    static char buf[LARGE_CAPACITY];
+    const char* request = "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"test.nested\",\"params\":[2]}";
+
+    // 放得下的时候正常返回
+    call(request, buf, LARGE_CAPACITY);
+    CHECK(error_code(buf) == 0);
+
+    // 放不下的时候回退成错误响应，id 不变
+    request = "{\"jsonrpc\":\"2.0\",\"id\":7,\"method\":\"test.nested\",\"params\":[50]}";
+    call(request, buf, SMALL_CAPACITY);
+    CHECK(error_code(buf) == RPC_ERROR_RESPONSE_TOO_LARGE);
+    CHECK(strstr(buf, "\"id\":7") != NULL);
+
+    // 批量调用里第二个放不下，整个批量都回退
+    request = "[{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"test.nested\",\"params\":[1]},"
+              "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"test.nested\",\"params\":[50]}]";
+    call(request, buf, SMALL_CAPACITY);
+    CHECK(strstr(buf, "-32001") != NULL);
+}
+
+int main()
+{
+    test_writer_after_error();
+    test_duplicate_method();
+
+    CHECK(Rpc_init(METHOD_TABLE, sizeof(METHOD_TABLE) / sizeof(RpcMethodEntry)) == 0);
+    CHECK(s_handler != NULL);
+    test_response_too_large();
+
+    printf("rpc: ok\n");
+    return 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "borneo/common.h"
+#include "borneo-doser/devices/pump.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 闭环投放：每个通道可以接一个脉冲输出的流量计，用 PID 调节 PWM 占空比，让实际流量保持在设定速度上
+// 管子老化以后流量变小，闭环会自动加大占空比，按时间计算的投放量就还是准的
+// 只在 PWM 驱动模式下生效，设定的占空比要留出余量（比如 80%），否则流量不够的时候没法再加大
+
+// 控制周期，单位毫秒
+#ifndef FLOW_CONTROL_PERIOD_MS
+#define FLOW_CONTROL_PERIOD_MS 50
+#endif
+
+// 按最近多少个周期的脉冲数计算流量，流量计的脉冲比较稀疏，一个周期里只有几个脉冲
+#ifndef FLOW_CONTROL_WINDOW
+#define FLOW_CONTROL_WINDOW 20
+#endif
+
+typedef struct {
+    uint8_t enabled_mask; // 启用闭环的通道
+    float pulses_per_ml[PUMP_MAX_CHANNELS]; // 流量计的 K 系数
+    // PID 的输入是流量，单位 µL/s，输出是在设定占空比之上的修正量，单位是 LEDC 的占空比
+    float kp;
+    float ki;
+    float kd;
+    // 积分项的范围，单位和输出一样，用来抗积分饱和
+    int16_t integral_min;
+    int16_t integral_max;
+} FlowControlConfig;
+
+int FlowControl_init();
+int FlowControl_update_config(const FlowControlConfig* config);
+const FlowControlConfig* FlowControl_get_config();
+bool FlowControl_is_enabled(int ch);
+void FlowControl_sample(int ch);
+void FlowControl_begin(int ch);
+void FlowControl_step(const double* target_speeds, const uint32_t* base_duties, uint32_t max_duty, uint32_t* duties);
+double FlowControl_get_measured_volume(int ch);
+double FlowControl_get_measured_flow(int ch);
+
+#ifdef __cplusplus
+}
+#endif
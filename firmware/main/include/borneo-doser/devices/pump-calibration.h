@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 蠕动泵有管路死体积、启动时的损失，短时间运行的投放量和时间并不成正比
+// 所以每个通道保存若干个实测的“运行时间 - 投放量”点，按分段线性插值
+// 这里只有纯计算，不依赖硬件，方便在上位机上测试
+
+#ifndef PUMP_MAX_CALIBRATION_POINTS
+#define PUMP_MAX_CALIBRATION_POINTS 8
+#endif
+
+enum {
+    PUMP_CALIBRATION_OK = 0,
+    PUMP_CALIBRATION_FULL = 1, // 点已经存满了
+    PUMP_CALIBRATION_NOT_MONOTONIC = 2, // 运行时间越长投放量应该越大
+    PUMP_CALIBRATION_INVALID_POINT = 3,
+};
+
+// 保存在 NVS 里
+typedef struct {
+    uint32_t duration; // 运行时间，单位毫秒
+    float volume; // 实测投放量，单位 mL
+} PumpCalibrationPoint;
+
+typedef struct {
+    uint8_t points_count;
+    PumpCalibrationPoint points[PUMP_MAX_CALIBRATION_POINTS]; // 按运行时间从短到长排列
+} PumpCalibration;
+
+// 由 PumpCalibration 预先算好的插值表，运行时只需要二分查找
+// 第一个节点是第一段延长到投放量为 0 的位置，也就是出液之前空转的时间
+typedef struct {
+    uint8_t knots_count; // 0 表示没有校准
+    double durations[PUMP_MAX_CALIBRATION_POINTS + 1];
+    double volumes[PUMP_MAX_CALIBRATION_POINTS + 1];
+    double ms_per_ml[PUMP_MAX_CALIBRATION_POINTS + 1]; // 从这个节点开始的一段的斜率，最后一段向后延长
+} PumpCurve;
+
+int PumpCalibration_add_point(PumpCalibration* cal, uint32_t duration, float volume);
+void PumpCurve_build(const PumpCalibration* cal, PumpCurve* curve);
+double PumpCurve_duration_for(const PumpCurve* curve, double volume);
+double PumpCurve_volume_for(const PumpCurve* curve, double duration);
+
+inline bool PumpCurve_is_calibrated(const PumpCurve* curve) { return curve->knots_count > 0; }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 电机软启动、软停止的加减速曲线，PWM 占空比在这段时间里线性变化，流量按和占空比成正比计算
+// 这里只有纯计算，不依赖硬件，方便在上位机上测试
+
+#define PUMP_RAMP_MAX_MS 10000
+
+typedef struct {
+    uint16_t ramp_up; // 从停止加速到设定速度的时间，单位毫秒
+    uint16_t ramp_down; // 从设定速度减速到停止的时间，单位毫秒
+} PumpRampProfile;
+
+// 一次投放的实际运行曲线：加速、保持、减速
+// 投放量太小的时候加速还没到设定速度就要开始减速，这时候按比例缩短加减速，peak 小于 1
+typedef struct {
+    uint32_t ramp_up; // 单位毫秒
+    uint32_t hold; // 单位毫秒
+    uint32_t ramp_down; // 单位毫秒
+    double peak; // 峰值速度占设定速度的比例
+} PumpRampPlan;
+
+void PumpRamp_plan_for_volume(const PumpRampProfile* profile, double speed, double volume, PumpRampPlan* plan);
+void PumpRamp_plan_for_duration(const PumpRampProfile* profile, uint32_t duration, PumpRampPlan* plan);
+double PumpRamp_volume(const PumpRampPlan* plan, double speed);
+uint32_t PumpRamp_deficit_us(const PumpRampPlan* plan);
+
+uint32_t PumpRamp_total_ms(const PumpRampPlan* plan);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <esp_event.h>
+
 #include "borneo/common.h"
+#include "borneo-doser/devices/pump-calibration.h"
+#include "borneo-doser/devices/pump-ramp.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,11 +15,41 @@ extern "C" {
 #define PUMP_MAX_CHANNELS 4
 #endif
 
+// 默认最多同时运行的电机个数，电源带不动全部电机同时启动
+#ifndef PUMP_DEFAULT_MAX_RUNNING
+#define PUMP_DEFAULT_MAX_RUNNING 2
+#endif
+
+// 两次电机启动之间最少间隔的时间，错开启动电流，单位毫秒
+#ifndef PUMP_START_INTERVAL_MS
+#define PUMP_START_INTERVAL_MS 200
+#endif
+
+// 通道忙的时候每个通道最多排队等待的投放个数
+#ifndef PUMP_MAX_QUEUED_DOSES
+#define PUMP_MAX_QUEUED_DOSES 4
+#endif
+
+// 投放不属于任何计划任务，比如手动投放和校准
+#define PUMP_JOB_NONE 0xFF
+
+// NVS 里配置的版本，布局改变时加一，并在 load_config() 里迁移旧的配置
+#define PUMP_CONFIG_VERSION 2
+
+ESP_EVENT_DECLARE_BASE(BORNEO_PUMP_EVENTS);
+
+enum {
+    BORNEO_EVENT_PUMP_STARTED = 1,
+    BORNEO_EVENT_PUMP_STOPPED,
+};
+
 enum {
     PUMP_ERROR_OK = 0, // 成功
-    PUMP_ERROR_BUSY = 1, // 设备忙
+    PUMP_ERROR_BUSY = 1, // 设备忙，排队也满了
     PUMP_ERROR_UNCALIBRATED = 2, // 未校准（未设置速度）
     PUMP_ERROR_INVALID_VOLUME = 3, // 无效的体积
+    PUMP_ERROR_INVALID_ARG = 4, // 无效的参数
+    PUMP_ERROR_CALIBRATION = 5, // 校准点无效、和已有的点矛盾或者已经存满
 };
 
 typedef enum {
@@ -29,23 +63,70 @@ typedef struct {
     uint8_t io_pin;
 } PumpPort;
 
+// 有校准曲线的通道按曲线计算运行时间，没有的才用 speeds
+// 校准曲线是在当时的驱动方式下测出来的，加减速的影响已经包含在里面，修改驱动方式以后需要重新校准
 typedef struct {
+    uint16_t version; // PUMP_CONFIG_VERSION
     double speeds[PUMP_MAX_CHANNELS];
+    PumpCalibration calibrations[PUMP_MAX_CHANNELS];
 } PumpDeviceConfig;
 
+typedef enum {
+    PUMP_DRIVE_GPIO = 0, // 直接开关，电机一上电就是全速
+    PUMP_DRIVE_PWM = 1, // LEDC 输出 PWM，可以软启动、软停止，也可以调速
+} PumpDriveMode;
+
+// PWM 模式下流量按和占空比成正比计算，校准的速度是 100% 占空比时的速度
+typedef struct {
+    uint8_t mode; // PumpDriveMode
+    PumpRampProfile ramp; // 只在 PWM 模式下生效
+    uint8_t duties[PUMP_MAX_CHANNELS]; // 各通道的设定速度，占空比的百分数，1～100
+} PumpDriveConfig;
+
 typedef struct {
     const char* name;
     PumpState state;
     double speed;
+    double effective_speed; // 按设定占空比折算后的速度，GPIO 模式下就是 speed
+    bool is_calibrated; // 是否有校准曲线
+    uint32_t completed_count; // 上电以来完成的次数
+    uint8_t queue_depth; // 正在排队等待的投放个数，不含正在运行的
+    double dispensed_volume; // 上电以来按实际运行时间和速度估算的投放量，单位 mL
+    uint32_t toggle_count; // 上电以来 GPIO 电平变化的次数
+    // 实际关泵时间比应该关泵的时间晚了多久，即定时器中断的延迟，单位微秒
+    int32_t last_timing_error;
+    int32_t max_timing_error;
+    int32_t mean_timing_error;
+    uint64_t last_on_time; // 最近一次投放实际开始的时间，硬件定时器计数，单位微秒
+    uint64_t last_off_time; // 最近一次投放实际结束的时间
 } PumpChannelInfo;
 
+// BORNEO_PUMP_EVENTS 的事件数据，事件处理时通道的状态可能已经又变了，所以这里带上事件发生时的计数
+typedef struct {
+    int channel;
+    uint32_t completed_count;
+    // 下面几项只有 BORNEO_EVENT_PUMP_STOPPED 才有
+    uint8_t job; // 计划任务的序号，PUMP_JOB_NONE 表示不是计划任务
+    float volume; // 请求的投放量，按时间运行的是 0，单位 mL
+    uint32_t duration; // 实际运行的时间，单位毫秒
+} PumpEventData;
+
 int Pump_init();
 int Pump_start(int ch, double vol);
 int Pump_start_until(int ch, int ms);
 int Pump_start_all(const double* vols);
+int Pump_start_job(int job, const double* vols, bool can_parallel);
 int Pump_on(int ch);
 int Pump_off(int ch);
 int Pump_update_speed(int ch, double speed);
+int Pump_update_max_running(int max_running);
+int Pump_get_max_running();
+int Pump_update_drive(const PumpDriveConfig* drive);
+const PumpDriveConfig* Pump_get_drive();
+int Pump_calibration_run(int ch, int ms);
+int Pump_calibration_add(int ch, double volume);
+int Pump_calibration_clear(int ch);
+const PumpCalibration* Pump_get_calibration(int ch);
 bool Pump_is_any_busy();
 PumpChannelInfo Pump_get_channel_info(int ch);
 
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <time.h>
+
+#include "borneo/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* Declarations of this file */
+
+// 投放历史存在单独的数据分区里，见 partitions.csv
+#define DOSE_HISTORY_PARTITION_LABEL "history"
+#define DOSE_HISTORY_PARTITION_SUBTYPE 0x40
+
+// 内存里最多攒这么多条记录才写一次 Flash
+#ifndef DOSE_HISTORY_BUFFER_SIZE
+#define DOSE_HISTORY_BUFFER_SIZE 16
+#endif
+
+// 攒不满也最多等这么久就写入，断电最多丢这么久的记录
+#ifndef DOSE_HISTORY_FLUSH_INTERVAL_SECS
+#define DOSE_HISTORY_FLUSH_INTERVAL_SECS 60
+#endif
+
+typedef struct {
+    time_t timestamp; // 投放结束的时间
+    uint8_t job; // 计划任务的序号，PUMP_JOB_NONE 表示不是计划任务
+    uint8_t channel;
+    float volume; // 请求的投放量，按时间运行的是 0，单位 mL
+    uint32_t duration; // 实际运行的时间，单位毫秒
+} DoseRecord;
+
+// 返回非 0 停止遍历
+typedef int (*DoseHistoryVisitor)(const DoseRecord* record, void* context);
+
+int DoseHistory_init();
+
+int DoseHistory_append(const DoseRecord* record);
+
+int DoseHistory_flush();
+
+int DoseHistory_query(time_t from, time_t to, DoseHistoryVisitor visitor, void* context);
+
+#ifdef __cplusplus
+}
+#endif
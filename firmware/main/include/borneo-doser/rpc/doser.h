@@ -9,12 +9,39 @@ extern "C" {
 
 // 滴定泵专有接口
 
+// 可以订阅的通知主题
+enum {
+    DOSER_TOPIC_PUMP = 1 << 0, // 通道开始或者停止，方法 doser.pump_state
+    DOSER_TOPIC_SCHEDULER = 1 << 1, // 计划任务开始执行，方法 doser.job_started
+};
+
+// 设备的全部 RPC 方法，固件和 PC 上的服务端共用一张表
+extern const RpcMethodEntry RPC_METHOD_TABLE[];
+extern const size_t RPC_METHOD_TABLE_SIZE;
+
+int DoserRpc_init();
+int DoserRpc_dose_init();
+
 RpcMethodResult RpcMethod_doser_pump_until(const cJSON* params);
 RpcMethodResult RpcMethod_doser_pump(const cJSON* params);
+RpcMethodResult RpcMethod_doser_dose(const cJSON* params, const RpcPendingCall* call);
 RpcMethodResult RpcMethod_doser_speed_set(const cJSON* params);
-RpcMethodResult RpcMethod_doser_schedule_get(const cJSON* params);
+RpcMethodResult RpcMethod_doser_max_running_set(const cJSON* params);
+RpcMethodResult RpcMethod_doser_drive_set(const cJSON* params);
+RpcMethodResult RpcMethod_doser_calibration_run(const cJSON* params);
+RpcMethodResult RpcMethod_doser_calibration_add(const cJSON* params);
+RpcMethodResult RpcMethod_doser_calibration_clear(const cJSON* params);
+RpcMethodResult RpcMethod_doser_calibration_get(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_flow_control_get(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_flow_control_set(const cJSON* params);
+RpcMethodResult RpcMethod_doser_history(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_schedule_get(const cJSON* params, JsonWriter* result_writer);
 RpcMethodResult RpcMethod_doser_schedule_set(const cJSON* params);
-RpcMethodResult RpcMethod_doser_status(const cJSON* params);
+RpcMethodResult RpcMethod_doser_status(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_stats(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_memory(const cJSON* params, JsonWriter* result_writer);
+RpcMethodResult RpcMethod_doser_subscribe(const cJSON* params);
+RpcMethodResult RpcMethod_doser_unsubscribe(const cJSON* params);
 
 #ifdef __cplusplus
 }
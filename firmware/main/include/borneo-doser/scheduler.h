@@ -1,5 +1,7 @@
 #pragma once
 
+#include <esp_event.h>
+
 #include "borneo/common.h"
 
 #ifdef __cplusplus
@@ -7,20 +9,83 @@ extern "C" {
 #endif
 /* Declarations of this file */
 
-#define SCHEDULER_MAX_JOB_NAME 128
-#define SCHEDULER_MAX_JOBS 10
+// 名字包括结尾的 '\0'，更长的名字按 UTF-8 字符截断
+#define SCHEDULER_MAX_JOB_NAME 32
+
+// 任务按块分配，用多少分配多少，这个只是防止把 NVS 写满的上限
+#ifndef SCHEDULER_MAX_JOBS
+#define SCHEDULER_MAX_JOBS 128
+#endif
+
+#define SCHEDULER_JOBS_PER_BLOCK 8
+#define SCHEDULER_MAX_JOB_BLOCKS ((SCHEDULER_MAX_JOBS + SCHEDULER_JOBS_PER_BLOCK - 1) / SCHEDULER_JOBS_PER_BLOCK)
+
+// NVS 里排程记录的版本，格式改变时加一，并在 load_config() 里迁移旧的配置
+// 0 和 1 是旧固件直接把整个 SchedulerStatus 存成一个 blob 的格式，从 2 开始每个任务单独一条带 CRC 的记录
+#define SCHEDULER_CONFIG_VERSION 2
+
+// 一条任务记录最大的字节数：版本、名字长度和名字、标志、策略、Cron、通道数和投放量、最近执行时间、CRC32
+// 旧固件写的记录名字最长 127 字节，按记录格式能表示的最长的名字算
+#define SCHEDULER_RECORD_MAX_SIZE (2 + UINT8_MAX + 4 + 4 + 1 + 8 * PUMP_MAX_CHANNELS + 8 + 4)
+
+// 计划时间过去一分钟之内执行都算准时
+#define SCHEDULER_FIRE_WINDOW_SECS 60
+
+// 只追溯这么久之内错过的执行，所以补执行最多补一天的量
+#define SCHEDULER_CATCHUP_WINDOW_SECS (24 * 60 * 60)
+
+// 每个通道在最近 24 小时里计划任务最多投放的量，单位 mL
+// 补执行按倍数合并的投放和正常的执行都受它限制，超过的部分削减掉，防止时钟错乱或者长时间断电后一次投放过量
+#ifndef SCHEDULER_MAX_DAILY_VOLUME
+#define SCHEDULER_MAX_DAILY_VOLUME 500.0
+#endif
+
+// 每天的投放量按小时统计，最近 24 小时就是最近的 24 格
+#define SCHEDULER_VOLUME_BUCKET_SECS (60 * 60)
+#define SCHEDULER_VOLUME_BUCKETS (SCHEDULER_CATCHUP_WINDOW_SECS / SCHEDULER_VOLUME_BUCKET_SECS)
+
+ESP_EVENT_DECLARE_BASE(BORNEO_SCHEDULER_EVENTS);
+
+enum {
+    BORNEO_EVENT_SCHEDULER_JOB_STARTED = 1,
+};
+
+typedef struct {
+    int job_index;
+    time_t execute_time;
+} SchedulerJobEventData;
+
+// 断电、时钟校正或者卡顿导致错过执行时间的处理方式
+typedef enum {
+    SCHEDULER_MISSED_SKIP = 0, // 跳过错过的
+    SCHEDULER_MISSED_ONCE, // 不管错过几次只补一次
+    SCHEDULER_MISSED_ALL, // 错过几次补几次，合并成一次按倍数投放
+} MissedJobPolicy;
 
 typedef struct {
     char name[SCHEDULER_MAX_JOB_NAME];
     bool can_parallel;
     Cron when;
     double payloads[PUMP_MAX_CHANNELS];
-    time_t last_execute_time;
+    uint8_t missed_policy;
+    time_t last_execute_time; // 最近一次处理过的计划时间，跳过的也算
 } ScheduledJob;
 
+// 某一时刻一个任务到期的情况
 typedef struct {
-    uint8_t jobs_count;
-    ScheduledJob jobs[SCHEDULER_MAX_JOBS];
+    uint8_t due_count; // 到期还没处理的计划时间个数
+    bool is_on_time; // 最后一个到期的是不是还在准时的范围内
+    uint8_t missed_count;
+    uint8_t runs; // 按策略这次要执行几次
+    time_t last_due_time;
+    time_t next_fire_time; // 处理完之后的下一次执行时间，-1 表示不会再执行
+} ScheduledJobDue;
+
+// 块只增加不释放，已有任务的地址不会变，其他任务读的时候不用担心内存被释放
+typedef struct {
+    uint16_t jobs_count;
+    uint16_t capacity; // 已经分配的块能放的任务个数
+    ScheduledJob* blocks[SCHEDULER_MAX_JOB_BLOCKS];
 } Schedule;
 
 typedef struct {
@@ -28,13 +93,57 @@ typedef struct {
     Schedule schedule;
 } SchedulerStatus;
 
+// 调度器占用的内存，单位字节
+typedef struct {
+    uint16_t jobs_count;
+    uint16_t capacity;
+    size_t jobs_size; // 任务块
+    size_t triggers_size; // 按执行时间排列的堆
+    size_t records_size; // NVS 记录的 CRC
+} SchedulerMemoryUsage;
+
+// 每个通道最近 24 小时计划任务的投放量，按小时分格循环使用
+typedef struct {
+    int64_t hour; // 最新一格的小时数，即时间戳除以 SCHEDULER_VOLUME_BUCKET_SECS，INT64_MIN 表示还没有记录
+    float volumes[PUMP_MAX_CHANNELS][SCHEDULER_VOLUME_BUCKETS];
+} ScheduledVolumeTally;
+
+// 上电以来的执行统计
+typedef struct {
+    uint32_t executed_count; // 启动过的执行次数，合并补执行的算一次
+    uint32_t missed_count; // 错过的计划时间个数，不管有没有补
+    uint32_t limited_count; // 因为超过 SCHEDULER_MAX_DAILY_VOLUME 被削减的执行次数
+    int32_t last_delay; // 最近一次启动时间比计划时间晚了多久，单位秒
+    int32_t max_delay; // 单位秒
+} SchedulerStats;
+
 int Scheduler_init();
 
 int Scheduler_start();
 
 const Schedule* Scheduler_get_schedule();
 
-int Scheduler_update_schedule(const Schedule* schedule);
+SchedulerStats Scheduler_get_stats();
+
+SchedulerMemoryUsage Scheduler_get_memory_usage();
+
+int Scheduler_update_schedule(const ScheduledJob* jobs, size_t jobs_count);
+
+inline ScheduledJob* Schedule_job_at(const Schedule* schedule, size_t index)
+{
+    return &schedule->blocks[index / SCHEDULER_JOBS_PER_BLOCK][index % SCHEDULER_JOBS_PER_BLOCK];
+}
+
+void Scheduler_check_job(const ScheduledJob* job, time_t now, ScheduledJobDue* due);
+
+void ScheduledVolumeTally_init(ScheduledVolumeTally* tally);
+void ScheduledVolumeTally_add(ScheduledVolumeTally* tally, time_t time, size_t ch, double volume);
+double ScheduledVolumeTally_sum(const ScheduledVolumeTally* tally, time_t now, size_t ch);
+bool Scheduler_limit_payloads(const ScheduledVolumeTally* tally, time_t now, double* payloads);
+
+size_t Scheduler_encode_job(const ScheduledJob* job, uint8_t* buf, uint32_t* crc);
+int Scheduler_decode_job(const uint8_t* buf, size_t size, ScheduledJob* job);
+void Scheduler_copy_job_name(char* dest, const char* src, size_t len);
 
 #ifdef __cplusplus
 }
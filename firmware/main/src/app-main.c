@@ -24,8 +24,11 @@
 #include "borneo/cron.h"
 #include "borneo/devices/leds.h"
 #include "borneo/devices/buttons.h"
+#include "borneo-doser/devices/flow-control.h"
+#include "borneo-doser/dose-history.h"
 #include "borneo-doser/devices/pump.h"
 #include "borneo/devices/wifi.h"
+#include "borneo/mdns-service.h"
 #include "borneo/rpc.h"
 #include "borneo/rtc.h"
 #include "borneo-doser/scheduler.h"
@@ -33,8 +36,6 @@
 #include "borneo/serial.h"
 #include "borneo/sntp.h"
 
-#include "borneo/rpc/sys.h"
-
 #include "borneo-doser/rpc/doser.h"
 
 static int App_init_core_devices();
@@ -43,16 +44,6 @@ static void init_network_task();
 
 static const char* TAG = "APP_MAIN";
 
-const RpcMethodEntry RPC_METHOD_TABLE[] = {
-    { .name = "sys.hello", .callback = &RpcMethod_sys_hello },
-    { .name = "doser.pump_until", .callback = &RpcMethod_doser_pump_until },
-    { .name = "doser.pump", .callback = &RpcMethod_doser_pump },
-    { .name = "doser.speed_set", .callback = &RpcMethod_doser_speed_set },
-    { .name = "doser.schedule_get", .callback = &RpcMethod_doser_schedule_get },
-    { .name = "doser.schedule_set", .callback = &RpcMethod_doser_schedule_set },
-    { .name = "doser.status", .callback = &RpcMethod_doser_status },
-};
-
 const SimpleButton SIMPLE_BUTTONS[] = { { .id = 0, .io_pin = 27 } };
 
 static void wifi_disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
@@ -110,12 +101,18 @@ static int App_init_core_devices()
 
     ESP_ERROR_CHECK(Serial_init());
 
+    ESP_ERROR_CHECK(FlowControl_init());
     ESP_ERROR_CHECK(Pump_init());
 
     // 初始化并启动 RTC
     ESP_ERROR_CHECK(Rtc_init());
     ESP_ERROR_CHECK(Rtc_start());
 
+    // 投放历史，旧的分区表没有历史分区，没有历史也照样投放
+    if (DoseHistory_init() != ESP_OK) {
+        ESP_LOGE(TAG, "Dose history is not available");
+    }
+
     // 初始化并启动 Scheduler
     ESP_ERROR_CHECK(Scheduler_init());
     ESP_ERROR_CHECK(Scheduler_start());
@@ -184,9 +181,19 @@ static void init_network_task(void* params) {
     ESP_ERROR_CHECK(Broadcast_init());
     ESP_ERROR_CHECK(Broadcast_start());
 
+    // 通过 mDNS 公布 RPC 服务，客户端查询时才应答，出错了也还能靠广播被发现
+    ESP_ERROR_CHECK(MdnsService_init());
+    if (MdnsService_start() != ESP_OK) {
+        ESP_LOGE(TAG, "mDNS service is not available");
+    }
+
     // 初始化 RPC 子系统
-    ESP_ERROR_CHECK(Rpc_init(RPC_METHOD_TABLE, sizeof(RPC_METHOD_TABLE) / sizeof(RpcMethodEntry)));
+    ESP_ERROR_CHECK(Rpc_init(RPC_METHOD_TABLE, RPC_METHOD_TABLE_SIZE));
     ESP_ERROR_CHECK(Rpc_start());
+    // 泵和计划任务的事件推送给订阅的客户端
+    ESP_ERROR_CHECK(DoserRpc_init());
+    // 等投放结束才返回的异步方法
+    ESP_ERROR_CHECK(DoserRpc_dose_init());
 
     // 初始化 SNTP 部件
     ESP_ERROR_CHECK(Sntp_init());
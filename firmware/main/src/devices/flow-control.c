@@ -0,0 +1,240 @@
+#include <math.h>
+#include <string.h>
+
+#include <driver/pcnt.h>
+#include <esp_log.h>
+#include <esp_system.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "borneo/common.h"
+#include "borneo/pid.h"
+#include "borneo-doser/devices/flow-control.h"
+
+// 脉冲计数器滤掉比这个短的毛刺，单位是 APB 时钟周期
+#define FLOW_METER_FILTER_VALUE 1000
+
+typedef struct {
+    uint16_t window[FLOW_CONTROL_WINDOW]; // 最近各个周期的脉冲数
+    uint8_t window_pos;
+    uint8_t window_count; // 这次闭环开始以后采样的周期数，不超过 FLOW_CONTROL_WINDOW
+    uint32_t window_sum;
+    uint32_t total_pulses; // 上电以来的脉冲数
+} FlowChannel;
+
+typedef struct {
+    FlowControlConfig config;
+    FlowChannel channels[PUMP_MAX_CHANNELS];
+    FastPidBank pids; // 每个通道一个 PID，一起计算
+} FlowControlStatus;
+
+static int load_config();
+static int save_config(const FlowControlConfig* config);
+
+// 流量计接在只能输入的引脚上
+const uint8_t FLOW_METER_IO_PINS[PUMP_MAX_CHANNELS] = { 34, 35, 36, 39 };
+
+static FlowControlStatus s_flow_status;
+
+static const char* TAG = "FLOW";
+
+static const char* NVS_NAMESPACE = "flow";
+static const char* NVS_FLOW_CONFIG_KEY = "config";
+
+static const FlowControlConfig FLOW_CONTROL_DEFAULT_CONFIG = {
+    .enabled_mask = 0,
+    .pulses_per_ml = { 20.0f, 20.0f, 20.0f, 20.0f },
+    .kp = 0.5f,
+    .ki = 1.0f,
+    .kd = 0.0f,
+    .integral_min = -512,
+    .integral_max = 512,
+};
+
+int FlowControl_init()
+{
+    memset(&s_flow_status, 0, sizeof(s_flow_status));
+    FastPidBank_init(&s_flow_status.pids, PUMP_MAX_CHANNELS);
+
+    if (load_config() != ESP_OK) {
+        memcpy(&s_flow_status.config, &FLOW_CONTROL_DEFAULT_CONFIG, sizeof(s_flow_status.config));
+    }
+
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        pcnt_config_t pcnt_config = {
+            .pulse_gpio_num = FLOW_METER_IO_PINS[i],
+            .ctrl_gpio_num = PCNT_PIN_NOT_USED,
+            .lctrl_mode = PCNT_MODE_KEEP,
+            .hctrl_mode = PCNT_MODE_KEEP,
+            .pos_mode = PCNT_COUNT_INC, // 只数上升沿
+            .neg_mode = PCNT_COUNT_DIS,
+            .counter_h_lim = INT16_MAX,
+            .counter_l_lim = 0,
+            .unit = (pcnt_unit_t)i,
+            .channel = PCNT_CHANNEL_0,
+        };
+        ESP_ERROR_CHECK(pcnt_unit_config(&pcnt_config));
+        pcnt_set_filter_value((pcnt_unit_t)i, FLOW_METER_FILTER_VALUE);
+        pcnt_filter_enable((pcnt_unit_t)i);
+        pcnt_counter_pause((pcnt_unit_t)i);
+        pcnt_counter_clear((pcnt_unit_t)i);
+        pcnt_counter_resume((pcnt_unit_t)i);
+    }
+
+    return 0;
+}
+
+int FlowControl_update_config(const FlowControlConfig* config)
+{
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        if (!(config->pulses_per_ml[i] > 0.0f)) {
+            return PUMP_ERROR_INVALID_ARG;
+        }
+    }
+    if (config->integral_min >= config->integral_max) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+
+    // 先试一下参数能不能用
+    FastPid pid;
+    if (!FastPid_configure(&pid, config->kp, config->ki, config->kd, 1000.0f / FLOW_CONTROL_PERIOD_MS, 16, true)) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+
+    int err = save_config(config);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // 正在运行的通道下一次投放才用新的参数
+    memcpy(&s_flow_status.config, config, sizeof(s_flow_status.config));
+    return 0;
+}
+
+const FlowControlConfig* FlowControl_get_config() { return &s_flow_status.config; }
+
+bool FlowControl_is_enabled(int ch) { return (s_flow_status.config.enabled_mask & (1U << ch)) != 0; }
+
+/**
+ * 每个控制周期调用一次，读出这个周期的脉冲数
+ */
+void FlowControl_sample(int ch)
+{
+    FlowChannel* fc = &s_flow_status.channels[ch];
+    int16_t count = 0;
+    pcnt_get_counter_value((pcnt_unit_t)ch, &count);
+    pcnt_counter_clear((pcnt_unit_t)ch);
+
+    uint16_t pulses = count > 0 ? (uint16_t)count : 0;
+    fc->total_pulses += pulses;
+    fc->window_sum -= fc->window[fc->window_pos];
+    fc->window[fc->window_pos] = pulses;
+    fc->window_sum += pulses;
+    fc->window_pos = (fc->window_pos + 1) % FLOW_CONTROL_WINDOW;
+    if (fc->window_count < FLOW_CONTROL_WINDOW) {
+        fc->window_count++;
+    }
+}
+
+/**
+ * 加速结束、开始闭环的时候调用，加速阶段的流量不算
+ */
+void FlowControl_begin(int ch)
+{
+    FlowChannel* fc = &s_flow_status.channels[ch];
+    const FlowControlConfig* config = &s_flow_status.config;
+
+    memset(fc->window, 0, sizeof(fc->window));
+    fc->window_pos = 0;
+    fc->window_count = 0;
+    fc->window_sum = 0;
+
+    FastPid pid;
+    FastPid_configure(&pid, config->kp, config->ki, config->kd, 1000.0f / FLOW_CONTROL_PERIOD_MS, 16, true);
+    FastPid_set_integral_range(&pid, config->integral_min, config->integral_max);
+    FastPidBank_load(&s_flow_status.pids, ch, &pid);
+}
+
+/**
+ * 一个控制周期算出全部通道新的占空比，target_speeds 单位 mL/min
+ * target_speeds 为 0 的通道不在闭环里，输出就是 base_duties
+ * 不在闭环里的通道 PID 也跟着算，它们开始闭环的时候 FlowControl_begin() 会重新装载
+ */
+void FlowControl_step(const double* target_speeds, const uint32_t* base_duties, uint32_t max_duty, uint32_t* duties)
+{
+    int16_t sp[PUMP_MAX_CHANNELS];
+    int16_t fb[PUMP_MAX_CHANNELS];
+    int16_t out[PUMP_MAX_CHANNELS];
+
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        bool is_active = target_speeds[i] > 0.0 && s_flow_status.channels[i].window_count > 0;
+        sp[i] = is_active ? (int16_t)lround(fmin(target_speeds[i] * 1000.0 / 60.0, INT16_MAX)) : 0;
+        fb[i] = is_active ? (int16_t)lround(fmin(FlowControl_get_measured_flow(i) * 1000.0 / 60.0, INT16_MAX)) : 0;
+    }
+
+    FastPidBank_step(&s_flow_status.pids, sp, fb, out);
+
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        bool is_active = target_speeds[i] > 0.0 && s_flow_status.channels[i].window_count > 0;
+        int32_t duty = (int32_t)base_duties[i] + (is_active ? out[i] : 0);
+        duty = duty < 0 ? 0 : duty;
+        duties[i] = (uint32_t)duty > max_duty ? max_duty : (uint32_t)duty;
+    }
+}
+
+double FlowControl_get_measured_volume(int ch)
+{
+    return s_flow_status.channels[ch].total_pulses / s_flow_status.config.pulses_per_ml[ch];
+}
+
+/**
+ * 窗口内的平均流量，单位 mL/min
+ */
+double FlowControl_get_measured_flow(int ch)
+{
+    const FlowChannel* fc = &s_flow_status.channels[ch];
+    if (fc->window_count == 0) {
+        return 0.0;
+    }
+    double ml = fc->window_sum / s_flow_status.config.pulses_per_ml[ch];
+    return ml * 60.0 * 1000.0 / (fc->window_count * FLOW_CONTROL_PERIOD_MS);
+}
+
+static int load_config()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    FlowControlConfig config;
+    size_t size = sizeof(config);
+    err = nvs_get_blob(nvs_handle, NVS_FLOW_CONFIG_KEY, &config, &size);
+    nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (size != sizeof(config)) {
+        ESP_LOGW(TAG, "Invalid config size %u", (unsigned)size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(&s_flow_status.config, &config, sizeof(s_flow_status.config));
+    return ESP_OK;
+}
+
+static int save_config(const FlowControlConfig* config)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, NVS_FLOW_CONFIG_KEY, config, sizeof(*config));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
@@ -0,0 +1,114 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "borneo-doser/devices/pump-calibration.h"
+
+/**
+ * 按运行时间插入一个点，运行时间相同的点直接替换
+ */
+int PumpCalibration_add_point(PumpCalibration* cal, uint32_t duration, float volume)
+{
+    if (duration == 0 || !(volume > 0.0f) || !isfinite(volume)) {
+        return PUMP_CALIBRATION_INVALID_POINT;
+    }
+
+    size_t i = 0;
+    while (i < cal->points_count && cal->points[i].duration < duration) {
+        i++;
+    }
+    bool is_replace = i < cal->points_count && cal->points[i].duration == duration;
+    if (!is_replace && cal->points_count >= PUMP_MAX_CALIBRATION_POINTS) {
+        return PUMP_CALIBRATION_FULL;
+    }
+
+    // 和前后两个点比较
+    if (i > 0 && cal->points[i - 1].volume >= volume) {
+        return PUMP_CALIBRATION_NOT_MONOTONIC;
+    }
+    size_t next = is_replace ? i + 1 : i;
+    if (next < cal->points_count && cal->points[next].volume <= volume) {
+        return PUMP_CALIBRATION_NOT_MONOTONIC;
+    }
+
+    if (!is_replace) {
+        memmove(&cal->points[i + 1], &cal->points[i], (cal->points_count - i) * sizeof(PumpCalibrationPoint));
+        cal->points_count++;
+    }
+    cal->points[i].duration = duration;
+    cal->points[i].volume = volume;
+    return PUMP_CALIBRATION_OK;
+}
+
+void PumpCurve_build(const PumpCalibration* cal, PumpCurve* curve)
+{
+    memset(curve, 0, sizeof(PumpCurve));
+    if (cal->points_count == 0) {
+        return;
+    }
+
+    // 只有一个点就按过原点的直线算
+    double start = 0.0;
+    if (cal->points_count > 1) {
+        const PumpCalibrationPoint* p0 = &cal->points[0];
+        const PumpCalibrationPoint* p1 = &cal->points[1];
+        double slope = (double)(p1->duration - p0->duration) / (p1->volume - p0->volume);
+        start = fmax(0.0, p0->duration - p0->volume * slope);
+    }
+
+    curve->durations[0] = start;
+    curve->volumes[0] = 0.0;
+    for (size_t i = 0; i < cal->points_count; i++) {
+        curve->durations[i + 1] = cal->points[i].duration;
+        curve->volumes[i + 1] = cal->points[i].volume;
+    }
+    curve->knots_count = cal->points_count + 1;
+
+    for (size_t i = 0; i + 1 < curve->knots_count; i++) {
+        curve->ms_per_ml[i]
+            = (curve->durations[i + 1] - curve->durations[i]) / (curve->volumes[i + 1] - curve->volumes[i]);
+    }
+    curve->ms_per_ml[curve->knots_count - 1] = curve->ms_per_ml[curve->knots_count - 2];
+}
+
+/**
+ * 投放 volume 需要运行的时间，单位毫秒
+ */
+double PumpCurve_duration_for(const PumpCurve* curve, double volume)
+{
+    // 找最后一个 volumes[i] <= volume 的节点
+    size_t lo = 0;
+    size_t hi = curve->knots_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (curve->volumes[mid] <= volume) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return curve->durations[lo] + (volume - curve->volumes[lo]) * curve->ms_per_ml[lo];
+}
+
+/**
+ * 运行 duration 毫秒的投放量，用来估算统计
+ */
+double PumpCurve_volume_for(const PumpCurve* curve, double duration)
+{
+    if (duration <= curve->durations[0]) {
+        return 0.0;
+    }
+
+    size_t lo = 0;
+    size_t hi = curve->knots_count;
+    while (hi - lo > 1) {
+        size_t mid = (lo + hi) / 2;
+        if (curve->durations[mid] <= duration) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return curve->volumes[lo] + (duration - curve->durations[lo]) / curve->ms_per_ml[lo];
+}
@@ -0,0 +1,76 @@
+#include <math.h>
+#include <stdint.h>
+
+#include "borneo-doser/devices/pump-ramp.h"
+
+// 设定速度下运行 1 毫秒的投放量，speed 单位 mL/min
+#define ML_PER_MS(speed) ((speed) / (60.0 * 1000.0))
+
+/**
+ * 算出投放 volume 需要的运行曲线。加减速阶段按线性变化的速度积分，各相当于用设定速度运行了一半的时间
+ */
+void PumpRamp_plan_for_volume(const PumpRampProfile* profile, double speed, double volume, PumpRampPlan* plan)
+{
+    // 全程都按设定速度运行需要的时间
+    double full_speed_ms = volume / ML_PER_MS(speed);
+    double ramps_ms = (profile->ramp_up + profile->ramp_down) / 2.0;
+
+    plan->peak = 1.0;
+    if (full_speed_ms >= ramps_ms) {
+        plan->ramp_up = profile->ramp_up;
+        plan->ramp_down = profile->ramp_down;
+        plan->hold = (uint32_t)lround(full_speed_ms - ramps_ms);
+        return;
+    }
+
+    // 加减速都按比例 p 缩短，峰值也只到 p，投放量是 p * p * ramps_ms
+    double p = sqrt(full_speed_ms / ramps_ms);
+    plan->ramp_up = (uint32_t)lround(profile->ramp_up * p);
+    plan->ramp_down = (uint32_t)lround(profile->ramp_down * p);
+    plan->hold = 0;
+    if (plan->ramp_up + plan->ramp_down == 0) {
+        // 短到没法加减速了，直接开关
+        plan->hold = (uint32_t)lround(full_speed_ms);
+        return;
+    }
+    // 时间取整以后重新算峰值，保证投放量不变
+    plan->peak = fmin(1.0, full_speed_ms * 2.0 / (plan->ramp_up + plan->ramp_down));
+}
+
+/**
+ * 按时间运行，加减速都包含在 duration 里
+ */
+void PumpRamp_plan_for_duration(const PumpRampProfile* profile, uint32_t duration, PumpRampPlan* plan)
+{
+    uint32_t ramps = profile->ramp_up + profile->ramp_down;
+    if (duration >= ramps) {
+        plan->ramp_up = profile->ramp_up;
+        plan->ramp_down = profile->ramp_down;
+        plan->hold = duration - ramps;
+        plan->peak = 1.0;
+        return;
+    }
+
+    double p = (double)duration / ramps;
+    plan->ramp_up = (uint32_t)lround(profile->ramp_up * p);
+    plan->ramp_down = duration - plan->ramp_up;
+    plan->hold = 0;
+    plan->peak = p;
+}
+
+uint32_t PumpRamp_total_ms(const PumpRampPlan* plan) { return plan->ramp_up + plan->hold + plan->ramp_down; }
+
+double PumpRamp_volume(const PumpRampPlan* plan, double speed)
+{
+    return ML_PER_MS(speed) * plan->peak * (plan->hold + (plan->ramp_up + plan->ramp_down) / 2.0);
+}
+
+/**
+ * 实际运行时间比按设定速度运行同样投放量多出来的时间，单位微秒
+ */
+uint32_t PumpRamp_deficit_us(const PumpRampPlan* plan)
+{
+    double effective_ms = plan->peak * (plan->hold + (plan->ramp_up + plan->ramp_down) / 2.0);
+    double deficit_ms = PumpRamp_total_ms(plan) - effective_ms;
+    return deficit_ms > 0 ? (uint32_t)lround(deficit_ms * 1000.0) : 0;
+}
@@ -4,9 +4,13 @@
 #include <string.h>
 
 #include <driver/gpio.h>
+#include <driver/ledc.h>
 #include <driver/periph_ctrl.h>
+#include <driver/timer.h>
 #include <esp32/clk.h>
 #include <esp32/rom/ets_sys.h>
+#include <esp_attr.h>
+#include <esp_intr_alloc.h>
 #include <esp_log.h>
 #include <esp_system.h>
 #include <esp_timer.h>
@@ -17,31 +21,134 @@
 #include <freertos/task.h>
 #include <nvs.h>
 #include <nvs_flash.h>
+#include <soc/gpio_reg.h>
+#include <soc/ledc_struct.h>
+#include <soc/soc.h>
 
 #include "borneo/common.h"
+#include "borneo-doser/devices/flow-control.h"
 #include "borneo-doser/devices/pump.h"
 
 #define PUMP_TIMER_GROUP TIMER_GROUP_1
-#define PUMP_TIMER_INDEX 0
+#define PUMP_TIMER_INDEX TIMER_0
+#define PUMP_TIMER_DIVIDER 80 // APB 时钟 80MHz 分频后计数器每微秒加一
+
+#define PUMP_PWM_SPEED_MODE LEDC_HIGH_SPEED_MODE
+#define PUMP_PWM_TIMER LEDC_TIMER_0
+#define PUMP_PWM_RESOLUTION LEDC_TIMER_10_BIT
+#define PUMP_PWM_MAX_DUTY ((1UL << 10) - 1)
+#define PUMP_PWM_FREQ_HZ 20000 // 超出人耳能听到的范围，电机不会叫
+
+// 通知 pump_task 的位：低位是结束了投放的通道，这个偏移之后是该开始减速的通道
+#define PUMP_NOTIFY_RAMP_DOWN_SHIFT 16
+#define PUMP_NOTIFY_CONTROL (1UL << 31) // 闭环控制的周期到了，或者有闭环的通道开始运行
+
+// 一次投放，group 非 0 的投放不能和同一组的其他投放同时运行
+typedef struct {
+    int duration; // 总时间，包括加减速，单位毫秒
+    uint8_t group;
+    uint16_t ramp_up; // 单位毫秒，GPIO 模式下都是 0
+    uint16_t ramp_down;
+    uint32_t peak_duty; // LEDC 占空比
+    uint32_t ramp_deficit; // 加减速比全速少转的等效时间，单位微秒
+    float volume; // 请求的投放量，按时间运行的是 0，单位 mL
+    uint8_t job; // 计划任务的序号，PUMP_JOB_NONE 表示不是计划任务
+} PumpDose;
+
+// 中断里结束的投放，pump_task 发事件时带上。排队的投放可能在 pump_task 处理之前接连结束，所以每个通道要能存下一整个队列
+#define PUMP_MAX_FINISHED_DOSES (PUMP_MAX_QUEUED_DOSES + 1)
+
+typedef struct {
+    PumpDose dose;
+    uint32_t duration; // 实际运行的时间，单位毫秒
+    uint32_t completed_count; // 这次投放结束以后的完成次数
+} PumpFinishedDose;
 
 typedef struct {
     volatile PumpState state; // 状态
-    volatile int duration; // 任务持续时间，单位毫秒
-    esp_timer_handle_t timer; // 任务定时器
-    esp_timer_create_args_t timer_args; // 任务定时器参数
+    PumpDose dose; // 当前或者下一个要运行的投放
+    PumpDose queue[PUMP_MAX_QUEUED_DOSES]; // 排队中的投放
+    volatile uint8_t queue_head;
+    volatile uint8_t queue_count;
+    volatile uint32_t completed_count; // 完成的次数，只在定时器中断里增加
+    // 下面的时间都是硬件定时器的计数，单位微秒
+    volatile uint64_t deadline; // 本次投放应该结束的时间
+    volatile uint64_t ramp_down_time; // 开始减速的时间，没有减速的话等于 deadline
+    volatile bool is_ramping_down;
+    volatile uint64_t last_on_time; // 最近一次投放实际开始的时间
+    volatile uint64_t last_off_time; // 最近一次投放实际结束的时间
+    PumpFinishedDose finished[PUMP_MAX_FINISHED_DOSES]; // 结束了还没发事件的投放，先进先出
+    volatile uint8_t finished_head;
+    volatile uint8_t finished_count;
+    volatile uint32_t finished_dropped; // pump_task 来不及处理、丢掉的记录数
+    volatile uint64_t pending_run_time; // 中断里累计、还没折算成投放量的运行时间
+    volatile double dispensed_volume; // 累计投放量，单位 mL
+    volatile uint32_t toggle_count; // GPIO 电平变化的次数
+    // 实际结束时间减去应该结束的时间，就是中断延迟带来的误差，单位微秒
+    volatile int32_t last_timing_error;
+    volatile int32_t max_timing_error; // 绝对值
+    volatile uint64_t timing_error_sum; // 绝对值之和，用来算平均
+    volatile uint32_t timing_error_count;
+    volatile bool is_on; // 当前输出的电平
+    uint32_t calibration_duration; // 引导校准时最近一次运行的时间，还没记录实测投放量，单位毫秒
+    uint32_t control_duty; // 闭环调节后的占空比，0 表示这次投放还没进入闭环
+    uint8_t io_pin; // PUMP_PORT_TABLE 在 Flash 里，中断里用这个
 } PumpChannel;
 
 typedef struct {
     PumpChannel channels[PUMP_MAX_CHANNELS];
     PumpDeviceConfig config;
+    PumpCurve curves[PUMP_MAX_CHANNELS]; // 由 config.calibrations 预先算好
+    PumpDriveConfig drive;
+    bool is_fade_installed;
+    uint8_t max_running; // 最多同时运行的电机个数
+    uint8_t last_group; // 最近分配的互斥组
+    int64_t last_start_time; // 最近一次冷启动电机的时间，单位微秒
+    esp_timer_handle_t dispatch_timer; // 错开启动时延迟调度用的定时器
+    esp_timer_handle_t control_timer; // 闭环控制的周期定时器，只在有闭环的通道运行时启动
+    bool is_control_running;
+    // 正在运行的通道，按下一个事件（开始减速或者结束）的时间从早到晚排列，定时器的闹钟总是设在第一个上
+    uint8_t deadlines[PUMP_MAX_CHANNELS];
+    uint8_t deadlines_count;
+    TaskHandle_t task; // 中断之后的收尾工作交给这个任务
 } PumpStatus;
 
-static int start_timer();
-static int prepare_for_duration(int ch, int duration);
-static int prepare_for_volume(int ch, double vol);
-static void timer_callback(void* params);
+// 版本 1 的配置没有版本号，只有各通道的速度
+typedef struct {
+    double speeds[PUMP_MAX_CHANNELS];
+} PumpDeviceConfigV1;
+
+static void init_timer();
+static void apply_drive();
+static void dispatch();
+static void start_dose(int ch);
+static void start_drive(int ch);
+static void start_ramp_down(int ch);
+static void push_deadline(int ch);
+static uint64_t next_event_time(const PumpChannel* pc);
+static void finish_dose(int ch, uint64_t now);
+static void set_pump_level(int ch, bool level);
+static int prepare_for_duration(int ch, int duration, uint8_t group);
+static int prepare_for_volume(int ch, double vol, uint8_t group, uint8_t job);
+static int prepare_dose(int ch, const PumpRampPlan* plan, uint8_t group, double volume, uint8_t job);
+static const PumpRampProfile* current_ramp();
+static double effective_speed(int ch);
+static bool is_group_running(uint8_t group, int except_ch);
+static void timer_isr(void* params);
+static void pump_task(void* params);
+static void dispatch_timer_callback(void* params);
+static void control_timer_callback(void* params);
+static void control_step();
+static void update_control_timer();
+static void set_pwm_duty(int ch, uint32_t duty);
+static bool uses_curve(int ch);
+static int load_max_running();
+static int load_drive();
+static int save_drive(const PumpDriveConfig* drive);
 static int save_config();
 static int load_config();
+static void build_curves();
+static void post_event(int32_t event_id, int ch, const PumpFinishedDose* finished);
 
 const PumpPort PUMP_PORT_TABLE[] = {
     { .name = "P1", .io_pin = 32 },
@@ -52,97 +159,140 @@ const PumpPort PUMP_PORT_TABLE[] = {
 
 static PumpStatus s_pump_status;
 
+// 保护通道状态和队列，定时器回调和调用者不在同一个任务里
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+ESP_EVENT_DEFINE_BASE(BORNEO_PUMP_EVENTS);
+
 static const char* TAG = "PUMP";
 
 static const char* NVS_NAMESPACE = "pump";
 static const char* NVS_PUMP_CONFIG_KEY = "config";
+static const char* NVS_PUMP_MAX_RUNNING_KEY = "max_running";
+static const char* NVS_PUMP_DRIVE_KEY = "drive";
 
-static const PumpDeviceConfig PUMP_DEFAULT_CONFIG = { .speeds = { 12.0, 12.0, 12.0, 12.0 } };
+static const PumpDeviceConfig PUMP_DEFAULT_CONFIG = {
+    .version = PUMP_CONFIG_VERSION,
+    .speeds = { 12.0, 12.0, 12.0, 12.0 },
+};
+
+static const PumpDriveConfig PUMP_DEFAULT_DRIVE = {
+    .mode = PUMP_DRIVE_GPIO,
+    .ramp = { .ramp_up = 0, .ramp_down = 0 },
+    .duties = { 100, 100, 100, 100 },
+};
 
 int Pump_init()
 {
     memset(&s_pump_status, 0, sizeof(s_pump_status));
 
-    uint64_t pins_mask = 0;
     for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
-        pins_mask |= (1ULL << PUMP_PORT_TABLE[i].io_pin);
+        s_pump_status.channels[i].io_pin = PUMP_PORT_TABLE[i].io_pin;
     }
 
-    gpio_config_t io_conf;
-    io_conf.intr_type = GPIO_PIN_INTR_DISABLE; // 禁止中断
-    io_conf.mode = GPIO_MODE_OUTPUT; // 输出模式
-    io_conf.pin_bit_mask = pins_mask; // 选定端口
-    io_conf.pull_down_en = 1; // 打开下拉
-    io_conf.pull_up_en = 0; // 禁止上拉
-    gpio_config(&io_conf);
-
-    // 确保全部都是关闭的
-    for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
-        Pump_off(i);
+    if (load_drive() != ESP_OK) {
+        memcpy(&s_pump_status.drive, &PUMP_DEFAULT_DRIVE, sizeof(s_pump_status.drive));
+    }
+    apply_drive();
 
-        // 初始化定时器
+    xTaskCreate(&pump_task, "pump_task", 1024 * 3, NULL, tskIDLE_PRIORITY + 5, &s_pump_status.task);
+    init_timer();
 
-        // 设置参数
-        PumpChannel* pc = &s_pump_status.channels[i];
-        pc->timer_args.callback = &timer_callback;
-        pc->timer_args.arg = (void*)i;
-        pc->timer_args.name = PUMP_PORT_TABLE[i].name;
+    esp_timer_create_args_t dispatch_timer_args = {
+        .callback = &dispatch_timer_callback,
+        .name = "pump_dispatch",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&dispatch_timer_args, &s_pump_status.dispatch_timer));
 
-        ESP_ERROR_CHECK(esp_timer_create(&pc->timer_args, &pc->timer));
-    }
+    esp_timer_create_args_t control_timer_args = {
+        .callback = &control_timer_callback,
+        .name = "pump_control",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&control_timer_args, &s_pump_status.control_timer));
 
     // 加载
-    if (load_config() == ESP_ERR_NVS_NOT_FOUND) {
+    int err = load_config();
+    if (err != ESP_OK) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "Invalid config (err=%d), falling back to defaults", err);
+        }
         ESP_LOGI(TAG, "Saving default config...");
         memcpy(&s_pump_status.config, &PUMP_DEFAULT_CONFIG, sizeof(s_pump_status.config));
         save_config();
     }
+    build_curves();
+
+    if (load_max_running() != ESP_OK) {
+        s_pump_status.max_running = PUMP_DEFAULT_MAX_RUNNING;
+    }
 
     return 0;
 }
 
 int Pump_start(int ch, double vol)
 {
-    int error = prepare_for_volume(ch, vol);
+    int error = prepare_for_volume(ch, vol, 0, PUMP_JOB_NONE);
     if (error != 0) {
         return error;
     }
-    return start_timer();
+    dispatch();
+    return 0;
 }
 
 int Pump_start_until(int ch, int ms)
 {
-    int error = prepare_for_duration(ch, ms);
+    int error = prepare_for_duration(ch, ms, 0);
     if (error != 0) {
         return error;
     }
-    return start_timer();
+    dispatch();
+    return 0;
 }
 
-int Pump_start_all(const double* vols)
+int Pump_start_all(const double* vols) { return Pump_start_job(PUMP_JOB_NONE, vols, true); }
+
+/**
+ * 不能并行的任务，各个通道分到同一个互斥组里一个接一个地运行
+ * job 是计划任务的序号，投放结束的事件里会带上，用来记录投放历史
+ */
+int Pump_start_job(int job, const double* vols, bool can_parallel)
 {
+    uint8_t group = 0;
+    if (!can_parallel) {
+        portENTER_CRITICAL(&s_lock);
+        s_pump_status.last_group = s_pump_status.last_group == UINT8_MAX ? 1 : s_pump_status.last_group + 1;
+        group = s_pump_status.last_group;
+        portEXIT_CRITICAL(&s_lock);
+    }
+
     int error = 0;
     for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
         if (isnormal(vols[i])) {
-            error = prepare_for_volume(i, vols[i]);
+            error = prepare_for_volume(i, vols[i], group, (uint8_t)job);
             if (error != 0) {
-                return error;
+                break;
             }
         }
     }
 
-    return start_timer();
+    // 出错之前已经准备好的通道照样执行
+    dispatch();
+    return error;
 }
 
 int Pump_on(int ch)
 {
-    gpio_set_level(PUMP_PORT_TABLE[ch].io_pin, 1);
+    if (s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        ledc_set_duty(PUMP_PWM_SPEED_MODE, ch, s_pump_status.drive.duties[ch] * PUMP_PWM_MAX_DUTY / 100);
+        ledc_update_duty(PUMP_PWM_SPEED_MODE, ch);
+    }
+    set_pump_level(ch, true);
     return 0;
 }
 
 int Pump_off(int ch)
 {
-    gpio_set_level(PUMP_PORT_TABLE[ch].io_pin, 0);
+    set_pump_level(ch, false);
     return 0;
 }
 
@@ -152,6 +302,127 @@ int Pump_update_speed(int ch, double speed)
     return save_config();
 }
 
+int Pump_update_max_running(int max_running)
+{
+    if (max_running < 1 || max_running > PUMP_MAX_CHANNELS) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_u8(nvs_handle, NVS_PUMP_MAX_RUNNING_KEY, (uint8_t)max_running);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    s_pump_status.max_running = (uint8_t)max_running;
+    // 调大了的话排队的可以马上启动
+    dispatch();
+    return 0;
+}
+
+int Pump_get_max_running() { return s_pump_status.max_running; }
+
+/**
+ * 切换驱动方式要重新配置引脚，所以只能在全部通道空闲的时候修改
+ */
+int Pump_update_drive(const PumpDriveConfig* drive)
+{
+    if (drive->mode != PUMP_DRIVE_GPIO && drive->mode != PUMP_DRIVE_PWM) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+    if (drive->ramp.ramp_up > PUMP_RAMP_MAX_MS || drive->ramp.ramp_down > PUMP_RAMP_MAX_MS) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        if (drive->duties[i] < 1 || drive->duties[i] > 100) {
+            return PUMP_ERROR_INVALID_ARG;
+        }
+    }
+    if (Pump_is_any_busy()) {
+        return PUMP_ERROR_BUSY;
+    }
+
+    int error = save_drive(drive);
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    bool is_mode_changed = drive->mode != s_pump_status.drive.mode;
+    memcpy(&s_pump_status.drive, drive, sizeof(s_pump_status.drive));
+    if (is_mode_changed) {
+        apply_drive();
+    }
+    return 0;
+}
+
+const PumpDriveConfig* Pump_get_drive() { return &s_pump_status.drive; }
+
+/**
+ * 引导校准的第一步：空闲的通道按时间运行一次，用户量出实际的投放量以后用 Pump_calibration_add() 记下来
+ */
+int Pump_calibration_run(int ch, int ms)
+{
+    if (s_pump_status.channels[ch].state != PUMP_STATE_IDLE) {
+        return PUMP_ERROR_BUSY;
+    }
+
+    int error = prepare_for_duration(ch, ms, 0);
+    if (error != 0) {
+        return error;
+    }
+    s_pump_status.channels[ch].calibration_duration = (uint32_t)ms;
+    dispatch();
+    return 0;
+}
+
+int Pump_calibration_add(int ch, double volume)
+{
+    PumpChannel* pc = &s_pump_status.channels[ch];
+    if (pc->calibration_duration == 0) {
+        return PUMP_ERROR_INVALID_ARG;
+    }
+    if (pc->state != PUMP_STATE_IDLE) {
+        return PUMP_ERROR_BUSY;
+    }
+
+    PumpCalibration cal = s_pump_status.config.calibrations[ch];
+    if (PumpCalibration_add_point(&cal, pc->calibration_duration, (float)volume) != PUMP_CALIBRATION_OK) {
+        return PUMP_ERROR_CALIBRATION;
+    }
+
+    s_pump_status.config.calibrations[ch] = cal;
+    int error = save_config();
+    if (error != ESP_OK) {
+        return error;
+    }
+    PumpCurve_build(&cal, &s_pump_status.curves[ch]);
+    pc->calibration_duration = 0;
+    return 0;
+}
+
+int Pump_calibration_clear(int ch)
+{
+    s_pump_status.config.calibrations[ch].points_count = 0;
+    s_pump_status.channels[ch].calibration_duration = 0;
+    int error = save_config();
+    if (error != ESP_OK) {
+        return error;
+    }
+    PumpCurve_build(&s_pump_status.config.calibrations[ch], &s_pump_status.curves[ch]);
+    return 0;
+}
+
+const PumpCalibration* Pump_get_calibration(int ch) { return &s_pump_status.config.calibrations[ch]; }
+
 double Pump_get_speed(int ch)
 {
     assert(ch > 0 && ch < PUMP_MAX_CHANNELS);
@@ -174,60 +445,688 @@ PumpChannelInfo Pump_get_channel_info(int ch)
         .name = PUMP_PORT_TABLE[ch].name,
         .state = s_pump_status.channels[ch].state,
         .speed = s_pump_status.config.speeds[ch],
+        .effective_speed = effective_speed(ch),
+        .is_calibrated = PumpCurve_is_calibrated(&s_pump_status.curves[ch]),
+        .completed_count = s_pump_status.channels[ch].completed_count,
+        .queue_depth = s_pump_status.channels[ch].queue_count,
+        .dispensed_volume = s_pump_status.channels[ch].dispensed_volume,
+        .toggle_count = s_pump_status.channels[ch].toggle_count,
+        .last_timing_error = s_pump_status.channels[ch].last_timing_error,
+        .max_timing_error = s_pump_status.channels[ch].max_timing_error,
+        .mean_timing_error = s_pump_status.channels[ch].timing_error_count == 0
+            ? 0
+            : (int32_t)(s_pump_status.channels[ch].timing_error_sum / s_pump_status.channels[ch].timing_error_count),
+        .last_on_time = s_pump_status.channels[ch].last_on_time,
+        .last_off_time = s_pump_status.channels[ch].last_off_time,
     };
     return info;
 }
 
-static int prepare_for_volume(int ch, double vol)
+/**
+ * 计算需要执行的时间：有校准曲线就查曲线，否则按速度计算，有加减速的话按加减速过程中的平均速度积分
+ */
+static int prepare_for_volume(int ch, double vol, uint8_t group, uint8_t job)
 {
-    // 计算需要执行的时间
-    double speed = s_pump_status.config.speeds[ch]; // 假如是 12mL/min
-    int duration = (int)round((vol / speed) * (60.0 * 1000.0));
-    return prepare_for_duration(ch, duration);
+    if (!(vol > 0.0)) {
+        ESP_LOGE(TAG, "Invalid volume %f for channel %d", vol, ch);
+        return PUMP_ERROR_INVALID_VOLUME;
+    }
+
+    // 闭环的通道流量保持在设定速度上，不用校准曲线
+    const PumpCurve* curve = &s_pump_status.curves[ch];
+    if (uses_curve(ch)) {
+        double duration = round(PumpCurve_duration_for(curve, vol));
+        if (!(duration >= 1.0 && duration <= INT32_MAX)) {
+            ESP_LOGE(TAG, "Invalid volume %f for channel %d", vol, ch);
+            return PUMP_ERROR_INVALID_VOLUME;
+        }
+        PumpRampPlan plan;
+        PumpRamp_plan_for_duration(current_ramp(), (uint32_t)duration, &plan);
+        return prepare_dose(ch, &plan, group, vol, job);
+    }
+
+    double speed = effective_speed(ch); // 假如是 12mL/min
+    if (!(speed > 0.0)) {
+        ESP_LOGE(TAG, "Channel %d is not calibrated", ch);
+        return PUMP_ERROR_UNCALIBRATED;
+    }
+    PumpRampPlan plan;
+    PumpRamp_plan_for_volume(current_ramp(), speed, vol, &plan);
+    return prepare_dose(ch, &plan, group, vol, job);
 }
 
-static int prepare_for_duration(int ch, int duration)
+static int prepare_for_duration(int ch, int duration, uint8_t group)
 {
     if (duration <= 0) {
         ESP_LOGE(TAG, "Invalid duration %d for channel %d", duration, ch);
         return PUMP_ERROR_INVALID_VOLUME;
     }
+    PumpRampPlan plan;
+    PumpRamp_plan_for_duration(current_ramp(), (uint32_t)duration, &plan);
+    return prepare_dose(ch, &plan, group, 0.0, PUMP_JOB_NONE);
+}
+
+static int prepare_dose(int ch, const PumpRampPlan* plan, uint8_t group, double volume, uint8_t job)
+{
+    uint32_t duration = PumpRamp_total_ms(plan);
+    if (duration == 0 || duration > INT32_MAX) {
+        ESP_LOGE(TAG, "Invalid duration %u for channel %d", duration, ch);
+        return PUMP_ERROR_INVALID_VOLUME;
+    }
+
+    PumpDose new_dose = {
+        .duration = (int)duration,
+        .group = group,
+        .ramp_up = (uint16_t)plan->ramp_up,
+        .ramp_down = (uint16_t)plan->ramp_down,
+        .peak_duty = (uint32_t)lround(plan->peak * s_pump_status.drive.duties[ch] * PUMP_PWM_MAX_DUTY / 100.0),
+        // 有校准曲线的通道统计时直接用实际运行时间查曲线
+        .ramp_deficit = uses_curve(ch) ? 0 : PumpRamp_deficit_us(plan),
+        .volume = (float)volume,
+        .job = job,
+    };
+
+    PumpChannel* pc = &s_pump_status.channels[ch];
+    int error = 0;
+    portENTER_CRITICAL(&s_lock);
+    if (pc->state == PUMP_STATE_IDLE) {
+        pc->dose = new_dose;
+        pc->state = PUMP_STATE_WAIT;
+    } else if (pc->queue_count < PUMP_MAX_QUEUED_DOSES) {
+        // 通道忙就排队，当前的投放结束后接着执行
+        pc->queue[(pc->queue_head + pc->queue_count) % PUMP_MAX_QUEUED_DOSES] = new_dose;
+        pc->queue_count++;
+    } else {
+        error = PUMP_ERROR_BUSY;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (error != 0) {
+        ESP_LOGE(TAG, "Pump channel %d is busy and its queue is full!", ch);
+    }
+    return error;
+}
 
+static const PumpRampProfile* current_ramp()
+{
+    static const PumpRampProfile NO_RAMP = { .ramp_up = 0, .ramp_down = 0 };
+    return s_pump_status.drive.mode == PUMP_DRIVE_PWM ? &s_pump_status.drive.ramp : &NO_RAMP;
+}
+
+static bool uses_curve(int ch)
+{
+    return PumpCurve_is_calibrated(&s_pump_status.curves[ch]) && !FlowControl_is_enabled(ch);
+}
+
+static double effective_speed(int ch)
+{
+    double speed = s_pump_status.config.speeds[ch];
+    if (s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        speed = speed * s_pump_status.drive.duties[ch] / 100.0;
+    }
+    return speed;
+}
+
+static void init_timer()
+{
+    timer_config_t config = {
+        .divider = PUMP_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_DIS,
+        .auto_reload = TIMER_AUTORELOAD_DIS,
+        .intr_type = TIMER_INTR_LEVEL,
+    };
+    ESP_ERROR_CHECK(timer_init(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, &config));
+    ESP_ERROR_CHECK(timer_set_counter_value(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, 0));
+    ESP_ERROR_CHECK(timer_enable_intr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX));
+    ESP_ERROR_CHECK(
+        timer_isr_register(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, &timer_isr, NULL, ESP_INTR_FLAG_IRAM, NULL));
+    ESP_ERROR_CHECK(timer_start(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX));
+}
+
+/**
+ * 按驱动方式配置引脚，配置完全部通道都是关闭的
+ */
+static void apply_drive()
+{
+    uint64_t pins_mask = 0;
     for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
-        PumpChannel* pc = &s_pump_status.channels[ch];
-        if (pc->state != PUMP_STATE_IDLE) {
-            ESP_LOGE(TAG, "Pump channel %d is busy!", ch);
-            return PUMP_ERROR_BUSY;
+        pins_mask |= (1ULL << PUMP_PORT_TABLE[i].io_pin);
+    }
+
+    gpio_config_t io_conf;
+    io_conf.intr_type = GPIO_PIN_INTR_DISABLE; // 禁止中断
+    io_conf.mode = GPIO_MODE_OUTPUT; // 输出模式
+    io_conf.pin_bit_mask = pins_mask; // 选定端口
+    io_conf.pull_down_en = 1; // 打开下拉
+    io_conf.pull_up_en = 0; // 禁止上拉
+    gpio_config(&io_conf);
+
+    if (s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        ledc_timer_config_t timer_conf = {
+            .speed_mode = PUMP_PWM_SPEED_MODE,
+            .duty_resolution = PUMP_PWM_RESOLUTION,
+            .timer_num = PUMP_PWM_TIMER,
+            .freq_hz = PUMP_PWM_FREQ_HZ,
+        };
+        ESP_ERROR_CHECK(ledc_timer_config(&timer_conf));
+
+        // gpio_config() 把引脚交还给了 GPIO，这里再交给 LEDC
+        for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
+            ledc_channel_config_t channel_conf = {
+                .gpio_num = PUMP_PORT_TABLE[i].io_pin,
+                .speed_mode = PUMP_PWM_SPEED_MODE,
+                .channel = (ledc_channel_t)i,
+                .intr_type = LEDC_INTR_DISABLE,
+                .timer_sel = PUMP_PWM_TIMER,
+                .duty = 0,
+                .hpoint = 0,
+            };
+            ESP_ERROR_CHECK(ledc_channel_config(&channel_conf));
+        }
+        if (!s_pump_status.is_fade_installed) {
+            ESP_ERROR_CHECK(ledc_fade_func_install(0));
+            s_pump_status.is_fade_installed = true;
+        }
+    }
+
+    // 确保全部都是关闭的
+    for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
+        Pump_off(i);
+    }
+}
+
+/**
+ * 把等待中的通道在电机个数限制内启动起来：
+ *  - 按最长的先启动，这样整批投放的总时间最短
+ *  - 每次最多冷启动一个电机，和上一次冷启动至少间隔 PUMP_START_INTERVAL_MS，没到时间就用定时器稍后再来
+ *  - 同一互斥组里同时只能有一个通道在运行
+ * 排队的下一个投放能不能接着运行由定时器中断直接决定，不经过这里
+ */
+static void dispatch()
+{
+    int starting_channels[PUMP_MAX_CHANNELS];
+    size_t starting_count = 0;
+    int64_t retry_delay = 0;
+    bool is_control_needed = false;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lock);
+    size_t running_count = 0;
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        if (s_pump_status.channels[i].state == PUMP_STATE_BUSY) {
+            running_count++;
+        }
+    }
+
+    while (running_count < s_pump_status.max_running) {
+        int next = -1;
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            PumpChannel* pc = &s_pump_status.channels[i];
+            if (pc->state != PUMP_STATE_WAIT || (pc->dose.group != 0 && is_group_running(pc->dose.group, -1))) {
+                continue;
+            }
+            if (next < 0 || pc->dose.duration > s_pump_status.channels[next].dose.duration) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+
+        int64_t since_last_start = now - s_pump_status.last_start_time;
+        if (since_last_start < PUMP_START_INTERVAL_MS * 1000LL) {
+            retry_delay = PUMP_START_INTERVAL_MS * 1000LL - since_last_start;
+            break;
         }
+        s_pump_status.last_start_time = now;
+        start_dose(next);
+        is_control_needed = is_control_needed || FlowControl_is_enabled(next);
+        starting_channels[starting_count++] = next;
+        running_count++;
     }
+    portEXIT_CRITICAL(&s_lock);
+
+    for (size_t i = 0; i < starting_count; i++) {
+        start_drive(starting_channels[i]);
+        post_event(BORNEO_EVENT_PUMP_STARTED, starting_channels[i], NULL);
+    }
+
+    if (is_control_needed && s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        // 控制定时器只由 pump_task 启停
+        xTaskNotify(s_pump_status.task, PUMP_NOTIFY_CONTROL, eSetBits);
+    }
+
+    if (retry_delay > 0) {
+        // 定时器已经在等了的话，它到时候会再调度一次
+        esp_timer_start_once(s_pump_status.dispatch_timer, (uint64_t)retry_delay);
+    }
+}
+
+/**
+ * 要在锁里调用，开泵的时间直接读硬件定时器，结束时间由定时器中断负责
+ * PWM 模式下 LEDC 的 API 不能在锁里调用，真正的输出由 start_drive() 在锁外面开始
+ */
+static void start_dose(int ch)
+{
     PumpChannel* pc = &s_pump_status.channels[ch];
-    pc->duration = duration;
-    pc->state = PUMP_STATE_WAIT;
-    return 0;
+    uint64_t now = 0;
+    timer_get_counter_value(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, &now);
+    set_pump_level(ch, true);
+    pc->state = PUMP_STATE_BUSY;
+    pc->last_on_time = now;
+    pc->deadline = now + (uint64_t)pc->dose.duration * 1000ULL;
+    pc->ramp_down_time = pc->deadline - (uint64_t)pc->dose.ramp_down * 1000ULL;
+    pc->is_ramping_down = false;
+    pc->control_duty = 0;
+    push_deadline(ch);
+
+    // 新的截止时间是最早的就要把闹钟提前
+    if (s_pump_status.deadlines[0] == ch) {
+        timer_set_alarm_value(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, next_event_time(pc));
+        timer_set_alarm(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, TIMER_ALARM_EN);
+    }
 }
 
-static int start_timer()
+/**
+ * PWM 模式下开始加速，LEDC 的渐变由硬件完成
+ */
+static void start_drive(int ch)
 {
-    // 设置任务状态
-    for (size_t i = 0; i < sizeof(PUMP_PORT_TABLE) / sizeof(PumpPort); i++) {
+    if (s_pump_status.drive.mode != PUMP_DRIVE_PWM) {
+        return;
+    }
+    const PumpDose* dose = &s_pump_status.channels[ch].dose;
+    if (dose->ramp_up > 0) {
+        ledc_set_duty(PUMP_PWM_SPEED_MODE, ch, 0);
+        ledc_update_duty(PUMP_PWM_SPEED_MODE, ch);
+        ledc_set_fade_with_time(PUMP_PWM_SPEED_MODE, ch, dose->peak_duty, dose->ramp_up);
+        ledc_fade_start(PUMP_PWM_SPEED_MODE, ch, LEDC_FADE_NO_WAIT);
+    } else {
+        ledc_set_duty(PUMP_PWM_SPEED_MODE, ch, dose->peak_duty);
+        ledc_update_duty(PUMP_PWM_SPEED_MODE, ch);
+    }
+}
+
+/**
+ * 从现在开始减速，到 deadline 正好停下来。加速还没结束的话 LEDC 会等加速完成再开始
+ */
+static void start_ramp_down(int ch)
+{
+    PumpChannel* pc = &s_pump_status.channels[ch];
+    uint64_t now = 0;
+    timer_get_counter_value(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, &now);
+    portENTER_CRITICAL(&s_lock);
+    bool is_ramping_down = pc->state == PUMP_STATE_BUSY && pc->is_ramping_down;
+    uint64_t deadline = pc->deadline;
+    portEXIT_CRITICAL(&s_lock);
+    if (!is_ramping_down || deadline <= now + 1000ULL) {
+        // 来不及减速了，定时器中断到时候会直接关掉
+        return;
+    }
+
+    ledc_set_fade_with_time(PUMP_PWM_SPEED_MODE, ch, 0, (int)((deadline - now) / 1000ULL));
+    ledc_fade_start(PUMP_PWM_SPEED_MODE, ch, LEDC_FADE_NO_WAIT);
+}
+
+/**
+ * 通道的下一个事件：有减速而且还没开始减速就是开始减速的时间，否则是结束的时间
+ */
+static uint64_t IRAM_ATTR next_event_time(const PumpChannel* pc)
+{
+    return (!pc->is_ramping_down && pc->ramp_down_time < pc->deadline) ? pc->ramp_down_time : pc->deadline;
+}
+
+static void IRAM_ATTR push_deadline(int ch)
+{
+    uint64_t deadline = next_event_time(&s_pump_status.channels[ch]);
+    size_t i = s_pump_status.deadlines_count++;
+    while (i > 0 && next_event_time(&s_pump_status.channels[s_pump_status.deadlines[i - 1]]) > deadline) {
+        s_pump_status.deadlines[i] = s_pump_status.deadlines[i - 1];
+        i--;
+    }
+    s_pump_status.deadlines[i] = (uint8_t)ch;
+}
+
+static bool IRAM_ATTR is_group_running(uint8_t group, int except_ch)
+{
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        const PumpChannel* pc = &s_pump_status.channels[i];
+        if ((int)i != except_ch && pc->state == PUMP_STATE_BUSY && pc->dose.group == group) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 直接写寄存器，中断里也能用
+ * PWM 模式下关闭是让 LEDC 通道停止输出、保持低电平，打开由 start_drive() 更新占空比时完成
+ */
+static void IRAM_ATTR set_pump_level(int ch, bool level)
+{
+    PumpChannel* pc = &s_pump_status.channels[ch];
+    if (pc->is_on != level) {
+        pc->toggle_count++;
+    }
+    pc->is_on = level;
+
+    if (s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        if (!level) {
+            LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf0.idle_lv = 0;
+            LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf0.sig_out_en = 0;
+        }
+        return;
+    }
+
+    uint8_t pin = pc->io_pin;
+    if (pin < 32) {
+        REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, 1UL << pin);
+    } else {
+        REG_WRITE(level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, 1UL << (pin - 32));
+    }
+}
+
+/**
+ * 一个闹钟服务全部通道：关掉所有到期的通道，再把闹钟设到下一个截止时间
+ * 该开始减速的通道重新按结束时间排队，减速交给 pump_task
+ * 中断里不能用浮点，投放量的折算和事件都留给 pump_task
+ */
+static void IRAM_ATTR timer_isr(void* params)
+{
+    timer_group_clr_intr_status_in_isr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX);
+
+    uint32_t notify_bits = 0;
+    portENTER_CRITICAL_ISR(&s_lock);
+    for (;;) {
+        uint64_t now = timer_group_get_counter_value_in_isr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX);
+        while (s_pump_status.deadlines_count > 0
+            && next_event_time(&s_pump_status.channels[s_pump_status.deadlines[0]]) <= now) {
+            int ch = s_pump_status.deadlines[0];
+            PumpChannel* pc = &s_pump_status.channels[ch];
+            s_pump_status.deadlines_count--;
+            for (size_t i = 0; i < s_pump_status.deadlines_count; i++) {
+                s_pump_status.deadlines[i] = s_pump_status.deadlines[i + 1];
+            }
+            if (!pc->is_ramping_down && pc->ramp_down_time < pc->deadline) {
+                pc->is_ramping_down = true;
+                push_deadline(ch);
+                notify_bits |= 1UL << (ch + PUMP_NOTIFY_RAMP_DOWN_SHIFT);
+            } else {
+                finish_dose(ch, now);
+                notify_bits |= 1UL << ch;
+            }
+        }
+        if (s_pump_status.deadlines_count == 0) {
+            break;
+        }
+
+        uint64_t next_deadline = next_event_time(&s_pump_status.channels[s_pump_status.deadlines[0]]);
+        timer_group_set_alarm_value_in_isr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, next_deadline);
+        timer_group_enable_alarm_in_isr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX);
+        // 设置闹钟的时候下一个截止时间可能已经过了
+        if (timer_group_get_counter_value_in_isr(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX) < next_deadline) {
+            break;
+        }
+    }
+    portEXIT_CRITICAL_ISR(&s_lock);
+
+    if (notify_bits != 0) {
+        BaseType_t is_higher_priority_task_woken = pdFALSE;
+        xTaskNotifyFromISR(s_pump_status.task, notify_bits, eSetBits, &is_higher_priority_task_woken);
+        if (is_higher_priority_task_woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+/**
+ * 在中断里、锁里调用。排队的下一个投放能接着运行就不关泵，否则关泵之后交给 dispatch()
+ * PWM 模式下下一个投放要重新加速，只能交给 dispatch()
+ */
+static void IRAM_ATTR finish_dose(int ch, uint64_t now)
+{
+    PumpChannel* pc = &s_pump_status.channels[ch];
+
+    int32_t error = (int32_t)(now - pc->deadline);
+    pc->last_timing_error = error;
+    if (error > pc->max_timing_error) {
+        pc->max_timing_error = error;
+    }
+    pc->timing_error_sum += error;
+    pc->timing_error_count++;
+    // 按全速折算的运行时间，加减速少转的部分要扣掉
+    uint64_t run_time = now - pc->last_on_time;
+    pc->pending_run_time += run_time > pc->dose.ramp_deficit ? run_time - pc->dose.ramp_deficit : 0;
+    pc->last_off_time = now;
+    pc->completed_count++;
+    if (pc->finished_count >= PUMP_MAX_FINISHED_DOSES) {
+        // 正常不会发生，丢掉最早的一条，pump_task 会报告
+        pc->finished_head = (pc->finished_head + 1) % PUMP_MAX_FINISHED_DOSES;
+        pc->finished_count--;
+        pc->finished_dropped++;
+    }
+    PumpFinishedDose* finished = &pc->finished[(pc->finished_head + pc->finished_count) % PUMP_MAX_FINISHED_DOSES];
+    finished->dose = pc->dose;
+    finished->duration = (uint32_t)(run_time / 1000ULL);
+    finished->completed_count = pc->completed_count;
+    pc->finished_count++;
+
+    if (pc->queue_count > 0) {
+        pc->dose = pc->queue[pc->queue_head];
+        pc->queue_head = (pc->queue_head + 1) % PUMP_MAX_QUEUED_DOSES;
+        pc->queue_count--;
+        if (s_pump_status.drive.mode == PUMP_DRIVE_GPIO
+            && (pc->dose.group == 0 || !is_group_running(pc->dose.group, ch))) {
+            // 电机不停，新的投放从现在开始算
+            pc->last_on_time = now;
+            pc->deadline = now + (uint64_t)pc->dose.duration * 1000ULL;
+            pc->ramp_down_time = pc->deadline;
+            pc->is_ramping_down = false;
+            push_deadline(ch);
+            return;
+        }
+        pc->state = PUMP_STATE_WAIT;
+    } else {
+        pc->state = PUMP_STATE_IDLE;
+    }
+    set_pump_level(ch, false);
+}
+
+/**
+ * 开始减速，折算投放量、发事件，再调度等待中的通道
+ */
+static void pump_task(void* params)
+{
+    for (;;) {
+        uint32_t notify_bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &notify_bits, portMAX_DELAY);
+
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            if ((notify_bits & (1UL << (i + PUMP_NOTIFY_RAMP_DOWN_SHIFT))) != 0) {
+                start_ramp_down(i);
+            }
+        }
+
+        if ((notify_bits & PUMP_NOTIFY_CONTROL) != 0) {
+            control_step();
+        }
+
+        uint32_t finished_channels = notify_bits & ((1UL << PUMP_NOTIFY_RAMP_DOWN_SHIFT) - 1);
+        if (finished_channels == 0) {
+            update_control_timer();
+            continue;
+        }
+
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            if ((finished_channels & (1UL << i)) == 0) {
+                continue;
+            }
+            PumpChannel* pc = &s_pump_status.channels[i];
+            portENTER_CRITICAL(&s_lock);
+            uint64_t run_time = pc->pending_run_time;
+            pc->pending_run_time = 0;
+            bool is_busy = pc->state == PUMP_STATE_BUSY;
+            PumpFinishedDose finished[PUMP_MAX_FINISHED_DOSES];
+            size_t finished_count = pc->finished_count;
+            for (size_t j = 0; j < finished_count; j++) {
+                finished[j] = pc->finished[(pc->finished_head + j) % PUMP_MAX_FINISHED_DOSES];
+            }
+            pc->finished_head = (pc->finished_head + finished_count) % PUMP_MAX_FINISHED_DOSES;
+            pc->finished_count = 0;
+            uint32_t dropped = pc->finished_dropped;
+            pc->finished_dropped = 0;
+            portEXIT_CRITICAL(&s_lock);
+
+            if (uses_curve(i)) {
+                pc->dispensed_volume += PumpCurve_volume_for(&s_pump_status.curves[i], (double)run_time / 1000.0);
+            } else {
+                pc->dispensed_volume += effective_speed(i) * (double)run_time / (60.0 * 1000.0 * 1000.0);
+            }
+            if (dropped > 0) {
+                ESP_LOGW(TAG, "Channel %u: %u finished dose(s) dropped", (unsigned)i, (unsigned)dropped);
+            }
+            // 每次投放一个事件，历史记录不会漏
+            for (size_t j = 0; j < finished_count; j++) {
+                post_event(BORNEO_EVENT_PUMP_STOPPED, i, &finished[j]);
+            }
+            if (is_busy) {
+                post_event(BORNEO_EVENT_PUMP_STARTED, i, NULL);
+            }
+        }
+
+        dispatch();
+        update_control_timer();
+    }
+    vTaskDelete(NULL);
+}
+
+static void dispatch_timer_callback(void* params) { dispatch(); }
+
+static void control_timer_callback(void* params) { xTaskNotify(s_pump_status.task, PUMP_NOTIFY_CONTROL, eSetBits); }
+
+/**
+ * 在 pump_task 里每个控制周期调用一次，和减速在同一个任务里，不会和 LEDC 的渐变冲突
+ * 只在加速结束到开始减速之间调节占空比
+ */
+static void control_step()
+{
+    if (s_pump_status.drive.mode != PUMP_DRIVE_PWM) {
+        return;
+    }
+
+    // target_speeds 为 0 的通道这个周期不调节
+    double target_speeds[PUMP_MAX_CHANNELS] = { 0 };
+    uint32_t base_duties[PUMP_MAX_CHANNELS] = { 0 };
+    uint32_t duties[PUMP_MAX_CHANNELS];
+
+    uint64_t now = 0;
+    timer_get_counter_value(PUMP_TIMER_GROUP, PUMP_TIMER_INDEX, &now);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        if (!FlowControl_is_enabled(i)) {
+            continue;
+        }
+        FlowControl_sample(i);
+
         PumpChannel* pc = &s_pump_status.channels[i];
-        if (pc->state == PUMP_STATE_WAIT) {
-            pc->state = PUMP_STATE_BUSY;
-            Pump_on(i);
-            // 启动定时器
-            ESP_ERROR_CHECK(esp_timer_start_once(pc->timer, (uint64_t)pc->duration * 1000ULL));
+        portENTER_CRITICAL(&s_lock);
+        bool is_holding = pc->state == PUMP_STATE_BUSY && !pc->is_ramping_down
+            && now >= pc->last_on_time + (uint64_t)pc->dose.ramp_up * 1000ULL && now < pc->ramp_down_time;
+        uint32_t base_duty = pc->dose.peak_duty;
+        portEXIT_CRITICAL(&s_lock);
+        if (!is_holding) {
+            continue;
+        }
+
+        if (pc->control_duty == 0) {
+            FlowControl_begin(i);
+            pc->control_duty = base_duty;
+            continue;
         }
+
+        // 投放量太小、没加速到设定速度的，目标流量也按比例降低
+        uint32_t setpoint_duty = s_pump_status.drive.duties[i] * PUMP_PWM_MAX_DUTY / 100;
+        target_speeds[i] = effective_speed(i) * base_duty / setpoint_duty;
+        base_duties[i] = base_duty;
+    }
+
+    // 全部通道的 PID 一次算完
+    FlowControl_step(target_speeds, base_duties, PUMP_PWM_MAX_DUTY, duties);
+
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        PumpChannel* pc = &s_pump_status.channels[i];
+        if (target_speeds[i] == 0.0 || duties[i] == pc->control_duty) {
+            continue;
+        }
+
+        // 中断可能刚刚关掉了这个通道，要在锁里确认还在运行再改占空比
+        portENTER_CRITICAL(&s_lock);
+        if (pc->state == PUMP_STATE_BUSY && pc->is_on && !pc->is_ramping_down) {
+            set_pwm_duty(i, duties[i]);
+            pc->control_duty = duties[i];
+        }
+        portEXIT_CRITICAL(&s_lock);
     }
-    return 0;
 }
 
-static void timer_callback(void* params)
+/**
+ * 只在 pump_task 里调用
+ */
+static void update_control_timer()
 {
-    int channel_index = (int)params;
-    PumpChannel* pc = &s_pump_status.channels[channel_index];
-    assert(pc->state == PUMP_STATE_BUSY);
-    Pump_off(channel_index);
-    pc->state = PUMP_STATE_IDLE;
+    bool is_needed = false;
+    if (s_pump_status.drive.mode == PUMP_DRIVE_PWM) {
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            if (FlowControl_is_enabled(i) && s_pump_status.channels[i].state == PUMP_STATE_BUSY) {
+                is_needed = true;
+                break;
+            }
+        }
+    }
+
+    if (is_needed && !s_pump_status.is_control_running) {
+        ESP_ERROR_CHECK(esp_timer_start_periodic(s_pump_status.control_timer, FLOW_CONTROL_PERIOD_MS * 1000ULL));
+        s_pump_status.is_control_running = true;
+    } else if (!is_needed && s_pump_status.is_control_running) {
+        esp_timer_stop(s_pump_status.control_timer);
+        s_pump_status.is_control_running = false;
+    }
+}
+
+/**
+ * 直接写寄存器，可以在锁里调用。LEDC 的 API 会重新打开输出，通道已经被中断关掉的时候不能用
+ */
+static void set_pwm_duty(int ch, uint32_t duty)
+{
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].duty.duty = duty << 4; // 低 4 位是小数部分
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf1.duty_inc = 1;
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf1.duty_num = 1;
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf1.duty_cycle = 1;
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf1.duty_scale = 0;
+    LEDC.channel_group[PUMP_PWM_SPEED_MODE].channel[ch].conf1.duty_start = 1;
+}
+
+/**
+ * 不等待事件队列，队列满了就丢掉事件，不能因为事件处理慢而拖住定时器回调
+ * dose 是结束了的投放，只有停止事件才有
+ */
+/**
+ * finished 为 NULL 的是开始运行的事件，计数用通道当前的
+ */
+static void post_event(int32_t event_id, int ch, const PumpFinishedDose* finished)
+{
+    PumpEventData data = {
+        .channel = ch,
+        .completed_count
+        = finished != NULL ? finished->completed_count : s_pump_status.channels[ch].completed_count,
+        .job = finished != NULL ? finished->dose.job : PUMP_JOB_NONE,
+        .volume = finished != NULL ? finished->dose.volume : 0.0f,
+        .duration = finished != NULL ? finished->duration : 0,
+    };
+    if (esp_event_post(BORNEO_PUMP_EVENTS, event_id, &data, sizeof(data), 0) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to post pump event %d for channel %d", event_id, ch);
+    }
 }
 
 static int save_config()
@@ -241,19 +1140,77 @@ static int save_config()
     }
 
     err = nvs_set_blob(nvs_handle, NVS_PUMP_CONFIG_KEY, &s_pump_status.config, sizeof(s_pump_status.config));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+static int load_max_running()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (err != ESP_OK) {
         return err;
     }
 
-    err = nvs_commit(nvs_handle);
+    uint8_t max_running = 0;
+    err = nvs_get_u8(nvs_handle, NVS_PUMP_MAX_RUNNING_KEY, &max_running);
+    nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (max_running < 1 || max_running > PUMP_MAX_CHANNELS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_pump_status.max_running = max_running;
+    return ESP_OK;
+}
+
+static int load_drive()
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle);
     if (err != ESP_OK) {
         return err;
     }
 
+    PumpDriveConfig drive;
+    size_t size = sizeof(drive);
+    err = nvs_get_blob(nvs_handle, NVS_PUMP_DRIVE_KEY, &drive, &size);
     nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (size != sizeof(drive)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(&s_pump_status.drive, &drive, sizeof(s_pump_status.drive));
     return ESP_OK;
 }
 
+static int save_drive(const PumpDriveConfig* drive)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(nvs_handle, NVS_PUMP_DRIVE_KEY, drive, sizeof(*drive));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs_handle);
+    }
+    nvs_close(nvs_handle);
+    return err;
+}
+
+/**
+ * 按大小区分旧的配置：版本 1 没有版本号，迁移到当前版本以后马上写回去
+ */
 static int load_config()
 {
     ESP_LOGI(TAG, "Loading config...");
@@ -264,12 +1221,46 @@ static int load_config()
         return err;
     }
 
-    size_t size = sizeof(s_pump_status.config);
-    err = nvs_get_blob(nvs_handle, NVS_PUMP_CONFIG_KEY, &s_pump_status.config, &size);
+    size_t size = 0;
+    err = nvs_get_blob(nvs_handle, NVS_PUMP_CONFIG_KEY, NULL, &size);
     if (err != ESP_OK) {
+        nvs_close(nvs_handle);
         return err;
     }
 
+    if (size == sizeof(PumpDeviceConfigV1)) {
+        PumpDeviceConfigV1 config_v1;
+        err = nvs_get_blob(nvs_handle, NVS_PUMP_CONFIG_KEY, &config_v1, &size);
+        nvs_close(nvs_handle);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        ESP_LOGI(TAG, "Migrating config from version 1...");
+        memset(&s_pump_status.config, 0, sizeof(s_pump_status.config));
+        s_pump_status.config.version = PUMP_CONFIG_VERSION;
+        memcpy(s_pump_status.config.speeds, config_v1.speeds, sizeof(s_pump_status.config.speeds));
+        return save_config();
+    }
+
+    if (size != sizeof(s_pump_status.config)) {
+        nvs_close(nvs_handle);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    err = nvs_get_blob(nvs_handle, NVS_PUMP_CONFIG_KEY, &s_pump_status.config, &size);
     nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (s_pump_status.config.version != PUMP_CONFIG_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+static void build_curves()
+{
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        PumpCurve_build(&s_pump_status.config.calibrations[i], &s_pump_status.curves[i]);
+    }
+}
@@ -0,0 +1,372 @@
+#include <memory.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#include <esp32/rom/crc.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include "borneo/common.h"
+#include "borneo/rtc.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/dose-history.h"
+
+// 历史记录是一个按扇区轮转的环形日志，只追加不修改：
+// 写满一个扇区就擦掉下一个扇区（里面是最旧的记录）接着写，每个扇区擦写的次数一样，不需要另外做磨损均衡
+// 每条记录带递增的序号和 CRC，上电时找序号最大的扇区就能恢复写入位置，写了一半断电的记录读的时候跳过
+
+#define DOSE_HISTORY_SECTOR_SIZE 4096
+#define DOSE_HISTORY_ENTRIES_PER_SECTOR (DOSE_HISTORY_SECTOR_SIZE / sizeof(DoseLogEntry))
+// 一次从 Flash 读这么多条
+#define DOSE_HISTORY_READ_CHUNK 8
+
+// Flash 里的一条记录，正好 32 字节，扇区里不会有跨界的记录
+typedef struct {
+    uint32_t seq; // 从 0 开始递增，擦除后是 0xFFFFFFFF
+    uint32_t crc; // 除了 crc 以外所有字节的 CRC32
+    int64_t timestamp;
+    uint32_t duration;
+    float volume;
+    uint8_t job;
+    uint8_t channel;
+    uint8_t reserved[6]; // 保持 0xFF，以后加字段用
+} DoseLogEntry;
+
+typedef struct {
+    const esp_partition_t* partition;
+    size_t sectors_count;
+    uint32_t write_pos; // 下一条记录写在分区里的第几条，到末尾之后回到开头
+    uint32_t next_seq;
+    DoseLogEntry buffer[DOSE_HISTORY_BUFFER_SIZE]; // 还没写入 Flash 的记录
+    size_t buffered_count;
+    uint32_t dropped_count; // Flash 写不进去、缓存又满了丢掉的记录
+    SemaphoreHandle_t lock;
+    TaskHandle_t task;
+} DoseHistoryStatus;
+
+static void history_task(void* params);
+static void pump_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data);
+static int mount();
+static int write_entries(const DoseLogEntry* entries, size_t count);
+static uint32_t entry_crc(const DoseLogEntry* entry);
+static bool is_entry_valid(const DoseLogEntry* entry);
+static bool is_entry_erased(const DoseLogEntry* entry);
+
+static const char* TAG = "DOSE_HISTORY";
+
+static DoseHistoryStatus s_history;
+
+int DoseHistory_init()
+{
+    _Static_assert(sizeof(DoseLogEntry) == 32, "A log entry must be 32 bytes");
+
+    memset(&s_history, 0, sizeof(s_history));
+    s_history.partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, DOSE_HISTORY_PARTITION_SUBTYPE, DOSE_HISTORY_PARTITION_LABEL);
+    if (s_history.partition == NULL) {
+        // 旧的分区表没有这个分区
+        ESP_LOGE(TAG, "Partition '%s' not found", DOSE_HISTORY_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_history.sectors_count = s_history.partition->size / DOSE_HISTORY_SECTOR_SIZE;
+    if (s_history.sectors_count < 2) {
+        // 至少要两个扇区，擦掉一个的时候另一个里还有记录
+        s_history.partition = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    s_history.lock = xSemaphoreCreateMutex();
+    if (s_history.lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int error = mount();
+    if (error != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount the history log, error=%X", error);
+        s_history.partition = NULL;
+        return error;
+    }
+    ESP_LOGI(TAG, "History log mounted, sectors=%d, write_pos=%u, next_seq=%u", (int)s_history.sectors_count,
+        s_history.write_pos, s_history.next_seq);
+
+    xTaskCreate(&history_task, "history_task", 1024 * 3, NULL, tskIDLE_PRIORITY + 1, &s_history.task);
+
+    ESP_ERROR_CHECK(
+        esp_event_handler_register(BORNEO_PUMP_EVENTS, BORNEO_EVENT_PUMP_STOPPED, &pump_event_handler, NULL));
+    return ESP_OK;
+}
+
+/**
+ * 记录先放在内存里，攒够一半缓存或者过了 DOSE_HISTORY_FLUSH_INTERVAL_SECS 才一起写入 Flash
+ */
+int DoseHistory_append(const DoseRecord* record)
+{
+    if (s_history.partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    DoseLogEntry entry;
+    memset(&entry, 0xFF, sizeof(entry));
+    entry.timestamp = (int64_t)record->timestamp;
+    entry.duration = record->duration;
+    entry.volume = record->volume;
+    entry.job = record->job;
+    entry.channel = record->channel;
+
+    int error = ESP_OK;
+    xSemaphoreTake(s_history.lock, portMAX_DELAY);
+    if (s_history.buffered_count < DOSE_HISTORY_BUFFER_SIZE) {
+        entry.seq = s_history.next_seq++;
+        entry.crc = entry_crc(&entry);
+        s_history.buffer[s_history.buffered_count++] = entry;
+    } else {
+        s_history.dropped_count++;
+        error = ESP_ERR_NO_MEM;
+    }
+    bool needs_flush = s_history.buffered_count >= DOSE_HISTORY_BUFFER_SIZE / 2;
+    xSemaphoreGive(s_history.lock);
+
+    if (needs_flush) {
+        xTaskNotifyGive(s_history.task);
+    }
+    return error;
+}
+
+int DoseHistory_flush()
+{
+    if (s_history.partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    int error = ESP_OK;
+    xSemaphoreTake(s_history.lock, portMAX_DELAY);
+    if (s_history.buffered_count > 0) {
+        // 写失败的话记录留在缓存里，下次再试
+        error = write_entries(s_history.buffer, s_history.buffered_count);
+        if (error == ESP_OK) {
+            s_history.buffered_count = 0;
+        }
+    }
+    xSemaphoreGive(s_history.lock);
+    return error;
+}
+
+/**
+ * 按时间先后遍历 [from, to] 之间的记录，包括还没写入 Flash 的
+ * 遍历的时候不持有锁，visitor 可以慢慢地把结果发出去，遍历期间新写入的记录不会被遍历到
+ */
+int DoseHistory_query(time_t from, time_t to, DoseHistoryVisitor visitor, void* context)
+{
+    if (s_history.partition == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    DoseLogEntry pending[DOSE_HISTORY_BUFFER_SIZE];
+    xSemaphoreTake(s_history.lock, portMAX_DELAY);
+    uint32_t write_pos = s_history.write_pos;
+    size_t pending_count = s_history.buffered_count;
+    memcpy(pending, s_history.buffer, sizeof(DoseLogEntry) * pending_count);
+    // 缓存里第一条的序号，Flash 里序号不小于它的是遍历开始以后才写进去的
+    uint32_t end_seq = s_history.next_seq - (uint32_t)pending_count;
+    xSemaphoreGive(s_history.lock);
+
+    // 写入位置正好在扇区开头的话这个扇区还没被擦，就是最旧的，否则最旧的是下一个扇区
+    size_t start_sector = (write_pos + DOSE_HISTORY_ENTRIES_PER_SECTOR - 1) / DOSE_HISTORY_ENTRIES_PER_SECTOR;
+    bool has_last_seq = false;
+    uint32_t last_seq = 0;
+    DoseLogEntry chunk[DOSE_HISTORY_READ_CHUNK];
+    DoseRecord record;
+    for (size_t si = 0; si < s_history.sectors_count; si++) {
+        size_t sector = (start_sector + si) % s_history.sectors_count;
+        for (size_t ei = 0; ei < DOSE_HISTORY_ENTRIES_PER_SECTOR; ei += DOSE_HISTORY_READ_CHUNK) {
+            size_t offset = sector * DOSE_HISTORY_SECTOR_SIZE + ei * sizeof(DoseLogEntry);
+            int error = esp_partition_read(s_history.partition, offset, chunk, sizeof(chunk));
+            if (error != ESP_OK) {
+                return error;
+            }
+            for (size_t i = 0; i < DOSE_HISTORY_READ_CHUNK; i++) {
+                const DoseLogEntry* entry = &chunk[i];
+                // 写失败的时候后面的位置也跳过了，所以遇到空位还要接着往后找
+                // 跳过写坏了的，以及遍历期间被擦除重写的
+                if (is_entry_erased(entry) || !is_entry_valid(entry) || entry->seq >= end_seq || (has_last_seq && entry->seq <= last_seq)) {
+                    continue;
+                }
+                has_last_seq = true;
+                last_seq = entry->seq;
+                if (entry->timestamp < from || entry->timestamp > to) {
+                    continue;
+                }
+                record.timestamp = (time_t)entry->timestamp;
+                record.job = entry->job;
+                record.channel = entry->channel;
+                record.volume = entry->volume;
+                record.duration = entry->duration;
+                if (visitor(&record, context) != 0) {
+                    return ESP_OK;
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < pending_count; i++) {
+        const DoseLogEntry* entry = &pending[i];
+        if (entry->timestamp < from || entry->timestamp > to) {
+            continue;
+        }
+        record.timestamp = (time_t)entry->timestamp;
+        record.job = entry->job;
+        record.channel = entry->channel;
+        record.volume = entry->volume;
+        record.duration = entry->duration;
+        if (visitor(&record, context) != 0) {
+            break;
+        }
+    }
+    return ESP_OK;
+}
+
+static void history_task(void* params)
+{
+    for (;;) {
+        // 缓存攒了一半会被提前叫醒
+        ulTaskNotifyTake(pdTRUE, DOSE_HISTORY_FLUSH_INTERVAL_SECS * 1000 / portTICK_PERIOD_MS);
+        int error = DoseHistory_flush();
+        if (error != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to flush history, error=%X", error);
+        }
+    }
+    vTaskDelete(NULL);
+}
+
+static void pump_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    const PumpEventData* data = (const PumpEventData*)event_data;
+    struct tm rtc_now = Rtc_local_now();
+    DoseRecord record = {
+        .timestamp = mktime(&rtc_now),
+        .job = data->job,
+        .channel = (uint8_t)data->channel,
+        .volume = data->volume,
+        .duration = data->duration,
+    };
+    if (DoseHistory_append(&record) != ESP_OK) {
+        ESP_LOGW(TAG, "History buffer is full, record dropped");
+    }
+}
+
+/**
+ * 找出写入位置：每个扇区第一条记录序号最大的扇区是最新的，它里面第一个空位就是下一条的位置
+ */
+static int mount()
+{
+    DoseLogEntry chunk[DOSE_HISTORY_READ_CHUNK];
+    bool has_head = false;
+    size_t head_sector = 0;
+    uint32_t head_seq = 0;
+    for (size_t sector = 0; sector < s_history.sectors_count; sector++) {
+        int error = esp_partition_read(
+            s_history.partition, sector * DOSE_HISTORY_SECTOR_SIZE, &chunk[0], sizeof(DoseLogEntry));
+        if (error != ESP_OK) {
+            return error;
+        }
+        if (is_entry_valid(&chunk[0]) && (!has_head || chunk[0].seq > head_seq)) {
+            has_head = true;
+            head_sector = sector;
+            head_seq = chunk[0].seq;
+        }
+    }
+
+    if (!has_head) {
+        // 空的分区，写第一条的时候会先擦除
+        s_history.write_pos = 0;
+        s_history.next_seq = 0;
+        return ESP_OK;
+    }
+
+    // 最后一个不是空的位置之后开始写，中间写坏了的记录也占着位置
+    size_t used_count = 0;
+    uint32_t max_seq = head_seq;
+    for (size_t ei = 0; ei < DOSE_HISTORY_ENTRIES_PER_SECTOR; ei += DOSE_HISTORY_READ_CHUNK) {
+        size_t offset = head_sector * DOSE_HISTORY_SECTOR_SIZE + ei * sizeof(DoseLogEntry);
+        int error = esp_partition_read(s_history.partition, offset, chunk, sizeof(chunk));
+        if (error != ESP_OK) {
+            return error;
+        }
+        for (size_t i = 0; i < DOSE_HISTORY_READ_CHUNK; i++) {
+            if (is_entry_erased(&chunk[i])) {
+                continue;
+            }
+            used_count = ei + i + 1;
+            if (is_entry_valid(&chunk[i]) && chunk[i].seq > max_seq) {
+                max_seq = chunk[i].seq;
+            }
+        }
+    }
+
+    uint32_t capacity = s_history.sectors_count * DOSE_HISTORY_ENTRIES_PER_SECTOR;
+    s_history.write_pos = (head_sector * DOSE_HISTORY_ENTRIES_PER_SECTOR + used_count) % capacity;
+    s_history.next_seq = max_seq + 1;
+    return ESP_OK;
+}
+
+/**
+ * 在锁里调用
+ */
+static int write_entries(const DoseLogEntry* entries, size_t count)
+{
+    uint32_t capacity = s_history.sectors_count * DOSE_HISTORY_ENTRIES_PER_SECTOR;
+    size_t written = 0;
+    while (written < count) {
+        size_t sector = s_history.write_pos / DOSE_HISTORY_ENTRIES_PER_SECTOR;
+        size_t index = s_history.write_pos % DOSE_HISTORY_ENTRIES_PER_SECTOR;
+        if (index == 0) {
+            // 进入新的扇区，里面是最旧的记录，整个擦掉
+            int error = esp_partition_erase_range(
+                s_history.partition, sector * DOSE_HISTORY_SECTOR_SIZE, DOSE_HISTORY_SECTOR_SIZE);
+            if (error != ESP_OK) {
+                return error;
+            }
+        }
+
+        size_t n = count - written;
+        if (n > DOSE_HISTORY_ENTRIES_PER_SECTOR - index) {
+            n = DOSE_HISTORY_ENTRIES_PER_SECTOR - index;
+        }
+        int error = esp_partition_write(
+            s_history.partition, s_history.write_pos * sizeof(DoseLogEntry), &entries[written], n * sizeof(DoseLogEntry));
+        // 写坏了的位置不再用，免得和半条记录叠在一起
+        s_history.write_pos = (s_history.write_pos + n) % capacity;
+        if (error != ESP_OK) {
+            return error;
+        }
+        written += n;
+    }
+    return ESP_OK;
+}
+
+static uint32_t entry_crc(const DoseLogEntry* entry)
+{
+    uint32_t crc = crc32_le(0, (const uint8_t*)&entry->seq, sizeof(entry->seq));
+    return crc32_le(crc, (const uint8_t*)&entry->timestamp, sizeof(DoseLogEntry) - offsetof(DoseLogEntry, timestamp));
+}
+
+static bool is_entry_valid(const DoseLogEntry* entry)
+{
+    return entry->seq != UINT32_MAX && entry->crc == entry_crc(entry);
+}
+
+static bool is_entry_erased(const DoseLogEntry* entry)
+{
+    const uint8_t* p = (const uint8_t*)entry;
+    for (size_t i = 0; i < sizeof(DoseLogEntry); i++) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/device-config.h"
+#include "borneo/rpc.h"
+#include "borneo/serial.h"
+
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/rpc/doser.h"
+
+// 引导校准流程：
+//  1. doser.calibration_run [通道, 运行时间毫秒]，通道按时间运行一次
+//  2. 用户量出实际的投放量，doser.calibration_add [通道, 投放量 mL] 记下这一点
+//  3. 换几个不同的运行时间重复上面两步，短时间的点越多，小剂量越准
+
+RpcMethodResult RpcMethod_doser_calibration_run(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    if (!cJSON_IsArray(params) || (cJSON_GetArraySize(params) != 2)) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* channel_json = cJSON_GetArrayItem(params, 0);
+    cJSON* duration_json = cJSON_GetArrayItem(params, 1);
+
+    if (!cJSON_IsNumber(channel_json) || !cJSON_IsNumber(duration_json) || channel_json->valueint < 0
+        || channel_json->valueint >= PUMP_MAX_CHANNELS) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    result.error.code = Pump_calibration_run(channel_json->valueint, duration_json->valueint);
+    if (result.error.code != 0) {
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_calibration_add(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    if (!cJSON_IsArray(params) || (cJSON_GetArraySize(params) != 2)) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* channel_json = cJSON_GetArrayItem(params, 0);
+    cJSON* volume_json = cJSON_GetArrayItem(params, 1);
+
+    if (!cJSON_IsNumber(channel_json) || !cJSON_IsNumber(volume_json) || channel_json->valueint < 0
+        || channel_json->valueint >= PUMP_MAX_CHANNELS) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    result.error.code = Pump_calibration_add(channel_json->valueint, volume_json->valuedouble);
+    if (result.error.code != 0) {
+        result.error.message = result.error.code == PUMP_ERROR_CALIBRATION ? "Bad calibration point" : "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_calibration_clear(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    if (!cJSON_IsArray(params) || (cJSON_GetArraySize(params) != 1)) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* channel_json = cJSON_GetArrayItem(params, 0);
+    if (!cJSON_IsNumber(channel_json) || channel_json->valueint < 0 || channel_json->valueint >= PUMP_MAX_CHANNELS) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    result.error.code = Pump_calibration_clear(channel_json->valueint);
+    if (result.error.code != 0) {
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_calibration_get(const cJSON* params, JsonWriter* result_writer)
+{
+    RpcMethodResult result;
+    /*
+        [
+            {
+                "name": "P1",
+                "points": [[2000, 0.2], [10000, 1.6]],  // [运行时间毫秒, 实测投放量 mL]，按运行时间排列
+            },
+        ]
+    */
+
+    JsonWriter_begin_array(result_writer);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        PumpChannelInfo info = Pump_get_channel_info(i);
+        const PumpCalibration* cal = Pump_get_calibration(i);
+        JsonWriter_begin_object(result_writer);
+        JsonWriter_add_string(result_writer, "name", info.name);
+        JsonWriter_key(result_writer, "points");
+        JsonWriter_begin_array(result_writer);
+        for (size_t pi = 0; pi < cal->points_count; pi++) {
+            JsonWriter_begin_array(result_writer);
+            JsonWriter_uint(result_writer, cal->points[pi].duration);
+            JsonWriter_double(result_writer, cal->points[pi].volume);
+            JsonWriter_end_array(result_writer);
+        }
+        JsonWriter_end_array(result_writer);
+        JsonWriter_end_object(result_writer);
+    }
+    JsonWriter_end_array(result_writer);
+
+    result.result = NULL;
+    result.is_succeed = true;
+    return result;
+}
@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include <cJSON.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc.h"
+#include "borneo/rpc-server.h"
+
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/rpc/doser.h"
+
+// doser.dose 是异步方法，启动一次投放，等投放结束才返回结果，等待期间连接照常处理其他请求
+// 调用时通道上可能还有正在运行和排队的投放，所以记下通道的完成计数到多少时才是这一次投放结束
+
+// 每个通道最多一个正在运行加上排满的队列，再多的投放启动时就会失败
+#define MAX_DOSE_WAITS (PUMP_MAX_CHANNELS * (PUMP_MAX_QUEUED_DOSES + 1))
+
+typedef struct {
+    bool is_used;
+    int channel;
+    uint32_t completed_count; // 通道的完成计数达到这个值时这次投放结束
+    RpcPendingCall call;
+} DoseWait;
+
+typedef struct {
+    int32_t channel;
+    uint32_t completed_count;
+    float volume;
+    uint32_t duration;
+} DoseResultArg;
+
+static void on_pump_stopped(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+static int write_dose_result(const void* arg, JsonWriter* writer);
+
+static const char* TAG = "RPC-DOSE";
+
+static SemaphoreHandle_t s_lock;
+static DoseWait s_waits[MAX_DOSE_WAITS];
+
+/**
+ * 每次 WiFi 重新连上都会调用，只在第一次初始化，否则会换掉正在使用的锁并重复注册事件处理函数
+ */
+int DoserRpc_dose_init()
+{
+    if (s_lock != NULL) {
+        return 0;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return -1;
+    }
+    ESP_ERROR_CHECK(esp_event_handler_register(BORNEO_PUMP_EVENTS, BORNEO_EVENT_PUMP_STOPPED, &on_pump_stopped, NULL));
+    return 0;
+}
+
+/**
+ * 参数和 doser.pump 相同：[通道, 体积]，体积单位 mL
+ * 投放结束以后返回 {"channel": 0, "volume": 1.5, "duration": 7200, "completedCount": 3}，duration 是实际运行的毫秒数
+ */
+RpcMethodResult RpcMethod_doser_dose(const cJSON* params, const RpcPendingCall* call)
+{
+    RpcMethodResult result;
+
+    if (!cJSON_IsArray(params) || (cJSON_GetArraySize(params) != 2)) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* channel_json = cJSON_GetArrayItem(params, 0);
+    cJSON* volume_json = cJSON_GetArrayItem(params, 1);
+
+    if (!cJSON_IsNumber(channel_json) || !cJSON_IsNumber(volume_json) || channel_json->valueint < 0
+        || channel_json->valueint >= PUMP_MAX_CHANNELS) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    int ch = channel_json->valueint;
+
+    // 先登记再启动，投放结束的事件不会在登记之前处理
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    DoseWait* wait = NULL;
+    for (size_t i = 0; i < MAX_DOSE_WAITS; i++) {
+        if (!s_waits[i].is_used) {
+            wait = &s_waits[i];
+            break;
+        }
+    }
+    if (wait == NULL) {
+        xSemaphoreGive(s_lock);
+        result.error.code = PUMP_ERROR_BUSY;
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    PumpChannelInfo info = Pump_get_channel_info(ch);
+    wait->is_used = true;
+    wait->channel = ch;
+    wait->completed_count = info.completed_count + info.queue_depth + (info.state == PUMP_STATE_IDLE ? 0 : 1) + 1;
+    wait->call = *call;
+
+    result.error.code = Pump_start(ch, volume_json->valuedouble);
+    if (result.error.code != 0) {
+        wait->is_used = false;
+    }
+    xSemaphoreGive(s_lock);
+
+    if (result.error.code != 0) {
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+static void on_pump_stopped(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    const PumpEventData* data = (const PumpEventData*)event_data;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    for (size_t i = 0; i < MAX_DOSE_WAITS; i++) {
+        DoseWait* wait = &s_waits[i];
+        if (!wait->is_used || wait->channel != data->channel
+            || (int32_t)(data->completed_count - wait->completed_count) < 0) {
+            continue;
+        }
+        DoseResultArg dose = {
+            .channel = data->channel,
+            .completed_count = data->completed_count,
+            .volume = data->volume,
+            .duration = data->duration,
+        };
+        // 发起调用的连接已经关闭时结果直接丢掉，投放照样完成
+        if (RpcServer_complete(&wait->call, &write_dose_result, &dose, sizeof(dose)) != 0) {
+            ESP_LOGW(TAG, "Dose on channel %d finished after its connection closed", data->channel);
+        }
+        wait->is_used = false;
+    }
+    xSemaphoreGive(s_lock);
+}
+
+static int write_dose_result(const void* arg, JsonWriter* writer)
+{
+    const DoseResultArg* dose = (const DoseResultArg*)arg;
+
+    JsonWriter_begin_object(writer);
+    JsonWriter_add_int(writer, "channel", dose->channel);
+    JsonWriter_add_double(writer, "volume", dose->volume);
+    JsonWriter_add_int(writer, "duration", dose->duration);
+    JsonWriter_add_int(writer, "completedCount", dose->completed_count);
+    return JsonWriter_end_object(writer);
+}
@@ -1,6 +1,8 @@
 #include <string.h>
 
 #include <cJSON.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
 #include <esp_timer.h>
 
 #include "borneo/common.h"
@@ -8,11 +10,14 @@
 #include "borneo/rpc.h"
 #include "borneo/serial.h"
 #include "borneo/rtc.h"
+#include "borneo/cron.h"
 
+#include "borneo-doser/devices/flow-control.h"
 #include "borneo-doser/devices/pump.h"
 #include "borneo-doser/rpc/doser.h"
+#include "borneo-doser/scheduler.h"
 
-RpcMethodResult RpcMethod_doser_status(const cJSON* params)
+RpcMethodResult RpcMethod_doser_status(const cJSON* params, JsonWriter* result_writer)
 {
 
     RpcMethodResult result;
@@ -22,11 +27,22 @@ RpcMethodResult RpcMethod_doser_status(const cJSON* params)
             "mode":     "scheduled",    // scheduled：自动运行，manual：手动模式
             "timestamp": 121212121,      // 设备 RTC，// Unix-Epoch 格式本地时间，非 UTC（单位：秒）
             "cpuTime": 121212121,      // CPU 时间，从上电启动到现在，单位：毫秒
+            "maxRunning": 2,            // 最多同时运行的电机个数
+            "drive": {
+                "mode": "pwm",          // gpio：直接开关，pwm：LEDC 调速、软启动
+                "rampUp": 500,          // 加速时间，单位：毫秒
+                "rampDown": 300,        // 减速时间，单位：毫秒
+            },
             "channels": [
                 {
                     "name":     "CH1",  // 名称
                     "speed":    12.0,   // 速度，单位 mL/min
+                    "duty":     80,     // PWM 模式下的占空比，百分数
+                    "effectiveSpeed": 9.6, // 按占空比折算后的速度，单位 mL/min
+                    "isCalibrated": true, // 是否有校准曲线，有的话按曲线计算运行时间
                     "isBusy":   false,  //  是否正在运行
+                    "completedCount": 3, // 上电以来完成的次数
+                    "queueDepth": 0,    // 排队等待的投放个数
                 },
                 {
                     "name": "CH2",
@@ -37,24 +53,153 @@ RpcMethodResult RpcMethod_doser_status(const cJSON* params)
         }
     */
 
-    cJSON* result_json = cJSON_CreateObject();
-    cJSON_AddItemToObject(result_json, "powered", cJSON_CreateTrue());
-    cJSON_AddItemToObject(result_json, "scheduled", cJSON_CreateString("scheduled"));
-    cJSON_AddItemToObject(result_json, "timestamp", cJSON_CreateNumber(Rtc_timestamp()));
-    cJSON_AddItemToObject(result_json, "cpuTime", cJSON_CreateNumber((double)(esp_timer_get_time() / 1000ULL)));
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_bool(result_writer, "powered", true);
+    JsonWriter_add_string(result_writer, "scheduled", "scheduled");
+    JsonWriter_add_int(result_writer, "timestamp", Rtc_timestamp());
+    JsonWriter_add_int(result_writer, "cpuTime", esp_timer_get_time() / 1000LL);
+    JsonWriter_add_int(result_writer, "maxRunning", Pump_get_max_running());
 
-    cJSON* channels_json = cJSON_CreateArray();
+    const PumpDriveConfig* drive = Pump_get_drive();
+    JsonWriter_key(result_writer, "drive");
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_string(result_writer, "mode", drive->mode == PUMP_DRIVE_PWM ? "pwm" : "gpio");
+    JsonWriter_add_int(result_writer, "rampUp", drive->ramp.ramp_up);
+    JsonWriter_add_int(result_writer, "rampDown", drive->ramp.ramp_down);
+    JsonWriter_end_object(result_writer);
+
+    JsonWriter_key(result_writer, "channels");
+    JsonWriter_begin_array(result_writer);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        PumpChannelInfo info = Pump_get_channel_info(i);
+        JsonWriter_begin_object(result_writer);
+        JsonWriter_add_string(result_writer, "name", info.name);
+        JsonWriter_add_double(result_writer, "speed", info.speed);
+        JsonWriter_add_int(result_writer, "duty", drive->duties[i]);
+        JsonWriter_add_double(result_writer, "effectiveSpeed", info.effective_speed);
+        JsonWriter_add_bool(result_writer, "isCalibrated", info.is_calibrated);
+        JsonWriter_add_bool(result_writer, "isBusy", info.state != PUMP_STATE_IDLE);
+        JsonWriter_add_int(result_writer, "completedCount", info.completed_count);
+        JsonWriter_add_int(result_writer, "queueDepth", info.queue_depth);
+        JsonWriter_end_object(result_writer);
+    }
+    JsonWriter_end_array(result_writer);
+
+    JsonWriter_end_object(result_writer);
+
+    result.result = NULL;
+    result.is_succeed = true;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_stats(const cJSON* params, JsonWriter* result_writer)
+{
+    RpcMethodResult result;
+    /*
+        {
+            "cpuTime": 121212121,       // CPU 时间，从上电启动到现在，单位：毫秒
+            "channels": [
+                {
+                    "name": "CH1",
+                    "dispensedVolume": 12.5,    // 上电以来按实际运行时间估算的投放量，单位 mL
+                    "toggleCount": 6,           // GPIO 电平变化的次数
+                    "lastTimingError": 12,      // 最近一次实际关泵比应该关泵晚了多久，单位：微秒
+                    "maxTimingError": 31,       // 单位：微秒
+                    "meanTimingError": 8,       // 单位：微秒
+                    "lastOnTime": 1200000,      // 最近一次投放实际开泵的时间，硬件定时器计数，单位：微秒
+                    "lastOffTime": 3700012,     // 最近一次投放实际关泵的时间
+                    "measuredVolume": 12.3,     // 启用了闭环的通道才有，流量计测到的累计投放量，单位 mL
+                    "measuredFlow": 11.9,       // 流量计测到的最近的流量，单位 mL/min
+                },
+            ],
+            "scheduler": {
+                "executedCount": 3,     // 启动过的计划任务次数
+                "missedCount": 0,       // 错过的计划时间个数
+                "lastDelay": 0,         // 最近一次启动比计划时间晚了多久，单位：秒
+                "maxDelay": 1,          // 单位：秒
+            }
+        }
+    */
+
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_int(result_writer, "cpuTime", esp_timer_get_time() / 1000LL);
+
+    JsonWriter_key(result_writer, "channels");
+    JsonWriter_begin_array(result_writer);
     for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
         PumpChannelInfo info = Pump_get_channel_info(i);
-        cJSON* channel_json = cJSON_CreateObject();
-        cJSON_AddItemToObject(channel_json, "name", cJSON_CreateString(info.name));
-        cJSON_AddItemToObject(channel_json, "speed", cJSON_CreateNumber(info.speed));
-        cJSON_AddItemToObject(channel_json, "isBusy", cJSON_CreateBool(info.state != PUMP_STATE_IDLE));
-        cJSON_AddItemToArray(channels_json, channel_json);
+        JsonWriter_begin_object(result_writer);
+        JsonWriter_add_string(result_writer, "name", info.name);
+        JsonWriter_add_double(result_writer, "dispensedVolume", info.dispensed_volume);
+        JsonWriter_add_int(result_writer, "toggleCount", info.toggle_count);
+        JsonWriter_add_int(result_writer, "lastTimingError", info.last_timing_error);
+        JsonWriter_add_int(result_writer, "maxTimingError", info.max_timing_error);
+        JsonWriter_add_int(result_writer, "meanTimingError", info.mean_timing_error);
+        JsonWriter_add_int(result_writer, "lastOnTime", info.last_on_time);
+        JsonWriter_add_int(result_writer, "lastOffTime", info.last_off_time);
+        if (FlowControl_is_enabled(i)) {
+            JsonWriter_add_double(result_writer, "measuredVolume", FlowControl_get_measured_volume(i));
+            JsonWriter_add_double(result_writer, "measuredFlow", FlowControl_get_measured_flow(i));
+        }
+        JsonWriter_end_object(result_writer);
     }
-    cJSON_AddItemToObject(result_json, "channels", channels_json);
+    JsonWriter_end_array(result_writer);
+
+    SchedulerStats stats = Scheduler_get_stats();
+    JsonWriter_key(result_writer, "scheduler");
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_int(result_writer, "executedCount", stats.executed_count);
+    JsonWriter_add_int(result_writer, "missedCount", stats.missed_count);
+    JsonWriter_add_int(result_writer, "limitedCount", stats.limited_count);
+    JsonWriter_add_int(result_writer, "lastDelay", stats.last_delay);
+    JsonWriter_add_int(result_writer, "maxDelay", stats.max_delay);
+    JsonWriter_end_object(result_writer);
+
+    JsonWriter_end_object(result_writer);
+
+    result.result = NULL;
+    result.is_succeed = true;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_memory(const cJSON* params, JsonWriter* result_writer)
+{
+    RpcMethodResult result;
+    /*
+        {
+            "heapFree": 123456,         // 当前空闲的堆内存，单位：字节
+            "heapMinFree": 100000,      // 上电以来最少的时候空闲的堆内存
+            "heapLargestBlock": 65536,  // 最大的一块连续空闲内存，比 heapFree 小很多说明碎片多
+            "scheduler": {
+                "jobsCount": 12,        // 任务个数
+                "capacity": 16,         // 已经分配的任务块能放的任务个数
+                "jobSize": 88,          // 一个任务占用的字节数
+                "jobsSize": 1408,       // 下面都是字节数
+                "triggersSize": 96,
+                "recordsSize": 96,
+            }
+        }
+    */
+
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_int(result_writer, "heapFree", esp_get_free_heap_size());
+    JsonWriter_add_int(result_writer, "heapMinFree", esp_get_minimum_free_heap_size());
+    JsonWriter_add_int(result_writer, "heapLargestBlock", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    SchedulerMemoryUsage usage = Scheduler_get_memory_usage();
+    JsonWriter_key(result_writer, "scheduler");
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_add_int(result_writer, "jobsCount", usage.jobs_count);
+    JsonWriter_add_int(result_writer, "capacity", usage.capacity);
+    JsonWriter_add_int(result_writer, "jobSize", sizeof(ScheduledJob));
+    JsonWriter_add_int(result_writer, "jobsSize", usage.jobs_size);
+    JsonWriter_add_int(result_writer, "triggersSize", usage.triggers_size);
+    JsonWriter_add_int(result_writer, "recordsSize", usage.records_size);
+    JsonWriter_end_object(result_writer);
+
+    JsonWriter_end_object(result_writer);
 
-    result.result = result_json;
+    result.result = NULL;
     result.is_succeed = true;
     return result;
-}
\ No newline at end of file
+}
@@ -0,0 +1,176 @@
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/device-config.h"
+#include "borneo/rpc.h"
+#include "borneo/serial.h"
+
+#include "borneo-doser/devices/flow-control.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/rpc/doser.h"
+
+static cJSON* flow_param(const cJSON* params, int index);
+
+RpcMethodResult RpcMethod_doser_flow_control_get(const cJSON* params, JsonWriter* result_writer)
+{
+    RpcMethodResult result;
+    /*
+        {
+            "enabled": [true, false, false, false], // 各通道是否启用闭环
+            "pulsesPerMl": [20.0, 20.0, 20.0, 20.0], // 流量计的 K 系数
+            "kp": 0.5,
+            "ki": 1.0,
+            "kd": 0.0,
+            "integralMin": -512,    // 积分项的范围，单位是 LEDC 的占空比，用来抗积分饱和
+            "integralMax": 512,
+            "period": 50,           // 控制周期，单位：毫秒，固定的
+        }
+    */
+
+    const FlowControlConfig* config = FlowControl_get_config();
+
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_key(result_writer, "enabled");
+    JsonWriter_begin_array(result_writer);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        JsonWriter_bool(result_writer, FlowControl_is_enabled(i));
+    }
+    JsonWriter_end_array(result_writer);
+
+    JsonWriter_key(result_writer, "pulsesPerMl");
+    JsonWriter_begin_array(result_writer);
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        JsonWriter_double(result_writer, config->pulses_per_ml[i]);
+    }
+    JsonWriter_end_array(result_writer);
+
+    JsonWriter_add_double(result_writer, "kp", config->kp);
+    JsonWriter_add_double(result_writer, "ki", config->ki);
+    JsonWriter_add_double(result_writer, "kd", config->kd);
+    JsonWriter_add_int(result_writer, "integralMin", config->integral_min);
+    JsonWriter_add_int(result_writer, "integralMax", config->integral_max);
+    JsonWriter_add_int(result_writer, "period", FLOW_CONTROL_PERIOD_MS);
+    JsonWriter_end_object(result_writer);
+
+    result.result = NULL;
+    result.is_succeed = true;
+    return result;
+}
+
+/**
+ * 参数 [enabled, pulsesPerMl, kp, ki, kd, integralMin, integralMax]，含义和 doser.flow_control_get 结果里的同名字段一样
+ * 后面的可以省略，省略或者为 null 的保持原来的值，比如只打开第一个通道的闭环：
+ *  [[true, false, false, false]]
+ */
+RpcMethodResult RpcMethod_doser_flow_control_set(const cJSON* params)
+{
+    RpcMethodResult result;
+    FlowControlConfig config = *FlowControl_get_config();
+
+    if (!cJSON_IsArray(params) || cJSON_GetArraySize(params) > 7) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* enabled_json = flow_param(params, 0);
+    if (enabled_json != NULL) {
+        if (!cJSON_IsArray(enabled_json) || cJSON_GetArraySize(enabled_json) != PUMP_MAX_CHANNELS) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad enabled";
+            goto __FAILED_EXIT;
+        }
+        config.enabled_mask = 0;
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            cJSON* item = cJSON_GetArrayItem(enabled_json, i);
+            if (!cJSON_IsBool(item)) {
+                result.error.code = RPC_ERROR_INVALID_PARAMS;
+                result.error.message = "Bad enabled";
+                goto __FAILED_EXIT;
+            }
+            if (cJSON_IsTrue(item)) {
+                config.enabled_mask |= 1U << i;
+            }
+        }
+    }
+
+    cJSON* pulses_json = flow_param(params, 1);
+    if (pulses_json != NULL) {
+        if (!cJSON_IsArray(pulses_json) || cJSON_GetArraySize(pulses_json) != PUMP_MAX_CHANNELS) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad pulsesPerMl";
+            goto __FAILED_EXIT;
+        }
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            cJSON* item = cJSON_GetArrayItem(pulses_json, i);
+            if (!cJSON_IsNumber(item)) {
+                result.error.code = RPC_ERROR_INVALID_PARAMS;
+                result.error.message = "Bad pulsesPerMl";
+                goto __FAILED_EXIT;
+            }
+            config.pulses_per_ml[i] = (float)item->valuedouble;
+        }
+    }
+
+    cJSON* kp_json = flow_param(params, 2);
+    cJSON* ki_json = flow_param(params, 3);
+    cJSON* kd_json = flow_param(params, 4);
+    cJSON* integral_min_json = flow_param(params, 5);
+    cJSON* integral_max_json = flow_param(params, 6);
+    if ((kp_json != NULL && !cJSON_IsNumber(kp_json)) || (ki_json != NULL && !cJSON_IsNumber(ki_json))
+        || (kd_json != NULL && !cJSON_IsNumber(kd_json))
+        || (integral_min_json != NULL && !cJSON_IsNumber(integral_min_json))
+        || (integral_max_json != NULL && !cJSON_IsNumber(integral_max_json))) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+    if (kp_json != NULL) {
+        config.kp = (float)kp_json->valuedouble;
+    }
+    if (ki_json != NULL) {
+        config.ki = (float)ki_json->valuedouble;
+    }
+    if (kd_json != NULL) {
+        config.kd = (float)kd_json->valuedouble;
+    }
+    if (integral_min_json != NULL) {
+        if (integral_min_json->valueint < INT16_MIN || integral_min_json->valueint > INT16_MAX) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad integralMin";
+            goto __FAILED_EXIT;
+        }
+        config.integral_min = (int16_t)integral_min_json->valueint;
+    }
+    if (integral_max_json != NULL) {
+        if (integral_max_json->valueint < INT16_MIN || integral_max_json->valueint > INT16_MAX) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad integralMax";
+            goto __FAILED_EXIT;
+        }
+        config.integral_max = (int16_t)integral_max_json->valueint;
+    }
+
+    result.error.code = FlowControl_update_config(&config);
+    if (result.error.code != 0) {
+        result.error.message = "Flow control error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+/**
+ * 取第 index 个参数，省略或者为 null 时返回 NULL
+ */
+static cJSON* flow_param(const cJSON* params, int index)
+{
+    cJSON* item = cJSON_GetArrayItem(params, index);
+    return cJSON_IsNull(item) ? NULL : item;
+}
@@ -0,0 +1,126 @@
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc.h"
+
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/dose-history.h"
+#include "borneo-doser/rpc/doser.h"
+
+// 一次最多返回的记录数，客户端按最后一条的时间接着查
+#ifndef DOSER_HISTORY_MAX_RECORDS
+#define DOSER_HISTORY_MAX_RECORDS 256
+#endif
+
+typedef struct {
+    JsonWriter* writer;
+    size_t limit;
+    size_t count;
+    bool has_more;
+} HistoryWriterContext;
+
+static int write_record(const DoseRecord* record, void* context);
+
+RpcMethodResult RpcMethod_doser_history(const cJSON* params, JsonWriter* result_writer)
+{
+    RpcMethodResult result;
+    /*
+        参数 [from, to, limit]，都可以不给，后面的可以省略，中间不给的用 null：
+        [
+            1600000000,     // 开始时间，包括这一秒
+            1600086400,     // 结束时间，包括这一秒
+            100,            // 最多返回几条，不超过 DOSER_HISTORY_MAX_RECORDS
+        ]
+        结果，按时间先后排列：
+        {
+            "records": [
+                [1600000000, 0, 2, 1.5, 6571],  // [结束时间, 计划任务序号（不是计划任务的是 null）, 通道, 请求的投放量 mL, 实际运行时间毫秒]
+            ],
+            "more": false,          // 是否因为 limit 没有返回全部
+        }
+    */
+
+    time_t from = 0;
+    time_t to = (time_t)INT32_MAX;
+    size_t limit = DOSER_HISTORY_MAX_RECORDS;
+    if (!cJSON_IsArray(params) || cJSON_GetArraySize(params) > 3) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+    const cJSON* from_json = cJSON_GetArrayItem(params, 0);
+    const cJSON* to_json = cJSON_GetArrayItem(params, 1);
+    const cJSON* limit_json = cJSON_GetArrayItem(params, 2);
+    if ((from_json != NULL && !cJSON_IsNull(from_json) && !cJSON_IsNumber(from_json))
+        || (to_json != NULL && !cJSON_IsNull(to_json) && !cJSON_IsNumber(to_json))
+        || (limit_json != NULL && !cJSON_IsNull(limit_json)
+            && (!cJSON_IsNumber(limit_json) || limit_json->valuedouble < 1))) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+    if (cJSON_IsNumber(from_json)) {
+        from = (time_t)from_json->valuedouble;
+    }
+    if (cJSON_IsNumber(to_json)) {
+        to = (time_t)to_json->valuedouble;
+    }
+    if (cJSON_IsNumber(limit_json) && limit_json->valuedouble < (double)limit) {
+        limit = (size_t)limit_json->valuedouble;
+    }
+
+    HistoryWriterContext context = {
+        .writer = result_writer,
+        .limit = limit,
+        .count = 0,
+        .has_more = false,
+    };
+
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_key(result_writer, "records");
+    JsonWriter_begin_array(result_writer);
+    // 历史分区不可用时在写入任何记录之前就会出错，结果还可以丢掉
+    int error = DoseHistory_query(from, to, &write_record, &context);
+    if (error != 0) {
+        result.error.code = error;
+        result.error.message = "History error";
+        goto __FAILED_EXIT;
+    }
+    JsonWriter_end_array(result_writer);
+    JsonWriter_add_bool(result_writer, "more", context.has_more);
+    JsonWriter_end_object(result_writer);
+
+    result.result = NULL;
+    result.is_succeed = true;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+static int write_record(const DoseRecord* record, void* context)
+{
+    HistoryWriterContext* ctx = (HistoryWriterContext*)context;
+    if (ctx->count >= ctx->limit) {
+        ctx->has_more = true;
+        return 1;
+    }
+
+    JsonWriter* writer = ctx->writer;
+    JsonWriter_begin_array(writer);
+    JsonWriter_int(writer, record->timestamp);
+    if (record->job == PUMP_JOB_NONE) {
+        JsonWriter_null(writer);
+    } else {
+        JsonWriter_uint(writer, record->job);
+    }
+    JsonWriter_uint(writer, record->channel);
+    JsonWriter_double(writer, record->volume);
+    JsonWriter_uint(writer, record->duration);
+    JsonWriter_end_array(writer);
+    ctx->count++;
+
+    // 连接已经写不进去了就不用接着读 Flash
+    return JsonWriter_has_error(writer) ? 1 : 0;
+}
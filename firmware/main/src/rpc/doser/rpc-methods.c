@@ -0,0 +1,34 @@
+#include <cJSON.h>
+
+#include "borneo/common.h"
+#include "borneo/rpc.h"
+
+#include "borneo/rpc/sys.h"
+
+#include "borneo-doser/rpc/doser.h"
+
+const RpcMethodEntry RPC_METHOD_TABLE[] = {
+    { .name = "sys.hello", .writer_callback = &RpcMethod_sys_hello },
+    { .name = "doser.pump_until", .callback = &RpcMethod_doser_pump_until },
+    { .name = "doser.pump", .callback = &RpcMethod_doser_pump },
+    { .name = "doser.dose", .async_callback = &RpcMethod_doser_dose },
+    { .name = "doser.speed_set", .callback = &RpcMethod_doser_speed_set },
+    { .name = "doser.max_running_set", .callback = &RpcMethod_doser_max_running_set },
+    { .name = "doser.drive_set", .callback = &RpcMethod_doser_drive_set },
+    { .name = "doser.calibration_run", .callback = &RpcMethod_doser_calibration_run },
+    { .name = "doser.calibration_add", .callback = &RpcMethod_doser_calibration_add },
+    { .name = "doser.calibration_clear", .callback = &RpcMethod_doser_calibration_clear },
+    { .name = "doser.calibration_get", .writer_callback = &RpcMethod_doser_calibration_get },
+    { .name = "doser.flow_control_get", .writer_callback = &RpcMethod_doser_flow_control_get },
+    { .name = "doser.flow_control_set", .callback = &RpcMethod_doser_flow_control_set },
+    { .name = "doser.history", .writer_callback = &RpcMethod_doser_history },
+    { .name = "doser.schedule_get", .writer_callback = &RpcMethod_doser_schedule_get },
+    { .name = "doser.schedule_set", .callback = &RpcMethod_doser_schedule_set },
+    { .name = "doser.status", .writer_callback = &RpcMethod_doser_status },
+    { .name = "doser.stats", .writer_callback = &RpcMethod_doser_stats },
+    { .name = "doser.memory", .writer_callback = &RpcMethod_doser_memory },
+    { .name = "doser.subscribe", .callback = &RpcMethod_doser_subscribe },
+    { .name = "doser.unsubscribe", .callback = &RpcMethod_doser_unsubscribe },
+};
+
+const size_t RPC_METHOD_TABLE_SIZE = sizeof(RPC_METHOD_TABLE) / sizeof(RpcMethodEntry);
@@ -1,4 +1,6 @@
 
+#include <string.h>
+
 #include <cJSON.h>
 
 #include "borneo/common.h"
@@ -112,4 +114,144 @@ RpcMethodResult RpcMethod_doser_speed_set(const cJSON* params)
 __FAILED_EXIT:
     result.is_succeed = false;
     return result;
-}
\ No newline at end of file
+}
+
+RpcMethodResult RpcMethod_doser_max_running_set(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    if (!cJSON_IsArray(params) || (cJSON_GetArraySize(params) != 1)) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* max_running_json = cJSON_GetArrayItem(params, 0);
+    if (!cJSON_IsNumber(max_running_json) || max_running_json->valueint < 1
+        || max_running_json->valueint > PUMP_MAX_CHANNELS) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    result.error.code = Pump_update_max_running(max_running_json->valueint);
+    if (result.error.code != 0) {
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+static const char* DRIVE_MODE_NAMES[] = { "gpio", "pwm" };
+
+static cJSON* drive_param(const cJSON* params, int index);
+
+/**
+ * 参数 [mode, rampUp, rampDown, duties]，后面的可以省略，省略或者为 null 的保持原来的值：
+ *  ["pwm", 500, 300, [100, 80, 100, 100]]
+ * 加减速单位毫秒，duties 是各通道占空比的百分数
+ */
+RpcMethodResult RpcMethod_doser_drive_set(const cJSON* params)
+{
+    RpcMethodResult result;
+    PumpDriveConfig drive = *Pump_get_drive();
+
+    if (!cJSON_IsArray(params) || cJSON_GetArraySize(params) > 4) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    cJSON* mode_json = drive_param(params, 0);
+    if (mode_json != NULL) {
+        if (!cJSON_IsString(mode_json)) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad mode";
+            goto __FAILED_EXIT;
+        }
+        size_t mode = 0;
+        while (mode < sizeof(DRIVE_MODE_NAMES) / sizeof(DRIVE_MODE_NAMES[0])
+            && strcmp(mode_json->valuestring, DRIVE_MODE_NAMES[mode]) != 0) {
+            mode++;
+        }
+        if (mode >= sizeof(DRIVE_MODE_NAMES) / sizeof(DRIVE_MODE_NAMES[0])) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad mode";
+            goto __FAILED_EXIT;
+        }
+        drive.mode = (uint8_t)mode;
+    }
+
+    cJSON* ramp_up_json = drive_param(params, 1);
+    cJSON* ramp_down_json = drive_param(params, 2);
+    if ((ramp_up_json != NULL && !cJSON_IsNumber(ramp_up_json))
+        || (ramp_down_json != NULL && !cJSON_IsNumber(ramp_down_json))) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad ramp";
+        goto __FAILED_EXIT;
+    }
+    if (ramp_up_json != NULL) {
+        if (ramp_up_json->valueint < 0 || ramp_up_json->valueint > PUMP_RAMP_MAX_MS) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad ramp";
+            goto __FAILED_EXIT;
+        }
+        drive.ramp.ramp_up = (uint16_t)ramp_up_json->valueint;
+    }
+    if (ramp_down_json != NULL) {
+        if (ramp_down_json->valueint < 0 || ramp_down_json->valueint > PUMP_RAMP_MAX_MS) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad ramp";
+            goto __FAILED_EXIT;
+        }
+        drive.ramp.ramp_down = (uint16_t)ramp_down_json->valueint;
+    }
+
+    cJSON* duties_json = drive_param(params, 3);
+    if (duties_json != NULL) {
+        if (!cJSON_IsArray(duties_json) || cJSON_GetArraySize(duties_json) != PUMP_MAX_CHANNELS) {
+            result.error.code = RPC_ERROR_INVALID_PARAMS;
+            result.error.message = "Bad duties";
+            goto __FAILED_EXIT;
+        }
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            cJSON* duty_json = cJSON_GetArrayItem(duties_json, i);
+            if (!cJSON_IsNumber(duty_json) || duty_json->valueint < 1 || duty_json->valueint > 100) {
+                result.error.code = RPC_ERROR_INVALID_PARAMS;
+                result.error.message = "Bad duties";
+                goto __FAILED_EXIT;
+            }
+            drive.duties[i] = (uint8_t)duty_json->valueint;
+        }
+    }
+
+    result.error.code = Pump_update_drive(&drive);
+    if (result.error.code != 0) {
+        result.error.message = "Pump error";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = NULL;
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+/**
+ * 取第 index 个参数，省略或者为 null 时返回 NULL
+ */
+static cJSON* drive_param(const cJSON* params, int index)
+{
+    cJSON* item = cJSON_GetArrayItem(params, index);
+    return cJSON_IsNull(item) ? NULL : item;
+}
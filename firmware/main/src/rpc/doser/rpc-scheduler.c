@@ -20,49 +20,53 @@
 
 #define TAG "SCHEDULER-RPC"
 
-RpcMethodResult RpcMethod_doser_schedule_get(const cJSON* params)
+static const char* MISSED_POLICY_NAMES[] = { "skip", "once", "all" };
+
+RpcMethodResult RpcMethod_doser_schedule_get(const cJSON* params, JsonWriter* result_writer)
 {
 
     const Schedule* schedule = Scheduler_get_schedule();
 
-    cJSON* result_json = cJSON_CreateObject();
-    cJSON* jobs_json = cJSON_CreateArray();
+    JsonWriter_begin_object(result_writer);
+    JsonWriter_key(result_writer, "jobs");
+    JsonWriter_begin_array(result_writer);
     for (size_t ji = 0; ji < schedule->jobs_count; ji++) {
-        const ScheduledJob* job = &schedule->jobs[ji];
-        cJSON* job_json = cJSON_CreateObject();
+        const ScheduledJob* job = Schedule_job_at(schedule, ji);
+        JsonWriter_begin_object(result_writer);
 
-        cJSON_AddItemToObject(job_json, "name", cJSON_CreateString(job->name));
+        JsonWriter_add_string(result_writer, "name", job->name);
 
-        cJSON_AddItemToObject(job_json, "canParallel", job->can_parallel ? cJSON_CreateTrue() : cJSON_CreateFalse());
+        JsonWriter_add_bool(result_writer, "canParallel", job->can_parallel);
 
-        cJSON_AddItemToObject(job_json, "when", Cron_to_json(&job->when));
+        JsonWriter_key(result_writer, "when");
+        Cron_write_json(&job->when, result_writer);
 
         // 填充 payloads 数组
-        cJSON* payloads_json = cJSON_CreateArray();
+        JsonWriter_key(result_writer, "payloads");
+        JsonWriter_begin_array(result_writer);
         for (size_t pi = 0; pi < PUMP_MAX_CHANNELS; pi++) {
-            double payload = job->payloads[pi];
-            cJSON_AddItemToArray(payloads_json, cJSON_CreateNumber(payload));
+            JsonWriter_double(result_writer, job->payloads[pi]);
         }
-        cJSON_AddItemToObject(job_json, "payloads", payloads_json);
+        JsonWriter_end_array(result_writer);
+
+        JsonWriter_add_string(result_writer, "missedPolicy", MISSED_POLICY_NAMES[job->missed_policy]);
 
-        cJSON_AddItemToObject(job_json, "lastExecuteTime", cJSON_CreateNumber(job->last_execute_time));
+        JsonWriter_add_int(result_writer, "lastExecuteTime", job->last_execute_time);
 
-        cJSON_AddItemToArray(jobs_json, job_json);
+        JsonWriter_end_object(result_writer);
     }
+    JsonWriter_end_array(result_writer);
 
-    cJSON_AddItemToObject(result_json, "jobs", jobs_json);
+    JsonWriter_end_object(result_writer);
 
-    RpcMethodResult result = { .is_succeed = 1, .result = result_json };
+    RpcMethodResult result = { .is_succeed = 1, .result = NULL };
     return result;
 }
 
 RpcMethodResult RpcMethod_doser_schedule_set(const cJSON* params)
 {
     RpcMethodResult result;
-
-    // 需要动态分配防止栈溢出
-    Schedule* schedule = malloc(sizeof(Schedule));
-    memset(schedule, 0, sizeof(Schedule));
+    ScheduledJob* jobs = NULL;
 
     if (Pump_is_any_busy()) {
         result.error.code = 100;
@@ -83,24 +87,30 @@ RpcMethodResult RpcMethod_doser_schedule_set(const cJSON* params)
         goto __FAILED_EXIT;
     }
 
-    schedule->jobs_count = job_count;
+    // 按任务个数动态分配，任务多的时候放在栈上会溢出
+    jobs = calloc(job_count, sizeof(ScheduledJob));
+    if (jobs == NULL) {
+        result.error.code = RPC_ERROR_INTERNAL_ERROR;
+        result.error.message = "Out of memory";
+        goto __FAILED_EXIT;
+    }
 
     cJSON* job_json;
     int job_index = 0;
     cJSON_ArrayForEach(job_json, params)
     {
-        ScheduledJob* job = &schedule->jobs[job_index];
+        ScheduledJob* job = &jobs[job_index];
 
         // 设置 name 元素
         if (cJSON_HasObjectItem(job_json, "name")) {
             cJSON* name_json = cJSON_GetObjectItemCaseSensitive(job_json, "name");
-            if (name_json == NULL || !cJSON_IsString(name_json)
-                || strnlen(name_json->valuestring, SCHEDULER_MAX_JOB_NAME - 1) > (SCHEDULER_MAX_JOB_NAME - 1)) {
+            if (name_json == NULL || !cJSON_IsString(name_json)) {
                 result.error.code = RPC_ERROR_INVALID_PARAMS;
                 result.error.message = "Invalid 'name'";
                 goto __FAILED_EXIT;
             } else {
-                strncpy(job->name, name_json->valuestring, SCHEDULER_MAX_JOB_NAME - 1);
+                // 太长的名字按字符截断
+                Scheduler_copy_job_name(job->name, name_json->valuestring, strlen(name_json->valuestring));
             }
         } else {
             result.error.code = RPC_ERROR_INVALID_PARAMS;
@@ -155,24 +165,44 @@ RpcMethodResult RpcMethod_doser_schedule_set(const cJSON* params)
             payload_index++;
         }
 
+        // 设置 missedPolicy 元素，不填就是跳过
+        job->missed_policy = SCHEDULER_MISSED_SKIP;
+        if (cJSON_HasObjectItem(job_json, "missedPolicy")) {
+            cJSON* policy_json = cJSON_GetObjectItemCaseSensitive(job_json, "missedPolicy");
+            int policy = -1;
+            if (cJSON_IsString(policy_json)) {
+                for (size_t pi = 0; pi < sizeof(MISSED_POLICY_NAMES) / sizeof(char*); pi++) {
+                    if (strcmp(policy_json->valuestring, MISSED_POLICY_NAMES[pi]) == 0) {
+                        policy = pi;
+                    }
+                }
+            }
+            if (policy < 0) {
+                result.error.code = RPC_ERROR_INVALID_PARAMS;
+                result.error.message = "Invalid 'missedPolicy'";
+                goto __FAILED_EXIT;
+            }
+            job->missed_policy = policy;
+        }
+
         memset(&job->last_execute_time, 0, sizeof(job->last_execute_time));
 
         job_index++;
     }
 
-    result.error.code = Scheduler_update_schedule(schedule);
+    result.error.code = Scheduler_update_schedule(jobs, job_count);
     if (result.error.code != 0) {
         result.error.message = "Failed to update schedule";
         goto __FAILED_EXIT;
     }
 
-    free(schedule);
+    free(jobs);
     result.is_succeed = true;
     result.result = NULL;
     return result;
 
 __FAILED_EXIT:
-    free(schedule);
+    free(jobs);
     result.is_succeed = false;
     return result;
 }
@@ -0,0 +1,218 @@
+#include <string.h>
+
+#include <cJSON.h>
+#include <esp_event.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "borneo/common.h"
+#include "borneo/cron.h"
+#include "borneo/rpc.h"
+#include "borneo/rpc-server.h"
+
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/scheduler.h"
+#include "borneo-doser/rpc/doser.h"
+
+// 把泵和计划任务的事件转成 RPC 通知推送给订阅的连接
+
+typedef struct {
+    int64_t cpu_time; // 事件发生时的 CPU 时间，单位毫秒
+    int32_t channel;
+    uint32_t completed_count;
+    bool is_busy;
+} PumpStateArg;
+
+typedef struct {
+    int64_t execute_time;
+    int32_t job_index;
+} JobStartedArg;
+
+static void on_pump_event(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+static void on_scheduler_event(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+static int write_pump_state(const void* arg, JsonWriter* writer);
+static int write_job_started(const void* arg, JsonWriter* writer);
+static uint32_t parse_topics(const cJSON* params);
+
+static const char* TAG = "RPC-DOSER";
+
+static bool s_is_initialized = false;
+
+/**
+ * 每次 WiFi 重新连上都会调用，事件处理函数只注册一次，否则同一个事件会推送多条通知
+ */
+int DoserRpc_init()
+{
+    if (s_is_initialized) {
+        return 0;
+    }
+    ESP_ERROR_CHECK(esp_event_handler_register(BORNEO_PUMP_EVENTS, ESP_EVENT_ANY_ID, &on_pump_event, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(
+        BORNEO_SCHEDULER_EVENTS, BORNEO_EVENT_SCHEDULER_JOB_STARTED, &on_scheduler_event, NULL));
+    s_is_initialized = true;
+    return 0;
+}
+
+/**
+ * 订阅通知，参数是主题名数组，比如 ["pump", "scheduler"]，空数组表示订阅全部
+ */
+RpcMethodResult RpcMethod_doser_subscribe(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    uint32_t topics = parse_topics(params);
+    if (topics == 0) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    if (RpcServer_subscribe(topics) != 0) {
+        result.error.code = RPC_ERROR_INTERNAL_ERROR;
+        result.error.message = "Failed to subscribe";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = cJSON_CreateTrue();
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+RpcMethodResult RpcMethod_doser_unsubscribe(const cJSON* params)
+{
+    RpcMethodResult result;
+
+    uint32_t topics = parse_topics(params);
+    if (topics == 0) {
+        result.error.code = RPC_ERROR_INVALID_PARAMS;
+        result.error.message = "Bad parameters";
+        goto __FAILED_EXIT;
+    }
+
+    if (RpcServer_unsubscribe(topics) != 0) {
+        result.error.code = RPC_ERROR_INTERNAL_ERROR;
+        result.error.message = "Failed to unsubscribe";
+        goto __FAILED_EXIT;
+    }
+
+    result.is_succeed = true;
+    result.result = cJSON_CreateTrue();
+    return result;
+
+__FAILED_EXIT:
+    result.is_succeed = false;
+    return result;
+}
+
+/**
+ * 返回 0 表示参数有误
+ */
+static uint32_t parse_topics(const cJSON* params)
+{
+    if (!cJSON_IsArray(params)) {
+        return 0;
+    }
+    if (cJSON_GetArraySize(params) == 0) {
+        return DOSER_TOPIC_PUMP | DOSER_TOPIC_SCHEDULER;
+    }
+
+    uint32_t topics = 0;
+    const cJSON* topic_json = NULL;
+    cJSON_ArrayForEach(topic_json, params)
+    {
+        if (!cJSON_IsString(topic_json)) {
+            return 0;
+        }
+        if (strcmp(topic_json->valuestring, "pump") == 0) {
+            topics |= DOSER_TOPIC_PUMP;
+        } else if (strcmp(topic_json->valuestring, "scheduler") == 0) {
+            topics |= DOSER_TOPIC_SCHEDULER;
+        } else {
+            return 0;
+        }
+    }
+    return topics;
+}
+
+static void on_pump_event(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    const PumpEventData* data = (const PumpEventData*)event_data;
+
+    RpcNotification notification = {
+        .topic = DOSER_TOPIC_PUMP,
+        .key = (uint32_t)data->channel, // 同一个通道只保留最新的状态
+        .method = "doser.pump_state",
+        .write_params = &write_pump_state,
+    };
+    PumpStateArg state = {
+        .cpu_time = esp_timer_get_time() / 1000LL,
+        .channel = data->channel,
+        .completed_count = data->completed_count,
+        .is_busy = event_id == BORNEO_EVENT_PUMP_STARTED,
+    };
+    memcpy(notification.arg, &state, sizeof(state));
+
+    if (RpcServer_publish(&notification) != 0) {
+        ESP_LOGW(TAG, "Failed to publish pump state of channel %d", data->channel);
+    }
+}
+
+static void on_scheduler_event(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    const SchedulerJobEventData* data = (const SchedulerJobEventData*)event_data;
+
+    RpcNotification notification = {
+        .topic = DOSER_TOPIC_SCHEDULER,
+        .key = (uint32_t)data->job_index,
+        .method = "doser.job_started",
+        .write_params = &write_job_started,
+    };
+    JobStartedArg job = {
+        .execute_time = data->execute_time,
+        .job_index = data->job_index,
+    };
+    memcpy(notification.arg, &job, sizeof(job));
+
+    if (RpcServer_publish(&notification) != 0) {
+        ESP_LOGW(TAG, "Failed to publish job %d started", data->job_index);
+    }
+}
+
+/**
+ * {"channel": 0, "name": "P1", "isBusy": false, "completedCount": 3, "cpuTime": 121212}
+ * 客户端来不及接收时同一通道的通知会合并，可以通过 completedCount 的变化知道中间完成过几次
+ */
+static int write_pump_state(const void* arg, JsonWriter* writer)
+{
+    const PumpStateArg* state = (const PumpStateArg*)arg;
+    PumpChannelInfo info = Pump_get_channel_info(state->channel);
+
+    JsonWriter_begin_object(writer);
+    JsonWriter_add_int(writer, "channel", state->channel);
+    JsonWriter_add_string(writer, "name", info.name);
+    JsonWriter_add_bool(writer, "isBusy", state->is_busy);
+    JsonWriter_add_int(writer, "completedCount", state->completed_count);
+    JsonWriter_add_int(writer, "cpuTime", state->cpu_time);
+    return JsonWriter_end_object(writer);
+}
+
+/**
+ * {"index": 0, "name": "Job1", "timestamp": 121212121}
+ */
+static int write_job_started(const void* arg, JsonWriter* writer)
+{
+    const JobStartedArg* job = (const JobStartedArg*)arg;
+    const Schedule* schedule = Scheduler_get_schedule();
+
+    JsonWriter_begin_object(writer);
+    JsonWriter_add_int(writer, "index", job->job_index);
+    if (job->job_index < schedule->jobs_count) {
+        JsonWriter_add_string(writer, "name", Schedule_job_at(schedule, job->job_index)->name);
+    }
+    JsonWriter_add_int(writer, "timestamp", job->execute_time);
+    return JsonWriter_end_object(writer);
+}
@@ -0,0 +1,136 @@
+#include <memory.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "borneo/common.h"
+#include "borneo/cron.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/scheduler.h"
+
+// 这里只有纯计算，不依赖 RTOS 和时钟，方便在上位机上用虚拟时间回放
+
+/**
+ * 根据 last_execute_time 找出到 now 为止到期还没处理的计划时间，并按任务的策略算出要执行几次
+ */
+void Scheduler_check_job(const ScheduledJob* job, time_t now, ScheduledJobDue* due)
+{
+    memset(due, 0, sizeof(ScheduledJobDue));
+    due->last_due_time = (time_t)-1;
+
+    time_t last = job->last_execute_time;
+    time_t after;
+    if (last > now + SCHEDULER_CATCHUP_WINDOW_SECS) {
+        // 比现在晚太多，多半是 RTC 时间还没校准，只处理准时的
+        after = now - SCHEDULER_FIRE_WINDOW_SECS;
+    } else if (last > now) {
+        // 时钟往回调了一点，已经执行过的不再重复执行
+        after = last;
+    } else if (job->missed_policy == SCHEDULER_MISSED_SKIP) {
+        after = last > now - SCHEDULER_FIRE_WINDOW_SECS ? last : now - SCHEDULER_FIRE_WINDOW_SECS;
+    } else {
+        after = last > now - SCHEDULER_CATCHUP_WINDOW_SECS ? last : now - SCHEDULER_CATCHUP_WINDOW_SECS;
+    }
+
+    // 一天之内最多 24 个计划时间
+    time_t t = Cron_next_after(&job->when, after);
+    while (t != (time_t)-1 && t <= now) {
+        due->due_count++;
+        due->last_due_time = t;
+        t = Cron_next_after(&job->when, t);
+    }
+    due->next_fire_time = t;
+
+    if (due->due_count == 0) {
+        return;
+    }
+
+    due->is_on_time = now - due->last_due_time < SCHEDULER_FIRE_WINDOW_SECS;
+    due->missed_count = due->due_count - (due->is_on_time ? 1 : 0);
+    due->runs = due->is_on_time ? 1 : 0;
+    if (due->missed_count > 0) {
+        if (job->missed_policy == SCHEDULER_MISSED_ONCE) {
+            due->runs += 1;
+        } else if (job->missed_policy == SCHEDULER_MISSED_ALL) {
+            due->runs += due->missed_count;
+        }
+    }
+}
+
+static int64_t hour_of(time_t time)
+{
+    // 向下取整，RTC 没校准时的负时间也落在正确的格子里
+    int64_t t = (int64_t)time;
+    int64_t hour = t / SCHEDULER_VOLUME_BUCKET_SECS;
+    return t % SCHEDULER_VOLUME_BUCKET_SECS < 0 ? hour - 1 : hour;
+}
+
+static size_t bucket_of(int64_t hour)
+{
+    int64_t i = hour % SCHEDULER_VOLUME_BUCKETS;
+    return (size_t)(i < 0 ? i + SCHEDULER_VOLUME_BUCKETS : i);
+}
+
+void ScheduledVolumeTally_init(ScheduledVolumeTally* tally)
+{
+    memset(tally, 0, sizeof(ScheduledVolumeTally));
+    tally->hour = INT64_MIN;
+}
+
+/**
+ * 记下 time 这个时间投放的量，比最新一格早 24 小时以上的直接丢掉
+ */
+void ScheduledVolumeTally_add(ScheduledVolumeTally* tally, time_t time, size_t ch, double volume)
+{
+    int64_t hour = hour_of(time);
+    if (tally->hour == INT64_MIN || hour - tally->hour >= SCHEDULER_VOLUME_BUCKETS) {
+        memset(tally->volumes, 0, sizeof(tally->volumes));
+        tally->hour = hour;
+    } else if (hour > tally->hour) {
+        // 清掉中间过去了的格子，循环使用
+        for (int64_t h = tally->hour + 1; h <= hour; h++) {
+            for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+                tally->volumes[i][bucket_of(h)] = 0.0f;
+            }
+        }
+        tally->hour = hour;
+    } else if (tally->hour - hour >= SCHEDULER_VOLUME_BUCKETS) {
+        return;
+    }
+    tally->volumes[ch][bucket_of(hour)] += (float)volume;
+}
+
+/**
+ * 最近 24 小时的投放量
+ * 时钟往回调过的话，时间比 now 晚的记录也算进去，宁可少投不能多投
+ */
+double ScheduledVolumeTally_sum(const ScheduledVolumeTally* tally, time_t now, size_t ch)
+{
+    if (tally->hour == INT64_MIN) {
+        return 0.0;
+    }
+    int64_t oldest = hour_of(now) - SCHEDULER_VOLUME_BUCKETS + 1;
+    double sum = 0.0;
+    for (int64_t h = tally->hour; h > tally->hour - SCHEDULER_VOLUME_BUCKETS && h >= oldest; h--) {
+        sum += tally->volumes[ch][bucket_of(h)];
+    }
+    return sum;
+}
+
+/**
+ * 把 payloads 削减到每个通道最近 24 小时剩下的额度之内，有通道被削减时返回 true
+ */
+bool Scheduler_limit_payloads(const ScheduledVolumeTally* tally, time_t now, double* payloads)
+{
+    bool is_limited = false;
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        if (!(payloads[i] > 0.0)) {
+            continue;
+        }
+        double remaining = SCHEDULER_MAX_DAILY_VOLUME - ScheduledVolumeTally_sum(tally, now, i);
+        if (payloads[i] > remaining) {
+            payloads[i] = remaining > 0.0 ? remaining : 0.0;
+            is_limited = true;
+        }
+    }
+    return is_limited;
+}
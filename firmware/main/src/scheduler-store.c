@@ -0,0 +1,167 @@
+#include <memory.h>
+#include <string.h>
+#include <time.h>
+
+#include <esp32/rom/crc.h>
+
+#include "borneo/common.h"
+#include "borneo/cron.h"
+#include "borneo-doser/devices/pump.h"
+#include "borneo-doser/scheduler.h"
+
+// 任务在 NVS 里的记录格式，和结构体的内存布局无关，整数都按小端序逐字节存放：
+//
+//   u8  版本，SCHEDULER_CONFIG_VERSION
+//   u8  名字长度 n，后面跟 n 个字节的名字，不含结尾的 '\0'
+//   u8  标志，第 0 位是 can_parallel
+//   u8  missed_policy
+//   u8  when.dow
+//   u8  when.minute
+//   u32 when.hours
+//   u8  通道数 c，后面跟 c 个 double 的投放量
+//   i64 last_execute_time
+//   u32 前面所有字节的 CRC32
+//
+// 通道数和固件不一样的时候多出来的丢掉，少的补 0，所以改通道数不会丢排程
+// 名字比 SCHEDULER_MAX_JOB_NAME 长的截断，所以名字改短了也不会丢排程
+
+#define JOB_FLAG_CAN_PARALLEL (1 << 0)
+
+static uint8_t* put_u32(uint8_t* p, uint32_t value)
+{
+    for (size_t i = 0; i < 4; i++) {
+        *p++ = (uint8_t)(value >> (i * 8));
+    }
+    return p;
+}
+
+static uint8_t* put_u64(uint8_t* p, uint64_t value)
+{
+    for (size_t i = 0; i < 8; i++) {
+        *p++ = (uint8_t)(value >> (i * 8));
+    }
+    return p;
+}
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+        value |= (uint32_t)p[i] << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const uint8_t* p)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; i++) {
+        value |= (uint64_t)p[i] << (i * 8);
+    }
+    return value;
+}
+
+/**
+ * 把任务编码成一条记录，buf 至少要有 SCHEDULER_RECORD_MAX_SIZE 个字节，返回记录的长度
+ * crc 不为 NULL 时顺便返回记录的 CRC，保存的时候用来判断任务有没有变
+ */
+size_t Scheduler_encode_job(const ScheduledJob* job, uint8_t* buf, uint32_t* crc)
+{
+    uint8_t* p = buf;
+    *p++ = SCHEDULER_CONFIG_VERSION;
+
+    size_t name_len = strnlen(job->name, SCHEDULER_MAX_JOB_NAME - 1);
+    *p++ = (uint8_t)name_len;
+    memcpy(p, job->name, name_len);
+    p += name_len;
+
+    *p++ = job->can_parallel ? JOB_FLAG_CAN_PARALLEL : 0;
+    *p++ = job->missed_policy;
+    *p++ = job->when.dow;
+    *p++ = job->when.minute;
+    p = put_u32(p, job->when.hours);
+
+    *p++ = PUMP_MAX_CHANNELS;
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        uint64_t bits;
+        memcpy(&bits, &job->payloads[i], sizeof(bits));
+        p = put_u64(p, bits);
+    }
+
+    p = put_u64(p, (uint64_t)(int64_t)job->last_execute_time);
+
+    uint32_t record_crc = crc32_le(0, buf, (uint32_t)(p - buf));
+    p = put_u32(p, record_crc);
+    if (crc != NULL) {
+        *crc = record_crc;
+    }
+    return (size_t)(p - buf);
+}
+
+/**
+ * 复制 len 字节的名字，放不下的话截断，截断的时候不会把一个 UTF-8 字符切成两半
+ */
+void Scheduler_copy_job_name(char* dest, const char* src, size_t len)
+{
+    if (len > SCHEDULER_MAX_JOB_NAME - 1) {
+        len = SCHEDULER_MAX_JOB_NAME - 1;
+        // 退到一个字符的开头，后续字节是 10xxxxxx
+        while (len > 0 && ((uint8_t)src[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+    memcpy(dest, src, len);
+    dest[len] = '\0';
+}
+
+/**
+ * 从记录解码出任务，记录被截断、CRC 不对或者是更新的固件写的，返回错误并且不修改 job
+ */
+int Scheduler_decode_job(const uint8_t* buf, size_t size, ScheduledJob* job)
+{
+    if (size < 2 + 4) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (crc32_le(0, buf, (uint32_t)(size - 4)) != get_u32(buf + size - 4)) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    if (buf[0] != SCHEDULER_CONFIG_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    const uint8_t* p = buf + 1;
+    const uint8_t* end = buf + size - 4;
+    size_t name_len = *p++;
+    if (end - p < (ptrdiff_t)(name_len + 4 + 4 + 1)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ScheduledJob decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    Scheduler_copy_job_name(decoded.name, (const char*)p, name_len);
+    p += name_len;
+
+    decoded.can_parallel = (*p++ & JOB_FLAG_CAN_PARALLEL) != 0;
+    decoded.missed_policy = *p++;
+    decoded.when.dow = *p++;
+    decoded.when.minute = *p++;
+    decoded.when.hours = get_u32(p);
+    p += 4;
+
+    size_t channels = *p++;
+    if (end - p != (ptrdiff_t)(channels * 8 + 8)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t i = 0; i < channels; i++) {
+        if (i < PUMP_MAX_CHANNELS) {
+            uint64_t bits = get_u64(p);
+            memcpy(&decoded.payloads[i], &bits, sizeof(bits));
+        }
+        p += 8;
+    }
+
+    decoded.last_execute_time = (time_t)(int64_t)get_u64(p);
+
+    memcpy(job, &decoded, sizeof(ScheduledJob));
+    return 0;
+}
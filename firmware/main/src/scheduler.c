@@ -1,3 +1,4 @@
+#include <assert.h>
 #include <cJSON.h>
 #include <memory.h>
 #include <stdlib.h>
@@ -11,6 +12,7 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/FreeRTOSConfig.h>
 #include <freertos/event_groups.h>
+#include <freertos/semphr.h>
 #include <freertos/task.h>
 #include <nvs_flash.h>
 #include <tcpip_adapter.h>
@@ -18,128 +20,533 @@
 #include "borneo/common.h"
 #include "borneo/cron.h"
 #include "borneo-doser/devices/pump.h"
+#include "borneo-doser/dose-history.h"
 #include "borneo/rtc.h"
 #include "borneo-doser/scheduler.h"
 #include "borneo/utils/bit-utils.h"
 #include "borneo/utils/time.h"
 
+// 任务通知的位
+#define SCHEDULER_NOTIFY_SCHEDULE_CHANGED (1 << 0)
+#define SCHEDULER_NOTIFY_CLOCK_CHANGED (1 << 1)
+
+// 最多睡这么久就醒来重新检查一遍，防止时钟被悄悄地改了
+#define SCHEDULER_MAX_SLEEP_SECS (60 * 60)
+
+// NVS 里任务记录的键名，后面跟任务的序号
+#define NVS_SCHEDULER_JOB_KEY_FORMAT "job%u"
+
+// 投放历史里的任务序号和 NVS 头里的任务个数都只有一个字节
+#if SCHEDULER_MAX_JOBS >= PUMP_JOB_NONE
+#error "SCHEDULER_MAX_JOBS must be less than PUMP_JOB_NONE"
+#endif
+
+// 旧固件的排程大小是固定的
+#define SCHEDULER_LEGACY_MAX_JOB_NAME 128
+#define SCHEDULER_LEGACY_MAX_JOBS 10
+
+typedef struct {
+    time_t fire_time;
+    uint16_t job_index;
+} JobTrigger;
+
+// NVS 里一个任务记录的状态
+typedef struct {
+    uint32_t crc;
+    bool is_synced; // crc 和 NVS 里的一致
+} JobRecordState;
+
+// 版本 0 和 1 的配置是整个 SchedulerStatus 的内存布局，这里按原样保留用来迁移
+// 版本 0 的任务没有 missed_policy
+typedef struct {
+    char name[SCHEDULER_LEGACY_MAX_JOB_NAME];
+    bool can_parallel;
+    Cron when;
+    double payloads[PUMP_MAX_CHANNELS];
+    time_t last_execute_time;
+} ScheduledJobV0;
+
+typedef struct {
+    bool is_running;
+    struct {
+        uint8_t jobs_count;
+        ScheduledJobV0 jobs[SCHEDULER_LEGACY_MAX_JOBS];
+    } schedule;
+} SchedulerStatusV0;
+
+typedef struct {
+    char name[SCHEDULER_LEGACY_MAX_JOB_NAME];
+    bool can_parallel;
+    Cron when;
+    double payloads[PUMP_MAX_CHANNELS];
+    uint8_t missed_policy;
+    time_t last_execute_time;
+} ScheduledJobV1;
+
+typedef struct {
+    bool is_running;
+    struct {
+        uint8_t jobs_count;
+        ScheduledJobV1 jobs[SCHEDULER_LEGACY_MAX_JOBS];
+    } schedule;
+} SchedulerStatusV1;
+
 static void scheduler_task(void* params);
+static void rtc_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data);
+static void rebuild_triggers(time_t now);
+static void run_due_jobs(time_t now);
+static void execute_job(size_t job_index, const ScheduledJobDue* due, time_t now);
+static void load_daily_volumes(time_t now);
+static int add_history_volume(const DoseRecord* record, void* context);
+static void push_trigger(time_t fire_time, size_t job_index);
+static JobTrigger pop_trigger();
+static int reserve_jobs(size_t jobs_count);
+static int reserve_records(size_t jobs_count);
 static int load_config();
+static int load_jobs(nvs_handle_t nvs_handle, size_t jobs_count);
+static int migrate_legacy_config(nvs_handle_t nvs_handle);
 static int restore_default_config();
 static int save_config();
 
 static const char* TAG = "SCHEDULER";
 static const char* NVS_NAMESPACE = "scheduler";
-static const char* NVS_SCHEDULER_CONFIG_KEY = "config";
+static const char* NVS_SCHEDULER_HEADER_KEY = "header";
+// 版本 0、1 的整块配置，迁移以后删除
+static const char* NVS_SCHEDULER_LEGACY_CONFIG_KEY = "config";
 
 SchedulerStatus s_scheduler_status;
 
+static TaskHandle_t s_task = NULL;
+
+// RPC 和调度任务都会修改排程、保存记录，用这个锁串起来
+static SemaphoreHandle_t s_lock = NULL;
+
+// 按 fire_time 排列的最小堆，每个任务最多一项，只在调度任务里访问
+static JobTrigger* s_triggers = NULL;
+static size_t s_triggers_count = 0;
+static size_t s_triggers_capacity = 0;
+
+static SchedulerStats s_stats;
+
+// 最近 24 小时计划任务的投放量，只在调度任务里访问
+static ScheduledVolumeTally s_daily_volumes;
+
+// NVS 里每个任务记录的状态，保存的时候只写 CRC 变了的任务，执行一次任务只需要写一条记录
+static JobRecordState* s_records = NULL;
+static size_t s_records_capacity = 0;
+static size_t s_stored_keys_count = 0; // NVS 里可能有记录的任务个数，记录的键总是从 0 开始连续的
+static int s_stored_jobs_count = -1; // NVS 头里的任务个数，-1 表示不知道
+
+ESP_EVENT_DEFINE_BASE(BORNEO_SCHEDULER_EVENTS);
+
 int Scheduler_init()
 {
+    s_lock = xSemaphoreCreateMutex();
+    if (s_lock == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
     int error = load_config();
-    if (error == ESP_ERR_NVS_NOT_FOUND || error == ESP_ERR_NVS_INVALID_LENGTH) {
-        // 这种情况说明没有保存的配置，初次上电或者存储格式变了，我们恢复默认配置然后保存配置
+    if (error == ESP_ERR_NVS_NOT_FOUND || error == ESP_ERR_INVALID_SIZE || error == ESP_ERR_INVALID_VERSION) {
+        // 初次上电，或者头坏了、是更新的固件写的，我们恢复默认配置然后保存配置
+        // 旧版本的配置在 load_config() 里迁移，单个任务的记录坏了只丢掉那个任务
+        ESP_LOGW(TAG, "No usable schedule in NVS, error=%X", error);
         ESP_ERROR_CHECK(restore_default_config());
     } else if (error != 0) {
         ESP_LOGE(TAG, "Failed to load Scheduler data from NVS. Error code=%X", error);
         return -1;
     }
+
+    ESP_ERROR_CHECK(
+        esp_event_handler_register(BORNEO_RTC_EVENTS, BORNEO_EVENT_RTC_TIME_SET, &rtc_event_handler, NULL));
     return 0;
 }
 
 int Scheduler_start()
 {
-    xTaskCreate(&scheduler_task, "scheduler_task", 1024 * 8, NULL, tskIDLE_PRIORITY + 4, NULL);
+    xTaskCreate(&scheduler_task, "scheduler_task", 1024 * 8, NULL, tskIDLE_PRIORITY + 4, &s_task);
     return 0;
 }
 
 const Schedule* Scheduler_get_schedule() { return &s_scheduler_status.schedule; }
 
-int Scheduler_update_schedule(const Schedule* schedule)
+SchedulerStats Scheduler_get_stats() { return s_stats; }
+
+SchedulerMemoryUsage Scheduler_get_memory_usage()
+{
+    const Schedule* sch = &s_scheduler_status.schedule;
+    SchedulerMemoryUsage usage = {
+        .jobs_count = sch->jobs_count,
+        .capacity = sch->capacity,
+        .jobs_size = sizeof(ScheduledJob) * sch->capacity,
+        .triggers_size = sizeof(JobTrigger) * s_triggers_capacity,
+        .records_size = sizeof(JobRecordState) * s_records_capacity,
+    };
+    return usage;
+}
+
+int Scheduler_update_schedule(const ScheduledJob* jobs, size_t jobs_count)
 {
+    if (jobs_count > SCHEDULER_MAX_JOBS) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
     Schedule* sch = &s_scheduler_status.schedule;
-    for (size_t i = 0; i < schedule->jobs_count; i++) {
-        const ScheduledJob* src_job = &schedule->jobs[i];
-        ScheduledJob* dest_job = &sch->jobs[i];
+    struct tm rtc_now = Rtc_local_now();
+    time_t now = mktime(&rtc_now);
 
-        // 更新 name
-        if (src_job->name != NULL && strlen(src_job->name) > 0) {
-            strcpy(dest_job->name, src_job->name);
-        }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    int error = reserve_jobs(jobs_count);
+    if (error != 0) {
+        xSemaphoreGive(s_lock);
+        return error;
+    }
+
+    for (size_t i = 0; i < jobs_count; i++) {
+        const ScheduledJob* src_job = &jobs[i];
+        ScheduledJob* dest_job = Schedule_job_at(sch, i);
+
+        // 更新 name，空的名字也要拷贝，槽位是复用的，不然会留下之前任务的名字
+        strcpy(dest_job->name, src_job->name);
 
         // 更新 canParallel
         dest_job->can_parallel = src_job->can_parallel;
 
+        // 新任务或者执行时间改了的任务从现在开始算，不然会被当成错过了很多次
+        // 否则 last_execute_time 不动，保持原来的
+        bool is_new_job = i >= sch->jobs_count || dest_job->last_execute_time == 0;
+        if (is_new_job || memcmp(&dest_job->when, &src_job->when, sizeof(Cron)) != 0) {
+            dest_job->last_execute_time = now;
+        }
+
         // 更新 when
         memcpy(&dest_job->when, &src_job->when, sizeof(Cron));
 
         // 更新 payloads
         memcpy(&dest_job->payloads, &src_job->payloads, sizeof(double) * PUMP_MAX_CHANNELS);
 
-        // last_execute_time 不动，保持原来的
+        dest_job->missed_policy = src_job->missed_policy;
     }
-    s_scheduler_status.schedule.jobs_count = schedule->jobs_count;
+    sch->jobs_count = (uint16_t)jobs_count;
 
     // 保存排程到 Flash
-    return save_config();
+    error = save_config();
+    xSemaphoreGive(s_lock);
+
+    // 让调度任务重新计算下次执行时间
+    if (s_task != NULL) {
+        xTaskNotify(s_task, SCHEDULER_NOTIFY_SCHEDULE_CHANGED, eSetBits);
+    }
+    return error;
 }
 
 static void scheduler_task(void* params)
 {
-    // 500 毫秒检查一次计划任务，有到期的就执行
-    const TickType_t freq = 500 / portTICK_PERIOD_MS;
-    TickType_t last_wake_time = xTaskGetTickCount();
-
-    Schedule* sch = &s_scheduler_status.schedule;
+    // 不再定时轮询，而是睡到最早一个任务的执行时间，排程或者时钟变了会被通知醒来
+    bool needs_rebuild = true;
+    bool is_volumes_loaded = false;
+    time_t last_time = 0;
     for (;;) {
         struct tm rtc_now = Rtc_local_now();
-        time_t rtc_time = mktime(&rtc_now);
-        for (size_t i = 0; i < sch->jobs_count; i++) {
-            ScheduledJob* job = &sch->jobs[i];
-            // 检查周、时、分
-            if (Cron_can_execute(&job->when, &rtc_now)) {
-                // TODO 这里计算执行时间，不要固定 60
-                double since_last = difftime(rtc_time, job->last_execute_time);
-                if (since_last > 60.0) {
-                    ESP_LOGI(TAG, "A scheduled job started...");
-                    // 设置执行时间，下次就不会再执行了
-                    job->last_execute_time = rtc_time;
-                    // 执行任务
-                    if (Pump_start_all(job->payloads) != 0) {
-                        ESP_LOGE(TAG, "Failed to start pump!");
-                    }
-                }
+        time_t now = mktime(&rtc_now);
+        if (now == (time_t)-1) {
+            // RTC 还没准备好，过一会再试
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        // 重启前投放过的量也要算进每天的上限，否则断电后的补执行还能再投一天的量
+        if (!is_volumes_loaded) {
+            load_daily_volumes(now);
+            is_volumes_loaded = true;
+        }
+
+        // 时间倒退了，堆里的执行时间都不对了
+        if (now < last_time) {
+            ESP_LOGW(TAG, "Clock went backwards, rescheduling...");
+            needs_rebuild = true;
+        }
+        last_time = now;
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (needs_rebuild) {
+            rebuild_triggers(now);
+            needs_rebuild = false;
+        }
+
+        run_due_jobs(now);
+        xSemaphoreGive(s_lock);
+
+        TickType_t wait_ticks = portMAX_DELAY;
+        if (s_triggers_count > 0) {
+            time_t delay = s_triggers[0].fire_time - now;
+            if (delay > SCHEDULER_MAX_SLEEP_SECS) {
+                delay = SCHEDULER_MAX_SLEEP_SECS;
             }
+            wait_ticks = (TickType_t)delay * 1000 / portTICK_PERIOD_MS;
         }
 
-        vTaskDelayUntil(&last_wake_time, freq);
+        uint32_t notified = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &notified, wait_ticks) == pdTRUE && notified != 0) {
+            needs_rebuild = true;
+        }
     }
     vTaskDelete(NULL);
 }
 
-static int save_config()
+static void rtc_event_handler(void* handler_args, esp_event_base_t base, int32_t id, void* event_data)
+{
+    if (s_task != NULL) {
+        xTaskNotify(s_task, SCHEDULER_NOTIFY_CLOCK_CHANGED, eSetBits);
+    }
+}
+
+static void rebuild_triggers(time_t now)
+{
+    const Schedule* sch = &s_scheduler_status.schedule;
+    s_triggers_count = 0;
+    if (s_triggers_capacity < sch->jobs_count) {
+        // 只增不减，任务变少了也不用重新分配
+        JobTrigger* triggers = realloc(s_triggers, sizeof(JobTrigger) * sch->jobs_count);
+        if (triggers == NULL) {
+            ESP_LOGE(TAG, "Out of memory for %d triggers", sch->jobs_count);
+            return;
+        }
+        s_triggers = triggers;
+        s_triggers_capacity = sch->jobs_count;
+    }
+    for (size_t i = 0; i < sch->jobs_count; i++) {
+        // 有到期没处理的（比如断电期间错过的）马上处理，否则等下次执行时间
+        ScheduledJobDue due;
+        Scheduler_check_job(Schedule_job_at(sch, i), now, &due);
+        time_t fire_time = due.due_count > 0 ? due.last_due_time : due.next_fire_time;
+        if (fire_time != (time_t)-1) {
+            push_trigger(fire_time, i);
+        }
+    }
+}
+
+static void run_due_jobs(time_t now)
+{
+    Schedule* sch = &s_scheduler_status.schedule;
+    bool is_dirty = false;
+    while (s_triggers_count > 0 && s_triggers[0].fire_time <= now) {
+        JobTrigger trigger = pop_trigger();
+        if (trigger.job_index >= sch->jobs_count) {
+            continue;
+        }
+
+        ScheduledJob* job = Schedule_job_at(sch, trigger.job_index);
+        ScheduledJobDue due;
+        Scheduler_check_job(job, now, &due);
+        if (due.due_count > 0) {
+            if (due.missed_count > 0) {
+                s_stats.missed_count += due.missed_count;
+                ESP_LOGW(TAG, "Job %d missed %d time(s), policy=%d, runs=%d", trigger.job_index, due.missed_count,
+                    job->missed_policy, due.runs);
+            }
+            if (due.runs > 0) {
+                execute_job(trigger.job_index, &due, now);
+            }
+            // 跳过的也记下来，重启以后不会再算一遍
+            job->last_execute_time = due.last_due_time;
+            is_dirty = true;
+        }
+        if (due.next_fire_time != (time_t)-1) {
+            push_trigger(due.next_fire_time, trigger.job_index);
+        }
+    }
+
+    if (is_dirty) {
+        // 断电后要靠 last_execute_time 判断错过了哪些
+        int error = save_config();
+        if (error != 0) {
+            ESP_LOGE(TAG, "Failed to save last execute time, error=%X", error);
+        }
+    }
+}
+
+static void execute_job(size_t job_index, const ScheduledJobDue* due, time_t now)
+{
+    const ScheduledJob* job = Schedule_job_at(&s_scheduler_status.schedule, job_index);
+    ESP_LOGI(TAG, "A scheduled job started...");
+
+    // 补执行的合并成一次，按次数放大投放量，但不能超过每天的上限
+    double payloads[PUMP_MAX_CHANNELS];
+    for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+        payloads[i] = job->payloads[i] * due->runs;
+    }
+    if (Scheduler_limit_payloads(&s_daily_volumes, now, payloads)) {
+        s_stats.limited_count++;
+        ESP_LOGW(TAG, "Job %d exceeds the daily volume limit of %.1f mL, payloads reduced", (int)job_index,
+            SCHEDULER_MAX_DAILY_VOLUME);
+    }
+
+    // 执行任务
+    if (Pump_start_job((int)job_index, payloads, job->can_parallel) != 0) {
+        ESP_LOGE(TAG, "Failed to start pump!");
+    } else {
+        for (size_t i = 0; i < PUMP_MAX_CHANNELS; i++) {
+            if (payloads[i] > 0.0) {
+                ScheduledVolumeTally_add(&s_daily_volumes, now, i, payloads[i]);
+            }
+        }
+        s_stats.executed_count++;
+        s_stats.last_delay = (int32_t)(now - due->last_due_time);
+        if (s_stats.last_delay > s_stats.max_delay) {
+            s_stats.max_delay = s_stats.last_delay;
+        }
+
+        SchedulerJobEventData data = { .job_index = job_index, .execute_time = due->last_due_time };
+        esp_event_post(BORNEO_SCHEDULER_EVENTS, BORNEO_EVENT_SCHEDULER_JOB_STARTED, &data, sizeof(data), 0);
+    }
+}
+
+/**
+ * 从投放历史里恢复最近 24 小时计划任务的投放量，历史不可用时从 0 开始算
+ */
+static void load_daily_volumes(time_t now)
+{
+    ScheduledVolumeTally_init(&s_daily_volumes);
+    int error = DoseHistory_query(now - SCHEDULER_CATCHUP_WINDOW_SECS, now + SCHEDULER_CATCHUP_WINDOW_SECS,
+        &add_history_volume, &s_daily_volumes);
+    if (error != 0) {
+        ESP_LOGW(TAG, "Failed to load daily volumes from dose history, error=%X", error);
+    }
+}
+
+static int add_history_volume(const DoseRecord* record, void* context)
+{
+    if (record->job != PUMP_JOB_NONE && record->channel < PUMP_MAX_CHANNELS) {
+        ScheduledVolumeTally_add((ScheduledVolumeTally*)context, record->timestamp, record->channel, record->volume);
+    }
+    return 0;
+}
+
+static void push_trigger(time_t fire_time, size_t job_index)
 {
-    ESP_LOGI(TAG, "Saving config...");
+    assert(s_triggers_count < s_triggers_capacity);
+    size_t i = s_triggers_count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (s_triggers[parent].fire_time <= fire_time) {
+            break;
+        }
+        s_triggers[i] = s_triggers[parent];
+        i = parent;
+    }
+    s_triggers[i].fire_time = fire_time;
+    s_triggers[i].job_index = (uint16_t)job_index;
+}
+
+static JobTrigger pop_trigger()
+{
+    assert(s_triggers_count > 0);
+    JobTrigger top = s_triggers[0];
+    JobTrigger last = s_triggers[--s_triggers_count];
+    size_t i = 0;
+    for (;;) {
+        size_t child = i * 2 + 1;
+        if (child >= s_triggers_count) {
+            break;
+        }
+        if (child + 1 < s_triggers_count && s_triggers[child + 1].fire_time < s_triggers[child].fire_time) {
+            child++;
+        }
+        if (last.fire_time <= s_triggers[child].fire_time) {
+            break;
+        }
+        s_triggers[i] = s_triggers[child];
+        i = child;
+    }
+    if (s_triggers_count > 0) {
+        s_triggers[i] = last;
+    }
+    return top;
+}
 
+static int save_config()
+{
     nvs_handle_t nvs_handle;
     esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
     if (err != ESP_OK) {
         return err;
     }
 
-    err = nvs_set_blob(nvs_handle, NVS_SCHEDULER_CONFIG_KEY, &s_scheduler_status, sizeof(s_scheduler_status));
-
+    const Schedule* sch = &s_scheduler_status.schedule;
+    size_t written_count = 0;
+    char key[16];
+    uint8_t record[SCHEDULER_RECORD_MAX_SIZE];
+    err = reserve_records(sch->jobs_count);
     if (err != ESP_OK) {
-        return err;
+        goto __EXIT;
     }
+    for (size_t i = 0; i < sch->jobs_count; i++) {
+        JobRecordState* state = &s_records[i];
+        uint32_t crc = 0;
+        size_t size = Scheduler_encode_job(Schedule_job_at(sch, i), record, &crc);
+        if (state->is_synced && state->crc == crc) {
+            continue;
+        }
 
-    err = nvs_commit(nvs_handle);
-    if (err != ESP_OK) {
-        return err;
+        snprintf(key, sizeof(key), NVS_SCHEDULER_JOB_KEY_FORMAT, (unsigned)i);
+        if (s_stored_keys_count < i + 1) {
+            s_stored_keys_count = i + 1;
+        }
+        state->is_synced = false;
+        err = nvs_set_blob(nvs_handle, key, record, size);
+        if (err != ESP_OK) {
+            goto __EXIT;
+        }
+        state->crc = crc;
+        state->is_synced = true;
+        written_count++;
+    }
+
+    // 先写任务再写头，写到一半断电的话头里还是原来的个数
+    if (s_stored_jobs_count != sch->jobs_count) {
+        uint8_t header[2] = { SCHEDULER_CONFIG_VERSION, sch->jobs_count };
+        s_stored_jobs_count = -1;
+        err = nvs_set_blob(nvs_handle, NVS_SCHEDULER_HEADER_KEY, header, sizeof(header));
+        if (err != ESP_OK) {
+            goto __EXIT;
+        }
+        s_stored_jobs_count = sch->jobs_count;
+        written_count++;
     }
 
+    // 删掉的任务的记录也不要留在 NVS 里占地方
+    // 从后往前删，中途出错的话 s_stored_keys_count 还是对的
+    while (s_stored_keys_count > sch->jobs_count) {
+        size_t i = s_stored_keys_count - 1;
+        snprintf(key, sizeof(key), NVS_SCHEDULER_JOB_KEY_FORMAT, (unsigned)i);
+        err = nvs_erase_key(nvs_handle, key);
+        if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+            goto __EXIT;
+        }
+        err = ESP_OK;
+        if (i < s_records_capacity) {
+            s_records[i].is_synced = false;
+        }
+        s_stored_keys_count = i;
+        written_count++;
+    }
+
+    if (written_count > 0) {
+        ESP_LOGI(TAG, "Saving config, %d record(s) changed...", (int)written_count);
+        err = nvs_commit(nvs_handle);
+        if (err != ESP_OK) {
+            // 不知道哪些真的写进去了，下次全部重写
+            for (size_t i = 0; i < s_records_capacity; i++) {
+                s_records[i].is_synced = false;
+            }
+            s_stored_jobs_count = -1;
+        }
+    }
+
+__EXIT:
     nvs_close(nvs_handle);
-    return ESP_OK;
+    return err;
 }
 
 static int load_config()
@@ -153,21 +560,216 @@ static int load_config()
         return err;
     }
 
-    size_t size = sizeof(s_scheduler_status);
-    err = nvs_get_blob(nvs_handle, NVS_SCHEDULER_CONFIG_KEY, &s_scheduler_status, &size);
+    s_scheduler_status.schedule.jobs_count = 0;
+
+    uint8_t header[2];
+    size_t size = sizeof(header);
+    err = nvs_get_blob(nvs_handle, NVS_SCHEDULER_HEADER_KEY, header, &size);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        // 没有新格式的配置，看看有没有旧固件留下来的
+        err = migrate_legacy_config(nvs_handle);
+        if (err == ESP_OK) {
+            // 新格式的记录都写好了才删掉旧的，中间断电下次上电会重新迁移
+            err = save_config();
+        }
+        if (err == ESP_OK) {
+            err = nvs_erase_key(nvs_handle, NVS_SCHEDULER_LEGACY_CONFIG_KEY);
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+        return err;
+    }
+    if (err == ESP_ERR_NVS_INVALID_LENGTH || (err == ESP_OK && size != sizeof(header))) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else if (err == ESP_OK && header[0] != SCHEDULER_CONFIG_VERSION) {
+        err = ESP_ERR_INVALID_VERSION;
+    } else if (err == ESP_OK && header[1] > SCHEDULER_MAX_JOBS) {
+        // 更大的上限编译出来的固件写的
+        ESP_LOGE(TAG, "Too many jobs in NVS: %d", header[1]);
+        err = ESP_ERR_INVALID_SIZE;
+    }
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get blob from NVS, error=%X", err);
+        nvs_close(nvs_handle);
         return err;
     }
+    s_stored_jobs_count = header[1];
 
+    err = load_jobs(nvs_handle, header[1]);
     nvs_close(nvs_handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // 有坏掉的记录被丢掉了的话，后面的任务往前挪了，把变了的重新写一遍
+    return save_config();
+}
+
+static int load_jobs(nvs_handle_t nvs_handle, size_t jobs_count)
+{
+    Schedule* sch = &s_scheduler_status.schedule;
+    s_stored_keys_count = jobs_count;
+    int error = reserve_jobs(jobs_count);
+    if (error == ESP_OK) {
+        error = reserve_records(jobs_count);
+    }
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    char key[16];
+    uint8_t record[SCHEDULER_RECORD_MAX_SIZE];
+    for (size_t i = 0; i < jobs_count; i++) {
+        snprintf(key, sizeof(key), NVS_SCHEDULER_JOB_KEY_FORMAT, (unsigned)i);
+        size_t size = sizeof(record);
+        esp_err_t err = nvs_get_blob(nvs_handle, key, record, &size);
+        if (err == ESP_OK) {
+            err = Scheduler_decode_job(record, size, Schedule_job_at(sch, sch->jobs_count));
+        }
+        if (err == ESP_ERR_NVS_NOT_FOUND || err == ESP_ERR_NVS_INVALID_LENGTH || err == ESP_ERR_INVALID_SIZE
+            || err == ESP_ERR_INVALID_CRC || err == ESP_ERR_INVALID_VERSION) {
+            ESP_LOGE(TAG, "Dropping unreadable job record %d, error=%X", (int)i, err);
+            continue;
+        } else if (err != ESP_OK) {
+            return err;
+        }
+
+        // 记录的位置没变、编码也没变（比如名字没被截断）的话就是 NVS 里那条，不用重写
+        if (sch->jobs_count == i) {
+            uint32_t crc = 0;
+            size_t encoded_size = Scheduler_encode_job(Schedule_job_at(sch, i), record, &crc);
+            s_records[i].crc = crc;
+            s_records[i].is_synced = encoded_size == size;
+        }
+        sch->jobs_count++;
+    }
     return ESP_OK;
 }
 
+static int migrate_legacy_config(nvs_handle_t nvs_handle)
+{
+    size_t size = 0;
+    esp_err_t err = nvs_get_blob(nvs_handle, NVS_SCHEDULER_LEGACY_CONFIG_KEY, NULL, &size);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    int version;
+    if (size == sizeof(SchedulerStatusV0)) {
+        version = 0;
+    } else if (size == sizeof(SchedulerStatusV1)) {
+        version = 1;
+    } else {
+        ESP_LOGE(TAG, "Unknown legacy config, size=%d", (int)size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // 旧的配置将近 2KB，不放在栈上
+    void* legacy = malloc(size);
+    if (legacy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(nvs_handle, NVS_SCHEDULER_LEGACY_CONFIG_KEY, legacy, &size);
+    if (err != ESP_OK) {
+        free(legacy);
+        return err;
+    }
+
+    ESP_LOGI(TAG, "Migrating config from version %d...", version);
+    Schedule* sch = &s_scheduler_status.schedule;
+    if (version == 0) {
+        const SchedulerStatusV0* status = (const SchedulerStatusV0*)legacy;
+        size_t jobs_count = status->schedule.jobs_count;
+        if (jobs_count > SCHEDULER_LEGACY_MAX_JOBS) {
+            jobs_count = SCHEDULER_LEGACY_MAX_JOBS;
+        }
+        err = reserve_jobs(jobs_count);
+        if (err != ESP_OK) {
+            goto __EXIT;
+        }
+        sch->jobs_count = (uint16_t)jobs_count;
+        for (size_t i = 0; i < sch->jobs_count; i++) {
+            const ScheduledJobV0* src = &status->schedule.jobs[i];
+            ScheduledJob* dest = Schedule_job_at(sch, i);
+            memset(dest, 0, sizeof(ScheduledJob));
+            Scheduler_copy_job_name(dest->name, src->name, strnlen(src->name, SCHEDULER_LEGACY_MAX_JOB_NAME));
+            dest->can_parallel = src->can_parallel;
+            dest->when = src->when;
+            memcpy(dest->payloads, src->payloads, sizeof(dest->payloads));
+            dest->missed_policy = SCHEDULER_MISSED_SKIP;
+            dest->last_execute_time = src->last_execute_time;
+        }
+    } else {
+        const SchedulerStatusV1* status = (const SchedulerStatusV1*)legacy;
+        size_t jobs_count = status->schedule.jobs_count;
+        if (jobs_count > SCHEDULER_LEGACY_MAX_JOBS) {
+            jobs_count = SCHEDULER_LEGACY_MAX_JOBS;
+        }
+        err = reserve_jobs(jobs_count);
+        if (err != ESP_OK) {
+            goto __EXIT;
+        }
+        sch->jobs_count = (uint16_t)jobs_count;
+        for (size_t i = 0; i < sch->jobs_count; i++) {
+            const ScheduledJobV1* src = &status->schedule.jobs[i];
+            ScheduledJob* dest = Schedule_job_at(sch, i);
+            memset(dest, 0, sizeof(ScheduledJob));
+            Scheduler_copy_job_name(dest->name, src->name, strnlen(src->name, SCHEDULER_LEGACY_MAX_JOB_NAME));
+            dest->can_parallel = src->can_parallel;
+            dest->when = src->when;
+            memcpy(dest->payloads, src->payloads, sizeof(dest->payloads));
+            dest->missed_policy = src->missed_policy;
+            dest->last_execute_time = src->last_execute_time;
+        }
+    }
+
+__EXIT:
+    free(legacy);
+    return err;
+}
+
 static int restore_default_config()
 {
     ESP_LOGI(TAG, "Restoring default config...");
-    memset(&s_scheduler_status, 0, sizeof(s_scheduler_status));
+    // 已经分配的任务块留着，以后还能用
+    s_scheduler_status.schedule.jobs_count = 0;
     s_scheduler_status.is_running = false;
+    // 可能有头坏掉了留下来的任务记录，全部删掉
+    s_stored_keys_count = SCHEDULER_MAX_JOBS;
+    s_stored_jobs_count = -1;
     return save_config();
-}
\ No newline at end of file
+}
+
+/**
+ * 按块分配，保证至少能放下 jobs_count 个任务，已有的块不动
+ */
+static int reserve_jobs(size_t jobs_count)
+{
+    Schedule* sch = &s_scheduler_status.schedule;
+    while (sch->capacity < jobs_count) {
+        ScheduledJob* block = calloc(SCHEDULER_JOBS_PER_BLOCK, sizeof(ScheduledJob));
+        if (block == NULL) {
+            ESP_LOGE(TAG, "Out of memory for %d jobs", (int)jobs_count);
+            return ESP_ERR_NO_MEM;
+        }
+        sch->blocks[sch->capacity / SCHEDULER_JOBS_PER_BLOCK] = block;
+        sch->capacity += SCHEDULER_JOBS_PER_BLOCK;
+    }
+    return ESP_OK;
+}
+
+static int reserve_records(size_t jobs_count)
+{
+    if (s_records_capacity >= jobs_count) {
+        return ESP_OK;
+    }
+    JobRecordState* records = realloc(s_records, sizeof(JobRecordState) * jobs_count);
+    if (records == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&records[s_records_capacity], 0, sizeof(JobRecordState) * (jobs_count - s_records_capacity));
+    s_records = records;
+    s_records_capacity = jobs_count;
+    return ESP_OK;
+}
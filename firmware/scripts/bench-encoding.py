@@ -0,0 +1,112 @@
+import argparse
+import socket
+import statistics
+import time
+
+from rpc_codec import CODECS, RpcError
+
+# 对比 JSON 和 CBOR 两种编码：线上传输的字节数、往返延迟，以及上位机编解码的耗时
+# 设备端的编解码耗时包含在往返延迟里
+
+DEVICE_IP = "192.168.1.8"
+DEVICE_PORT = 1022
+
+
+class Client:
+
+    def __init__(self, host, port, codec, timeout):
+        self.codec = codec
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rx_buf = b''
+        self.bytes_sent = 0
+        self.bytes_received = 0
+        if codec.preamble:
+            self.sock.sendall(codec.preamble)
+            self.bytes_sent += len(codec.preamble)
+
+    def close(self):
+        self.sock.close()
+
+    def call(self, id, method, params):
+        request = self.codec.encode_request(id, method, params)
+        self.sock.sendall(request)
+        self.bytes_sent += len(request)
+        while True:
+            response, consumed = self.codec.try_decode_response(self.rx_buf)
+            if consumed > 0:
+                self.rx_buf = self.rx_buf[consumed:]
+                self.bytes_received += consumed
+                return self.codec.unwrap(response)
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed by device')
+            self.rx_buf += data
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float('nan')
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def bench_device(args, codec):
+    client = Client(args.host, args.port, codec, args.timeout)
+    latencies = []
+    result = None
+    try:
+        for i in range(args.calls):
+            begin = time.perf_counter()
+            id, result = client.call(i + 1, args.method, [])
+            latencies.append(time.perf_counter() - begin)
+            if id != i + 1:
+                raise RpcError(0, 'id mismatch {} != {}'.format(id, i + 1))
+    finally:
+        client.close()
+
+    latencies.sort()
+    print('{:>5}: request {:.1f} B/call, response {:.1f} B/call, latency p50 {:.2f} ms, p99 {:.2f} ms, mean {:.2f} ms'.format(
+        codec.name, client.bytes_sent / args.calls, client.bytes_received / args.calls,
+        percentile(latencies, 50) * 1000, percentile(latencies, 99) * 1000, statistics.mean(latencies) * 1000))
+    return result
+
+
+def bench_host(args, codec, result):
+    # 用设备返回的真实结果在上位机上测编解码，设备端的解析和生成走的是同样的数据
+    request = codec.encode_request(1, args.method, [])
+    response = codec.encode_response(1, result)
+
+    begin = time.perf_counter()
+    for i in range(args.iterations):
+        codec.encode_response(i, result)
+    encode_time = (time.perf_counter() - begin) / args.iterations
+
+    begin = time.perf_counter()
+    for i in range(args.iterations):
+        codec.try_decode_response(response)
+    decode_time = (time.perf_counter() - begin) / args.iterations
+
+    print('{:>5}: request {} B, response {} B, host encode {:.1f} us, host decode {:.1f} us'.format(
+        codec.name, len(request), len(response), encode_time * 1e6, decode_time * 1e6))
+
+
+def main(args):
+    results = {}
+    print('method: {}, calls: {}'.format(args.method, args.calls))
+    for name in args.encodings:
+        results[name] = bench_device(args, CODECS[name])
+    for name in args.encodings:
+        bench_host(args, CODECS[name], results[name])
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo RPC encoding benchmark')
+    parser.add_argument('--host', default=DEVICE_IP)
+    parser.add_argument('--port', type=int, default=DEVICE_PORT)
+    parser.add_argument('--method', default='doser.status')
+    parser.add_argument('--calls', type=int, default=200, help='calls per encoding')
+    parser.add_argument('--iterations', type=int, default=10000, help='host encode/decode iterations')
+    parser.add_argument('--encodings', nargs='+', default=['json', 'cbor'], choices=sorted(CODECS.keys()))
+    parser.add_argument('--timeout', type=float, default=10.0)
+    main(parser.parse_args())
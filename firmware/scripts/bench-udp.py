@@ -0,0 +1,157 @@
+import argparse
+import json
+import random
+import socket
+import statistics
+import struct
+import time
+
+# 对比轮询状态时 UDP 单个数据报和 TCP 调用的延迟：
+#   connect: 和 test.py 的 invoke_async 一样，每次调用都新建一个 TCP 连接
+#   udp:     一个数据报发出请求，一个数据报收回响应，超时用相同的请求序号重发
+# 响应或者请求放不下一个数据报时设备返回 -32001 或 -32003 错误，这里和正式的客户端一样改用 TCP 重新调用
+
+DEVICE_IP = "192.168.1.8"
+DEVICE_PORT = 1022
+DEVICE_UDP_PORT = 1022
+
+ERROR_RESPONSE_TOO_LARGE = -32001
+ERROR_REQUEST_TOO_LARGE = -32003
+
+
+def make_jsonrpc(id, method, params):
+    jsonrpc = {
+        'jsonrpc':      '2.0',
+        'id':           id,
+        'method':       method,
+        'params':       params
+    }
+    return bytes(json.dumps(jsonrpc), 'utf-8')
+
+
+def invoke_tcp(host, port, id, method, params, timeout):
+    with socket.create_connection((host, port), timeout=timeout) as sock:
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        sock.sendall(make_jsonrpc(id, method, params) + b'\0')
+        rx_buf = b''
+        while b'\0' not in rx_buf:
+            data = sock.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed by device')
+            rx_buf += data
+    return json.loads(rx_buf[:rx_buf.find(b'\0')].decode())
+
+
+class UdpClient:
+
+    def __init__(self, host, port, tcp_port, retry_timeout, retries):
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+        self.sock.connect((host, port))
+        self.host = host
+        self.tcp_port = tcp_port
+        self.retry_timeout = retry_timeout
+        self.retries = retries
+        self.next_id = random.getrandbits(32)
+        self.resent = 0
+        self.fallbacks = 0
+
+    def close(self):
+        self.sock.close()
+
+    def invoke(self, id, method, params):
+        request_id = self.next_id
+        self.next_id = (self.next_id + 1) & 0xFFFFFFFF
+        datagram = struct.pack('!I', request_id) + make_jsonrpc(id, method, params)
+        for attempt in range(self.retries + 1):
+            if attempt > 0:
+                self.resent += 1
+            self.sock.send(datagram)
+            deadline = time.perf_counter() + self.retry_timeout
+            while True:
+                remaining = deadline - time.perf_counter()
+                if remaining <= 0:
+                    break
+                self.sock.settimeout(remaining)
+                try:
+                    data = self.sock.recv(2048)
+                except socket.timeout:
+                    break
+                # 之前超时的请求迟到的响应，序号对不上，丢掉
+                if len(data) < 4 or struct.unpack_from('!I', data)[0] != request_id:
+                    continue
+                response = json.loads(data[4:].decode())
+                error = response.get('error')
+                if error is not None and error.get('code') in (ERROR_RESPONSE_TOO_LARGE, ERROR_REQUEST_TOO_LARGE):
+                    self.fallbacks += 1
+                    return invoke_tcp(self.host, self.tcp_port, id, method, params, 10.0)
+                return response
+        raise TimeoutError('No response after {} attempts'.format(self.retries + 1))
+
+
+def check_response(response, id):
+    if 'error' in response:
+        raise RuntimeError(response['error'])
+    if response.get('id') != id:
+        raise RuntimeError('id mismatch {} != {}'.format(response.get('id'), id))
+    return response['result']
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float('nan')
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def report(name, latencies, elapsed):
+    latencies.sort()
+    print('{:>8}: {:.1f} req/s, latency p50 {:.2f} ms, p99 {:.2f} ms, mean {:.2f} ms'.format(
+        name, len(latencies) / elapsed, percentile(latencies, 50) * 1000, percentile(latencies, 99) * 1000,
+        statistics.mean(latencies) * 1000))
+
+
+def bench_connect(args):
+    latencies = []
+    begin = time.perf_counter()
+    for i in range(args.calls):
+        call_begin = time.perf_counter()
+        check_response(invoke_tcp(args.host, args.port, i + 1, args.method, [], args.timeout), i + 1)
+        latencies.append(time.perf_counter() - call_begin)
+    report('connect', latencies, time.perf_counter() - begin)
+
+
+def bench_udp(args):
+    client = UdpClient(args.host, args.udp_port, args.port, args.retry_timeout, args.retries)
+    latencies = []
+    begin = time.perf_counter()
+    try:
+        for i in range(args.calls):
+            call_begin = time.perf_counter()
+            check_response(client.invoke(i + 1, args.method, []), i + 1)
+            latencies.append(time.perf_counter() - call_begin)
+    finally:
+        client.close()
+    report('udp', latencies, time.perf_counter() - begin)
+    print('          resent {}, fell back to tcp {}'.format(client.resent, client.fallbacks))
+
+
+def main(args):
+    print('method: {}, calls: {}'.format(args.method, args.calls))
+    if 'connect' in args.modes:
+        bench_connect(args)
+    if 'udp' in args.modes:
+        bench_udp(args)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo UDP RPC benchmark')
+    parser.add_argument('--host', default=DEVICE_IP)
+    parser.add_argument('--port', type=int, default=DEVICE_PORT)
+    parser.add_argument('--udp-port', type=int, default=DEVICE_UDP_PORT)
+    parser.add_argument('--method', default='doser.status')
+    parser.add_argument('--calls', type=int, default=200, help='calls per mode')
+    parser.add_argument('--retry-timeout', type=float, default=0.2, help='seconds before resending a datagram')
+    parser.add_argument('--retries', type=int, default=3)
+    parser.add_argument('--modes', nargs='+', default=['connect', 'udp'], choices=['connect', 'udp'])
+    parser.add_argument('--timeout', type=float, default=10.0)
+    main(parser.parse_args())
@@ -0,0 +1,233 @@
+import argparse
+import base64
+import hashlib
+import json
+import os
+import socket
+import statistics
+import struct
+import time
+
+# 对比三种调用方式的吞吐量和延迟：
+#   connect: 和 test.py 的 invoke_async 一样，每次调用都新建一个 TCP 连接
+#   tcp:     一个 TCP 连接上顺序调用
+#   ws:      一个 WebSocket 连接上流水线调用，同时最多有 --window 个请求在路上，--window 1 就是顺序调用
+
+DEVICE_IP = "192.168.1.8"
+DEVICE_PORT = 1022
+DEVICE_WS_PORT = 1023
+
+WEBSOCKET_GUID = b'258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+OPCODE_CONTINUATION = 0x0
+OPCODE_TEXT = 0x1
+OPCODE_CLOSE = 0x8
+OPCODE_PING = 0x9
+OPCODE_PONG = 0xA
+
+
+def make_jsonrpc(id, method, params):
+    jsonrpc = {
+        'jsonrpc':      '2.0',
+        'id':           id,
+        'method':       method,
+        'params':       params
+    }
+    return bytes(json.dumps(jsonrpc), 'utf-8')
+
+
+def check_response(data, id):
+    response = json.loads(data.decode())
+    if 'error' in response:
+        raise RuntimeError(response['error'])
+    if response.get('id') != id:
+        raise RuntimeError('id mismatch {} != {}'.format(response.get('id'), id))
+    return response['result']
+
+
+class TcpClient:
+
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rx_buf = b''
+
+    def close(self):
+        self.sock.close()
+
+    def send(self, id, method, params):
+        self.sock.sendall(make_jsonrpc(id, method, params) + b'\0')
+
+    def receive(self):
+        while True:
+            end = self.rx_buf.find(b'\0')
+            if end >= 0:
+                message = self.rx_buf[:end]
+                self.rx_buf = self.rx_buf[end + 1:]
+                return message
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed by device')
+            self.rx_buf += data
+
+
+class WebSocketClient:
+
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.rx_buf = b''
+        self.handshake(host, port)
+
+    def close(self):
+        try:
+            self.send_frame(OPCODE_CLOSE, struct.pack('!H', 1000))
+        finally:
+            self.sock.close()
+
+    def handshake(self, host, port):
+        key = base64.b64encode(os.urandom(16))
+        request = ('GET / HTTP/1.1\r\n'
+                   'Host: {}:{}\r\n'
+                   'Upgrade: websocket\r\n'
+                   'Connection: Upgrade\r\n'
+                   'Sec-WebSocket-Key: {}\r\n'
+                   'Sec-WebSocket-Version: 13\r\n'
+                   '\r\n').format(host, port, key.decode())
+        self.sock.sendall(request.encode())
+        while b'\r\n\r\n' not in self.rx_buf:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed during handshake')
+            self.rx_buf += data
+        head, self.rx_buf = self.rx_buf.split(b'\r\n\r\n', 1)
+        lines = head.decode().split('\r\n')
+        if not lines[0].startswith('HTTP/1.1 101'):
+            raise ConnectionError('Handshake rejected: {}'.format(lines[0]))
+        accept = base64.b64encode(hashlib.sha1(key + WEBSOCKET_GUID).digest()).decode()
+        headers = dict(line.split(':', 1) for line in lines[1:])
+        if headers.get('Sec-WebSocket-Accept', '').strip() != accept:
+            raise ConnectionError('Bad Sec-WebSocket-Accept')
+
+    def send(self, id, method, params):
+        self.send_frame(OPCODE_TEXT, make_jsonrpc(id, method, params))
+
+    def send_frame(self, opcode, payload):
+        # 客户端发出的帧必须加掩码
+        mask = os.urandom(4)
+        size = len(payload)
+        if size < 126:
+            head = struct.pack('!BB', 0x80 | opcode, 0x80 | size)
+        elif size < 65536:
+            head = struct.pack('!BBH', 0x80 | opcode, 0x80 | 126, size)
+        else:
+            head = struct.pack('!BBQ', 0x80 | opcode, 0x80 | 127, size)
+        masked = bytes(b ^ mask[i & 3] for i, b in enumerate(payload))
+        self.sock.sendall(head + mask + masked)
+
+    def read_exact(self, size):
+        while len(self.rx_buf) < size:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError('Connection closed by device')
+            self.rx_buf += data
+        data, self.rx_buf = self.rx_buf[:size], self.rx_buf[size:]
+        return data
+
+    def receive(self):
+        # 设备发送大的响应时会分片，把分片拼成完整的消息
+        message = b''
+        while True:
+            b0, b1 = self.read_exact(2)
+            size = b1 & 0x7F
+            if size == 126:
+                size, = struct.unpack('!H', self.read_exact(2))
+            elif size == 127:
+                size, = struct.unpack('!Q', self.read_exact(8))
+            payload = self.read_exact(size)
+            opcode = b0 & 0x0F
+            if opcode == OPCODE_PING:
+                self.send_frame(OPCODE_PONG, payload)
+                continue
+            if opcode == OPCODE_CLOSE:
+                raise ConnectionError('Closed by device: {}'.format(payload))
+            if opcode == OPCODE_PONG:
+                continue
+            message += payload
+            if b0 & 0x80:
+                return message
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float('nan')
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def report(name, latencies, elapsed):
+    latencies.sort()
+    print('{:>8}: {:.1f} req/s, latency p50 {:.2f} ms, p99 {:.2f} ms, mean {:.2f} ms'.format(
+        name, len(latencies) / elapsed, percentile(latencies, 50) * 1000, percentile(latencies, 99) * 1000,
+        statistics.mean(latencies) * 1000))
+
+
+def bench_connect(args):
+    latencies = []
+    begin = time.perf_counter()
+    for i in range(args.calls):
+        call_begin = time.perf_counter()
+        client = TcpClient(args.host, args.port, args.timeout)
+        try:
+            client.send(i + 1, args.method, [])
+            check_response(client.receive(), i + 1)
+        finally:
+            client.close()
+        latencies.append(time.perf_counter() - call_begin)
+    report('connect', latencies, time.perf_counter() - begin)
+
+
+def bench_persistent(name, client, args, window):
+    # 响应按请求的顺序返回，记下每个请求的发送时间就能算出延迟
+    latencies = []
+    sent_times = []
+    sent = 0
+    received = 0
+    begin = time.perf_counter()
+    try:
+        while received < args.calls:
+            while sent < args.calls and sent - received < window:
+                sent_times.append(time.perf_counter())
+                client.send(sent + 1, args.method, [])
+                sent += 1
+            check_response(client.receive(), received + 1)
+            latencies.append(time.perf_counter() - sent_times[received])
+            received += 1
+    finally:
+        client.close()
+    report(name, latencies, time.perf_counter() - begin)
+
+
+def main(args):
+    print('method: {}, calls: {}, window: {}'.format(args.method, args.calls, args.window))
+    if 'connect' in args.modes:
+        bench_connect(args)
+    if 'tcp' in args.modes:
+        bench_persistent('tcp', TcpClient(args.host, args.port, args.timeout), args, 1)
+    if 'ws' in args.modes:
+        bench_persistent('ws', WebSocketClient(args.host, args.ws_port, args.timeout), args, 1)
+        if args.window > 1:
+            bench_persistent('ws-pipe', WebSocketClient(args.host, args.ws_port, args.timeout), args, args.window)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo RPC WebSocket benchmark')
+    parser.add_argument('--host', default=DEVICE_IP)
+    parser.add_argument('--port', type=int, default=DEVICE_PORT)
+    parser.add_argument('--ws-port', type=int, default=DEVICE_WS_PORT)
+    parser.add_argument('--method', default='doser.status')
+    parser.add_argument('--calls', type=int, default=200, help='calls per mode')
+    parser.add_argument('--window', type=int, default=4, help='requests in flight on the pipelined WebSocket')
+    parser.add_argument('--modes', nargs='+', default=['connect', 'tcp', 'ws'], choices=['connect', 'tcp', 'ws'])
+    parser.add_argument('--timeout', type=float, default=10.0)
+    main(parser.parse_args())
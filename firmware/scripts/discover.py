@@ -0,0 +1,147 @@
+import argparse
+import socket
+import struct
+import time
+
+# mDNS/DNS-SD 查询：向局域网查询 _borneo._tcp.local，打印应答的设备和第一个应答到达的时间
+# 不依赖第三方库，也可以用来检查设备端的应答是否正确
+
+MDNS_ADDR = '224.0.0.251'
+MDNS_PORT = 5353
+SERVICE = '_borneo._tcp.local'
+
+TYPE_A = 1
+TYPE_PTR = 12
+TYPE_TXT = 16
+TYPE_SRV = 33
+CLASS_IN = 1
+
+
+def encode_name(name):
+    data = b''
+    for label in name.rstrip('.').split('.'):
+        encoded = label.encode()
+        data += struct.pack('!B', len(encoded)) + encoded
+    return data + b'\0'
+
+
+def make_query(name):
+    # id 为 0，没有标志位，一个问题
+    header = struct.pack('!HHHHHH', 0, 0, 1, 0, 0, 0)
+    return header + encode_name(name) + struct.pack('!HH', TYPE_PTR, CLASS_IN)
+
+
+def decode_name(data, offset):
+    labels = []
+    end = None
+    for _ in range(128):
+        length = data[offset]
+        if length & 0xC0 == 0xC0:
+            # 压缩指针
+            if end is None:
+                end = offset + 2
+            offset = ((length & 0x3F) << 8) | data[offset + 1]
+            continue
+        offset += 1
+        if length == 0:
+            break
+        labels.append(data[offset:offset + length].decode(errors='replace'))
+        offset += length
+    return '.'.join(labels), end if end is not None else offset
+
+
+def decode_records(data):
+    id, flags, qdcount, ancount, nscount, arcount = struct.unpack_from('!HHHHHH', data, 0)
+    offset = 12
+    for _ in range(qdcount):
+        _, offset = decode_name(data, offset)
+        offset += 4
+    records = []
+    for _ in range(ancount + nscount + arcount):
+        name, offset = decode_name(data, offset)
+        rtype, rclass, ttl, rdlength = struct.unpack_from('!HHIH', data, offset)
+        offset += 10
+        rdata_offset = offset
+        offset += rdlength
+        if rtype == TYPE_PTR:
+            value, _ = decode_name(data, rdata_offset)
+        elif rtype == TYPE_SRV:
+            priority, weight, port = struct.unpack_from('!HHH', data, rdata_offset)
+            target, _ = decode_name(data, rdata_offset + 6)
+            value = (target, port)
+        elif rtype == TYPE_TXT:
+            value = {}
+            pos = rdata_offset
+            while pos < offset:
+                length = data[pos]
+                item = data[pos + 1:pos + 1 + length].decode(errors='replace')
+                key, _, item_value = item.partition('=')
+                value[key] = item_value
+                pos += 1 + length
+        elif rtype == TYPE_A:
+            value = socket.inet_ntoa(data[rdata_offset:rdata_offset + 4])
+        else:
+            continue
+        records.append((name, rtype, value))
+    return records
+
+
+def discover(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 255)
+    if args.interface:
+        sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF, socket.inet_aton(args.interface))
+    # 源端口不是 5353 的查询，应答方会直接单播回到这个端口（RFC 6762 6.7），不用加入组播组
+    sock.bind(('', 0))
+    sock.settimeout(0.05)
+
+    begin = time.perf_counter()
+    sock.sendto(make_query(SERVICE), (MDNS_ADDR, MDNS_PORT))
+
+    instances = {}
+    services = {}
+    texts = {}
+    addresses = {}
+    first_answer = None
+    while time.perf_counter() - begin < args.timeout:
+        try:
+            data, addr = sock.recvfrom(9000)
+        except socket.timeout:
+            continue
+        try:
+            records = decode_records(data)
+        except (IndexError, struct.error):
+            continue
+        for name, rtype, value in records:
+            if rtype == TYPE_PTR and name.lower() == SERVICE.lower():
+                if value not in instances:
+                    instances[value] = addr[0]
+                    if first_answer is None:
+                        first_answer = time.perf_counter() - begin
+            elif rtype == TYPE_SRV:
+                services[name] = value
+            elif rtype == TYPE_TXT:
+                texts[name] = value
+            elif rtype == TYPE_A:
+                addresses[name] = value
+    sock.close()
+
+    for instance, source in instances.items():
+        target, port = services.get(instance, ('?', 0))
+        txt = texts.get(instance, {})
+        print('{}\n    host: {} ({}), port: {}, from: {}'.format(
+            instance, target, addresses.get(target, '?'), port, source))
+        for key in sorted(txt.keys()):
+            print('    {}: {}'.format(key, txt[key]))
+    if first_answer is None:
+        print('No device found in {:.1f} s'.format(args.timeout))
+    else:
+        print('{} device(s), first answer after {:.1f} ms'.format(len(instances), first_answer * 1000))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo mDNS discovery')
+    parser.add_argument('--timeout', type=float, default=1.0, help='seconds to collect answers')
+    parser.add_argument('--interface', default=None, help='local IPv4 address to send the query from')
+    discover(parser.parse_args())
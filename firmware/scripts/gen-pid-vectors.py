@@ -0,0 +1,179 @@
+import argparse
+import random
+import struct
+
+# 生成 components/borneo/test/pid-vectors.h：FastPid 的黄金测试向量
+# 这里是按 components/borneo/src/pid.c 的定点流水线独立写的参考实现，不调用固件代码：
+#   参数换算按 float32 计算，和 C 里的 float 运算逐位相同
+#   P 项按 32 位补码回绕，和 ESP32 上 int32 乘法溢出的结果相同
+# FastPid_step() 和 FastPidBank_step() 都必须逐位重现这些输出，改了 PID 的算法就要重新生成并说明原因
+
+PARAM_SHIFT = 8
+PARAM_BITS = 16
+PARAM_MAX = ((1 << PARAM_BITS) - 1) >> PARAM_SHIFT
+PARAM_MULT = (1 << PARAM_BITS) >> (PARAM_BITS - PARAM_SHIFT)
+INT32_MAX = 2**31 - 1
+INT32_MIN = -2**31
+INT16_MAX = 2**15 - 1
+INT16_MIN = -2**15
+
+STEPS = 128
+OUTPUT = 'components/borneo/test/pid-vectors.h'
+
+# kp, ki, kd, hz, bits, sign, 积分范围（None 表示默认的 int32 范围）
+CONFIGS = [
+    (1.0, 0.0, 0.0, 20.0, 16, True, None),
+    (0.5, 2.0, 0.0, 20.0, 16, True, None),
+    (0.8, 1.5, 0.02, 20.0, 16, True, (-2000, 2000)),
+    (2.0, 0.4, 0.01, 20.0, 16, True, (100, 3000)),  # 积分范围不含 0
+    (255.0, 0.0, 0.0, 20.0, 16, True, None),  # P 项会回绕
+    (0.1, 5.0, 0.5, 50.0, 12, False, None),
+    (3.3, 0.7, 0.05, 20.0, 8, True, (-100, 100)),
+    (0.0, 0.0, 0.0, 20.0, 16, True, None),  # 全是 0
+]
+
+
+def f32(value):
+    return struct.unpack('f', struct.pack('f', value))[0]
+
+
+def wrap32(value):
+    value &= 0xFFFFFFFF
+    return value - 0x100000000 if value & 0x80000000 else value
+
+
+def trunc16(value):
+    value &= 0xFFFF
+    return value - 0x10000 if value & 0x8000 else value
+
+
+class FastPid:
+
+    def __init__(self, kp, ki, kd, hz, bits, sign, integral):
+        self.cfg_err = False
+        self.p = self._param(f32(kp))
+        self.i = self._param(f32(f32(ki) / f32(hz)))
+        self.d = self._param(f32(f32(kd) * f32(hz)))
+        if bits == 16:
+            self.outmax = (0xFFFF >> (17 - bits)) * PARAM_MULT
+        else:
+            self.outmax = (0xFFFF >> (16 - bits)) * PARAM_MULT
+        self.outmin = -((0xFFFF >> (17 - bits)) + 1) * PARAM_MULT if sign else 0
+        self.integ_min, self.integ_max = INT32_MIN, INT32_MAX
+        if integral is not None:
+            self.integ_min = integral[0] * PARAM_MULT
+            self.integ_max = integral[1] * PARAM_MULT
+        if self.cfg_err:
+            self.p = self.i = self.d = 0
+        self.last_sp = 0
+        self.last_err = 0
+        self.sum = 0
+
+    def _param(self, value):
+        if value > PARAM_MAX or value < 0:
+            self.cfg_err = True
+            return 0
+        param = int(f32(value * PARAM_MULT))
+        if value != 0 and param == 0:
+            self.cfg_err = True
+            return 0
+        return param
+
+    def step(self, sp, fb):
+        err = sp - fb
+        p = wrap32(self.p * err) if self.p else 0
+        i = 0
+        d = 0
+        if self.i:
+            self.sum += err * self.i
+            self.sum = max(self.integ_min, min(self.integ_max, self.sum))
+            i = self.sum
+        if self.d:
+            deriv = (err - self.last_err) - (sp - self.last_sp)
+            self.last_sp = sp
+            self.last_err = err
+            deriv = max(INT16_MIN, min(INT16_MAX, deriv))
+            d = self.d * deriv
+        out = max(self.outmin, min(self.outmax, p + i + d))
+        rval = trunc16(out >> PARAM_SHIFT)
+        if out & (1 << (PARAM_SHIFT - 1)):
+            rval = trunc16(rval + 1)
+        return rval
+
+
+def random_inputs(rng):
+    # 大部分是设定值附近的小扰动，也有阶跃、极值和设定值的跳变
+    sp = rng.randint(-2000, 2000)
+    fb = sp
+    for _ in range(STEPS):
+        kind = rng.random()
+        if kind < 0.05:
+            sp = rng.choice([INT16_MIN, INT16_MAX, 0])
+        elif kind < 0.15:
+            sp = rng.randint(INT16_MIN, INT16_MAX)
+        elif kind < 0.20:
+            fb = rng.choice([INT16_MIN, INT16_MAX, 0])
+        else:
+            fb = max(INT16_MIN, min(INT16_MAX, fb + (sp - fb) // 4 + rng.randint(-200, 200)))
+        yield sp, fb
+
+
+def format_float(value):
+    return '{!r}f'.format(float(value))
+
+
+def main(args):
+    rng = random.Random(args.seed)
+    lines = [
+        '#pragma once',
+        '',
+        '// 由 scripts/gen-pid-vectors.py 生成，不要手工修改',
+        '// 每组配置从复位状态开始连续执行 PID_VECTOR_STEPS 步，out 是期望的输出',
+        '',
+        '#define PID_VECTOR_STEPS {}'.format(STEPS),
+        '#define PID_VECTOR_CONFIGS {}'.format(len(CONFIGS)),
+        '',
+        'typedef struct {',
+        '    float kp, ki, kd, hz;',
+        '    int bits;',
+        '    bool sign;',
+        '    bool has_integral_range;',
+        '    int16_t integral_min, integral_max;',
+        '    uint32_t p, i, d; // 换算以后的定点参数',
+        '} PidVectorConfig;',
+        '',
+        'typedef struct {',
+        '    int16_t sp, fb, out;',
+        '} PidVectorStep;',
+        '',
+        'static const PidVectorConfig PID_VECTOR_CONFIG_TABLE[PID_VECTOR_CONFIGS] = {',
+    ]
+    pids = []
+    for kp, ki, kd, hz, bits, sign, integral in CONFIGS:
+        pid = FastPid(kp, ki, kd, hz, bits, sign, integral)
+        assert not pid.cfg_err
+        pids.append(pid)
+        lines.append('    {{ {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {}, {} }},'.format(
+            format_float(kp), format_float(ki), format_float(kd), format_float(hz), bits,
+            'true' if sign else 'false', 'true' if integral else 'false',
+            integral[0] if integral else 0, integral[1] if integral else 0, pid.p, pid.i, pid.d))
+    lines.append('};')
+    lines.append('')
+    lines.append('static const PidVectorStep PID_VECTOR_STEP_TABLE[PID_VECTOR_CONFIGS][PID_VECTOR_STEPS] = {')
+    for pid in pids:
+        lines.append('    {')
+        steps = ['{{ {}, {}, {} }}'.format(sp, fb, pid.step(sp, fb)) for sp, fb in random_inputs(rng)]
+        for i in range(0, len(steps), 4):
+            lines.append('        ' + ', '.join(steps[i:i + 4]) + ',')
+        lines.append('    },')
+    lines.append('};')
+
+    with open(args.output, 'w', newline='\n') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Generate FastPid golden vectors')
+    parser.add_argument('--seed', type=int, default=20240817)
+    parser.add_argument('--output', default=OUTPUT)
+    main(parser.parse_args())
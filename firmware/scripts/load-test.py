@@ -0,0 +1,92 @@
+import argparse
+import asyncio
+import json
+import statistics
+import time
+
+# 多客户端并发压力测试：同时打开多个 TCP 连接，每个连接顺序调用 RPC 方法，统计延迟分布
+
+DEVICE_IP = "192.168.1.8"
+DEVICE_PORT = 1022
+
+
+def make_jsonrpc(id, method, params):
+    jsonrpc = {
+        'jsonrpc':      '2.0',
+        'id':           id,
+        'method':       method,
+        'params':       params
+    }
+    return bytes(json.dumps(jsonrpc), 'utf-8') + b'\0'
+
+
+async def run_client(client_id, args, latencies, errors):
+    try:
+        fut = asyncio.open_connection(args.host, args.port)
+        reader, writer = await asyncio.wait_for(fut, timeout=10)
+    except (OSError, asyncio.TimeoutError) as e:
+        errors.append('client {}: connect failed: {}'.format(client_id, e))
+        return
+
+    try:
+        for i in range(args.calls):
+            request_id = client_id * args.calls + i + 1
+            begin = time.perf_counter()
+            writer.write(make_jsonrpc(request_id, args.method, []))
+            await writer.drain()
+            rx_buf = await asyncio.wait_for(reader.readuntil(separator=b'\0'), timeout=args.timeout)
+            latencies.append(time.perf_counter() - begin)
+
+            response = json.loads(rx_buf[:-1].decode())
+            if 'error' in response:
+                errors.append('client {}: {}'.format(client_id, response['error']))
+            elif response.get('id') != request_id:
+                errors.append('client {}: id mismatch {} != {}'.format(client_id, response.get('id'), request_id))
+
+            # 模拟空闲的客户端，占着连接不发请求
+            if args.think > 0:
+                await asyncio.sleep(args.think)
+    except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError) as e:
+        errors.append('client {}: {}'.format(client_id, e))
+    finally:
+        writer.close()
+        await writer.wait_closed()
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return float('nan')
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+async def main(args):
+    latencies = []
+    errors = []
+    begin = time.perf_counter()
+    await asyncio.gather(*[run_client(i, args, latencies, errors) for i in range(args.clients)])
+    elapsed = time.perf_counter() - begin
+
+    latencies.sort()
+    print('clients: {}, calls per client: {}, method: {}'.format(args.clients, args.calls, args.method))
+    print('completed: {}, errors: {}, elapsed: {:.3f} s, throughput: {:.1f} req/s'.format(
+        len(latencies), len(errors), elapsed, len(latencies) / elapsed if elapsed > 0 else 0))
+    if latencies:
+        print('latency p50: {:.2f} ms, p99: {:.2f} ms, max: {:.2f} ms, mean: {:.2f} ms'.format(
+            percentile(latencies, 50) * 1000, percentile(latencies, 99) * 1000,
+            latencies[-1] * 1000, statistics.mean(latencies) * 1000))
+    for e in errors[:10]:
+        print(e)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo JSON-RPC server load test')
+    parser.add_argument('--host', default=DEVICE_IP)
+    parser.add_argument('--port', type=int, default=DEVICE_PORT)
+    parser.add_argument('--clients', type=int, default=8, help='number of concurrent connections')
+    parser.add_argument('--calls', type=int, default=50, help='calls per connection')
+    parser.add_argument('--method', default='sys.hello')
+    parser.add_argument('--think', type=float, default=0.0, help='idle seconds between calls')
+    parser.add_argument('--timeout', type=float, default=30.0)
+    loop = asyncio.get_event_loop()
+    loop.run_until_complete(main(parser.parse_args()))
@@ -0,0 +1,109 @@
+import argparse
+import json
+import socket
+import time
+
+# 局域网发现的上位机测试：
+#   probe: 往设备的探测端口发送探测包，检查单播回复的内容和往返时间
+#   watch: 监听广播端口，统计每台设备主动广播的信标个数、间隔和字节数，用来确认广播在退避
+
+PROBE_PORT = 9061
+BEACON_PORT = 9060
+PROBE = b'{"MagicWord":9966,"Probe":1}'
+
+
+def parse_beacon(data):
+    beacon = json.loads(data.decode())
+    if beacon.get('MagicWord') != 9966:
+        raise ValueError('bad magic word')
+    message = beacon['Message']
+    for key in ('Ts', 'TcpPort', 'Serial', 'DevName'):
+        if key not in message:
+            raise ValueError('missing {}'.format(key))
+    return message
+
+
+def probe(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    sock.bind(('', 0))
+    sock.settimeout(0.05)
+
+    rtts = []
+    devices = {}
+    for _ in range(args.count):
+        begin = time.perf_counter()
+        sock.sendto(PROBE, (args.host, PROBE_PORT))
+        while time.perf_counter() - begin < args.timeout:
+            try:
+                data, addr = sock.recvfrom(1024)
+            except socket.timeout:
+                continue
+            try:
+                message = parse_beacon(data)
+            except (ValueError, KeyError) as e:
+                print('Bad reply from {}: {}'.format(addr[0], e))
+                continue
+            rtts.append(time.perf_counter() - begin)
+            devices[addr[0]] = message
+    sock.close()
+
+    for ip, message in devices.items():
+        print('{}: {} serial {} tcp {} ws {} ts {}'.format(
+            ip, message['DevName'], message['Serial'], message['TcpPort'], message.get('WsPort'), message['Ts']))
+    if rtts:
+        rtts.sort()
+        print('{} device(s), replies {}, rtt min {:.1f} ms, median {:.1f} ms'.format(
+            len(devices), len(rtts), rtts[0] * 1000, rtts[len(rtts) // 2] * 1000))
+    else:
+        print('No reply in {:.1f} s'.format(args.timeout))
+
+
+def watch(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind(('', BEACON_PORT))
+    sock.settimeout(0.5)
+
+    beacons = {}
+    begin = time.time()
+    while time.time() - begin < args.duration:
+        try:
+            data, addr = sock.recvfrom(1024)
+        except socket.timeout:
+            continue
+        try:
+            message = parse_beacon(data)
+        except (ValueError, KeyError):
+            continue
+        now = time.time() - begin
+        times, size = beacons.get(message['Serial'], ([], 0))
+        times.append(now)
+        beacons[message['Serial']] = (times, size + len(data))
+        print('{:8.1f} s  {} {}'.format(now, addr[0], message['Serial']))
+    sock.close()
+
+    print('')
+    for serial, (times, size) in beacons.items():
+        intervals = ['{:.0f}'.format(b - a) for a, b in zip(times, times[1:])]
+        print('{}: {} beacons, {} bytes in {:.0f} s, intervals: {}'.format(
+            serial, len(times), size, args.duration, ' '.join(intervals)))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo discovery probe')
+    subparsers = parser.add_subparsers(dest='command', required=True)
+
+    probe_parser = subparsers.add_parser('probe', help='send probes and check the replies')
+    probe_parser.add_argument('--host', default='255.255.255.255', help='device address, broadcast by default')
+    probe_parser.add_argument('--count', type=int, default=10)
+    probe_parser.add_argument('--timeout', type=float, default=0.5, help='seconds to wait for replies per probe')
+
+    watch_parser = subparsers.add_parser('watch', help='count unprompted beacons')
+    watch_parser.add_argument('--duration', type=float, default=300.0)
+
+    args = parser.parse_args()
+    if args.command == 'probe':
+        probe(args)
+    else:
+        watch(args)
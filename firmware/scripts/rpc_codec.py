@@ -0,0 +1,242 @@
+import json
+import math
+import struct
+
+# 上位机用的 RPC 编解码，不依赖第三方库
+#
+# JSON 编码：每个请求和响应都是以 '\0' 结尾的 JSON-RPC 2.0 文本
+# CBOR 编码：连接建立后先发送 CBOR 自描述标签 D9 D9 F7，之后每个请求是两字节大端序长度加上 CBOR 数据，
+#           请求为 [id, method, params]，批量调用为请求的数组
+#           响应直接就是一串 CBOR 数据项，成功为 [id, result]，失败为 [id, code, message]
+# 订阅之后设备会在响应之间插入通知：JSON 是没有 id 的 JSON-RPC 请求，CBOR 是 [method, params]
+
+CBOR_MAGIC = b'\xd9\xd9\xf7'
+
+
+class RpcError(Exception):
+
+    def __init__(self, code, message):
+        super().__init__('{}: {}'.format(code, message))
+        self.code = code
+        self.message = message
+
+
+def _cbor_head(major_type, value):
+    major_type <<= 5
+    if value < 24:
+        return bytes([major_type | value])
+    elif value <= 0xFF:
+        return bytes([major_type | 24, value])
+    elif value <= 0xFFFF:
+        return bytes([major_type | 25]) + struct.pack('>H', value)
+    elif value <= 0xFFFFFFFF:
+        return bytes([major_type | 26]) + struct.pack('>I', value)
+    return bytes([major_type | 27]) + struct.pack('>Q', value)
+
+
+def cbor_dumps(value):
+    if value is None:
+        return b'\xf6'
+    elif value is True:
+        return b'\xf5'
+    elif value is False:
+        return b'\xf4'
+    elif isinstance(value, int):
+        return _cbor_head(0, value) if value >= 0 else _cbor_head(1, -1 - value)
+    elif isinstance(value, float):
+        if math.isfinite(value) and struct.unpack('>f', struct.pack('>f', value))[0] == value:
+            return b'\xfa' + struct.pack('>f', value)
+        return b'\xfb' + struct.pack('>d', value)
+    elif isinstance(value, str):
+        encoded = value.encode('utf-8')
+        return _cbor_head(3, len(encoded)) + encoded
+    elif isinstance(value, bytes):
+        return _cbor_head(2, len(value)) + value
+    elif isinstance(value, (list, tuple)):
+        return _cbor_head(4, len(value)) + b''.join(cbor_dumps(x) for x in value)
+    elif isinstance(value, dict):
+        return _cbor_head(5, len(value)) + b''.join(cbor_dumps(k) + cbor_dumps(v) for k, v in value.items())
+    raise TypeError('Unsupported type: {}'.format(type(value)))
+
+
+class _NeedMoreData(Exception):
+    pass
+
+
+_BREAK = object()
+
+
+class _CborDecoder:
+
+    def __init__(self, data, pos=0):
+        self.data = data
+        self.pos = pos
+
+    def _take(self, size):
+        if self.pos + size > len(self.data):
+            raise _NeedMoreData()
+        chunk = self.data[self.pos:self.pos + size]
+        self.pos += size
+        return chunk
+
+    def decode(self):
+        initial = self._take(1)[0]
+        major_type = initial >> 5
+        info = initial & 0x1F
+        if initial == 0xFF:
+            return _BREAK
+
+        if major_type == 7:
+            if info == 20:
+                return False
+            elif info == 21:
+                return True
+            elif info in (22, 23):
+                return None
+            elif info == 25:
+                return struct.unpack('>e', self._take(2))[0]
+            elif info == 26:
+                return struct.unpack('>f', self._take(4))[0]
+            elif info == 27:
+                return struct.unpack('>d', self._take(8))[0]
+            raise ValueError('Unsupported simple value: {}'.format(info))
+
+        if info < 24:
+            argument = info
+        elif info == 31:
+            argument = None
+        else:
+            size = {24: 1, 25: 2, 26: 4, 27: 8}.get(info)
+            if size is None:
+                raise ValueError('Invalid additional information: {}'.format(info))
+            argument = int.from_bytes(self._take(size), 'big')
+
+        if major_type == 0:
+            return argument
+        elif major_type == 1:
+            return -1 - argument
+        elif major_type in (2, 3):
+            if argument is None:
+                chunks = []
+                while True:
+                    chunk = self.decode()
+                    if chunk is _BREAK:
+                        break
+                    chunks.append(chunk)
+                return ''.join(chunks) if major_type == 3 else b''.join(chunks)
+            raw = self._take(argument)
+            return raw.decode('utf-8') if major_type == 3 else bytes(raw)
+        elif major_type == 4:
+            items = []
+            while argument is None or len(items) < argument:
+                item = self.decode()
+                if item is _BREAK:
+                    break
+                items.append(item)
+            return items
+        elif major_type == 5:
+            items = {}
+            count = 0
+            while argument is None or count < argument:
+                key = self.decode()
+                if key is _BREAK:
+                    break
+                items[key] = self.decode()
+                count += 1
+            return items
+        else:
+            # 标签只做语义提示，直接返回被标记的数据
+            return self.decode()
+
+
+def cbor_loads(data):
+    decoder = _CborDecoder(data)
+    value = decoder.decode()
+    if decoder.pos != len(data):
+        raise ValueError('Trailing data')
+    return value
+
+
+def cbor_try_decode(data):
+    '''
+    从流里解码一个数据项，数据不完整时返回 (None, 0)，否则返回 (value, consumed)
+    '''
+    decoder = _CborDecoder(data)
+    try:
+        value = decoder.decode()
+    except _NeedMoreData:
+        return None, 0
+    return value, decoder.pos
+
+
+class JsonCodec:
+    name = 'json'
+    preamble = b''
+
+    def encode_request(self, id, method, params):
+        request = {'jsonrpc': '2.0', 'id': id, 'method': method, 'params': params}
+        return json.dumps(request, separators=(',', ':')).encode('utf-8') + b'\0'
+
+    def encode_batch(self, calls):
+        requests = [{'jsonrpc': '2.0', 'id': id, 'method': method, 'params': params} for id, method, params in calls]
+        return json.dumps(requests, separators=(',', ':')).encode('utf-8') + b'\0'
+
+    def encode_response(self, id, result):
+        response = {'jsonrpc': '2.0', 'id': id, 'result': result}
+        return json.dumps(response, separators=(',', ':')).encode('utf-8') + b'\0'
+
+    def try_decode_response(self, buf):
+        end = buf.find(b'\0')
+        if end < 0:
+            return None, 0
+        return json.loads(buf[:end].decode('utf-8')), end + 1
+
+    def is_notification(self, message):
+        return isinstance(message, dict) and 'method' in message
+
+    def unwrap_notification(self, message):
+        return message['method'], message.get('params')
+
+    def unwrap(self, response):
+        if 'error' in response:
+            raise RpcError(response['error']['code'], response['error']['message'])
+        return response.get('id'), response.get('result')
+
+
+class CborCodec:
+    name = 'cbor'
+    preamble = CBOR_MAGIC
+
+    def _frame(self, payload):
+        if len(payload) > 0xFFFF:
+            raise ValueError('Request too large')
+        return struct.pack('>H', len(payload)) + payload
+
+    def encode_request(self, id, method, params):
+        return self._frame(cbor_dumps([id, method, params]))
+
+    def encode_batch(self, calls):
+        return self._frame(cbor_dumps([[id, method, params] for id, method, params in calls]))
+
+    def encode_response(self, id, result):
+        return cbor_dumps([id, result])
+
+    def try_decode_response(self, buf):
+        return cbor_try_decode(buf)
+
+    def is_notification(self, message):
+        return isinstance(message, list) and len(message) == 2 and isinstance(message[0], str)
+
+    def unwrap_notification(self, message):
+        return message[0], message[1]
+
+    def unwrap(self, response):
+        if len(response) == 3:
+            raise RpcError(response[1], response[2])
+        return response[0], response[1]
+
+
+CODECS = {
+    'json': JsonCodec(),
+    'cbor': CborCodec(),
+}
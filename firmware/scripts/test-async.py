@@ -0,0 +1,81 @@
+import argparse
+import json
+import socket
+import time
+
+# 异步方法的上位机测试：在一个 TCP 连接上先调用 doser.dose，紧接着流水线发出几个 doser.status
+# doser.status 的响应应该在投放结束之前就陆续回来，doser.dose 的响应最后按 id 对上
+
+DEVICE_IP = "192.168.1.8"
+DEVICE_PORT = 1022
+
+
+def make_jsonrpc(id, method, params):
+    jsonrpc = {
+        'jsonrpc':      '2.0',
+        'id':           id,
+        'method':       method,
+        'params':       params
+    }
+    return bytes(json.dumps(jsonrpc), 'utf-8') + b'\0'
+
+
+def receive_messages(sock, rx_buf):
+    data = sock.recv(4096)
+    if not data:
+        raise ConnectionError('Connection closed by device')
+    rx_buf += data
+    messages = []
+    while b'\0' in rx_buf:
+        message, rx_buf = rx_buf.split(b'\0', 1)
+        messages.append(json.loads(message.decode()))
+    return messages, rx_buf
+
+
+def main(args):
+    sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+
+    dose_id = 1
+    begin = time.perf_counter()
+    sock.sendall(make_jsonrpc(dose_id, 'doser.dose', [args.channel, args.volume]))
+    for i in range(args.polls):
+        sock.sendall(make_jsonrpc(dose_id + 1 + i, 'doser.status', []))
+
+    pending = set(range(dose_id, dose_id + 1 + args.polls))
+    order = []
+    rx_buf = b''
+    try:
+        while pending:
+            messages, rx_buf = receive_messages(sock, rx_buf)
+            for message in messages:
+                id = message.get('id')
+                if id is None:
+                    continue  # 订阅的通知
+                elapsed = time.perf_counter() - begin
+                pending.discard(id)
+                order.append(id)
+                if 'error' in message:
+                    print('{:8.1f} ms  id {}: error {}'.format(elapsed * 1000, id, message['error']))
+                elif id == dose_id:
+                    print('{:8.1f} ms  id {}: doser.dose {}'.format(elapsed * 1000, id, message['result']))
+                else:
+                    print('{:8.1f} ms  id {}: doser.status'.format(elapsed * 1000, id))
+    finally:
+        sock.close()
+
+    if order and order[-1] == dose_id and args.polls > 0:
+        print('OK: doser.status was not blocked behind doser.dose')
+    else:
+        print('Response order: {}'.format(order))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo asynchronous RPC test')
+    parser.add_argument('--host', default=DEVICE_IP)
+    parser.add_argument('--port', type=int, default=DEVICE_PORT)
+    parser.add_argument('--channel', type=int, default=0)
+    parser.add_argument('--volume', type=float, default=1.0, help='mL')
+    parser.add_argument('--polls', type=int, default=5, help='doser.status calls sent right after doser.dose')
+    parser.add_argument('--timeout', type=float, default=120.0)
+    main(parser.parse_args())
@@ -0,0 +1,153 @@
+import argparse
+
+# 闭环流量控制的上位机仿真，用来在不接设备的情况下调 PID 参数
+# PID 是 components/borneo/src/pid.c 的逐位移植，控制逻辑和 main/src/devices/flow-control.c 一样：
+# 每个控制周期读一次流量计的脉冲数，按滑动窗口算流量（µL/s），PID 的输出加在设定的占空比上
+# 泵的模型：流量和占空比成正比，管子老化以后乘上一个小于 1 的系数，电机和管路有一阶惯性
+
+PARAM_SHIFT = 8
+PARAM_BITS = 16
+PARAM_MAX = ((1 << PARAM_BITS) - 1) >> PARAM_SHIFT
+PARAM_MULT = (1 << PARAM_BITS) >> (PARAM_BITS - PARAM_SHIFT)
+INT32_MAX = 2**31 - 1
+INT32_MIN = -2**31
+INT16_MAX = 2**15 - 1
+INT16_MIN = -2**15
+
+PWM_MAX_DUTY = (1 << 10) - 1
+
+
+def _trunc_int16(value):
+    value &= 0xFFFF
+    return value - 0x10000 if value & 0x8000 else value
+
+
+class FastPid:
+
+    def __init__(self, kp, ki, kd, hz, integral_min, integral_max):
+        self.cfg_err = False
+        self.p = self._param(kp)
+        self.i = self._param(ki / hz)
+        self.d = self._param(kd * hz)
+        self.outmax = (0xFFFF >> 1) * PARAM_MULT
+        self.outmin = -((0xFFFF >> 1) + 1) * PARAM_MULT
+        if integral_min >= integral_max:
+            self.cfg_err = True
+        self.integ_min = integral_min * PARAM_MULT
+        self.integ_max = integral_max * PARAM_MULT
+        self.last_sp = 0
+        self.last_err = 0
+        self.sum = 0
+
+    def _param(self, value):
+        if value > PARAM_MAX or value < 0:
+            self.cfg_err = True
+            return 0
+        param = int(value * PARAM_MULT)
+        if value != 0 and param == 0:
+            self.cfg_err = True
+            return 0
+        return param
+
+    def step(self, sp, fb):
+        err = sp - fb
+        p = self.p * err if self.p else 0
+        i = 0
+        d = 0
+        if self.i:
+            self.sum += err * self.i
+            self.sum = max(self.integ_min, min(self.integ_max, self.sum))
+            i = self.sum
+        if self.d:
+            deriv = (err - self.last_err) - (sp - self.last_sp)
+            self.last_sp = sp
+            self.last_err = err
+            deriv = max(INT16_MIN, min(INT16_MAX, deriv))
+            d = self.d * deriv
+        out = max(self.outmin, min(self.outmax, p + i + d))
+        rval = out >> PARAM_SHIFT
+        if out & (1 << (PARAM_SHIFT - 1)):
+            rval += 1
+        return _trunc_int16(rval)
+
+
+def simulate(args, wear, closed_loop):
+    period = args.period / 1000.0
+    dt = period / 10
+    base_duty = int(args.duty * PWM_MAX_DUTY // 100)
+    target_ul_s = args.speed * args.duty / 100.0 * 1000.0 / 60.0
+    hold = args.volume / (target_ul_s / 1000.0)
+
+    pid = FastPid(args.kp, args.ki, args.kd, 1000.0 / args.period, args.integral_min, args.integral_max)
+    if pid.cfg_err:
+        raise ValueError('Invalid PID configuration')
+
+    window = []
+    duty = base_duty
+    flow = 0.0  # µL/s
+    volume = 0.0  # µL
+    pulse_acc = 0.0
+    settled_at = None
+    max_error = 0.0
+    t = 0.0
+    while t < hold:
+        # 一个控制周期里泵按当前占空比运行
+        pulses = 0
+        for _ in range(10):
+            target_flow = wear * args.speed * 1000.0 / 60.0 * duty / PWM_MAX_DUTY
+            flow += (target_flow - flow) * dt / args.tau
+            volume += flow * dt
+            pulse_acc += flow * dt / 1000.0 * args.pulses_per_ml
+            pulses += int(pulse_acc)
+            pulse_acc -= int(pulse_acc)
+        t += period
+
+        window.append(pulses)
+        if len(window) > args.window:
+            window.pop(0)
+        measured = sum(window) / args.pulses_per_ml * 1000.0 / (len(window) * period)
+
+        error = abs(flow - target_ul_s) / target_ul_s
+        if t > args.window * period:
+            max_error = max(max_error, error)
+        if settled_at is None and error < 0.02:
+            settled_at = t
+        elif error >= 0.02:
+            settled_at = None
+
+        if closed_loop:
+            out = pid.step(int(round(min(target_ul_s, INT16_MAX))), int(round(min(measured, INT16_MAX))))
+            duty = max(0, min(PWM_MAX_DUTY, base_duty + out))
+
+    return volume / 1000.0, settled_at, duty, max_error
+
+
+def main(args):
+    print('target {:.3f} mL at {:.1f}% duty, kp {} ki {} kd {}, integral [{}, {}]'.format(
+        args.volume, args.duty, args.kp, args.ki, args.kd, args.integral_min, args.integral_max))
+    for wear in args.wear:
+        open_volume, _, _, _ = simulate(args, wear, False)
+        closed_volume, settled_at, duty, max_error = simulate(args, wear, True)
+        print('wear {:.2f}: open loop {:.3f} mL ({:+.1f}%), closed loop {:.3f} mL ({:+.1f}%), '
+              'settled {}, final duty {}, max flow error {:.1f}%'.format(
+                  wear, open_volume, (open_volume / args.volume - 1) * 100, closed_volume,
+                  (closed_volume / args.volume - 1) * 100,
+                  'at {:.2f} s'.format(settled_at) if settled_at is not None else 'never', duty, max_error * 100))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Borneo doser flow PID tuning simulation')
+    parser.add_argument('--speed', type=float, default=12.0, help='flow at 100%% duty, mL/min')
+    parser.add_argument('--duty', type=float, default=80.0, help='duty setpoint, percent')
+    parser.add_argument('--volume', type=float, default=5.0, help='dose volume, mL')
+    parser.add_argument('--kp', type=float, default=0.5)
+    parser.add_argument('--ki', type=float, default=1.0)
+    parser.add_argument('--kd', type=float, default=0.0)
+    parser.add_argument('--integral-min', type=int, default=-512)
+    parser.add_argument('--integral-max', type=int, default=512)
+    parser.add_argument('--pulses-per-ml', type=float, default=20.0)
+    parser.add_argument('--period', type=int, default=50, help='control period, ms')
+    parser.add_argument('--window', type=int, default=20, help='flow window, periods')
+    parser.add_argument('--tau', type=float, default=0.2, help='plant time constant, s')
+    parser.add_argument('--wear', type=float, nargs='+', default=[1.0, 0.9, 0.8], help='tubing wear factors')
+    main(parser.parse_args())